@@ -0,0 +1,127 @@
+// Copyright (c) 2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+namespace epee
+{
+  /*!
+    \brief Immutable, reference counted sequence of bytes
+
+    Copies and slices share the bytes instead of copying them, and the bytes
+    are released along with the last slice referring to them. Intended for
+    data queued for sending on several connections at once: it is built once
+    and every send queue refers to the same buffer.
+   */
+  class byte_slice
+  {
+    std::shared_ptr<const std::string> storage_;
+    const char* data_;
+    std::size_t size_;
+
+  public:
+    byte_slice() noexcept
+      : storage_(), data_(nullptr), size_(0)
+    {}
+
+    //! Takes ownership of `buffer`, without copying it
+    explicit byte_slice(std::string&& buffer)
+      : storage_(std::make_shared<const std::string>(std::move(buffer))),
+        data_(storage_->data()),
+        size_(storage_->size())
+    {}
+
+    //! Deep copies `size` bytes from `data`
+    byte_slice(const void* data, std::size_t size)
+      : byte_slice(std::string(static_cast<const char*>(data), size))
+    {}
+
+    byte_slice(const byte_slice&) = default;
+    byte_slice(byte_slice&& source) noexcept
+      : storage_(std::move(source.storage_)), data_(source.data_), size_(source.size_)
+    {
+      source.data_ = nullptr;
+      source.size_ = 0;
+    }
+
+    byte_slice& operator=(const byte_slice&) = default;
+    byte_slice& operator=(byte_slice&& source) noexcept
+    {
+      if (this != &source)
+      {
+        storage_ = std::move(source.storage_);
+        data_ = source.data_;
+        size_ = source.size_;
+        source.data_ = nullptr;
+        source.size_ = 0;
+      }
+      return *this;
+    }
+
+    const char* data() const noexcept { return data_; }
+    std::size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+
+    //! \return Number of slices sharing the bytes, 0 if empty
+    long use_count() const noexcept { return storage_.use_count(); }
+
+    //! \return Slice of bytes `[begin, end)`, sharing them with `this`
+    //! \throw std::out_of_range if `begin > end` or `end > size()`
+    byte_slice get_slice(std::size_t begin, std::size_t end) const
+    {
+      if (begin > end || end > size_)
+        throw std::out_of_range("byte_slice::get_slice: bad range");
+      byte_slice out;
+      if (begin != end)
+      {
+        out.storage_ = storage_;
+        out.data_ = data_ + begin;
+        out.size_ = end - begin;
+      }
+      return out;
+    }
+
+    //! Removes up to `max_size` bytes from the front of `this`
+    //! \return The bytes removed, sharing them with `this`
+    byte_slice take_slice(std::size_t max_size)
+    {
+      const std::size_t size = max_size < size_ ? max_size : size_;
+      byte_slice out = get_slice(0, size);
+      data_ += size;
+      size_ -= size;
+      if (size_ == 0)
+        *this = byte_slice();
+      return out;
+    }
+  };
+} // epee
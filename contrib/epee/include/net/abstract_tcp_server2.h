@@ -135,7 +135,8 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb); ///< (see do_send from i_service_endpoint)
-    virtual bool do_send_chunk(const void* ptr, size_t cb); ///< will send (or queue) a part of data
+    virtual bool do_send(byte_slice message); ///< (see do_send from i_service_endpoint)
+    virtual bool do_send_chunk(byte_slice chunk); ///< will send (or queue) a part of data
     virtual bool send_done();
     virtual bool close();
     virtual bool call_run_once_service_io();
@@ -200,7 +201,7 @@ namespace net_utils
         if (!m_send_que_lock.tryLock())
             return false;
         int64_t bytes_in_que = 0;
-        for (auto entry : m_send_que)
+        for (const auto &entry : m_send_que)
             bytes_in_que += entry.size();
 
         int64_t bytes_to_wait = bytes_in_que + callback.first;
@@ -248,6 +249,11 @@ namespace net_utils
     /// Run the server's io_service loop.
     bool run_server(size_t threads_count, bool wait = true, const boost::thread::attributes& attrs = boost::thread::attributes());
 
+    /// Run one io_service per worker thread, with each connection pinned to one of them.
+    /// With reuse_port, every worker thread also gets its own SO_REUSEPORT acceptor.
+    /// Must be called before init_server.
+    void set_io_service_sharding(bool sharded, bool reuse_port = false);
+
     /// wait for service workers stop
     bool timed_wait_server_stop(uint64_t wait_mseconds);
 
@@ -274,7 +280,8 @@ namespace net_utils
 
     long get_connections_count() const
     {
-      auto connections_count = (m_sock_count > 0) ? (m_sock_count - 1) : 0; // Socket count minus listening socket
+      const long acceptors_count = m_acceptors_count;
+      auto connections_count = (m_sock_count > acceptors_count) ? (m_sock_count - acceptors_count) : 0; // Socket count minus listening sockets
       return connections_count;
     }
 
@@ -339,10 +346,26 @@ namespace net_utils
     typename t_protocol_handler::config_type m_config;
 
   private:
-    /// Run the server's io_service loop.
-    bool worker_thread();
+    struct io_shard
+    {
+      io_shard(): work(io_service), acceptor(io_service) {}
+
+      boost::asio::io_service io_service;
+      boost::asio::io_service::work work;
+      boost::asio::ip::tcp::acceptor acceptor; // only opened with SO_REUSEPORT
+      connection_ptr new_connection;
+    };
+
+    /// Run the server's io_service loop, or the given shard's.
+    bool worker_thread(size_t shard);
+    /// Start an asynchronous accept on the given shard's acceptor.
+    void start_accept(size_t shard);
     /// Handle completion of an asynchronous accept operation.
-    void handle_accept(const boost::system::error_code& e);
+    void handle_accept(const boost::system::error_code& e, size_t shard);
+    bool init_shards(size_t threads_count);
+    /// Shard 0 is io_service_ itself.
+    boost::asio::io_service& get_shard_io_service(size_t shard);
+    size_t next_shard();
 
     bool is_thread_worker();
 
@@ -374,6 +397,12 @@ namespace net_utils
     boost::mutex connections_mutex;
     std::deque<std::pair<boost::system_time, connection_ptr>> connections_;
     boost::asio::io_service::strand m_strand;
+
+    bool m_sharded;
+    bool m_reuse_port;
+    std::vector<std::unique_ptr<io_shard>> m_shards;
+    std::atomic<size_t> m_next_shard;
+    std::atomic<long> m_acceptors_count;
   }; // class <>boosted_tcp_server
 
 
@@ -423,8 +452,7 @@ namespace net_utils
         con_->m_send_que_lock.lock(); // *** critical ***
         epee::misc_utils::auto_scope_leave_caller scope_exit_handler = epee::misc_utils::create_scope_leave_handler([&](){con_->m_send_que_lock.unlock();});
 
-        con_->m_send_que.resize(con_->m_send_que.size()+1);
-        con_->m_send_que.back().assign((const char*)mach->message, mach->length);
+        con_->m_send_que.push_back(byte_slice(mach->message, mach->length));
         typename connection<t_protocol_handler>::callback_type callback = boost::bind(&do_send_chunk_state_machine::send_result,mach,_1);
         con_->add_on_write_callback(std::pair<int64_t, typename connection<t_protocol_handler>::callback_type> { mach->length, callback } );
 
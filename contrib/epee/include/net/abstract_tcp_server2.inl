@@ -407,12 +407,19 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb) {
     TRY_ENTRY();
+    return do_send(byte_slice(ptr, cb));
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+  }
+  //---------------------------------------------------------------------------------
+    template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send(byte_slice message) {
+    TRY_ENTRY();
 
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
     auto self = safe_shared_from_this();
     if (!self) return false;
     if (m_was_shutdown) return false;
-		// TODO avoid copy
+		const size_t cb = message.size();
 
         // I think that author of this was a little drunk, or something else |
 		const double factor = 32; // TODO config
@@ -438,7 +445,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     		epee::critical_region_t<decltype(m_chunking_lock)> send_guard(m_chunking_lock); // *** critical *** 
             // Here we should also lock m_send_que_lock but we've forgotten, haven't we?
 
-				MDEBUG("do_send() will SPLIT into small chunks, from packet="<<cb<<" B for ptr="<<ptr);
+				MDEBUG("do_send() will SPLIT into small chunks, from packet="<<cb<<" B");
 				t_safe all = cb; // all bytes to send 
 				t_safe pos = 0; // current sending position
 				// 01234567890 
@@ -461,17 +468,13 @@ PRAGMA_WARNING_DISABLE_VS(4355)
                     CHECK_AND_ASSERT_MES(len>0, false, "len not strictly positive"); // (redundant)
                     CHECK_AND_ASSERT_MES(len_unsigned < std::numeric_limits<size_t>::max(), false, "Invalid len_unsigned");   // yeap we want strong < then max size, to be sure
 					
-					void *chunk_start = ((char*)ptr) + pos;
-					MDEBUG("chunk_start="<<chunk_start<<" ptr="<<ptr<<" pos="<<pos);
-					CHECK_AND_ASSERT_MES(chunk_start >= ptr, false, "Pointer wraparound"); // not wrapped around address?
-
 					MDEBUG("part of " << lenall << ": pos="<<pos << " len="<<len);
 
-					bool ok = do_send_chunk(chunk_start, len); // <====== ***
+					bool ok = do_send_chunk(message.take_slice(len)); // <====== *** (shares the bytes, no copy)
 
 					all_ok = all_ok && ok;
 					if (!all_ok) {
-						MDEBUG("do_send() DONE ***FAILED*** from packet="<<cb<<" B for ptr="<<ptr);
+						MDEBUG("do_send() DONE ***FAILED*** from packet="<<cb<<" B");
 						MDEBUG("do_send() SEND was aborted in middle of big package - this is mostly harmless "
 							<< " (e.g. peer closed connection) but if it causes trouble tell us at #monero-dev. " << cb);
 						return false; // partial failure in sending
@@ -482,7 +485,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 					// (in catch block, or uniq pointer) delete buf;
 				} // each chunk
 
-				MDEBUG("do_send() DONE SPLIT from packet="<<cb<<" B for ptr="<<ptr);
+				MDEBUG("do_send() DONE SPLIT from packet="<<cb<<" B");
 
                 MDEBUG("do_send() m_connection_type = " << m_connection_type);
 
@@ -490,7 +493,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 			} // LOCK: chunking
 		} // a big block (to be chunked) - all chunks
 		else { // small block
-			return do_send_chunk(ptr,cb); // just send as 1 big chunk
+			return do_send_chunk(std::move(message)); // just send as 1 big chunk
 		}
 
     CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
@@ -498,8 +501,9 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool connection<t_protocol_handler>::do_send_chunk(const void* ptr, size_t cb)
+  bool connection<t_protocol_handler>::do_send_chunk(byte_slice chunk)
   {
+    const size_t cb = chunk.size();
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
     auto self = safe_shared_from_this();
@@ -532,8 +536,7 @@ PRAGMA_WARNING_DISABLE_VS(4355)
       return false;
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    m_send_que.push_back(std::move(chunk));
     
     if(m_send_que.size() > 1)
     { // active operation should be in progress, nothing to do, just wait last operation callback
@@ -844,6 +847,10 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		m_connection_type( connection_type ),
     new_connection_()
   , m_strand(io_service_)
+  , m_sharded(false)
+  , m_reuse_port(false)
+  , m_next_shard(0)
+  , m_acceptors_count(1)
   {
     create_server_type_map();
     m_thread_name_prefix = "NET";
@@ -859,6 +866,10 @@ PRAGMA_WARNING_DISABLE_VS(4355)
 		m_connection_type(connection_type),
     new_connection_()
   , m_strand(io_service_)
+  , m_sharded(false)
+  , m_reuse_port(false)
+  , m_next_shard(0)
+  , m_acceptors_count(1)
   {
     create_server_type_map();
     m_thread_name_prefix = "NET";
@@ -892,15 +903,16 @@ PRAGMA_WARNING_DISABLE_VS(4355)
     boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
     acceptor_.open(endpoint.protocol());
     acceptor_.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+#ifdef SO_REUSEPORT
+    if (m_reuse_port)
+      acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+#endif
     acceptor_.bind(endpoint);
     acceptor_.listen();
     boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
     m_port = binded_endpoint.port();
     MDEBUG("start accept");
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
-    acceptor_.async_accept(new_connection_->socket(),
-      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
-      boost::asio::placeholders::error));
+    start_accept(0);
 
     return true;
     }
@@ -932,7 +944,7 @@ DISABLE_GCC_WARNING(maybe-uninitialized)
 POP_WARNINGS
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  bool boosted_tcp_server<t_protocol_handler>::worker_thread()
+  bool boosted_tcp_server<t_protocol_handler>::worker_thread(size_t shard)
   {
     TRY_ENTRY();
     uint32_t local_thr_index = boost::interprocess::ipcdetail::atomic_inc32(&m_thread_index); 
@@ -940,11 +952,12 @@ POP_WARNINGS
     thread_name += boost::to_string(local_thr_index) + "]";
     MLOG_SET_THREAD_NAME(thread_name);
     //   _fact("Thread name: " << m_thread_name_prefix);
+    boost::asio::io_service& io_service = get_shard_io_service(shard);
     while(!m_stop_signal_sent)
     {
       try
       {
-        io_service_.run();
+        io_service.run();
       }
       catch(const std::exception& ex)
       {
@@ -977,12 +990,72 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::set_io_service_sharding(bool sharded, bool reuse_port)
+  {
+    m_sharded = sharded;
+#ifdef SO_REUSEPORT
+    m_reuse_port = sharded && reuse_port;
+#else
+    if (sharded && reuse_port)
+      MWARNING("SO_REUSEPORT is not supported on this platform, using a single acceptor");
+#endif
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool boosted_tcp_server<t_protocol_handler>::init_shards(size_t threads_count)
+  {
+    TRY_ENTRY();
+    if (!m_sharded || !m_shards.empty() || threads_count < 2)
+      return true;
+
+    for (size_t i = 1; i < threads_count; ++i)
+      m_shards.emplace_back(new io_shard());
+    MINFO("Running " << threads_count << " io_service shards" << (m_reuse_port ? " with SO_REUSEPORT acceptors" : ""));
+
+#ifdef SO_REUSEPORT
+    if (m_reuse_port && acceptor_.is_open())
+    {
+      const boost::asio::ip::tcp::endpoint endpoint = acceptor_.local_endpoint();
+      for (size_t shard = 1; shard < threads_count; ++shard)
+      {
+        boost::asio::ip::tcp::acceptor& acceptor = m_shards[shard - 1]->acceptor;
+        acceptor.open(endpoint.protocol());
+        acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        acceptor.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+        acceptor.bind(endpoint);
+        acceptor.listen();
+        ++m_acceptors_count;
+        start_accept(shard);
+      }
+    }
+#endif
+    return true;
+    CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::init_shards", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::get_shard_io_service(size_t shard)
+  {
+    return shard == 0 ? io_service_ : m_shards[shard - 1]->io_service;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  size_t boosted_tcp_server<t_protocol_handler>::next_shard()
+  {
+    if (m_shards.empty())
+      return 0;
+    return m_next_shard++ % (m_shards.size() + 1);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   bool boosted_tcp_server<t_protocol_handler>::run_server(size_t threads_count, bool wait, const boost::thread::attributes& attrs)
   {
     TRY_ENTRY();
     m_threads_count = threads_count;
     m_main_thread_id = boost::this_thread::get_id();
     MLOG_SET_THREAD_NAME("[SRV_MAIN]");
+    if (!init_shards(threads_count))
+      return false;
     while(!m_stop_signal_sent)
     {
 
@@ -990,8 +1063,9 @@ POP_WARNINGS
       CRITICAL_REGION_BEGIN(m_threads_lock);
       for (std::size_t i = 0; i < threads_count; ++i)
       {
+        const size_t shard = m_shards.empty() ? 0 : i;
         boost::shared_ptr<boost::thread> thread(new boost::thread(
-          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this)));
+          attrs, boost::bind(&boosted_tcp_server<t_protocol_handler>::worker_thread, this, shard)));
           _note("Run server thread name: " << m_thread_name_prefix);
         m_threads.push_back(thread);
       }
@@ -1077,6 +1151,8 @@ POP_WARNINGS
     connections_.clear();
     connections_mutex.unlock();
     io_service_.stop();
+    for (auto &shard: m_shards)
+      shard->io_service.stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
   //---------------------------------------------------------------------------------
@@ -1087,22 +1163,33 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
-  void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::error_code& e)
+  void boosted_tcp_server<t_protocol_handler>::start_accept(size_t shard)
+  {
+    boost::asio::ip::tcp::acceptor& acceptor = shard == 0 ? acceptor_ : m_shards[shard - 1]->acceptor;
+    connection_ptr& new_connection = shard == 0 ? new_connection_ : m_shards[shard - 1]->new_connection;
+    // with SO_REUSEPORT the kernel already spread connections over the acceptors
+    boost::asio::io_service& io_service = get_shard_io_service(m_reuse_port ? shard : next_shard());
+    new_connection.reset(new connection<t_protocol_handler>(io_service, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
+    acceptor.async_accept(new_connection->socket(),
+      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
+      boost::asio::placeholders::error, shard));
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::handle_accept(const boost::system::error_code& e, size_t shard)
   {
     MDEBUG("handle_accept");
+    connection_ptr& new_connection = shard == 0 ? new_connection_ : m_shards[shard - 1]->new_connection;
     try
     {
     if (!e)
     {
 		if (m_connection_type == e_connection_type_RPC) {
 			MDEBUG("New server for RPC connections");
-			new_connection_->setRpcStation(); // hopefully this is not needed actually
+			new_connection->setRpcStation(); // hopefully this is not needed actually
 		}
-		connection_ptr conn(std::move(new_connection_));
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
-      acceptor_.async_accept(new_connection_->socket(),
-        boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
-        boost::asio::placeholders::error));
+		connection_ptr conn(std::move(new_connection));
+      start_accept(shard);
 
       boost::asio::socket_base::keep_alive opt(true);
       conn->socket().set_option(opt);
@@ -1124,10 +1211,7 @@ POP_WARNINGS
     // error path, if e or exception
     _erro("Some problems at accept: " << e.message() << ", connections_count = " << m_sock_count);
     misc_utils::sleep_no_w(100);
-    new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type));
-    acceptor_.async_accept(new_connection_->socket(),
-      boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
-      boost::asio::placeholders::error));
+    start_accept(shard);
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
@@ -1135,7 +1219,7 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(get_shard_io_service(next_shard()), m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
     connections_mutex.lock();
     connections_.push_back(std::make_pair(boost::get_system_time(), new_connection_l));
     auto remove_connection = [](std::deque<std::pair<boost::system_time, connection_ptr>>& connections, const connection_ptr& c) {
@@ -1260,7 +1344,8 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, const t_callback &cb, const std::string& bind_ip)
   {
     TRY_ENTRY();    
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
+    boost::asio::io_service& io_service = get_shard_io_service(next_shard());
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service, m_config, m_sock_count, m_sock_number, m_pfilter, m_connection_type) );
     connections_mutex.lock();
     connections_.push_back(std::make_pair(boost::get_system_time(), new_connection_l));
     auto remove_connection = [](std::deque<std::pair<boost::system_time, connection_ptr>>& connections, const connection_ptr& c) {
@@ -1304,7 +1389,7 @@ POP_WARNINGS
       }
     }
     
-    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
@@ -59,6 +59,7 @@
 
 #include <memory>
 
+#include "byte_slice.h"
 #include "net/net_utils_base.h"
 #include "syncobj.h"
 
@@ -90,7 +91,7 @@ class connection_basic { // not-templated base class for rapid developmet of som
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    std::list<byte_slice> m_send_que;
     volatile bool m_is_multithreaded;
     double m_start_time;
     /// Strand to ensure the connection's handlers are not called concurrently.
@@ -34,6 +34,7 @@
 #include <atomic>
 
 #include "levin_base.h"
+#include "network_throttle.hpp"
 #include "misc_language.h"
 #include "syncobj.h"
 #include "misc_os_dependent.h"
@@ -56,6 +57,26 @@ namespace levin
 
 using async_state_machine=cblp::async_callback_state_machine;
 
+//! \return Levin notification for `command` with `in_buff` as payload, which
+//!   can be sent on any number of connections without copying it again
+inline byte_slice make_notify(int command, const std::string& in_buff)
+{
+  bucket_head2 head = {0};
+  head.m_signature = LEVIN_SIGNATURE;
+  head.m_have_to_return_data = false;
+  head.m_cb = in_buff.size();
+
+  head.m_command = command;
+  head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+  head.m_flags = LEVIN_PACKET_REQUEST;
+
+  std::string message;
+  message.reserve(sizeof(head) + in_buff.size());
+  message.append(reinterpret_cast<const char*>(&head), sizeof(head));
+  message.append(in_buff);
+  return byte_slice(std::move(message));
+}
+
 
 /************************************************************************/
 /*                                                                      */
@@ -100,6 +121,7 @@ public:
   int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, const callback_t &cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int send(byte_slice message, boost::uuids::uuid connection_id);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -139,6 +161,7 @@ public:
   volatile uint32_t m_invoke_buf_ready;
 
   volatile int m_invoke_result_code;
+  std::atomic<int> m_invoke_command;  //!< of the synchronous invoke waiting for its response
 
   critical_section m_local_inv_buff_lock;
   std::string m_local_inv_buff;
@@ -166,6 +189,7 @@ public:
     virtual void cancel()=0;
     virtual bool cancel_timer()=0;
     virtual void reset_timer()=0;
+    virtual int get_command() const=0;
   };
   template <class callback_t>
   struct invoke_handler: invoke_response_handler_base
@@ -201,6 +225,7 @@ public:
     bool m_timer_cancelled;
     uint64_t m_timeout;
     int m_command;
+    virtual int get_command() const { return m_command; }
     virtual bool handle(int res, const std::string& buff, typename async_protocol_handler::connection_context& context)
     {
       if(!cancel_timer())
@@ -283,6 +308,7 @@ public:
     m_wait_count = 0;
     m_oponent_protocol_ver = 0;
     m_connection_initialized = false;
+    m_invoke_command = 0;
   }
   virtual ~async_protocol_handler()
   {
@@ -369,6 +395,26 @@ public:
     m_config.m_pcommands_handler->callback(m_connection_context);
   }
 
+  //! commands with no handler are all accounted as other_command, so a peer can't use up the slots
+  void account_recv(int command, size_t bytes, uint64_t queue_ns, uint64_t handler_ns)
+  {
+    ++m_connection_context.m_recv_msgs;
+    m_connection_context.m_queue_ns += queue_ns;
+    m_connection_context.m_handler_ns += handler_ns;
+    if (m_connection_context.m_command_stats)
+      m_connection_context.m_command_stats->handle_recv(command, bytes, queue_ns, handler_ns);
+    net_utils::network_throttle_manager::get_global_command_stats().handle_recv(command, bytes, queue_ns, handler_ns);
+  }
+
+  //! called with m_send_lock held
+  void account_send(int command, size_t bytes)
+  {
+    ++m_connection_context.m_send_msgs;
+    if (m_connection_context.m_command_stats)
+      m_connection_context.m_command_stats->handle_send(command, bytes);
+    net_utils::network_throttle_manager::get_global_command_stats().handle_send(command, bytes);
+  }
+
   virtual bool handle_recv(const void* ptr, size_t cb)
   {
     if(boost::interprocess::ipcdetail::atomic_read32(&m_close_called))
@@ -389,6 +435,7 @@ public:
     }
 
     m_cache_in_buffer.append((const char*)ptr, cb);
+    const uint64_t recv_ns = misc_utils::get_ns_count();
 
     bool is_continue = true;
     while(is_continue)
@@ -424,6 +471,16 @@ public:
 
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
 
+          // messages after the first one in this read wait for the handlers before them.
+          // The command is only known to be valid once it was handled.
+          int command = net_utils::network_command_stats::other_command;
+          const size_t message_size = sizeof(bucket_head2) + m_current_head.m_cb;
+          const uint64_t queue_ns = misc_utils::get_ns_count() - recv_ns;
+          const uint64_t cpu_start_ns = net_utils::network_command_stats::get_thread_cpu_ns();
+          misc_utils::auto_scope_leave_caller account_handler = misc_utils::create_scope_leave_handler([&](){
+            account_recv(command, message_size, queue_ns, net_utils::network_command_stats::get_thread_cpu_ns() - cpu_start_ns);
+          });
+
           MDEBUG(m_connection_context << "LEVIN_PACKET_RECIEVED. [len=" << m_current_head.m_cb
             << ", flags" << m_current_head.m_flags 
             << ", r?=" << m_current_head.m_have_to_return_data 
@@ -437,6 +494,8 @@ public:
             if(!m_invoke_response_handlers.empty())
             {//async call scenario
               boost::shared_ptr<invoke_response_handler_base> response_handler = m_invoke_response_handlers.front();
+              if(response_handler->get_command() == m_current_head.m_command)
+                command = m_current_head.m_command;
               bool timer_cancelled = response_handler->cancel_timer();
                // Don't pop handler, to avoid destroying it
               if(timer_cancelled)
@@ -456,6 +515,8 @@ public:
                 return false;
               }else
               {
+                if(m_invoke_command == m_current_head.m_command)
+                  command = m_current_head.m_command;
                 CRITICAL_REGION_BEGIN(m_local_inv_buff_lock);
                 buff_to_invoke.swap(m_local_inv_buff);
                 buff_to_invoke.clear();
@@ -474,6 +535,8 @@ public:
                                                                   buff_to_invoke, 
                                                                   return_buff, 
                                                                   m_connection_context);
+              if(m_current_head.m_return_code != LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED)
+                command = m_current_head.m_command;
               m_current_head.m_cb = return_buff.size();
               m_current_head.m_have_to_return_data = false;
               m_current_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
@@ -483,6 +546,7 @@ public:
               CRITICAL_REGION_BEGIN(m_send_lock);
               if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
                 return false;
+              account_send(command, send_buff.size());
               CRITICAL_REGION_END();
               MDEBUG(m_connection_context << "LEVIN_PACKET_SENT. [len=" << m_current_head.m_cb
                 << ", flags" << m_current_head.m_flags 
@@ -491,7 +555,10 @@ public:
                 << ", ver=" << m_current_head.m_protocol_version);
             }
             else
-              m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context);
+            {
+              if(m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context) != LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED)
+                command = m_current_head.m_command;
+            }
           }
         }
         m_state = stream_state_head;
@@ -543,6 +610,7 @@ public:
     if (!m_connection_initialized)
     {
       m_connection_initialized = true;
+      m_connection_context.m_command_stats = std::make_shared<net_utils::network_command_stats>(net_utils::network_command_stats::connection_slot_count);
       m_config.add_connection(this);
     }
     return true;
@@ -605,6 +673,7 @@ public:
         err_code = LEVIN_ERROR_CONNECTION;
         break;
       }
+      account_send(command, sizeof(head) + in_buff.size());
 
       CRITICAL_REGION_END();
     } while (false);
@@ -643,6 +712,7 @@ public:
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
 
     boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
+    m_invoke_command = command;
     CRITICAL_REGION_BEGIN(m_send_lock);
     if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
     {
@@ -655,6 +725,7 @@ public:
       LOG_ERROR_CC(m_connection_context, "Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
     }
+    account_send(command, sizeof(head) + in_buff.size());
     CRITICAL_REGION_END();
 
     MDEBUG(m_connection_context << "LEVIN_PACKET_SENT. [len=" << head.m_cb
@@ -695,6 +766,13 @@ public:
   }
 
   int notify(int command, const std::string& in_buff)
+  {
+    return send(make_notify(command, in_buff));
+  }
+  //------------------------------------------------------------------------------------------
+  /*! Sends a message made by `make_notify`. The bytes are queued as is, so
+    the same message can be sent on many connections with no further copy. */
+  int send(byte_slice message)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -707,32 +785,19 @@ public:
     if(m_deletion_initiated)
       return LEVIN_ERROR_CONNECTION_DESTROYED;
 
+    const size_t size = message.size();
     bucket_head2 head = {0};
-    head.m_signature = LEVIN_SIGNATURE;
-    head.m_have_to_return_data = false;
-    head.m_cb = in_buff.size();
-
-    head.m_command = command;
-    head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
-    head.m_flags = LEVIN_PACKET_REQUEST;
+    if(size >= sizeof(head))
+      memcpy(&head, message.data(), sizeof(head));
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
-      return -1;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!m_pservice_endpoint->do_send(std::move(message)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send()");
       return -1;
     }
+    account_send(head.m_command, size);
     CRITICAL_REGION_END();
-    LOG_DEBUG_CC(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb <<
-      ", f=" << head.m_flags << 
-      ", r?=" << head.m_have_to_return_data <<
-      ", cmd = " << head.m_command << 
-      ", ver=" << head.m_protocol_version);
+    LOG_DEBUG_CC(m_connection_context, "LEVIN_PACKET_SENT. [len=" << size << "]");
 
     return 1;
   }
@@ -892,6 +957,14 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::send(byte_slice message, boost::uuids::uuid connection_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->send(std::move(message)) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
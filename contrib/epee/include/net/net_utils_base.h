@@ -31,9 +31,11 @@
 
 #include <boost/uuid/uuid.hpp>
 #include <boost/asio/io_service.hpp>
+#include <memory>
 #include <typeinfo>
 #include <type_traits>
 #include "serialization/keyvalue_serialization.h"
+#include "byte_slice.h"
 #include "misc_log_ex.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -47,6 +49,8 @@ namespace epee
 {
 namespace net_utils
 {
+	class network_command_stats;
+
 	class ipv4_network_address
 	{
 		uint32_t m_ip;
@@ -226,6 +230,11 @@ namespace net_utils
     time_t   m_last_send;
     uint64_t m_recv_cnt;
     uint64_t m_send_cnt;
+    uint64_t m_recv_msgs;
+    uint64_t m_send_msgs;
+    uint64_t m_handler_ns;
+    uint64_t m_queue_ns;
+    std::shared_ptr<network_command_stats> m_command_stats; //!< per command totals of this connection, set once it is initialized
     double m_current_speed_down;
     double m_current_speed_up;
 
@@ -241,6 +250,10 @@ namespace net_utils
                                             m_last_send(last_send),
                                             m_recv_cnt(recv_cnt),
                                             m_send_cnt(send_cnt),
+                                            m_recv_msgs(0),
+                                            m_send_msgs(0),
+                                            m_handler_ns(0),
+                                            m_queue_ns(0),
                                             m_current_speed_down(0),
                                             m_current_speed_up(0)
     {}
@@ -253,6 +266,10 @@ namespace net_utils
                                m_last_send(0),
                                m_recv_cnt(0),
                                m_send_cnt(0),
+                               m_recv_msgs(0),
+                               m_send_msgs(0),
+                               m_handler_ns(0),
+                               m_queue_ns(0),
                                m_current_speed_down(0),
                                m_current_speed_up(0)
     {}
@@ -280,6 +297,8 @@ namespace net_utils
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    //! Queues `message` without copying it, it may be shared with other endpoints
+    virtual bool do_send(byte_slice message) { return do_send(message.data(), message.size()); }
     virtual bool close()=0;
     virtual bool send_done()=0;
     virtual bool call_run_once_service_io()=0;
@@ -43,6 +43,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <atomic>
+#include <limits>
 
 #include <boost/asio.hpp>
 #include <boost/array.hpp>
@@ -86,6 +87,7 @@ typedef double network_time_seconds;
 typedef double network_MB;
 
 class i_network_throttle;
+class network_command_stats;
 
 /***
 @brief All information about given throttle - speed calculations
@@ -122,6 +124,53 @@ class network_throttle_manager {
 		static i_network_throttle & get_global_throttle_in(); ///< singleton ; for friend class ; caller MUST use proper locks! like m_lock_get_global_throttle_in
 		static i_network_throttle & get_global_throttle_inreq(); ///< ditto ; use lock ... use m_lock_get_global_throttle_inreq obviously
 		static i_network_throttle & get_global_throttle_out(); ///< ditto ; use lock ... use m_lock_get_global_throttle_out obviously
+		static network_command_stats & get_global_command_stats(); ///< singleton ; lock free, no lock needed
+};
+
+
+/***
+@brief Totals per levin command of traffic, handler cpu time and queueing delay, updated with lock free counters
+*/
+class network_command_stats {
+	public:
+		struct command_totals {
+			int command;
+			uint64_t messages_in;
+			uint64_t bytes_in;
+			uint64_t messages_out;
+			uint64_t bytes_out;
+			uint64_t handler_ns; // cpu time spent in the handlers of received messages
+			uint64_t queue_ns; // time received messages waited before their handler started
+		};
+
+		explicit network_command_stats(size_t slot_count = global_slot_count);
+
+		void handle_recv(int command, size_t bytes, uint64_t queue_ns, uint64_t handler_ns);
+		void handle_send(int command, size_t bytes);
+		std::vector<command_totals> get_totals() const; ///< commands seen so far, in no particular order
+
+		static uint64_t get_thread_cpu_ns(); ///< cpu time used by the calling thread, or wall time where that is not available
+
+		static constexpr int other_command = -1; ///< totals of commands with no handler, and of those seen after all slots were taken
+		static constexpr size_t global_slot_count = 256;
+		static constexpr size_t connection_slot_count = 64;
+
+	private:
+		struct slot {
+			std::atomic<int64_t> command;
+			std::atomic<uint64_t> messages_in;
+			std::atomic<uint64_t> bytes_in;
+			std::atomic<uint64_t> messages_out;
+			std::atomic<uint64_t> bytes_out;
+			std::atomic<uint64_t> handler_ns;
+			std::atomic<uint64_t> queue_ns;
+		};
+
+		slot & get_slot(int command);
+
+		static constexpr int64_t empty_slot = std::numeric_limits<int64_t>::min();
+		const size_t m_slot_count;
+		std::unique_ptr<slot[]> m_slots;
 };
 
 
@@ -54,7 +54,9 @@ Throttling work by:
 // STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
 // THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+#include <boost/chrono/thread_clock.hpp>
 #include "net/network_throttle-detail.hpp"
+#include "misc_os_dependent.h"
 
 namespace epee
 {
@@ -91,6 +93,94 @@ i_network_throttle & network_throttle_manager::get_global_throttle_out() {
 	return obj_get_global_throttle_out;
 }
 
+network_command_stats & network_throttle_manager::get_global_command_stats() {
+	static network_command_stats obj_get_global_command_stats;
+	return obj_get_global_command_stats;
+}
+
+// ================================================================================================
+// network_command_stats
+// ================================================================================================
+
+constexpr int network_command_stats::other_command;
+constexpr size_t network_command_stats::global_slot_count;
+constexpr size_t network_command_stats::connection_slot_count;
+constexpr int64_t network_command_stats::empty_slot;
+
+network_command_stats::network_command_stats(size_t slot_count)
+	: m_slot_count(std::max<size_t>(slot_count, 2)), m_slots(new slot[m_slot_count]) {
+	for (size_t i = 0; i < m_slot_count; ++i) {
+		slot &s = m_slots[i];
+		s.command = empty_slot;
+		s.messages_in = 0;
+		s.bytes_in = 0;
+		s.messages_out = 0;
+		s.bytes_out = 0;
+		s.handler_ns = 0;
+		s.queue_ns = 0;
+	}
+	m_slots[m_slot_count - 1].command = other_command;
+}
+
+network_command_stats::slot & network_command_stats::get_slot(int command) {
+	// open addressing over all but the last slot, which collects whatever does not fit
+	if (command == other_command)
+		return m_slots[m_slot_count - 1];
+	const size_t start = static_cast<unsigned int>(command) % (m_slot_count - 1);
+	for (size_t i = 0; i < m_slot_count - 1; ++i) {
+		slot &s = m_slots[(start + i) % (m_slot_count - 1)];
+		int64_t current = s.command.load(std::memory_order_acquire);
+		if (current == empty_slot && s.command.compare_exchange_strong(current, command, std::memory_order_acq_rel))
+			return s;
+		if (current == command)
+			return s;
+	}
+	return m_slots[m_slot_count - 1];
+}
+
+void network_command_stats::handle_recv(int command, size_t bytes, uint64_t queue_ns, uint64_t handler_ns) {
+	slot &s = get_slot(command);
+	s.messages_in.fetch_add(1, std::memory_order_relaxed);
+	s.bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+	s.queue_ns.fetch_add(queue_ns, std::memory_order_relaxed);
+	s.handler_ns.fetch_add(handler_ns, std::memory_order_relaxed);
+}
+
+void network_command_stats::handle_send(int command, size_t bytes) {
+	slot &s = get_slot(command);
+	s.messages_out.fetch_add(1, std::memory_order_relaxed);
+	s.bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+std::vector<network_command_stats::command_totals> network_command_stats::get_totals() const {
+	std::vector<command_totals> totals;
+	for (size_t i = 0; i < m_slot_count; ++i) {
+		const slot &s = m_slots[i];
+		const int64_t command = s.command.load(std::memory_order_acquire);
+		if (command == empty_slot)
+			continue;
+		command_totals t;
+		t.command = command;
+		t.messages_in = s.messages_in.load(std::memory_order_relaxed);
+		t.bytes_in = s.bytes_in.load(std::memory_order_relaxed);
+		t.messages_out = s.messages_out.load(std::memory_order_relaxed);
+		t.bytes_out = s.bytes_out.load(std::memory_order_relaxed);
+		t.handler_ns = s.handler_ns.load(std::memory_order_relaxed);
+		t.queue_ns = s.queue_ns.load(std::memory_order_relaxed);
+		if (t.messages_in || t.messages_out)
+			totals.push_back(t);
+	}
+	return totals;
+}
+
+uint64_t network_command_stats::get_thread_cpu_ns() {
+#if defined(BOOST_CHRONO_HAS_THREAD_CLOCK)
+	return boost::chrono::duration_cast<boost::chrono::nanoseconds>(boost::chrono::thread_clock::now().time_since_epoch()).count();
+#else
+	return misc_utils::get_ns_count();
+#endif
+}
+
 
 
 
@@ -34,12 +34,14 @@
 #include <string>
 #include <exception>
 #include <boost/program_options.hpp>
+#include "span.h"
 #include "common/command_line.h"
 #include "crypto/hash.h"
 #include "cryptonote_basic/blobdatatype.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "cryptonote_basic/difficulty.h"
 #include "cryptonote_basic/hardfork.h"
+#include "blockchain_db/key_image_filter.h"
 
 /** \file
  * Cryptonote Blockchain Database Interface
@@ -1344,6 +1346,15 @@ public:
    */
   virtual bool has_key_image(const crypto::key_image& img) const = 0;
 
+  /**
+   * @brief get the counters of the filter in front of has_key_image, if any
+   *
+   * @param stats return-by-reference the filter counters
+   *
+   * @return false if the subclass does not filter key image lookups
+   */
+  virtual bool get_key_image_filter_stats(key_image_filter_stats &stats) const { return false; }
+
   /**
    * @brief add a txpool transaction
    *
@@ -1455,6 +1466,29 @@ public:
    */
   virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const = 0;
 
+  /**
+   * @brief runs a function over a range of block blobs, without copying them
+   *
+   * The subclass should run the passed function for each block in the
+   * specified range, passing (block_height, block_blob) as its parameters.
+   * The blob is a view of the database's own storage: it is only valid for
+   * the duration of the call, and the function must copy whatever it wants
+   * to keep.  This lets callers which serve blocks copy each blob exactly
+   * once, straight into its final container.
+   *
+   * If any call to the function returns false, the subclass should stop
+   * and return false.  Otherwise, the subclass returns true.
+   *
+   * The subclass should throw BLOCK_DNE if a block in the range is missing.
+   *
+   * @param h1 the start height
+   * @param h2 the end height (inclusive)
+   * @param std::function fn the function to run
+   *
+   * @return false if the function returns false for any block, otherwise true
+   */
+  virtual bool for_block_blobs_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const epee::span<const uint8_t>&)>) const = 0;
+
   /**
    * @brief runs a function over all transactions stored
    *
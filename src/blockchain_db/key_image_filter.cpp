@@ -0,0 +1,263 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <boost/filesystem.hpp>
+#include "misc_log_ex.h"
+#include "key_image_filter.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "blockchain.db"
+
+namespace
+{
+  const char FILE_MAGIC[8] = {'K', 'I', 'F', 'I', 'L', 'T', 'E', 'R'};
+  const uint32_t FILE_VERSION = 1;
+  const uint64_t MIN_CAPACITY = 65536;
+
+  struct file_header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t word_size;
+    uint64_t salt[2];
+    uint64_t blocks;
+    uint64_t entries;
+    crypto::hash top_hash;
+    uint64_t num_key_images;
+  };
+
+  // splitmix64 finalizer
+  inline uint64_t mix(uint64_t x)
+  {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+}
+
+namespace cryptonote
+{
+
+key_image_filter::key_image_filter():
+  m_blocks(0), m_capacity(0), m_entries(0), m_negatives(0), m_positives(0), m_false_positives(0)
+{
+  m_salt[0] = m_salt[1] = 0;
+}
+
+void key_image_filter::reset(uint64_t expected_entries)
+{
+  boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+  const uint64_t capacity = std::max(expected_entries * 2, MIN_CAPACITY);
+  const uint64_t entries_per_block = WORDS_PER_BLOCK * 64 / BITS_PER_ENTRY;
+  m_blocks = (capacity + entries_per_block - 1) / entries_per_block;
+  m_capacity = m_blocks * entries_per_block;
+  m_words.reset(new std::atomic<uint64_t>[m_blocks * WORDS_PER_BLOCK]);
+  for (uint64_t i = 0; i < m_blocks * WORDS_PER_BLOCK; ++i)
+    m_words[i].store(0, std::memory_order_relaxed);
+  m_salt[0] = crypto::rand<uint64_t>();
+  m_salt[1] = crypto::rand<uint64_t>();
+  m_entries = 0;
+}
+
+void key_image_filter::get_position(const crypto::key_image &ki, uint64_t &block, uint64_t &bits) const
+{
+  static_assert(sizeof(crypto::key_image) >= 4 * sizeof(uint64_t), "key image too small");
+  uint64_t w[4];
+  memcpy(w, &ki, sizeof(w));
+  block = mix(w[0] ^ m_salt[0] ^ (w[2] << 1)) % m_blocks;
+  bits = mix(w[1] ^ m_salt[1] ^ (w[3] << 1));
+}
+
+void key_image_filter::insert(const crypto::key_image &ki)
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  if (!m_blocks)
+    return;
+  uint64_t block, bits;
+  get_position(ki, block, bits);
+  std::atomic<uint64_t> *words = &m_words[block * WORDS_PER_BLOCK];
+  for (unsigned i = 0; i < HASHES; ++i, bits >>= 9)
+  {
+    const unsigned bit = bits & 511;
+    words[bit >> 6].fetch_or(1ull << (bit & 63), std::memory_order_relaxed);
+  }
+  ++m_entries;
+}
+
+bool key_image_filter::maybe_contains(const crypto::key_image &ki) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  if (!m_blocks)
+  {
+    ++m_positives;
+    return true;
+  }
+  uint64_t block, bits;
+  get_position(ki, block, bits);
+  const std::atomic<uint64_t> *words = &m_words[block * WORDS_PER_BLOCK];
+  for (unsigned i = 0; i < HASHES; ++i, bits >>= 9)
+  {
+    const unsigned bit = bits & 511;
+    if (!(words[bit >> 6].load(std::memory_order_relaxed) & (1ull << (bit & 63))))
+    {
+      ++m_negatives;
+      return false;
+    }
+  }
+  ++m_positives;
+  return true;
+}
+
+bool key_image_filter::needs_rebuild() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  return m_entries > m_capacity;
+}
+
+void key_image_filter::swap(key_image_filter &other)
+{
+  boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+  boost::unique_lock<boost::shared_mutex> other_lock(other.m_mutex);
+  std::swap(m_words, other.m_words);
+  std::swap(m_blocks, other.m_blocks);
+  std::swap(m_capacity, other.m_capacity);
+  std::swap(m_salt, other.m_salt);
+  const uint64_t entries = m_entries;
+  m_entries = other.m_entries.load();
+  other.m_entries = entries;
+}
+
+key_image_filter_stats key_image_filter::get_stats() const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  key_image_filter_stats stats;
+  stats.negatives = m_negatives;
+  stats.positives = m_positives;
+  stats.false_positives = m_false_positives;
+  stats.entries = m_entries;
+  stats.size = m_blocks * WORDS_PER_BLOCK * sizeof(uint64_t);
+  return stats;
+}
+
+bool key_image_filter::store(const std::string &filename, const crypto::hash &top_hash, uint64_t num_key_images) const
+{
+  boost::shared_lock<boost::shared_mutex> lock(m_mutex);
+  if (!m_blocks)
+    return false;
+
+  file_header header;
+  memcpy(header.magic, FILE_MAGIC, sizeof(header.magic));
+  header.version = FILE_VERSION;
+  header.word_size = sizeof(uint64_t);
+  header.salt[0] = m_salt[0];
+  header.salt[1] = m_salt[1];
+  header.blocks = m_blocks;
+  header.entries = m_entries;
+  header.top_hash = top_hash;
+  header.num_key_images = num_key_images;
+
+  const std::string tmp_filename = filename + ".tmp";
+  {
+    std::ofstream out(tmp_filename, std::ios::binary | std::ios::trunc);
+    if (!out)
+    {
+      MERROR("Failed to open " << tmp_filename << " for writing");
+      return false;
+    }
+    out.write((const char*)&header, sizeof(header));
+    for (uint64_t i = 0; i < m_blocks * WORDS_PER_BLOCK; ++i)
+    {
+      const uint64_t word = m_words[i].load(std::memory_order_relaxed);
+      out.write((const char*)&word, sizeof(word));
+    }
+    if (!out)
+    {
+      MERROR("Failed to write key image filter to " << tmp_filename);
+      return false;
+    }
+  }
+
+  boost::system::error_code ec;
+  boost::filesystem::rename(tmp_filename, filename, ec);
+  if (ec)
+  {
+    MERROR("Failed to rename " << tmp_filename << " to " << filename << ": " << ec.message());
+    return false;
+  }
+  return true;
+}
+
+bool key_image_filter::load(const std::string &filename, const crypto::hash &top_hash, uint64_t num_key_images)
+{
+  std::ifstream in(filename, std::ios::binary);
+  if (!in)
+    return false;
+
+  file_header header;
+  in.read((char*)&header, sizeof(header));
+  if (!in || memcmp(header.magic, FILE_MAGIC, sizeof(header.magic)) || header.version != FILE_VERSION || header.word_size != sizeof(uint64_t))
+  {
+    MWARNING("Ignoring invalid key image filter file " << filename);
+    return false;
+  }
+  if (header.top_hash != top_hash || header.num_key_images != num_key_images)
+  {
+    MINFO("Key image filter file " << filename << " does not match the db, ignoring it");
+    return false;
+  }
+  if (header.blocks == 0 || header.blocks > std::numeric_limits<uint64_t>::max() / (WORDS_PER_BLOCK * sizeof(uint64_t)))
+    return false;
+
+  const uint64_t nwords = header.blocks * WORDS_PER_BLOCK;
+  std::unique_ptr<std::atomic<uint64_t>[]> words(new std::atomic<uint64_t>[nwords]);
+  for (uint64_t i = 0; i < nwords; ++i)
+  {
+    uint64_t word;
+    in.read((char*)&word, sizeof(word));
+    if (!in)
+    {
+      MWARNING("Truncated key image filter file " << filename);
+      return false;
+    }
+    words[i].store(word, std::memory_order_relaxed);
+  }
+
+  boost::unique_lock<boost::shared_mutex> lock(m_mutex);
+  m_words = std::move(words);
+  m_blocks = header.blocks;
+  m_capacity = m_blocks * (WORDS_PER_BLOCK * 64 / BITS_PER_ENTRY);
+  m_salt[0] = header.salt[0];
+  m_salt[1] = header.salt[1];
+  m_entries = header.entries;
+  return true;
+}
+
+}  // namespace cryptonote
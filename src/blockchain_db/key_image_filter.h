@@ -0,0 +1,134 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <boost/thread/shared_mutex.hpp>
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+
+/**
+ * @brief counters describing how a key_image_filter has been answering
+ */
+struct key_image_filter_stats
+{
+  uint64_t negatives;       //!< lookups answered by the filter alone
+  uint64_t positives;       //!< lookups which had to go to the db
+  uint64_t false_positives; //!< db lookups which found nothing
+  uint64_t entries;         //!< key images inserted since the last rebuild
+  uint64_t size;            //!< filter size in bytes
+};
+
+/**
+ * @brief Bloom filter over the spent key images
+ *
+ * Sits in front of the spent key image table. A negative answer is final,
+ * so the common case when validating fresh transactions (an unspent key
+ * image) never touches the db. All the bits for a key image live in a
+ * single cache line.
+ *
+ * Key images cannot be removed. A key image that is removed from the db
+ * (on pop_block) only costs a db lookup, until the filter is next rebuilt.
+ *
+ * Lookups may run concurrently with each other and with a single writer
+ * inserting. Rebuilds are done aside and swapped in.
+ */
+class key_image_filter
+{
+public:
+  key_image_filter();
+
+  /**
+   * @brief clears the filter and sizes it for the given number of entries
+   *
+   * A new random salt is picked, so the bit positions cannot be predicted
+   * by whoever crafts the key images.
+   */
+  void reset(uint64_t expected_entries);
+
+  void insert(const crypto::key_image &ki);
+
+  /**
+   * @brief checks the filter for a key image
+   *
+   * @return false if the key image is definitely absent, true if it may be present
+   */
+  bool maybe_contains(const crypto::key_image &ki) const;
+
+  //! records that a positive answer was not confirmed by the db
+  void add_false_positive() const { ++m_false_positives; }
+
+  //! whether enough entries were inserted that the false positive rate degrades
+  bool needs_rebuild() const;
+
+  uint64_t entries() const { return m_entries; }
+
+  //! swaps contents with another filter, keeping this filter's counters
+  void swap(key_image_filter &other);
+
+  key_image_filter_stats get_stats() const;
+
+  /**
+   * @brief saves the filter to disk, tagged with the db state it describes
+   */
+  bool store(const std::string &filename, const crypto::hash &top_hash, uint64_t num_key_images) const;
+
+  /**
+   * @brief loads a filter saved by store(), if it matches the given db state
+   *
+   * @return false if the file is missing, unreadable, or describes another db state
+   */
+  bool load(const std::string &filename, const crypto::hash &top_hash, uint64_t num_key_images);
+
+private:
+  void get_position(const crypto::key_image &ki, uint64_t &block, uint64_t &bits) const;
+
+  // each block is one 64 byte cache line
+  static constexpr unsigned WORDS_PER_BLOCK = 8;
+  static constexpr unsigned BITS_PER_ENTRY = 16;
+  static constexpr unsigned HASHES = 6;
+
+  mutable boost::shared_mutex m_mutex;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+  uint64_t m_blocks;
+  uint64_t m_capacity;
+  uint64_t m_salt[2];
+  std::atomic<uint64_t> m_entries;
+
+  mutable std::atomic<uint64_t> m_negatives;
+  mutable std::atomic<uint64_t> m_positives;
+  mutable std::atomic<uint64_t> m_false_positives;
+};
+
+}  // namespace cryptonote
@@ -1087,6 +1087,10 @@ void BlockchainLMDB::add_spent_key(const crypto::key_image& k_image)
     else
       throw1(DB_ERROR(lmdb_error("Error adding spent key image to db transaction: ", result).c_str()));
   }
+
+  m_key_image_filter.insert(k_image);
+  if (m_key_image_filter.needs_rebuild())
+    rebuild_key_image_filter();
 }
 
 void BlockchainLMDB::remove_spent_key(const crypto::key_image& k_image)
@@ -1397,6 +1401,8 @@ void BlockchainLMDB::open(const std::string& filename, const int db_flags)
   txn.commit();
 
   m_open = true;
+
+  init_key_image_filter();
   // from here, init should be finished
 }
 
@@ -1409,6 +1415,7 @@ void BlockchainLMDB::close()
     batch_abort();
   }
   this->sync();
+  store_key_image_filter();
   m_tinfo.reset();
 
   // FIXME: not yet thread safe!!!  Use with care.
@@ -1484,6 +1491,7 @@ void BlockchainLMDB::reset()
   txn.commit();
   m_cum_size = 0;
   m_cum_count = 0;
+  m_key_image_filter.reset(0);
 }
 
 std::vector<std::string> BlockchainLMDB::get_filenames() const
@@ -2133,11 +2141,16 @@ std::vector<block> BlockchainLMDB::get_blocks_range(const uint64_t& h1, const ui
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
   std::vector<block> v;
+  if (h2 >= h1)
+    v.reserve(h2 - h1 + 1);
 
-  for (uint64_t height = h1; height <= h2; ++height)
-  {
-    v.push_back(get_block_from_height(height));
-  }
+  for_block_blobs_range(h1, h2, [&v](uint64_t height, const epee::span<const uint8_t> &blob) {
+    blobdata bd(reinterpret_cast<const char*>(blob.data()), blob.size());
+    v.push_back(block());
+    if (!parse_and_validate_block_from_blob(bd, v.back()))
+      throw0(DB_ERROR("Failed to parse block from blob retrieved from the db"));
+    return true;
+  });
 
   return v;
 }
@@ -2327,6 +2340,7 @@ bool BlockchainLMDB::get_tx_blob(const crypto::hash& h, cryptonote::blobdata &bd
   else if (get_result)
     throw0(DB_ERROR(lmdb_error("DB error attempting to fetch tx from hash", get_result).c_str()));
 
+  bd.reserve(result0.mv_size + result1.mv_size);
   bd.assign(reinterpret_cast<char*>(result0.mv_data), result0.mv_size);
   bd.append(reinterpret_cast<char*>(result1.mv_data), result1.mv_size);
 
@@ -2584,6 +2598,9 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
   check_open();
 
+  if (!m_key_image_filter.maybe_contains(img))
+    return false;
+
   bool ret;
 
   TXN_PREFIX_RDONLY();
@@ -2593,9 +2610,91 @@ bool BlockchainLMDB::has_key_image(const crypto::key_image& img) const
   ret = (mdb_cursor_get(m_cur_spent_keys, (MDB_val *)&zerokval, &k, MDB_GET_BOTH) == 0);
 
   TXN_POSTFIX_RDONLY();
+  if (!ret)
+    m_key_image_filter.add_false_positive();
   return ret;
 }
 
+bool BlockchainLMDB::get_key_image_filter_stats(key_image_filter_stats &stats) const
+{
+  stats = m_key_image_filter.get_stats();
+  return true;
+}
+
+uint64_t BlockchainLMDB::get_num_key_images() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  int result;
+  MDB_stat db_stats;
+  if ((result = mdb_stat(m_txn, m_spent_keys, &db_stats)))
+    throw0(DB_ERROR(lmdb_error("Failed to query m_spent_keys: ", result).c_str()));
+  TXN_POSTFIX_RDONLY();
+  return db_stats.ms_entries;
+}
+
+std::string BlockchainLMDB::get_key_image_filter_filename() const
+{
+  boost::filesystem::path filename(m_folder);
+  filename /= "keyimages.filter";
+  return filename.string();
+}
+
+void BlockchainLMDB::init_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  const uint64_t num_key_images = get_num_key_images();
+  const std::string filename = get_key_image_filter_filename();
+  if (m_key_image_filter.load(filename, top_block_hash(), num_key_images))
+  {
+    MINFO("Loaded key image filter for " << num_key_images << " key images");
+  }
+  else
+  {
+    MINFO("Building key image filter for " << num_key_images << " key images...");
+    rebuild_key_image_filter();
+  }
+  // the file only describes the db as it was on a clean shutdown, so it
+  // must not survive a crash once we start writing
+  if (!is_read_only())
+  {
+    boost::system::error_code ec;
+    boost::filesystem::remove(filename, ec);
+  }
+}
+
+void BlockchainLMDB::rebuild_key_image_filter()
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  // build aside and swap in, so concurrent lookups are not stalled
+  key_image_filter filter;
+  filter.reset(get_num_key_images());
+  for_all_key_images([&filter](const crypto::key_image &k_image) {
+    filter.insert(k_image);
+    return true;
+  });
+  m_key_image_filter.swap(filter);
+  MDEBUG("Key image filter rebuilt with " << m_key_image_filter.entries() << " key images");
+}
+
+void BlockchainLMDB::store_key_image_filter() const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  if (!m_open || is_read_only())
+    return;
+  try
+  {
+    if (!m_key_image_filter.store(get_key_image_filter_filename(), top_block_hash(), get_num_key_images()))
+      MWARNING("Failed to save key image filter, it will be rebuilt on next start");
+  }
+  catch (const std::exception &e)
+  {
+    MWARNING("Failed to save key image filter: " << e.what());
+  }
+}
+
 bool BlockchainLMDB::for_all_key_images(std::function<bool(const crypto::key_image&)> f) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
@@ -2680,6 +2779,38 @@ bool BlockchainLMDB::for_blocks_range(const uint64_t& h1, const uint64_t& h2, st
   return fret;
 }
 
+bool BlockchainLMDB::for_block_blobs_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const epee::span<const uint8_t>&)> f) const
+{
+  LOG_PRINT_L3("BlockchainLMDB::" << __func__);
+  check_open();
+
+  TXN_PREFIX_RDONLY();
+  RCURSOR(blocks);
+
+  bool fret = true;
+  MDB_val_copy<uint64_t> k(h1);
+  MDB_val v;
+  MDB_cursor_op op = MDB_SET;
+  for (uint64_t height = h1; height <= h2; ++height)
+  {
+    int ret = mdb_cursor_get(m_cur_blocks, &k, &v, op);
+    op = MDB_NEXT;
+    if (ret == MDB_NOTFOUND)
+      throw0(BLOCK_DNE(std::string("Attempt to get block from height ").append(boost::lexical_cast<std::string>(height)).append(" failed -- block not in db").c_str()));
+    if (ret)
+      throw0(DB_ERROR(lmdb_error("Failed to enumerate blocks: ", ret).c_str()));
+    if (!f(height, epee::span<const uint8_t>(reinterpret_cast<const uint8_t*>(v.mv_data), v.mv_size)))
+    {
+      fret = false;
+      break;
+    }
+  }
+
+  TXN_POSTFIX_RDONLY();
+
+  return fret;
+}
+
 bool BlockchainLMDB::for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)> f, bool pruned) const
 {
   LOG_PRINT_L3("BlockchainLMDB::" << __func__);
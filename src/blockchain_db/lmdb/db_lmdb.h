@@ -255,6 +255,7 @@ public:
   virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_id) const;
 
   virtual bool has_key_image(const crypto::key_image& img) const;
+  virtual bool get_key_image_filter_stats(key_image_filter_stats &stats) const;
 
   virtual void add_txpool_tx(const transaction &tx, const txpool_tx_meta_t& meta);
   virtual void update_txpool_tx(const crypto::hash &txid, const txpool_tx_meta_t& meta);
@@ -268,6 +269,7 @@ public:
 
   virtual bool for_all_key_images(std::function<bool(const crypto::key_image&)>) const;
   virtual bool for_blocks_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const crypto::hash&, const cryptonote::block&)>) const;
+  virtual bool for_block_blobs_range(const uint64_t& h1, const uint64_t& h2, std::function<bool(uint64_t, const epee::span<const uint8_t>&)>) const;
   virtual bool for_all_transactions(std::function<bool(const crypto::hash&, const cryptonote::transaction&)>, bool pruned) const;
   virtual bool for_all_outputs(std::function<bool(uint64_t amount, const crypto::hash &tx_hash, uint64_t height, size_t tx_idx)> f) const;
   virtual bool for_all_outputs(uint64_t amount, const std::function<bool(uint64_t height)> &f) const;
@@ -399,6 +401,12 @@ private:
   void cleanup_batch();
 
 private:
+  uint64_t get_num_key_images() const;
+  std::string get_key_image_filter_filename() const;
+  void init_key_image_filter();
+  void rebuild_key_image_filter();
+  void store_key_image_filter() const;
+
   MDB_env* m_env;
 
   MDB_dbi m_blocks;
@@ -438,6 +446,8 @@ private:
   mdb_txn_cursors m_wcursors;
   mutable boost::thread_specific_ptr<mdb_threadinfo> m_tinfo;
 
+  key_image_filter m_key_image_filter;
+
 #if defined(__arm__)
   // force a value so it can compile with 32-bit ARM
   constexpr static uint64_t DEFAULT_MAPSIZE = 1LL << 31;
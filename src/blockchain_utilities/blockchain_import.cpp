@@ -30,10 +30,14 @@
 #include <atomic>
 #include <cstdio>
 #include <algorithm>
+#include <deque>
 #include <fstream>
 
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 #include <unistd.h>
 #include "misc_log_ex.h"
 #include "bootstrap_file.h"
@@ -42,6 +46,8 @@
 #include "serialization/binary_utils.h" // dump_binary(), parse_binary()
 #include "serialization/json_utils.h" // dump_json()
 #include "include_base_utils.h"
+#include "profile_tools.h"
+#include "common/threadpool.h"
 #include "blockchain_db/db_types.h"
 #include "cryptonote_core/cryptonote_core.h"
 
@@ -70,6 +76,10 @@ uint64_t db_batch_size = 100;
 // frequently saved
 uint64_t db_batch_size_verify = 5000;
 
+// number of blocks the reader thread keeps buffered ahead of verification;
+// half of this is handed to the thread pool for deserialization at a time
+uint64_t read_ahead = 1000;
+
 std::string refresh_string = "\r                                    \r";
 }
 
@@ -139,14 +149,10 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
     core.get_blockchain_storage().get_db().batch_start();
 
   int quit = 0;
-  block popped_block;
-  std::vector<transaction> popped_txs;
-  for (int i=0; i < num_blocks; ++i)
-  {
-    // simple_core.m_storage.pop_block_from_blockchain() is private, so call directly through db
-    core.get_blockchain_storage().get_db().pop_block(popped_block, popped_txs);
+  // pop through Blockchain rather than the db, so its cached windows follow
+  core.get_blockchain_storage().pop_blocks(num_blocks);
+  if (num_blocks > 0)
     quit = 1;
-  }
 
 
   if (use_batch)
@@ -166,7 +172,247 @@ int pop_blocks(cryptonote::core& core, int num_blocks)
   return num_blocks;
 }
 
-int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, bool force)
+// a raw bootstrap chunk, as read from the file
+struct import_chunk
+{
+  uint64_t height;
+  std::string data;
+};
+
+// a chunk once deserialized and hashed on the thread pool
+struct import_block
+{
+  bootstrap::block_package bp;
+  block_complete_entry entry; // blobs, only filled in when verifying
+  crypto::hash hash;
+};
+
+// per stage totals, reported as throughput once the import stops
+struct import_stats
+{
+  std::atomic<uint64_t> read_bytes, read_blocks, read_ns;
+  std::atomic<uint64_t> parse_blocks, parse_ns;
+  std::atomic<uint64_t> verify_blocks, verify_ns;
+
+  import_stats(): read_bytes(0), read_blocks(0), read_ns(0), parse_blocks(0), parse_ns(0), verify_blocks(0), verify_ns(0) {}
+
+  static double rate(uint64_t n, uint64_t ns) { return ns ? n * 1e9 / ns : 0.0; }
+
+  void print() const
+  {
+    MINFO("read:   " << read_blocks << " blocks, " << read_bytes / 1048576 << " MB in " << read_ns / 1000000 << " ms ("
+        << rate(read_blocks, read_ns) << " blocks/s, " << rate(read_bytes, read_ns) / 1048576 << " MB/s)");
+    MINFO("parse:  " << parse_blocks << " blocks in " << parse_ns / 1000000 << " ms of thread time ("
+        << rate(parse_blocks, parse_ns) << " blocks/s per thread)");
+    MINFO("verify: " << verify_blocks << " blocks in " << verify_ns / 1000000 << " ms ("
+        << rate(verify_blocks, verify_ns) << " blocks/s)");
+  }
+};
+
+// Reads chunks from the bootstrap file on its own thread, keeping up to
+// max_queued of them buffered so disk reads overlap with parsing and
+// verification.
+class chunk_reader
+{
+public:
+  chunk_reader(std::ifstream &import_file, uint64_t start_height, uint64_t block_stop, size_t max_queued, import_stats &stats):
+    m_import_file(import_file), m_height(start_height), m_block_stop(block_stop), m_max_queued(std::max<size_t>(max_queued, 1)),
+    m_stats(stats), m_done(false), m_stop(false), m_result(0)
+  {
+    m_thread = boost::thread(&chunk_reader::run, this);
+  }
+
+  ~chunk_reader()
+  {
+    {
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      m_stop = true;
+      m_cond.notify_all();
+    }
+    m_thread.join();
+  }
+
+  // waits until chunks are available, and moves up to max_chunks of them
+  // into chunks; returns false once the file has been exhausted
+  bool next(std::vector<import_chunk> &chunks, size_t max_chunks)
+  {
+    chunks.clear();
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (m_queue.empty() && !m_done)
+      m_cond.wait(lock);
+    while (!m_queue.empty() && chunks.size() < max_chunks)
+    {
+      chunks.push_back(std::move(m_queue.front()));
+      m_queue.pop_front();
+    }
+    m_cond.notify_all();
+    return !chunks.empty();
+  }
+
+  // 1 once the end of the file or block_stop is reached, 2 on error
+  int result() const
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    return m_result;
+  }
+
+private:
+  void finish(int result)
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_result = result;
+    m_done = true;
+    m_cond.notify_all();
+  }
+
+  void run()
+  {
+    char buffer1[1024];
+    std::string str1;
+    while (1)
+    {
+      {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        while (m_queue.size() >= m_max_queued && !m_stop)
+          m_cond.wait(lock);
+        if (m_stop)
+          break;
+      }
+
+      if (m_height > m_block_stop)
+      {
+        std::cout << refresh_string << "block " << m_height-1
+          << " / " << m_block_stop
+          << std::flush;
+        std::cout << ENDL << ENDL;
+        MINFO("Specified block number reached - stopping.  block: " << m_height-1 << "  total blocks: " << m_height);
+        finish(1);
+        return;
+      }
+
+      TIME_MEASURE_NS_START(read_time);
+      uint32_t chunk_size;
+      m_import_file.read(buffer1, sizeof(chunk_size));
+      if (! m_import_file) {
+        std::cout << refresh_string;
+        MINFO("End of file reached");
+        finish(1);
+        return;
+      }
+
+      str1.assign(buffer1, sizeof(chunk_size));
+      if (! ::serialization::parse_binary(str1, chunk_size))
+      {
+        MFATAL("Error in deserialization of chunk size");
+        finish(2);
+        return;
+      }
+      MDEBUG("chunk_size: " << chunk_size);
+
+      if (chunk_size > BUFFER_SIZE)
+      {
+        MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
+        MFATAL("Aborting: chunk size exceeds buffer size");
+        finish(2);
+        return;
+      }
+      if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+      {
+        MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
+      }
+      else if (chunk_size == 0) {
+        MFATAL("ERROR: chunk_size == 0");
+        finish(2);
+        return;
+      }
+
+      import_chunk chunk;
+      chunk.height = m_height;
+      chunk.data.resize(chunk_size);
+      m_import_file.read(&chunk.data[0], chunk_size);
+      if (! m_import_file) {
+        if (m_import_file.eof())
+        {
+          std::cout << refresh_string;
+          MINFO("End of file reached - file was truncated");
+          finish(1);
+        }
+        else
+        {
+          MFATAL("ERROR: unexpected end of file: bytes read before error: "
+              << m_import_file.gcount() << " of chunk_size " << chunk_size);
+          finish(2);
+        }
+        return;
+      }
+      TIME_MEASURE_NS_FINISH(read_time);
+      m_stats.read_ns += read_time;
+      m_stats.read_bytes += sizeof(chunk_size) + chunk_size;
+      ++m_stats.read_blocks;
+
+      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
+      m_height += NUM_BLOCKS_PER_CHUNK;
+
+      boost::unique_lock<boost::mutex> lock(m_mutex);
+      m_queue.push_back(std::move(chunk));
+      m_cond.notify_all();
+    }
+    finish(1);
+  }
+
+  std::ifstream &m_import_file;
+  uint64_t m_height;
+  const uint64_t m_block_stop;
+  const size_t m_max_queued;
+  import_stats &m_stats;
+
+  mutable boost::mutex m_mutex;
+  boost::condition_variable m_cond;
+  std::deque<import_chunk> m_queue;
+  bool m_done;
+  bool m_stop;
+  int m_result;
+  boost::thread m_thread;
+};
+
+bool parse_chunk(const import_chunk &chunk, import_block &ib, bool verify, import_stats &stats)
+{
+  TIME_MEASURE_NS_START(parse_time);
+  try
+  {
+    if (! ::serialization::parse_binary(chunk.data, ib.bp))
+    {
+      MFATAL("Error in deserialization of chunk at height " << chunk.height);
+      return false;
+    }
+    ib.hash = cryptonote::get_block_hash(ib.bp.block);
+    if (verify)
+    {
+      // the verifier works on blobs, so serialize here rather than on the
+      // verification thread, and drop the parsed txs we no longer need
+      cryptonote::block_to_blob(ib.bp.block, ib.entry.block);
+      ib.entry.txs.reserve(ib.bp.txs.size());
+      for (const auto &tx: ib.bp.txs)
+      {
+        ib.entry.txs.push_back(cryptonote::blobdata());
+        cryptonote::tx_to_blob(tx, ib.entry.txs.back());
+      }
+      ib.bp.txs.clear();
+      ib.bp.txs.shrink_to_fit();
+    }
+  }
+  catch (const std::exception &e)
+  {
+    MFATAL("exception while parsing chunk at height " << chunk.height << ": " << e.what());
+    return false;
+  }
+  TIME_MEASURE_NS_FINISH(parse_time);
+  stats.parse_ns += parse_time;
+  ++stats.parse_blocks;
+  return true;
+}
+
+int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &blocks, std::vector<crypto::hash> &hashes, bool force)
 {
   if (blocks.empty())
     return 0;
@@ -178,19 +424,7 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
   if (!force && new_height % HASH_OF_HASHES_STEP)
     return 0;
 
-  std::vector<crypto::hash> hashes;
-  for (const auto &b: blocks)
-  {
-    cryptonote::block block;
-    if (!parse_and_validate_block_from_blob(b.block, block))
-    {
-      MERROR("Failed to parse block: "
-          << epee::string_tools::pod_to_hex(get_blob_hash(b.block)));
-      core.cleanup_handle_incoming_blocks();
-      return 1;
-    }
-    hashes.push_back(cryptonote::get_block_hash(block));
-  }
+  // block hashes were already computed by the parsing stage
   core.prevalidate_block_hashes(core.get_blockchain_storage().get_db().height(), hashes);
 
   core.prepare_handle_incoming_blocks(blocks);
@@ -236,6 +470,7 @@ int check_flush(cryptonote::core &core, std::vector<block_complete_entry> &block
     return 1;
 
   blocks.clear();
+  hashes.clear();
   return 0;
 }
 
@@ -288,13 +523,8 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   // 4 byte magic + (currently) 1024 byte header structures
   bootstrap.seek_to_first_chunk(import_file);
 
-  std::string str1;
-  char buffer1[1024];
-  char buffer_block[BUFFER_SIZE];
-  block b;
-  transaction tx;
   int quit = 0;
-  uint64_t bytes_read;
+  import_stats stats;
 
   // Note that a new blockchain will start with block number 0 (total blocks: 1)
   // due to genesis block being added at initialization.
@@ -315,12 +545,13 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
   std::cout << ENDL;
 
   std::vector<block_complete_entry> blocks;
+  std::vector<crypto::hash> hashes;
 
   // Skip to start_height before we start adding.
   {
     bool q2 = false;
     import_file.seekg(pos);
-    bytes_read = bootstrap.count_bytes(import_file, start_height-seek_height, h, q2);
+    bootstrap.count_bytes(import_file, start_height-seek_height, h, q2);
     if (q2)
     {
       quit = 2;
@@ -340,80 +571,40 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
     import_file.seekg(pos);
     core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
   }
-  while (! quit)
-  {
-    uint32_t chunk_size;
-    import_file.read(buffer1, sizeof(chunk_size));
-    // TODO: bootstrap.read_chunk();
-    if (! import_file) {
-      std::cout << refresh_string;
-      MINFO("End of file reached");
-      quit = 1;
-      break;
-    }
-    bytes_read += sizeof(chunk_size);
-
-    str1.assign(buffer1, sizeof(chunk_size));
-    if (! ::serialization::parse_binary(str1, chunk_size))
-    {
-      throw std::runtime_error("Error in deserialization of chunk size");
-    }
-    MDEBUG("chunk_size: " << chunk_size);
 
-    if (chunk_size > BUFFER_SIZE)
-    {
-      MWARNING("WARNING: chunk_size " << chunk_size << " > BUFFER_SIZE " << BUFFER_SIZE);
-      throw std::runtime_error("Aborting: chunk size exceeds buffer size");
-    }
-    if (chunk_size > CHUNK_SIZE_WARNING_THRESHOLD)
+  {
+    // The import is a three stage pipeline: the reader thread streams raw
+    // chunks from disk, batches of chunks are deserialized, hashed and (when
+    // verifying) re-serialized to blobs on the thread pool, and this thread
+    // verifies and stores the previous batch in the meantime.
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const size_t parse_batch_size = std::max<size_t>(read_ahead / 2, 1);
+    chunk_reader reader(import_file, h, block_stop, read_ahead, stats);
+    std::vector<import_chunk> chunks;
+    std::vector<import_block> ready, parsing;
+    bool more = true;
+    while (!quit && (more || !ready.empty()))
     {
-      MINFO("NOTE: chunk_size " << chunk_size << " > " << CHUNK_SIZE_WARNING_THRESHOLD);
-    }
-    else if (chunk_size == 0) {
-      MFATAL("ERROR: chunk_size == 0");
-      return 2;
-    }
-    import_file.read(buffer_block, chunk_size);
-    if (! import_file) {
-      if (import_file.eof())
-      {
-        std::cout << refresh_string;
-        MINFO("End of file reached - file was truncated");
-        quit = 1;
-        break;
-      }
+      if (more)
+        more = reader.next(chunks, parse_batch_size);
       else
+        chunks.clear();
+
+      tools::threadpool::waiter waiter;
+      std::unique_ptr<std::atomic<bool>[]> parsed_ok(new std::atomic<bool>[chunks.size()]);
+      parsing.clear();
+      parsing.resize(chunks.size());
+      for (size_t i = 0; i < chunks.size(); ++i)
       {
-        MFATAL("ERROR: unexpected end of file: bytes read before error: "
-            << import_file.gcount() << " of chunk_size " << chunk_size);
-        return 2;
+        parsed_ok[i] = false;
+        tpool.submit(&waiter, [&, i](){ parsed_ok[i] = parse_chunk(chunks[i], parsing[i], opt_verify, stats); });
       }
-    }
-    bytes_read += chunk_size;
-    MDEBUG("Total bytes read: " << bytes_read);
-
-    if (h > block_stop)
-    {
-      std::cout << refresh_string << "block " << h-1
-        << " / " << block_stop
-        << std::flush;
-      std::cout << ENDL << ENDL;
-      MINFO("Specified block number reached - stopping.  block: " << h-1 << "  total blocks: " << h);
-      quit = 1;
-      break;
-    }
-
-    try
-    {
-      str1.assign(buffer_block, chunk_size);
-      bootstrap::block_package bp;
-      if (! ::serialization::parse_binary(str1, bp))
-        throw std::runtime_error("Error in deserialization of chunk");
 
+      TIME_MEASURE_NS_START(verify_time);
+      uint64_t verified = 0;
       int display_interval = 1000;
       int progress_interval = 10;
-      // NOTE: use of NUM_BLOCKS_PER_CHUNK is a placeholder in case multi-block chunks are later supported.
-      for (int chunk_ind = 0; chunk_ind < NUM_BLOCKS_PER_CHUNK; ++chunk_ind)
+      for (import_block &ib: ready)
       {
         ++h;
         if ((h-1) % display_interval == 0)
@@ -425,8 +616,7 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
         {
           MDEBUG("loading block number " << h-1);
         }
-        b = bp.block;
-        MDEBUG("block prev_id: " << b.prev_id << ENDL);
+        MDEBUG("block prev_id: " << ib.bp.block.prev_id << ENDL);
 
         if ((h-1) % progress_interval == 0)
         {
@@ -437,16 +627,9 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
 
         if (opt_verify)
         {
-          cryptonote::blobdata block;
-          cryptonote::block_to_blob(bp.block, block);
-          std::vector<cryptonote::blobdata> txs;
-          for (const auto &tx: bp.txs)
-          {
-            txs.push_back(cryptonote::blobdata());
-            cryptonote::tx_to_blob(tx, txs.back());
-          }
-          blocks.push_back({block, txs});
-          int ret = check_flush(core, blocks, false);
+          blocks.push_back(std::move(ib.entry));
+          hashes.push_back(ib.hash);
+          int ret = check_flush(core, blocks, hashes, false);
           if (ret)
           {
             quit = 2; // make sure we don't commit partial block data
@@ -455,37 +638,20 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
         }
         else
         {
-          std::vector<transaction> txs;
-          std::vector<transaction> archived_txs;
-
-          archived_txs = bp.txs;
-
           // tx number 1: coinbase tx
-          // tx number 2 onwards: archived_txs
-          for (const transaction &tx : archived_txs)
-          {
-            // add blocks with verification.
-            // for Blockchain and blockchain_storage add_new_block().
-            // for add_block() method, without (much) processing.
-            // don't add coinbase transaction to txs.
-            //
-            // because add_block() calls
-            // add_transaction(blk_hash, blk.miner_tx) first, and
-            // then a for loop for the transactions in txs.
-            txs.push_back(tx);
-          }
-
-          size_t block_weight;
-          difficulty_type cumulative_difficulty;
-          uint64_t coins_generated;
-
-          block_weight = bp.block_weight;
-          cumulative_difficulty = bp.cumulative_difficulty;
-          coins_generated = bp.coins_generated;
-
+          // tx number 2 onwards: archived txs
+          //
+          // add blocks with verification.
+          // for Blockchain and blockchain_storage add_new_block().
+          // for add_block() method, without (much) processing.
+          // don't add coinbase transaction to txs.
+          //
+          // because add_block() calls
+          // add_transaction(blk_hash, blk.miner_tx) first, and
+          // then a for loop for the transactions in txs.
           try
           {
-            core.get_blockchain_storage().get_db().add_block(b, block_weight, cumulative_difficulty, coins_generated, txs);
+            core.get_blockchain_storage().get_db().add_block(ib.bp.block, ib.bp.block_weight, ib.bp.cumulative_difficulty, ib.bp.coins_generated, ib.bp.txs);
           }
           catch (const std::exception& e)
           {
@@ -499,38 +665,47 @@ int import_from_file(cryptonote::core& core, const std::string& import_file_path
           {
             if ((h-1) % db_batch_size == 0)
             {
-              uint64_t bytes, h2;
-              bool q2;
               std::cout << refresh_string;
               // zero-based height
               std::cout << ENDL << "[- batch commit at height " << h-1 << " -]" << ENDL;
               core.get_blockchain_storage().get_db().batch_stop();
-              pos = import_file.tellg();
-              bytes = bootstrap.count_bytes(import_file, db_batch_size, h2, q2);
-              import_file.seekg(pos);
-              core.get_blockchain_storage().get_db().batch_start(db_batch_size, bytes);
+              // the reader owns the file now, so let the db estimate the
+              // next batch's size from the blocks it already has
+              core.get_blockchain_storage().get_db().batch_start(db_batch_size, 0);
               std::cout << ENDL;
               core.get_blockchain_storage().get_db().show_stats();
             }
           }
         }
         ++num_imported;
+        ++verified;
       }
+      TIME_MEASURE_NS_FINISH(verify_time);
+      stats.verify_ns += verify_time;
+      stats.verify_blocks += verified;
+
+      waiter.wait(&tpool);
+      for (size_t i = 0; i < chunks.size(); ++i)
+      {
+        if (!parsed_ok[i])
+        {
+          std::cout << refresh_string;
+          MFATAL("exception while reading from file, height=" << chunks[i].height);
+          return 2;
+        }
+      }
+      ready.swap(parsing);
     }
-    catch (const std::exception& e)
-    {
-      std::cout << refresh_string;
-      MFATAL("exception while reading from file, height=" << h << ": " << e.what());
-      return 2;
-    }
-  } // while
+    if (!quit)
+      quit = reader.result();
+  }
 
 quitting:
   import_file.close();
 
-  if (opt_verify)
+  if (opt_verify && quit <= 1)
   {
-    int ret = check_flush(core, blocks, true);
+    int ret = check_flush(core, blocks, hashes, true);
     if (ret)
       return ret;
   }
@@ -549,6 +724,7 @@ quitting:
   }
 
   core.get_blockchain_storage().get_db().show_stats();
+  stats.print();
   MINFO("Number of blocks imported: " << num_imported);
   if (h > 0)
     // TODO: if there was an error, the last added block is probably at zero-based height h-2
@@ -585,6 +761,7 @@ int main(int argc, char* argv[])
   const command_line::arg_descriptor<std::string> arg_log_level   = {"log-level",  "0-4 or categories", ""};
   const command_line::arg_descriptor<uint64_t> arg_block_stop  = {"block-stop", "Stop at block number", block_stop};
   const command_line::arg_descriptor<uint64_t> arg_batch_size  = {"batch-size", "", db_batch_size};
+  const command_line::arg_descriptor<uint64_t> arg_read_ahead  = {"read-ahead", "Number of blocks to read and deserialize ahead of verification", read_ahead};
   const command_line::arg_descriptor<uint64_t> arg_pop_blocks  = {"pop-blocks", "Remove blocks from end of blockchain", num_blocks};
   const command_line::arg_descriptor<bool>        arg_drop_hf  = {"drop-hard-fork", "Drop hard fork subdbs", false};
   const command_line::arg_descriptor<bool>     arg_count_blocks = {
@@ -607,6 +784,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_cmd_sett, arg_database);
   command_line::add_arg(desc_cmd_sett, arg_batch_size);
   command_line::add_arg(desc_cmd_sett, arg_block_stop);
+  command_line::add_arg(desc_cmd_sett, arg_read_ahead);
 
   command_line::add_arg(desc_cmd_only, arg_count_blocks);
   command_line::add_arg(desc_cmd_only, arg_pop_blocks);
@@ -640,6 +818,7 @@ int main(int argc, char* argv[])
   opt_resume    = command_line::get_arg(vm, arg_resume);
   block_stop    = command_line::get_arg(vm, arg_block_stop);
   db_batch_size = command_line::get_arg(vm, arg_batch_size);
+  read_ahead    = command_line::get_arg(vm, arg_read_ahead);
 
   if (command_line::get_arg(vm, command_line::arg_help))
   {
@@ -658,6 +837,11 @@ int main(int argc, char* argv[])
     std::cerr << "Error: batch-size must be > 0" << ENDL;
     return 1;
   }
+  if (! read_ahead)
+  {
+    std::cerr << "Error: read-ahead must be > 0" << ENDL;
+    return 1;
+  }
   if (opt_verify && command_line::is_arg_defaulted(vm, arg_batch_size))
   {
     // usually want batch size default lower if verify on, so progress can be
@@ -0,0 +1,156 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <deque>
+#include <iterator>
+#include <set>
+#include <boost/utility/value_init.hpp>
+
+namespace tools
+{
+
+/**
+ * @brief the median of the last N values pushed, updated in O(log N)
+ *
+ * Values are kept in arrival order in a ring buffer, and split into a low
+ * and a high half, so the median is always at the boundary of the two.
+ * The newest value can be taken back (pop_back), and an older value put
+ * back at the front (push_front), which is what rolling back a block does.
+ *
+ * The median is computed the same way as epee::misc_utils::median.
+ */
+template<typename T>
+class windowed_median
+{
+public:
+  explicit windowed_median(size_t window): m_window(window) {}
+
+  size_t window() const { return m_window; }
+  size_t size() const { return m_values.size(); }
+  bool empty() const { return m_values.empty(); }
+  bool full() const { return m_values.size() >= m_window; }
+  const T &front() const { return m_values.front(); }
+  const T &back() const { return m_values.back(); }
+
+  /**
+   * @brief adds the newest value, dropping the oldest one if the window is full
+   */
+  void push_back(const T &value)
+  {
+    if (m_window == 0)
+      return;
+    if (full())
+      pop_front();
+    m_values.push_back(value);
+    insert(value);
+  }
+
+  /**
+   * @brief adds a value older than all the others, if there is room for it
+   */
+  void push_front(const T &value)
+  {
+    if (full())
+      return;
+    m_values.push_front(value);
+    insert(value);
+  }
+
+  void pop_back()
+  {
+    erase(m_values.back());
+    m_values.pop_back();
+  }
+
+  void pop_front()
+  {
+    erase(m_values.front());
+    m_values.pop_front();
+  }
+
+  void clear()
+  {
+    m_values.clear();
+    m_low.clear();
+    m_high.clear();
+  }
+
+  T median() const
+  {
+    if (m_values.empty())
+      return boost::value_initialized<T>();
+    if (m_low.size() > m_high.size())
+      return *m_low.rbegin();
+    return (*m_low.rbegin() + *m_high.begin()) / 2;
+  }
+
+private:
+  void insert(const T &value)
+  {
+    if (m_low.empty() || !(*m_low.rbegin() < value))
+      m_low.insert(value);
+    else
+      m_high.insert(value);
+    rebalance();
+  }
+
+  void erase(const T &value)
+  {
+    if (!(*m_low.rbegin() < value))
+      m_low.erase(m_low.find(value));
+    else
+      m_high.erase(m_high.find(value));
+    rebalance();
+  }
+
+  // keeps the low half the same size as the high half, or one larger
+  void rebalance()
+  {
+    if (m_low.size() > m_high.size() + 1)
+    {
+      auto it = std::prev(m_low.end());
+      m_high.insert(*it);
+      m_low.erase(it);
+    }
+    else if (m_high.size() > m_low.size())
+    {
+      auto it = m_high.begin();
+      m_low.insert(*it);
+      m_high.erase(it);
+    }
+  }
+
+  size_t m_window;
+  std::deque<T> m_values;
+  std::multiset<T> m_low;
+  std::multiset<T> m_high;
+};
+
+}
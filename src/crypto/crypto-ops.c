@@ -1985,12 +1985,9 @@ static void ge_cached_cmov(ge_cached *t, const ge_cached *u, unsigned char b) {
 }
 
 /* Assumes that a[31] <= 127 */
-void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
-  signed char e[64];
+/* Signed radix-16 recoding of a scalar for ge_scalarmult_recoded: e[0..63] in -8..8 */
+void ge_scalarmult_recode(signed char *e, const unsigned char *a) {
   int carry, carry2, i;
-  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
-  ge_p1p1 t;
-  ge_p3 u;
 
   carry = 0; /* 0..1 */
   for (i = 0; i < 31; i++) {
@@ -2004,6 +2001,13 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   carry2 = (carry + 8) >> 4; /* 0..8 */
   e[62] = carry - (carry2 << 4); /* -8..7 */
   e[63] = carry2; /* 0..8 */
+}
+
+void ge_scalarmult_recoded(ge_p2 *r, const signed char *e, const ge_p3 *A) {
+  int i;
+  ge_cached Ai[8]; /* 1 * A, 2 * A, ..., 8 * A */
+  ge_p1p1 t;
+  ge_p3 u;
 
   ge_p3_to_cached(&Ai[0], A);
   for (i = 0; i < 7; i++) {
@@ -2045,6 +2049,13 @@ void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
   }
 }
 
+void ge_scalarmult(ge_p2 *r, const unsigned char *a, const ge_p3 *A) {
+  signed char e[64];
+
+  ge_scalarmult_recode(e, a);
+  ge_scalarmult_recoded(r, e, A);
+}
+
 void ge_scalarmult_p3(ge_p3 *r3, const unsigned char *a, const ge_p3 *A) {
   signed char e[64];
   int carry, carry2, i;
@@ -2198,6 +2209,45 @@ void ge_double_scalarmult_precomp_vartime(ge_p2 *r, const unsigned char *a, cons
   ge_double_scalarmult_precomp_vartime2(r, a, Ai, b, Bi);
 }
 
+/*
+ge_tobytes for n points at once, s receiving 32 * n bytes.
+
+Montgomery's trick: the n Z coordinates are inverted with one fe_invert
+and 3 * (n - 1) multiplications. tmp must hold n field elements.
+Z is never zero for points in p2 form, so neither is the product.
+*/
+void ge_p2_batch_tobytes(unsigned char *s, const ge_p2 *h, fe *tmp, size_t n) {
+  fe inv;
+  fe recip;
+  fe x;
+  fe y;
+  size_t i;
+
+  if (n == 0) {
+    return;
+  }
+
+  /* tmp[i] = Z[0] * ... * Z[i] */
+  fe_copy(tmp[0], h[0].Z);
+  for (i = 1; i < n; i++) {
+    fe_mul(tmp[i], tmp[i - 1], h[i].Z);
+  }
+
+  fe_invert(inv, tmp[n - 1]);
+  for (i = n; i-- > 0; ) {
+    if (i > 0) {
+      fe_mul(recip, inv, tmp[i - 1]); /* 1 / Z[i] */
+      fe_mul(inv, inv, h[i].Z); /* 1 / (Z[0] * ... * Z[i - 1]) */
+    } else {
+      fe_copy(recip, inv);
+    }
+    fe_mul(x, h[i].X, recip);
+    fe_mul(y, h[i].Y, recip);
+    fe_tobytes(s + 32 * i, y);
+    s[32 * i + 31] ^= fe_isnegative(x) << 7;
+  }
+}
+
 void ge_mul8(ge_p1p1 *r, const ge_p2 *t) {
   ge_p2 u;
   ge_p2_dbl(r, t);
@@ -186,6 +186,44 @@ namespace crypto {
     return true;
   }
 
+  bool crypto_ops::generate_key_derivations(const std::vector<public_key> &keys, const secret_key &key2, std::vector<key_derivation> &derivations, std::vector<bool> &valid) {
+    signed char e[64];
+    std::vector<ge_p2> points;
+    std::vector<size_t> indices;
+    assert(sc_check(&key2) == 0);
+    ge_scalarmult_recode(e, &unwrap(key2));
+    derivations.resize(keys.size());
+    valid.assign(keys.size(), false);
+    points.reserve(keys.size());
+    indices.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      ge_p3 point;
+      ge_p2 point2;
+      ge_p1p1 point3;
+      if (ge_frombytes_vartime(&point, &keys[i]) != 0) {
+        continue;
+      }
+      ge_scalarmult_recoded(&point2, e, &point);
+      ge_mul8(&point3, &point2);
+      ge_p1p1_to_p2(&point2, &point3);
+      points.push_back(point2);
+      indices.push_back(i);
+      valid[i] = true;
+    }
+    memwipe(e, sizeof(e));
+    if (points.empty()) {
+      return keys.empty();
+    }
+
+    std::unique_ptr<fe[]> tmp(new fe[points.size()]);
+    std::vector<key_derivation> bytes(points.size());
+    ge_p2_batch_tobytes(reinterpret_cast<unsigned char*>(bytes.data()), points.data(), tmp.get(), points.size());
+    for (size_t n = 0; n < indices.size(); ++n) {
+      derivations[indices[n]] = bytes[n];
+    }
+    return indices.size() == keys.size();
+  }
+
   void crypto_ops::derivation_to_scalar(const key_derivation &derivation, size_t output_index, ec_scalar &res) {
     struct {
       key_derivation derivation;
@@ -85,6 +85,8 @@ enum {
 
 void cn_fast_hash(const void *data, size_t length, char *hash);
 void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int prehashed, int modifier);
+#define CN_SLOW_HASH_MAX_WAYS 4
+void cn_slow_hash_multi(const void *const *data, const size_t *length, char (*hashes)[HASH_SIZE], size_t count, size_t ways, int variant, int modifier);
 
 void hash_extra_blake(const void *data, size_t length, char *hash);
 void hash_extra_groestl(const void *data, size_t length, char *hash);
@@ -100,3 +102,5 @@ uint64_t rx_seedheight(const uint64_t height);
 void rx_seedheights(const uint64_t height, uint64_t *seed_height, uint64_t *next_height);
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length, char *hash, int miners, int is_alt);
 void rx_reorg(const uint64_t split_height);
+void rx_prepare_next_seed(const uint64_t seedheight, const char *seedhash);
+void rx_stop_prepare_next_seed(void);
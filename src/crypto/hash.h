@@ -79,6 +79,10 @@ namespace crypto {
     cn_slow_hash(data, length, reinterpret_cast<char *>(&hash), variant, 1/*prehashed*/, modifier);
   }
 
+  inline void cn_slow_hash_multi(const void *const *data, const std::size_t *length, hash *hashes, std::size_t count, std::size_t ways, int variant = 0, int modifier = 0) {
+    cn_slow_hash_multi(data, length, reinterpret_cast<char (*)[HASH_SIZE]>(hashes), count, ways, variant, modifier);
+  }
+
   inline void tree_hash(const hash *hashes, std::size_t count, hash &root_hash) {
     tree_hash(reinterpret_cast<const char (*)[HASH_SIZE]>(hashes), count, reinterpret_cast<char *>(&root_hash));
   }
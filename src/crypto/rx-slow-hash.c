@@ -52,18 +52,31 @@ typedef struct rx_state {
   CTHR_MUTEX_TYPE rs_mutex;
   char rs_hash[32];
   uint64_t  rs_height;
+  uint64_t  rs_gen;	/* changes each time the cache is initialized, unique across slots */
   randomx_cache *rs_cache;
 } rx_state;
 
 static CTHR_MUTEX_TYPE rx_mutex = CTHR_MUTEX_INIT;
 static CTHR_MUTEX_TYPE rx_dataset_mutex = CTHR_MUTEX_INIT;
+static CTHR_MUTEX_TYPE rx_warm_mutex = CTHR_MUTEX_INIT;
 
-static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0},{CTHR_MUTEX_INIT,{0},0,0}};
+static rx_state rx_s[2] = {{CTHR_MUTEX_INIT,{0},0,0,0},{CTHR_MUTEX_INIT,{0},0,0,0}};
 
 static randomx_dataset *rx_dataset;
-static uint64_t rx_dataset_height;
+static char rx_dataset_hash[32];
+static int rx_dataset_valid;
 static THREADV randomx_vm *rx_vm = NULL;
 static THREADV int rx_toggle;
+static THREADV uint64_t rx_vm_gen;
+
+typedef struct warminfo {
+  uint64_t wi_height;
+  char wi_hash[32];
+} warminfo;
+
+static CTHR_THREAD_TYPE rx_warm_thread;
+static int rx_warm_started;
+static warminfo rx_warm_info;
 
 static void local_abort(const char *msg)
 {
@@ -155,9 +168,60 @@ static inline int use_rx_jit(void)
 #endif
 }
 
+/**
+ * @brief number of threads used to initialize the dataset
+ *
+ * Defaults to the number of CPUs, as the dataset init is only done when
+ * mining starts or the seed changes, and the miner waits for it anyway.
+ */
+static int rx_init_threads(const int miners)
+{
+  static int threads = -1;
+
+  if (threads == -1) {
+    const char *env = getenv("MONERO_RANDOMX_INIT_THREADS");
+    threads = env ? atoi(env) : 0;
+#if defined(_SC_NPROCESSORS_ONLN)
+    if (threads <= 0)
+      threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (threads <= 0)
+      threads = 1;
+  }
+  return threads > miners ? threads : miners;
+}
+
+/**
+ * @brief directory the datasets are saved to, if any
+ *
+ * A dataset file is keyed by its seed hash, so a restarted miner can
+ * load it instead of initializing the dataset again.
+ */
+static const char *rx_dataset_dir(void)
+{
+  const char *env = getenv("MONERO_RANDOMX_DATASET_DIR");
+  return env && *env ? env : NULL;
+}
+
+static int rx_large_pages(void)
+{
+  static int use = -1;
+
+  if (use != -1)
+    return use;
+
+  const char *env = getenv("MONERO_RANDOMX_LARGE_PAGES");
+  use = !(env && (!strcmp(env, "0") || !strcmp(env, "no")));
+  return use;
+}
+
 #define SEEDHASH_EPOCH_BLOCKS	2048	/* Must be same as BLOCKS_SYNCHRONIZING_MAX_COUNT in cryptonote_config.h */
 #define SEEDHASH_EPOCH_LAG		64
 
+/* The caches and the dataset are keyed by seed hash, so a reorg which
+ * brings back the same seed block does not need them initialized again.
+ * Only the heights get invalidated here.
+ */
 void rx_reorg(const uint64_t split_height) {
   int i;
   CTHR_MUTEX_LOCK(rx_mutex);
@@ -191,7 +255,81 @@ static CTHR_THREAD_RTYPE rx_seedthread(void *arg) {
   CTHR_THREAD_RETURN;
 }
 
-static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_t seedheight) {
+#define RX_DATASET_MAGIC	"RXDATASET1"
+
+static void rx_dataset_path(char *path, size_t size, const char *dir, const char *seedhash) {
+  static const char hex[] = "0123456789abcdef";
+  char name[65];
+  int i;
+  for (i=0; i<32; i++) {
+    name[i*2] = hex[(seedhash[i] >> 4) & 0xf];
+    name[i*2+1] = hex[seedhash[i] & 0xf];
+  }
+  name[64] = 0;
+  snprintf(path, size, "%s/rx-dataset-%s.bin", dir, name);
+}
+
+/* The file holds a magic, the seed hash and the item count, then the dataset */
+static int rx_load_dataset(const char *seedhash) {
+  const char *dir = rx_dataset_dir();
+  char path[4096], magic[sizeof(RX_DATASET_MAGIC)], hash[32];
+  uint64_t count;
+  FILE *f;
+  int ok = 0;
+
+  if (dir == NULL)
+    return 0;
+  rx_dataset_path(path, sizeof(path), dir, seedhash);
+  f = fopen(path, "rb");
+  if (f == NULL)
+    return 0;
+  if (fread(magic, sizeof(magic), 1, f) == 1 && !memcmp(magic, RX_DATASET_MAGIC, sizeof(magic)) &&
+      fread(hash, sizeof(hash), 1, f) == 1 && !memcmp(hash, seedhash, sizeof(hash)) &&
+      fread(&count, sizeof(count), 1, f) == 1 && count == randomx_dataset_item_count()) {
+    ok = fread(randomx_get_dataset_memory(rx_dataset), RANDOMX_DATASET_ITEM_SIZE, count, f) == count;
+  }
+  fclose(f);
+  if (ok)
+    minfo(RX_LOGCAT, "Loaded RandomX dataset from %s", path);
+  else
+    mwarning(RX_LOGCAT, "Ignoring invalid RandomX dataset file %s", path);
+  return ok;
+}
+
+static void rx_save_dataset(const char *seedhash) {
+  const char *dir = rx_dataset_dir();
+  char path[4096], tmp[4096 + 8];
+  uint64_t count = randomx_dataset_item_count();
+  FILE *f;
+  int ok;
+
+  if (dir == NULL)
+    return;
+  rx_dataset_path(path, sizeof(path), dir, seedhash);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  f = fopen(tmp, "wb");
+  if (f == NULL) {
+    mwarning(RX_LOGCAT, "Couldn't create RandomX dataset file %s", tmp);
+    return;
+  }
+  ok = fwrite(RX_DATASET_MAGIC, sizeof(RX_DATASET_MAGIC), 1, f) == 1 &&
+    fwrite(seedhash, 32, 1, f) == 1 &&
+    fwrite(&count, sizeof(count), 1, f) == 1 &&
+    fwrite(randomx_get_dataset_memory(rx_dataset), RANDOMX_DATASET_ITEM_SIZE, count, f) == count;
+  ok = !fclose(f) && ok;
+  if (!ok || rename(tmp, path)) {
+    mwarning(RX_LOGCAT, "Couldn't write RandomX dataset file %s", path);
+    remove(tmp);
+  }
+}
+
+static void rx_initdata(randomx_cache *rs_cache, int miners, const char *seedhash) {
+  if (rx_load_dataset(seedhash)) {
+    memcpy(rx_dataset_hash, seedhash, sizeof(rx_dataset_hash));
+    rx_dataset_valid = 1;
+    return;
+  }
+  miners = rx_init_threads(miners);
   if (miners > 1) {
     unsigned long delta = randomx_dataset_item_count() / miners;
     unsigned long start = 0;
@@ -227,7 +365,82 @@ static void rx_initdata(randomx_cache *rs_cache, const int miners, const uint64_
   } else {
     randomx_init_dataset(rx_dataset, rs_cache, 0, randomx_dataset_item_count());
   }
-  rx_dataset_height = seedheight;
+  memcpy(rx_dataset_hash, seedhash, sizeof(rx_dataset_hash));
+  rx_dataset_valid = 1;
+  rx_save_dataset(seedhash);
+}
+
+static randomx_cache *rx_alloc_cache(void) {
+  randomx_flags flags = RANDOMX_FLAG_DEFAULT;
+  randomx_cache *cache = NULL;
+  if (use_rx_jit())
+    flags |= RANDOMX_FLAG_JIT;
+  if (rx_large_pages()) {
+    cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
+    if (cache == NULL)
+      mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX cache");
+  }
+  if (cache == NULL)
+    cache = randomx_alloc_cache(flags);
+  if (cache == NULL)
+    local_abort("Couldn't allocate RandomX cache");
+  return cache;
+}
+
+/* must be called with the slot mutex held */
+static void rx_init_slot(rx_state *rx_sp, const uint64_t seedheight, const char *seedhash) {
+  if (rx_sp->rs_cache == NULL)
+    rx_sp->rs_cache = rx_alloc_cache();
+  if (memcmp(seedhash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash)) || rx_sp->rs_gen == 0) {
+    randomx_init_cache(rx_sp->rs_cache, seedhash, 32);
+    memcpy(rx_sp->rs_hash, seedhash, sizeof(rx_sp->rs_hash));
+    /* odd generations for the first slot, even ones for the second */
+    rx_sp->rs_gen = rx_sp->rs_gen ? rx_sp->rs_gen + 2 : (uint64_t)(rx_sp - rx_s) + 1;
+  }
+  rx_sp->rs_height = seedheight;
+}
+
+static CTHR_THREAD_RTYPE rx_warmthread(void *arg) {
+  warminfo *wi = arg;
+  rx_state *rx_sp = &rx_s[(wi->wi_height & SEEDHASH_EPOCH_BLOCKS) != 0];
+  CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
+  rx_init_slot(rx_sp, wi->wi_height, wi->wi_hash);
+  CTHR_MUTEX_UNLOCK(rx_sp->rs_mutex);
+  CTHR_THREAD_RETURN;
+}
+
+/* Initializes the cache for the next seed in the background, in the slot
+ * which is not used by the current seed, so hashing does not stall when
+ * the seed changes.
+ */
+void rx_prepare_next_seed(const uint64_t seedheight, const char *seedhash) {
+  CTHR_MUTEX_LOCK(rx_warm_mutex);
+  /* already requested, the thread leaves the cache alone if it is warm */
+  if (rx_warm_info.wi_height == seedheight && !memcmp(seedhash, rx_warm_info.wi_hash, sizeof(rx_warm_info.wi_hash))) {
+    CTHR_MUTEX_UNLOCK(rx_warm_mutex);
+    return;
+  }
+  if (rx_warm_started) {
+    CTHR_THREAD_JOIN(rx_warm_thread);
+    rx_warm_started = 0;
+  }
+  rx_warm_info.wi_height = seedheight;
+  memcpy(rx_warm_info.wi_hash, seedhash, sizeof(rx_warm_info.wi_hash));
+  CTHR_THREAD_CREATE(rx_warm_thread, rx_warmthread, &rx_warm_info);
+  rx_warm_started = 1;
+  CTHR_MUTEX_UNLOCK(rx_warm_mutex);
+}
+
+/* Waits for a cache warming started by rx_prepare_next_seed, if any.
+ * Called at shutdown so the thread does not outlive its caller.
+ */
+void rx_stop_prepare_next_seed(void) {
+  CTHR_MUTEX_LOCK(rx_warm_mutex);
+  if (rx_warm_started) {
+    CTHR_THREAD_JOIN(rx_warm_thread);
+    rx_warm_started = 0;
+  }
+  CTHR_MUTEX_UNLOCK(rx_warm_mutex);
 }
 
 void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const char *seedhash, const void *data, size_t length,
@@ -235,9 +448,7 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   uint64_t s_height = rx_seedheight(mainheight);
   int changed = 0;
   int toggle = is_alt ? s_height : seedheight;
-  randomx_flags flags = RANDOMX_FLAG_DEFAULT;
   rx_state *rx_sp;
-  randomx_cache *cache;
 
   toggle = (toggle & SEEDHASH_EPOCH_BLOCKS) != 0;
   CTHR_MUTEX_LOCK(rx_mutex);
@@ -259,27 +470,12 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
   CTHR_MUTEX_LOCK(rx_sp->rs_mutex);
   CTHR_MUTEX_UNLOCK(rx_mutex);
 
-  cache = rx_sp->rs_cache;
-  if (cache == NULL) {
-    if (use_rx_jit())
-      flags |= RANDOMX_FLAG_JIT;
-    if (cache == NULL) {
-      cache = randomx_alloc_cache(flags | RANDOMX_FLAG_LARGE_PAGES);
-      if (cache == NULL) {
-        mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX cache");
-        cache = randomx_alloc_cache(flags);
-      }
-      if (cache == NULL)
-        local_abort("Couldn't allocate RandomX cache");
-    }
-  }
-  if (rx_sp->rs_height != seedheight || rx_sp->rs_cache == NULL || memcmp(seedhash, rx_sp->rs_hash, sizeof(rx_sp->rs_hash))) {
-    randomx_init_cache(cache, seedhash, 32);
-    rx_sp->rs_cache = cache;
-    rx_sp->rs_height = seedheight;
-    memcpy(rx_sp->rs_hash, seedhash, sizeof(rx_sp->rs_hash));
+  /* the cache may also have been initialized by another thread, or by
+   * rx_prepare_next_seed, since this thread's VM last used it */
+  rx_init_slot(rx_sp, seedheight, seedhash);
+  if (rx_sp->rs_gen != rx_vm_gen)
     changed = 1;
-  }
+  rx_vm_gen = rx_sp->rs_gen;
   if (rx_vm == NULL) {
     randomx_flags flags = RANDOMX_FLAG_DEFAULT;
     if (use_rx_jit()) {
@@ -292,14 +488,17 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
     if (miners) {
       CTHR_MUTEX_LOCK(rx_dataset_mutex);
       if (rx_dataset == NULL) {
-        rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
-        if (rx_dataset == NULL) {
-          mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX dataset");
-          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+        if (rx_large_pages()) {
+          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_LARGE_PAGES);
+          if (rx_dataset == NULL)
+            mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX dataset");
         }
-        if (rx_dataset != NULL)
-          rx_initdata(rx_sp->rs_cache, miners, seedheight);
+        if (rx_dataset == NULL)
+          rx_dataset = randomx_alloc_dataset(RANDOMX_FLAG_DEFAULT);
+        rx_dataset_valid = 0;
       }
+      if (rx_dataset != NULL && (!rx_dataset_valid || memcmp(rx_dataset_hash, seedhash, sizeof(rx_dataset_hash))))
+        rx_initdata(rx_sp->rs_cache, miners, seedhash);
       if (rx_dataset != NULL)
         flags |= RANDOMX_FLAG_FULL_MEM;
       else {
@@ -308,11 +507,13 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
       }
       CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
     }
-    rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
-    if(rx_vm == NULL) { //large pages failed
-      mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
-      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
+    if (rx_large_pages()) {
+      rx_vm = randomx_create_vm(flags | RANDOMX_FLAG_LARGE_PAGES, rx_sp->rs_cache, rx_dataset);
+      if(rx_vm == NULL) //large pages failed
+        mdebug(RX_LOGCAT, "Couldn't use largePages for RandomX VM");
     }
+    if(rx_vm == NULL)
+      rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
     if(rx_vm == NULL) {//fallback if everything fails
       flags = RANDOMX_FLAG_DEFAULT | (miners ? RANDOMX_FLAG_FULL_MEM : 0);
       rx_vm = randomx_create_vm(flags, rx_sp->rs_cache, rx_dataset);
@@ -321,8 +522,8 @@ void rx_slow_hash(const uint64_t mainheight, const uint64_t seedheight, const ch
       local_abort("Couldn't allocate RandomX VM");
   } else if (miners) {
     CTHR_MUTEX_LOCK(rx_dataset_mutex);
-    if (rx_dataset != NULL && rx_dataset_height != seedheight)
-      rx_initdata(cache, miners, seedheight);
+    if (rx_dataset != NULL && (!rx_dataset_valid || memcmp(rx_dataset_hash, seedhash, sizeof(rx_dataset_hash))))
+      rx_initdata(rx_sp->rs_cache, miners, seedhash);
     CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
   } else if (changed) {
     randomx_vm_set_cache(rx_vm, rx_sp->rs_cache);
@@ -351,6 +552,7 @@ void rx_stop_mining(void) {
   if (rx_dataset != NULL) {
     randomx_dataset *rd = rx_dataset;
     rx_dataset = NULL;
+    rx_dataset_valid = 0;
     randomx_release_dataset(rd);
   }
   CTHR_MUTEX_UNLOCK(rx_dataset_mutex);
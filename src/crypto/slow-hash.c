@@ -328,6 +328,9 @@ union cn_slow_hash_state
 
 THREADV uint8_t *hp_state = NULL;
 THREADV int hp_allocated = 0;
+// extra scratchpads for the lanes of cn_slow_hash_multi beyond the first, which uses hp_state
+THREADV uint8_t *hp_multi_state[CN_SLOW_HASH_MAX_WAYS - 1] = { NULL };
+THREADV int hp_multi_allocated[CN_SLOW_HASH_MAX_WAYS - 1] = { 0 };
 
 #if defined(_MSC_VER)
 #define cpuid(info,x)    __cpuidex(info,x,0)
@@ -599,66 +602,99 @@ BOOL SetLockPagesPrivilege(HANDLE hProcess, BOOL bEnable)
 #endif
 
 /**
- * @brief allocate the 2MB scratch buffer using OS support for huge pages, if available
+ * @brief allocate a 2MB scratch buffer using OS support for huge pages, if available
  *
  * This function tries to allocate the 2MB scratch buffer using a single
  * 2MB "huge page" (instead of the usual 4KB page sizes) to reduce TLB misses
  * during the random accesses to the scratch buffer.  This is one of the
  * important speed optimizations needed to make CryptoNight faster.
  *
- * No parameters.  Updates a thread-local pointer, hp_state, to point to
- * the allocated buffer.
+ * @param allocated set to 1 if the buffer came from the OS page allocator, 0 if from malloc
+ * @return the buffer, or NULL if no memory could be had at all
  */
 
-void cn_slow_hash_allocate_state(void)
+STATIC uint8_t *cn_slow_hash_allocate_scratchpad(int *allocated)
 {
-    if(hp_state != NULL)
-        return;
+    uint8_t *scratchpad = NULL;
 
 #if defined(_MSC_VER) || defined(__MINGW32__)
     SetLockPagesPrivilege(GetCurrentProcess(), TRUE);
-    hp_state = (uint8_t *) VirtualAlloc(hp_state, MEMORY, MEM_LARGE_PAGES |
-                                        MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    scratchpad = (uint8_t *) VirtualAlloc(NULL, MEMORY, MEM_LARGE_PAGES |
+                                          MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
 #else
 #if defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
   defined(__DragonFly__) || defined(__NetBSD__)
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANON, 0, 0);
+    scratchpad = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANON, 0, 0);
 #else
-    hp_state = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
-                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
+    scratchpad = mmap(0, MEMORY, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, 0, 0);
 #endif
-    if(hp_state == MAP_FAILED)
-        hp_state = NULL;
+    if(scratchpad == MAP_FAILED)
+        scratchpad = NULL;
 #endif
-    hp_allocated = 1;
-    if(hp_state == NULL)
+    *allocated = 1;
+    if(scratchpad == NULL)
     {
-        hp_allocated = 0;
-        hp_state = (uint8_t *) malloc(MEMORY);
+        *allocated = 0;
+        scratchpad = (uint8_t *) malloc(MEMORY);
     }
+    return scratchpad;
 }
 
 /**
- *@brief frees the state allocated by slow_hash_allocate_state
+ * @brief frees a buffer returned by cn_slow_hash_allocate_scratchpad
  */
 
-void cn_slow_hash_free_state(void)
+STATIC void cn_slow_hash_free_scratchpad(uint8_t *scratchpad, int allocated)
 {
-    if(hp_state == NULL)
-        return;
-
-    if(!hp_allocated)
-        free(hp_state);
+    if(!allocated)
+        free(scratchpad);
     else
     {
 #if defined(_MSC_VER) || defined(__MINGW32__)
-        VirtualFree(hp_state, 0, MEM_RELEASE);
+        VirtualFree(scratchpad, 0, MEM_RELEASE);
 #else
-        munmap(hp_state, MEMORY);
+        munmap(scratchpad, MEMORY);
 #endif
     }
+}
+
+/**
+ * @brief allocate the 2MB scratch buffer for this thread
+ *
+ * No parameters.  Updates a thread-local pointer, hp_state, to point to
+ * the allocated buffer.
+ */
+
+void cn_slow_hash_allocate_state(void)
+{
+    if(hp_state != NULL)
+        return;
+
+    hp_state = cn_slow_hash_allocate_scratchpad(&hp_allocated);
+}
+
+/**
+ *@brief frees the state allocated by slow_hash_allocate_state
+ */
+
+void cn_slow_hash_free_state(void)
+{
+    size_t k;
+
+    for(k = 0; k < CN_SLOW_HASH_MAX_WAYS - 1; k++)
+    {
+        if(hp_multi_state[k] != NULL)
+            cn_slow_hash_free_scratchpad(hp_multi_state[k], hp_multi_allocated[k]);
+        hp_multi_state[k] = NULL;
+        hp_multi_allocated[k] = 0;
+    }
+
+    if(hp_state == NULL)
+        return;
 
+    cn_slow_hash_free_scratchpad(hp_state, hp_allocated);
     hp_state = NULL;
     hp_allocated = 0;
 }
@@ -854,6 +890,246 @@ void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int
     extra_hashes[state.hs.b[0] & 3](&state, 200, hash);
 }
 
+/*
+ * Per-input state of cn_slow_hash_multi.  Everything the main loop of
+ * cn_slow_hash keeps in locals lives here instead, so that several inputs
+ * can be stepped through their mixing loops side by side.
+ */
+typedef struct
+{
+    RDATA_ALIGN16 uint64_t a[2];
+    RDATA_ALIGN16 uint64_t b[4];
+    RDATA_ALIGN16 uint64_t c[2];
+    __m128i _b, _b1;
+    uint64_t tweak1_2;
+    uint64_t division_result;
+    uint64_t sqrt_result;
+    uint8_t *hp;
+    union cn_slow_hash_state state;
+} cn_slow_hash_lane;
+
+/**
+ * @brief CryptoNight steps 1 and 2 for one lane of cn_slow_hash_multi
+ */
+
+STATIC INLINE void cn_slow_hash_lane_init(cn_slow_hash_lane *lane, const void *data, size_t length, int variant)
+{
+    RDATA_ALIGN16 uint8_t expandedKey[240];
+    uint8_t text[INIT_SIZE_BYTE];
+    uint8_t *hp_state = lane->hp;
+    uint64_t *b = lane->b;
+    union cn_slow_hash_state state;
+    size_t i;
+
+    hash_process(&state.hs, data, length);
+    memcpy(text, state.init, INIT_SIZE_BYTE);
+
+    VARIANT1_INIT64();
+    VARIANT2_INIT64();
+    lane->tweak1_2 = tweak1_2;
+    lane->division_result = division_result;
+    lane->sqrt_result = sqrt_result;
+
+    aes_expand_key(state.hs.b, expandedKey);
+    for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+    {
+        aes_pseudo_round(text, text, expandedKey, INIT_SIZE_BLK);
+        memcpy(&hp_state[i * INIT_SIZE_BYTE], text, INIT_SIZE_BYTE);
+    }
+
+    U64(lane->a)[0] = U64(&state.k[0])[0] ^ U64(&state.k[32])[0];
+    U64(lane->a)[1] = U64(&state.k[0])[1] ^ U64(&state.k[32])[1];
+    U64(b)[0] = U64(&state.k[16])[0] ^ U64(&state.k[48])[0];
+    U64(b)[1] = U64(&state.k[16])[1] ^ U64(&state.k[48])[1];
+    memcpy(&lane->state, &state, sizeof(state));
+
+    lane->_b = _mm_load_si128(R128(b));
+    lane->_b1 = _mm_load_si128(R128(b) + 1);
+}
+
+/**
+ * @brief one iteration of CryptoNight step 3 for one lane of cn_slow_hash_multi
+ *
+ * This is the body of the AES-NI loop of cn_slow_hash, reading and writing
+ * the lane instead of locals.  Once inlined into the loop in
+ * cn_slow_hash_multi, the lanes form independent dependency chains, so the
+ * CPU can overlap the scratchpad reads and the AES and multiply latencies
+ * of one lane with the work of the others.
+ */
+
+STATIC INLINE void cn_slow_hash_lane_round(cn_slow_hash_lane *lane, int variant, int reverse)
+{
+    uint8_t *hp_state = lane->hp;
+    uint64_t *a = lane->a;
+    uint64_t *b = lane->b;
+    uint64_t *c = lane->c;
+    const uint64_t tweak1_2 = lane->tweak1_2;
+    uint64_t division_result = lane->division_result;
+    uint64_t sqrt_result = lane->sqrt_result;
+    __m128i _a, _c;
+    __m128i _b = lane->_b;
+    __m128i _b1 = lane->_b1;
+    uint64_t hi, lo;
+    uint64_t *p;
+    size_t j;
+
+    pre_aes();
+    _c = _mm_aesenc_si128(_c, _a);
+    post_aes(reverse);
+
+    lane->_b = _b;
+    lane->_b1 = _b1;
+    lane->division_result = division_result;
+    lane->sqrt_result = sqrt_result;
+}
+
+/**
+ * @brief CryptoNight steps 4 and 5 for one lane of cn_slow_hash_multi
+ */
+
+STATIC INLINE void cn_slow_hash_lane_final(cn_slow_hash_lane *lane, char *hash)
+{
+    RDATA_ALIGN16 uint8_t expandedKey[240];
+    uint8_t text[INIT_SIZE_BYTE];
+    size_t i;
+
+    static void (*const extra_hashes[4])(const void *, size_t, char *) =
+    {
+        hash_extra_blake, hash_extra_groestl, hash_extra_jh, hash_extra_skein
+    };
+
+    memcpy(text, lane->state.init, INIT_SIZE_BYTE);
+    aes_expand_key(&lane->state.hs.b[32], expandedKey);
+    for(i = 0; i < MEMORY / INIT_SIZE_BYTE; i++)
+        aes_pseudo_round_xor(text, text, expandedKey, &lane->hp[i * INIT_SIZE_BYTE], INIT_SIZE_BLK);
+
+    memcpy(lane->state.init, text, INIT_SIZE_BYTE);
+    hash_permutation(&lane->state.hs);
+    extra_hashes[lane->state.hs.b[0] & 3](&lane->state, 200, hash);
+}
+
+/**
+ * @brief hashes several inputs with CryptoNight, interleaving their mixing loops
+ *
+ * Produces exactly the same hashes as calling cn_slow_hash (not prehashed)
+ * on each input in turn, but runs up to <ways> inputs through the mixing
+ * loop together, each with its own scratchpad.  A single CryptoNight hash
+ * spends most of its time waiting on the latency of scratchpad reads, AES
+ * rounds and multiplies of one serial dependency chain; stepping two or more
+ * chains at once fills those stalls, so total throughput goes up at the cost
+ * of 2MB of extra scratchpad per additional lane.  This is meant for checking
+ * many historical blocks, where all inputs are known up front.
+ *
+ * Without hardware AES this falls back to cn_slow_hash for each input.
+ *
+ * @param data pointers to the <count> inputs
+ * @param length the lengths of the inputs, in bytes
+ * @param hashes where the <count> 256 bit hashes are stored
+ * @param count the number of inputs
+ * @param ways how many inputs to interleave, clamped to 1..CN_SLOW_HASH_MAX_WAYS
+ * @param variant the CryptoNight variant, as for cn_slow_hash
+ * @param modifier the CryptoNight modifier, as for cn_slow_hash
+ */
+void cn_slow_hash_multi(const void *const *data, const size_t *length, char (*hashes)[HASH_SIZE], size_t count, size_t ways, int variant, int modifier)
+{
+    cn_slow_hash_lane lanes[CN_SLOW_HASH_MAX_WAYS];
+    const uint64_t iters = (modifier & CN_MODIFIER_WALTZ) ? (3 * ITER) / 8 : ITER / 2;
+    size_t n, i, k;
+
+    if(ways > CN_SLOW_HASH_MAX_WAYS)
+        ways = CN_SLOW_HASH_MAX_WAYS;
+    if(ways <= 1 || force_software_aes() || !check_aes_hw())
+    {
+        for(n = 0; n < count; n++)
+            cn_slow_hash(data[n], length[n], hashes[n], variant, 0, modifier);
+        return;
+    }
+
+    if(hp_state == NULL)
+        cn_slow_hash_allocate_state();
+    for(k = 0; k < ways - 1; k++)
+    {
+        if(hp_multi_state[k] == NULL)
+            hp_multi_state[k] = cn_slow_hash_allocate_scratchpad(&hp_multi_allocated[k]);
+    }
+
+    for(n = 0; n < count; n += ways)
+    {
+        const size_t lanes_used = count - n < ways ? count - n : ways;
+        if(lanes_used == 1)
+        {
+            cn_slow_hash(data[n], length[n], hashes[n], variant, 0, modifier);
+            break;
+        }
+
+        for(k = 0; k < lanes_used; k++)
+        {
+            lanes[k].hp = k == 0 ? hp_state : hp_multi_state[k - 1];
+            cn_slow_hash_lane_init(&lanes[k], data[n + k], length[n + k], variant);
+        }
+
+        // Separate loops for the common lane counts and for each direction
+        // keep the lane count and the reverse flag constant inside the loop.
+        if(modifier & CN_MODIFIER_REVERSE)
+        {
+            if(lanes_used == 2)
+            {
+                for(i = 0; i < iters; i++)
+                {
+                    cn_slow_hash_lane_round(&lanes[0], variant, 1);
+                    cn_slow_hash_lane_round(&lanes[1], variant, 1);
+                }
+            }
+            else if(lanes_used == 4)
+            {
+                for(i = 0; i < iters; i++)
+                {
+                    cn_slow_hash_lane_round(&lanes[0], variant, 1);
+                    cn_slow_hash_lane_round(&lanes[1], variant, 1);
+                    cn_slow_hash_lane_round(&lanes[2], variant, 1);
+                    cn_slow_hash_lane_round(&lanes[3], variant, 1);
+                }
+            }
+            else
+            {
+                for(i = 0; i < iters; i++)
+                    for(k = 0; k < lanes_used; k++)
+                        cn_slow_hash_lane_round(&lanes[k], variant, 1);
+            }
+        }
+        else
+        {
+            if(lanes_used == 2)
+            {
+                for(i = 0; i < iters; i++)
+                {
+                    cn_slow_hash_lane_round(&lanes[0], variant, 0);
+                    cn_slow_hash_lane_round(&lanes[1], variant, 0);
+                }
+            }
+            else if(lanes_used == 4)
+            {
+                for(i = 0; i < iters; i++)
+                {
+                    cn_slow_hash_lane_round(&lanes[0], variant, 0);
+                    cn_slow_hash_lane_round(&lanes[1], variant, 0);
+                    cn_slow_hash_lane_round(&lanes[2], variant, 0);
+                    cn_slow_hash_lane_round(&lanes[3], variant, 0);
+                }
+            }
+            else
+            {
+                for(i = 0; i < iters; i++)
+                    for(k = 0; k < lanes_used; k++)
+                        cn_slow_hash_lane_round(&lanes[k], variant, 0);
+            }
+        }
+
+        for(k = 0; k < lanes_used; k++)
+            cn_slow_hash_lane_final(&lanes[k], hashes[n + k]);
+    }
+}
+
 #elif !defined NO_AES && (defined(__arm__) || defined(__aarch64__))
 void cn_slow_hash_allocate_state(void)
 {
@@ -1624,6 +1900,18 @@ void cn_slow_hash(const void *data, size_t length, char *hash, int variant, int
 
 #endif
 
+#if !(!defined NO_AES && (defined(__x86_64__) || (defined(_MSC_VER) && defined(_WIN64))))
+// Only the x86 AES-NI code above has an interleaved kernel; elsewhere the
+// inputs are simply hashed one after the other.
+void cn_slow_hash_multi(const void *const *data, const size_t *length, char (*hashes)[HASH_SIZE], size_t count, size_t ways, int variant, int modifier)
+{
+  size_t n;
+  (void)ways;
+  for (n = 0; n < count; n++)
+    cn_slow_hash(data[n], length[n], hashes[n], variant, 0, modifier);
+}
+#endif
+
 void slow_hash_allocate_state(void)
 {
   cn_slow_hash_allocate_state();
@@ -1078,6 +1078,18 @@ namespace cryptonote
     return parse_and_validate_block_from_blob(b_blob, b, NULL);
   }
   //---------------------------------------------------------------
+  bool parse_block_header_from_hashing_blob(const blobdata& hashing_blob, block_header& h)
+  {
+    // the hashing blob is the serialized header, followed by the tx tree root and tx count
+    std::stringstream ss;
+    ss << hashing_blob;
+    binary_archive<false> ba(ss);
+    bool r = ::do_serialize(ba, h) && ss.good();
+    CHECK_AND_ASSERT_MES(r, false, "Failed to parse block header from hashing blob");
+    CHECK_AND_ASSERT_MES(hashing_blob.size() >= (size_t)ss.tellg() + sizeof(crypto::hash) + 1, false, "Block hashing blob is too short");
+    return true;
+  }
+  //---------------------------------------------------------------
   bool parse_and_validate_block_from_blob(const blobdata& b_blob, block& b, crypto::hash &block_hash)
   {
     return parse_and_validate_block_from_blob(b_blob, b, &block_hash);
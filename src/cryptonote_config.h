@@ -100,12 +100,18 @@
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT_PRE_V4       100    //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              20     //by default, blocks count in blocks downloading
 #define BLOCKS_SYNCHRONIZING_MAX_COUNT                  2048   //must be a power of 2, greater than 128, equal to SEEDHASH_EPOCH_BLOCKS
+#define BLOCKS_SYNCHRONIZING_SPAN_SECONDS               5      //spans are sized to take about this long at the peer's measured rate
+#define BLOCKS_SYNCHRONIZING_MAX_SPAN_SIZE              (16*1024*1024) //bytes
+#define BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT           2048   //headers checked ahead of the block bodies per request
+#define BLOCK_HEADERS_PREVALIDATED_MAX_COUNT            (4*BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT) //headers kept while waiting for their bodies
+#define BLOCK_LONGHASH_INTERLEAVE_WAYS                  2      //CryptoNight hashes computed side by side per thread when checking synced blocks
 
 #define CRYPTONOTE_MEMPOOL_TX_LIVETIME                    (86400*3) //seconds, three days
 #define CRYPTONOTE_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     604800 //seconds, one week
 
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
+#define COMMAND_RPC_GET_BLOCKS_SCAN_DATA_MAX_COUNT      1000
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -127,7 +133,30 @@
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
 
 #define P2P_SUPPORT_FLAG_FLUFFY_BLOCKS                  0x01
-#define P2P_SUPPORT_FLAGS                               P2P_SUPPORT_FLAG_FLUFFY_BLOCKS
+#define P2P_SUPPORT_FLAG_TX_ANNOUNCE                    0x02
+#define P2P_SUPPORT_FLAG_COMPACT_BLOCKS                 0x04
+#define P2P_SUPPORT_FLAG_COMPRESSION                    0x08
+#define P2P_SUPPORT_FLAG_BLOCK_HEADERS                  0x10
+#ifdef HAVE_ZLIB
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_TX_ANNOUNCE | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_COMPRESSION | P2P_SUPPORT_FLAG_BLOCK_HEADERS)
+#else
+#define P2P_SUPPORT_FLAGS                               (P2P_SUPPORT_FLAG_FLUFFY_BLOCKS | P2P_SUPPORT_FLAG_TX_ANNOUNCE | P2P_SUPPORT_FLAG_COMPACT_BLOCKS | P2P_SUPPORT_FLAG_BLOCK_HEADERS)
+#endif
+
+#define P2P_TX_RELAY_FLUSH_INTERVAL_MS                  500     // average, jittered by +/- 50%
+#define P2P_TX_RELAY_MAX_HASHES                         1000    // per NOTIFY_NEW_TRANSACTION_HASHES/NOTIFY_REQUEST_TRANSACTIONS
+#define P2P_TX_RELAY_KNOWN_TXS                          16384   // per connection
+#define P2P_TX_RELAY_REQUEST_TIMEOUT                    30      // seconds before asking another peer for an announced tx
+#define P2P_TX_RELAY_MAX_REQUESTED                      5000    // per connection, txes asked for and not received yet
+#define P2P_TX_RELAY_MAX_UNDELIVERED                    100     // per connection, announced txes not sent when asked before it is dropped
+#define P2P_COMPACT_BLOCK_MAX_TXS                       65536
+#define P2P_COMPRESSION_MIN_THRESHOLD                   1024            // bytes, smaller payloads are never compressed
+#define P2P_COMPRESSION_DEFAULT_THRESHOLD               (16*1024)
+#define P2P_COMPRESSION_MAX_THRESHOLD                   (1024*1024)
+#define P2P_COMPRESSION_DEFAULT_LEVEL                   3
+#define P2P_COMPRESSION_MAX_RATIO                       64              // decompressed/compressed, anything higher is refused
+#define P2P_COMPRESSION_MAX_REQUEST_SIZE                (1024*1024)     // decompressed, requests and tx hash announcements
+#define P2P_COMPRESSION_MAX_NOTIFY_SIZE                 (16*1024*1024)  // decompressed, relayed blocks and transactions
 
 #define ALLOW_DEBUG_COMMANDS
 
@@ -155,6 +184,8 @@
 
 #define BULLETPROOF_MAX_OUTPUTS                 16
 
+#define OUTPUT_KEY_CACHE_SIZE                   (1 << 17) // ring member keys kept in memory, about 100 bytes each
+
 // New constants are intended to go here
 namespace config
 {
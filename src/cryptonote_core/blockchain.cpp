@@ -202,7 +202,10 @@ Blockchain::Blockchain(tx_memory_pool& tx_pool)
   m_difficulty_for_next_block_top_hash(crypto::null_hash),
   m_difficulty_for_next_block(1),
   m_btc_valid(false),
-  m_prepare_height(0)
+  m_prepare_height(0),
+  m_output_key_cache(OUTPUT_KEY_CACHE_SIZE),
+  m_weights_window(CRYPTONOTE_REWARD_BLOCKS_WINDOW),
+  m_weights_window_height(0)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
 }
@@ -265,7 +268,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   {
     try
     {
-      m_db->get_output_key(tx_in_to_key.amount, absolute_offsets, outputs, true);
+      get_output_keys_cached(tx_in_to_key.amount, absolute_offsets, outputs);
       if (absolute_offsets.size() != outputs.size())
       {
         MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
@@ -291,7 +294,7 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
         add_offsets.push_back(absolute_offsets[i]);
       try
       {
-        m_db->get_output_key(tx_in_to_key.amount, add_offsets, add_outputs, true);
+        get_output_keys_cached(tx_in_to_key.amount, add_offsets, add_outputs);
         if (add_offsets.size() != add_outputs.size())
         {
           MERROR_VER("Output does not exist! amount = " << tx_in_to_key.amount);
@@ -362,6 +365,46 @@ bool Blockchain::scan_outputkeys_for_indexes(size_t tx_version, const txin_to_ke
   return true;
 }
 //------------------------------------------------------------------
+void Blockchain::get_output_keys_cached(const uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs) const
+{
+  outputs.resize(offsets.size());
+  std::vector<uint64_t> missed_offsets;
+  std::vector<size_t> missed_positions;
+  for (size_t i = 0; i < offsets.size(); ++i)
+  {
+    if (!m_output_key_cache.get(amount, offsets[i], outputs[i]))
+    {
+      missed_offsets.push_back(offsets[i]);
+      missed_positions.push_back(i);
+    }
+  }
+  if (missed_offsets.empty())
+    return;
+
+  std::vector<output_data_t> missed_outputs;
+  try
+  {
+    m_db->get_output_key(amount, missed_offsets, missed_outputs, true);
+  }
+  catch (...)
+  {
+    outputs.clear();
+    throw;
+  }
+  for (size_t i = 0; i < missed_outputs.size(); ++i)
+  {
+    outputs[missed_positions[i]] = missed_outputs[i];
+    m_output_key_cache.put(amount, missed_offsets[i], missed_outputs[i]);
+  }
+  if (missed_outputs.size() < missed_offsets.size())
+    outputs.resize(missed_positions[missed_outputs.size()]);
+}
+//------------------------------------------------------------------
+output_key_cache_stats Blockchain::get_output_key_cache_stats() const
+{
+  return m_output_key_cache.get_stats();
+}
+//------------------------------------------------------------------
 uint64_t Blockchain::get_current_blockchain_height() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -522,6 +565,8 @@ bool Blockchain::init(BlockchainDB* db, const network_type nettype, bool offline
   if (num_popped_blocks > 0)
   {
     m_timestamps_and_difficulties_height = 0;
+    m_weights_window.clear();
+    m_weights_window_height = 0;
     m_hardfork->reorganize_from_chain_height(get_current_blockchain_height());
     m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
   }
@@ -581,6 +626,9 @@ bool Blockchain::deinit()
   m_async_pool.join_all();
   m_async_service.stop();
 
+  // wait for any RandomX cache being warmed for the next seed
+  get_block_longhash_stop_next_seed();
+
   // as this should be called if handling a SIGSEGV, need to check
   // if m_db is a NULL pointer (and thus may have caused the illegal
   // memory operation), otherwise we may cause a loop.
@@ -618,7 +666,7 @@ block Blockchain::pop_block_from_blockchain()
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
+  const uint64_t height = m_db->height();
 
   block popped_block;
   std::vector<transaction> popped_txs;
@@ -674,6 +722,52 @@ block Blockchain::pop_block_from_blockchain()
   m_scan_table.clear();
   m_blocks_txs_check.clear();
   m_check_txin_table.clear();
+  m_output_key_cache.clear();
+
+  // headers prevalidated on top of the popped block were checked against
+  // a chain we may now leave, drop them and let them be checked again
+  {
+    CRITICAL_REGION_LOCAL(m_prevalidated_headers_lock);
+    for (auto i = m_prevalidated_headers.begin(); i != m_prevalidated_headers.end(); )
+    {
+      if (i->second.height + 1 >= height)
+        i = m_prevalidated_headers.erase(i);
+      else
+        ++i;
+    }
+  }
+
+  // roll the difficulty and weight windows back by one block, rather than
+  // having them reloaded in full: drop the popped block, and bring back the
+  // block which had slid out of the window when it was added
+  if (m_timestamps_and_difficulties_height == height && !m_timestamps.empty())
+  {
+    const uint64_t window_start = height - m_timestamps.size();
+    m_timestamps.pop_back();
+    m_difficulties.pop_back();
+    if (window_start > 1)
+    {
+      m_timestamps.push_front(m_db->get_block_timestamp(window_start - 1));
+      m_difficulties.push_front(m_db->get_block_cumulative_difficulty(window_start - 1));
+    }
+    m_timestamps_and_difficulties_height = height - 1;
+  }
+  else
+  {
+    m_timestamps_and_difficulties_height = 0;
+  }
+  if (m_weights_window_height == height && !m_weights_window.empty())
+  {
+    m_weights_window.pop_back();
+    if (height - 1 >= m_weights_window.window())
+      m_weights_window.push_front(m_db->get_block_weight(height - 1 - m_weights_window.window()));
+    m_weights_window_height = height - 1;
+  }
+  else
+  {
+    m_weights_window.clear();
+    m_weights_window_height = 0;
+  }
 
   update_next_cumulative_weight_limit();
   m_tx_pool.on_blockchain_dec(m_db->height()-1, get_tail_id());
@@ -682,13 +776,29 @@ block Blockchain::pop_block_from_blockchain()
   return popped_block;
 }
 //------------------------------------------------------------------
+void Blockchain::pop_blocks(uint64_t nblocks)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_tx_pool);
+  CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+
+  const uint64_t height = m_db->height();
+  if (height > 0)
+    nblocks = std::min(nblocks, height - 1);
+  for (uint64_t i = 0; i < nblocks; ++i)
+    pop_block_from_blockchain();
+}
+//------------------------------------------------------------------
 bool Blockchain::reset_and_set_genesis_block(const block& b)
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_timestamps_and_difficulties_height = 0;
+  m_weights_window.clear();
+  m_weights_window_height = 0;
   m_alternative_chains.clear();
   invalidate_block_template_cache();
+  m_output_key_cache.clear();
   m_db->reset();
   m_hardfork->init();
 
@@ -869,8 +979,6 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   }
 
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  std::vector<uint64_t> timestamps;
-  std::vector<difficulty_type> difficulties;
   auto height = m_db->height();
 
   uint8_t version = get_current_hard_fork_version();
@@ -881,45 +989,42 @@ difficulty_type Blockchain::get_difficulty_for_next_block()
   //    then when the next block difficulty is queried, push the latest height data and
   //    pop the oldest one from the list. This only requires 1x read per height instead
   //    of doing 735 (DIFFICULTY_BLOCKS_COUNT).
-  if (m_timestamps_and_difficulties_height != 0 && ((height - m_timestamps_and_difficulties_height) == 1) && m_timestamps.size() >= DIFFICULTY_BLOCKS_COUNT)
+  // 2. pop_block_from_blockchain rolls the list back the same way, so the list
+  //    survives reorgs too. It is only reloaded when it does not cover the window
+  //    needed, eg, when the window size changes at a fork.
+  uint64_t window_start = height - std::min<uint64_t>(height, difficulty_blocks_count);
+  if (window_start == 0)
+    ++window_start;
+
+  if (m_timestamps_and_difficulties_height != 0 && height == m_timestamps_and_difficulties_height + 1)
   {
     uint64_t index = height - 1;
     m_timestamps.push_back(m_db->get_block_timestamp(index));
     m_difficulties.push_back(m_db->get_block_cumulative_difficulty(index));
-
+    m_timestamps_and_difficulties_height = height;
+  }
+  if (m_timestamps_and_difficulties_height == height)
+  {
     while (m_timestamps.size() > difficulty_blocks_count)
-      m_timestamps.erase(m_timestamps.begin());
+      m_timestamps.pop_front();
     while (m_difficulties.size() > difficulty_blocks_count)
-      m_difficulties.erase(m_difficulties.begin());
-
-    m_timestamps_and_difficulties_height = height;
-    timestamps = m_timestamps;
-    difficulties = m_difficulties;
+      m_difficulties.pop_front();
   }
-  else
+  if (m_timestamps_and_difficulties_height != height || height - m_timestamps.size() != window_start)
   {
-    size_t offset = height - std::min < size_t > (height, static_cast<size_t>(difficulty_blocks_count));
-    if (offset == 0)
-      ++offset;
-
-    timestamps.clear();
-    difficulties.clear();
-    if (height > offset)
+    m_timestamps.clear();
+    m_difficulties.clear();
+    for (uint64_t offset = window_start; offset < height; offset++)
     {
-      timestamps.reserve(height - offset);
-      difficulties.reserve(height - offset);
+      m_timestamps.push_back(m_db->get_block_timestamp(offset));
+      m_difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
     }
-    for (; offset < height; offset++)
-    {
-      timestamps.push_back(m_db->get_block_timestamp(offset));
-      difficulties.push_back(m_db->get_block_cumulative_difficulty(offset));
-    }
-
     m_timestamps_and_difficulties_height = height;
-    m_timestamps = timestamps;
-    m_difficulties = difficulties;
   }
 
+  std::vector<uint64_t> timestamps(m_timestamps.begin(), m_timestamps.end());
+  std::vector<difficulty_type> difficulties(m_difficulties.begin(), m_difficulties.end());
+
   const size_t target = get_difficulty_target();
   if (version < 8)
   {
@@ -949,8 +1054,6 @@ bool Blockchain::rollback_blockchain_switching(std::list<block>& original_chain,
     return true;
   }
 
-  m_timestamps_and_difficulties_height = 0;
-
   // remove blocks from blockchain until we get back to where we should be.
   while (m_db->height() != rollback_height)
   {
@@ -985,8 +1088,6 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
 
-  m_timestamps_and_difficulties_height = 0;
-
   // if empty alt chain passed (not sure how that could happen), return false
   CHECK_AND_ASSERT_MES(alt_chain.size(), false, "switch_to_alternative_blockchain: empty chain passed");
 
@@ -1113,11 +1214,24 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     if(!main_chain_start_offset)
       ++main_chain_start_offset; //skip genesis block
 
-    // get difficulties and timestamps from relevant main chain blocks
-    for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+    // alt chains usually fork off near the top, so the main chain blocks
+    // needed are often all in the main chain difficulty window already
+    const uint64_t cached_height = m_timestamps_and_difficulties_height;
+    const uint64_t cached_start = cached_height - m_timestamps.size();
+    if (cached_height != 0 && cached_height <= m_db->height() && main_chain_start_offset < main_chain_stop_offset
+        && main_chain_start_offset >= cached_start && main_chain_stop_offset <= cached_height)
+    {
+      timestamps.assign(m_timestamps.begin() + (main_chain_start_offset - cached_start), m_timestamps.begin() + (main_chain_stop_offset - cached_start));
+      cumulative_difficulties.assign(m_difficulties.begin() + (main_chain_start_offset - cached_start), m_difficulties.begin() + (main_chain_stop_offset - cached_start));
+    }
+    else
     {
-      timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
-      cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      // get difficulties and timestamps from relevant main chain blocks
+      for(; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset)
+      {
+        timestamps.push_back(m_db->get_block_timestamp(main_chain_start_offset));
+        cumulative_difficulties.push_back(m_db->get_block_cumulative_difficulty(main_chain_start_offset));
+      }
     }
 
     // make sure we haven't accidentally grabbed too many blocks...maybe don't need this check?
@@ -1215,9 +1329,7 @@ bool Blockchain::validate_miner_transaction(const block& b, size_t cumulative_bl
     }
   }
 
-  std::vector<size_t> last_blocks_weights;
-  get_last_n_blocks_weights(last_blocks_weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-  if (!get_block_reward(epee::misc_utils::median(last_blocks_weights), cumulative_block_weight, already_generated_coins, base_reward, version))
+  if (!get_block_reward(get_block_weights_median(), cumulative_block_weight, already_generated_coins, base_reward, version))
   {
     MERROR_VER("block weight " << cumulative_block_weight << " is bigger than allowed for this blockchain");
     return false;
@@ -1271,6 +1383,33 @@ void Blockchain::get_last_n_blocks_weights(std::vector<size_t>& weights, size_t
   m_db->block_txn_stop();
 }
 //------------------------------------------------------------------
+size_t Blockchain::get_block_weights_median() const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  const uint64_t height = m_db->height();
+
+  // the window covers the blocks below m_weights_window_height, it follows
+  // new blocks one at a time, and pop_block_from_blockchain rolls it back
+  if (height != m_weights_window_height)
+  {
+    if (height == m_weights_window_height + 1)
+    {
+      m_weights_window.push_back(m_db->get_block_weight(height - 1));
+    }
+    else
+    {
+      m_weights_window.clear();
+      m_db->block_txn_start(true);
+      for (uint64_t i = height - std::min<uint64_t>(height, m_weights_window.window()); i < height; ++i)
+        m_weights_window.push_back(m_db->get_block_weight(i));
+      m_db->block_txn_stop();
+    }
+    m_weights_window_height = height;
+  }
+  return m_weights_window.median();
+}
+//------------------------------------------------------------------
 uint64_t Blockchain::get_current_cumulative_block_weight_limit() const
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
@@ -1515,7 +1654,6 @@ bool Blockchain::handle_alternative_block(const block& b, const crypto::hash& id
 {
   LOG_PRINT_L3("Blockchain::" << __func__);
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
-  m_timestamps_and_difficulties_height = 0;
   uint64_t block_height = get_block_height(b);
   if(0 == block_height)
   {
@@ -1749,17 +1887,19 @@ bool Blockchain::get_blocks(uint64_t start_offset, size_t count, std::vector<std
   if(start_offset >= height)
     return false;
 
-  blocks.reserve(blocks.size() + height - start_offset);
-  for(size_t i = start_offset; i < start_offset + count && i < height;i++)
-  {
-    blocks.push_back(std::make_pair(m_db->get_block_blob_from_height(i), block()));
+  if (count == 0)
+    return true;
+  const uint64_t end = std::min<uint64_t>(start_offset + count, height);
+  blocks.reserve(blocks.size() + end - start_offset);
+  return m_db->for_block_blobs_range(start_offset, end - 1, [&blocks](uint64_t, const epee::span<const uint8_t> &blob) {
+    blocks.push_back(std::make_pair(cryptonote::blobdata(reinterpret_cast<const char*>(blob.data()), blob.size()), block()));
     if (!parse_and_validate_block_from_blob(blocks.back().first, blocks.back().second))
     {
       LOG_ERROR("Invalid block");
       return false;
     }
-  }
-  return true;
+    return true;
+  });
 }
 //------------------------------------------------------------------
 //TODO: This function *looks* like it won't need to be rewritten
@@ -2191,31 +2331,43 @@ bool Blockchain::find_blockchain_supplement(const uint64_t req_start_block, cons
   m_db->block_txn_start(true);
   total_height = get_current_blockchain_height();
   size_t count = 0, size = 0;
+  bool ok = true;
   blocks.reserve(std::min(std::min(max_count, (size_t)10000), (size_t)(total_height - start_height)));
-  for(uint64_t i = start_height; i < total_height && count < max_count && (size < FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE || count < 3); i++, count++)
-  {
+  // blobs are copied once, straight from the db into the returned containers
+  m_db->for_block_blobs_range(start_height, total_height - 1, [&](uint64_t height, const epee::span<const uint8_t> &blob) {
+    if (count >= max_count || (size >= FIND_BLOCKCHAIN_SUPPLEMENT_MAX_SIZE && count >= 3))
+      return false;
+    ++count;
     blocks.resize(blocks.size()+1);
-    blocks.back().first.first = m_db->get_block_blob_from_height(i);
+    blocks.back().first.first.assign(reinterpret_cast<const char*>(blob.data()), blob.size());
     block b;
-    CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(blocks.back().first.first, b), false, "internal error, invalid block");
+    if (!parse_and_validate_block_from_blob(blocks.back().first.first, b))
+    {
+      MERROR("internal error, invalid block at height " << height);
+      ok = false;
+      return false;
+    }
     blocks.back().first.second = get_miner_tx_hash ? cryptonote::get_transaction_hash(b.miner_tx) : crypto::null_hash;
-    std::vector<crypto::hash> mis;
-    std::vector<cryptonote::blobdata> txs;
-    get_transactions_blobs(b.tx_hashes, txs, mis, pruned);
-    CHECK_AND_ASSERT_MES(!mis.size(), false, "internal error, transaction from block not found");
-    size += blocks.back().first.first.size();
-    for (const auto &t: txs)
-      size += t.size();
+    size += blob.size();
 
-    CHECK_AND_ASSERT_MES(txs.size() == b.tx_hashes.size(), false, "mismatched sizes of b.tx_hashes and txs");
-    blocks.back().second.reserve(txs.size());
-    for (size_t i = 0; i < txs.size(); ++i)
+    auto &txs = blocks.back().second;
+    txs.reserve(b.tx_hashes.size());
+    for (const crypto::hash &tx_hash: b.tx_hashes)
     {
-      blocks.back().second.push_back(std::make_pair(b.tx_hashes[i], std::move(txs[i])));
+      txs.push_back(std::make_pair(tx_hash, cryptonote::blobdata()));
+      const bool found = pruned ? m_db->get_pruned_tx_blob(tx_hash, txs.back().second) : m_db->get_tx_blob(tx_hash, txs.back().second);
+      if (!found)
+      {
+        MERROR("internal error, transaction " << tx_hash << " from block " << height << " not found");
+        ok = false;
+        return false;
+      }
+      size += txs.back().second.size();
     }
-  }
+    return true;
+  });
   m_db->block_txn_stop();
-  return true;
+  return ok;
 }
 //------------------------------------------------------------------
 bool Blockchain::add_block_as_invalid(const block& bl, const crypto::hash& h)
@@ -3443,6 +3595,8 @@ leave:
       precomputed = true;
       proof_of_work = it->second;
     }
+    else if (get_prevalidated_pow(id, proof_of_work))
+      precomputed = true;
     else
       proof_of_work = get_block_longhash(this, bl, m_db->height(), 0);
 
@@ -3642,6 +3796,7 @@ leave:
     {
       LOG_ERROR("Error adding block with hash: " << id << " to blockchain, what = " << e.what());
       bvc.m_verifivation_failed = true;
+      m_output_key_cache.clear();
       return_tx_to_pool(txs);
       return false;
     }
@@ -3650,6 +3805,7 @@ leave:
       //TODO: figure out the best way to deal with this failure
       LOG_ERROR("Error adding block with hash: " << id << " to blockchain, what = " << e.what());
       bvc.m_verifivation_failed = true;
+      m_output_key_cache.clear();
       return_tx_to_pool(txs);
       return false;
     }
@@ -3677,11 +3833,25 @@ leave:
   bvc.m_added_to_main_chain = true;
   ++m_sync_counter;
 
+  {
+    CRITICAL_REGION_LOCAL(m_prevalidated_headers_lock);
+    m_prevalidated_headers.erase(id);
+  }
+
   // appears to be a NOP *and* is called elsewhere.  wat?
   m_tx_pool.on_blockchain_inc(new_height, id);
   get_difficulty_for_next_block(); // just to cache it
   invalidate_block_template_cache();
 
+  // once the next RandomX seed block is known, get its cache ready before it is used
+  if (bl.major_version >= RX_BLOCK_VERSION)
+  {
+    uint64_t seed_height, next_seed_height;
+    rx_seedheights(new_height, &seed_height, &next_seed_height);
+    if (next_seed_height != seed_height)
+      get_block_longhash_next_seed(next_seed_height, m_db->get_block_hash_from_height(next_seed_height));
+  }
+
   std::shared_ptr<tools::Notify> block_notify = m_block_notify;
   if (block_notify)
     block_notify->notify(epee::string_tools::pod_to_hex(id).c_str());
@@ -3694,10 +3864,7 @@ bool Blockchain::update_next_cumulative_weight_limit()
   uint64_t full_reward_zone = get_min_block_weight(get_current_hard_fork_version());
 
   LOG_PRINT_L3("Blockchain::" << __func__);
-  std::vector<size_t> weights;
-  get_last_n_blocks_weights(weights, CRYPTONOTE_REWARD_BLOCKS_WINDOW);
-
-  uint64_t median = epee::misc_utils::median(weights);
+  uint64_t median = get_block_weights_median();
   m_current_block_cumul_weight_median = median;
   if(median <= full_reward_zone)
     median = full_reward_zone;
@@ -3825,18 +3992,83 @@ void Blockchain::block_longhash_worker(uint64_t height, const std::vector<block>
   TIME_MEASURE_START(t);
   slow_hash_allocate_state();
 
-  for (const auto & block : blocks)
+  // blocks still needing their PoW are gathered a few at a time so that
+  // several can be hashed at once, while still checking for cancellation
+  std::vector<crypto::hash> ids;
+  std::vector<blobdata> blobs;
+  std::vector<uint8_t> versions;
+  std::vector<uint64_t> heights;
+  std::vector<crypto::hash> pows;
+  for (size_t i = 0; i < blocks.size(); )
   {
     if (m_cancel)
        break;
-    crypto::hash id = get_block_hash(block);
-    crypto::hash pow = get_block_longhash(this, block, height++, 0);
-    map.emplace(id, pow);
+    ids.clear();
+    blobs.clear();
+    versions.clear();
+    heights.clear();
+    for (; i < blocks.size() && blobs.size() < BLOCK_LONGHASH_INTERLEAVE_WAYS; ++i, ++height)
+    {
+      const block &b = blocks[i];
+      crypto::hash id = get_block_hash(b);
+      crypto::hash pow;
+      if (get_prevalidated_pow(id, pow))
+      {
+        map.emplace(id, pow);
+        continue;
+      }
+      ids.push_back(id);
+      blobs.push_back(get_block_hashing_blob(b));
+      versions.push_back(b.major_version);
+      heights.push_back(height);
+    }
+    get_block_longhashes(this, blobs, versions, heights, pows, 0);
+    for (size_t n = 0; n < ids.size(); ++n)
+      map.emplace(ids[n], pows[n]);
   }
 
   slow_hash_free_state();
   TIME_MEASURE_FINISH(t);
 }
+//------------------------------------------------------------------
+void Blockchain::header_longhash_worker(uint64_t height, const std::vector<blobdata> &blobs, const std::vector<uint8_t> &versions, std::vector<crypto::hash> &pows) const
+{
+  TIME_MEASURE_START(t);
+  slow_hash_allocate_state();
+
+  pows.resize(blobs.size(), crypto::null_hash);
+  std::vector<blobdata> batch_blobs;
+  std::vector<uint8_t> batch_versions;
+  std::vector<uint64_t> batch_heights;
+  std::vector<crypto::hash> batch_pows;
+  for (size_t i = 0; i < blobs.size(); )
+  {
+    if (m_cancel)
+       break;
+    const size_t count = std::min<size_t>(blobs.size() - i, BLOCK_LONGHASH_INTERLEAVE_WAYS);
+    batch_blobs.assign(blobs.begin() + i, blobs.begin() + i + count);
+    batch_versions.assign(versions.begin() + i, versions.begin() + i + count);
+    batch_heights.clear();
+    for (size_t n = 0; n < count; ++n)
+      batch_heights.push_back(height + i + n);
+    get_block_longhashes(this, batch_blobs, batch_versions, batch_heights, batch_pows, 0);
+    std::copy(batch_pows.begin(), batch_pows.end(), pows.begin() + i);
+    i += count;
+  }
+
+  slow_hash_free_state();
+  TIME_MEASURE_FINISH(t);
+}
+//------------------------------------------------------------------
+bool Blockchain::get_prevalidated_pow(const crypto::hash &id, crypto::hash &pow) const
+{
+  CRITICAL_REGION_LOCAL(m_prevalidated_headers_lock);
+  auto it = m_prevalidated_headers.find(id);
+  if (it == m_prevalidated_headers.end() || it->second.pow == crypto::null_hash)
+    return false;
+  pow = it->second.pow;
+  return true;
+}
 
 //------------------------------------------------------------------
 bool Blockchain::cleanup_handle_incoming_blocks(bool force_sync)
@@ -3911,7 +4143,7 @@ void Blockchain::output_scan_worker(const uint64_t amount, const std::vector<uin
 {
   try
   {
-    m_db->get_output_key(amount, offsets, outputs, true);
+    get_output_keys_cached(amount, offsets, outputs);
   }
   catch (const std::exception& e)
   {
@@ -4018,6 +4250,252 @@ uint64_t Blockchain::prevalidate_block_hashes(uint64_t height, const std::vector
   CHECK_AND_ASSERT_MES(usable < std::numeric_limits<uint64_t>::max() / 2, 0, "usable is negative");
   return usable;
 }
+//------------------------------------------------------------------
+bool Blockchain::get_block_hashing_blobs(const std::vector<crypto::hash> &ids, std::vector<blobdata> &blobs) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+
+  blobs.clear();
+  blobs.reserve(ids.size());
+  m_db->block_txn_start(true);
+  for (const auto &id: ids)
+  {
+    block b;
+    try
+    {
+      if (!parse_and_validate_block_from_blob(m_db->get_block_blob(id), b))
+        break;
+    }
+    catch (const BLOCK_DNE &)
+    {
+      break;
+    }
+    blobs.push_back(get_block_hashing_blob(b));
+  }
+  m_db->block_txn_stop();
+  return blobs.size() == ids.size();
+}
+//------------------------------------------------------------------
+uint64_t Blockchain::get_known_block_headers_count(const std::vector<crypto::hash> &ids) const
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  CRITICAL_REGION_LOCAL1(m_prevalidated_headers_lock);
+
+  uint64_t n = 0;
+  for (const auto &id: ids)
+  {
+    if (m_prevalidated_headers.find(id) == m_prevalidated_headers.end() && !m_db->block_exists(id))
+      break;
+    ++n;
+  }
+  return n;
+}
+//------------------------------------------------------------------
+// Checks headers received ahead of their blocks: linkage, difficulty
+// continuity and proof of work. The difficulty window comes from the
+// main chain and from the headers already prevalidated, so headers can
+// be checked many spans ahead of the block bodies. The full block
+// validation is unchanged, this only lets us reject bad peers early and
+// keep the proof of work so it is not computed again.
+bool Blockchain::prevalidate_block_headers(const std::vector<crypto::hash> &ids, const std::vector<blobdata> &blobs, uint64_t &nvalid)
+{
+  LOG_PRINT_L3("Blockchain::" << __func__);
+  nvalid = 0;
+  if (ids.size() != blobs.size())
+  {
+    MERROR("Got " << blobs.size() << " block headers for " << ids.size() << " blocks");
+    return false;
+  }
+  if (ids.empty())
+    return true;
+
+  // the blobs must hash to the ids, and link to each other
+  std::vector<block_header> headers(ids.size());
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    crypto::hash id;
+    if (!parse_block_header_from_hashing_blob(blobs[i], headers[i]) || !get_object_hash(blobs[i], id) || id != ids[i])
+    {
+      MERROR("Block header " << ids[i] << " does not match its hashing blob");
+      return false;
+    }
+    if (i > 0 && headers[i].prev_id != ids[i - 1])
+    {
+      MERROR("Block header " << ids[i] << " does not link to " << ids[i - 1]);
+      return false;
+    }
+  }
+
+  const size_t window = std::max<size_t>(DIFFICULTY_BLOCKS_COUNT, DIFFICULTY_BLOCKS_COUNT_V8);
+  std::vector<difficulty_type> difficulties(ids.size(), 0);
+  std::vector<difficulty_type> cumulative_difficulties(ids.size(), 0);
+  size_t first = 0, bad_hash = ids.size();
+  uint64_t base_height, hash_check_height;
+  {
+    CRITICAL_REGION_LOCAL(m_blockchain_lock);
+    CRITICAL_REGION_LOCAL1(m_prevalidated_headers_lock);
+
+    while (first < ids.size() && (m_prevalidated_headers.find(ids[first]) != m_prevalidated_headers.end() || m_db->block_exists(ids[first])))
+      ++first;
+    nvalid = first;
+    if (first == ids.size())
+      return true;
+
+    // find where these headers attach, and gather the difficulty window below them
+    std::deque<uint64_t> timestamps;
+    std::deque<difficulty_type> cumulative;
+    crypto::hash parent = headers[first].prev_id;
+    uint64_t parent_height = 0;
+    auto it = m_prevalidated_headers.find(parent);
+    if (it != m_prevalidated_headers.end())
+      parent_height = it->second.height;
+    while (it != m_prevalidated_headers.end() && timestamps.size() < window)
+    {
+      timestamps.push_front(it->second.timestamp);
+      cumulative.push_front(it->second.cumulative_difficulty);
+      parent = it->second.prev_id;
+      it = m_prevalidated_headers.find(parent);
+    }
+    if (timestamps.size() < window)
+    {
+      uint64_t db_height;
+      if (!m_db->block_exists(parent, &db_height))
+      {
+        MDEBUG("Block headers from " << ids[first] << " do not attach to a known block, not checking them");
+        return true;
+      }
+      if (timestamps.empty())
+        parent_height = db_height;
+      for (uint64_t h = db_height; h > 0 && timestamps.size() < window; --h)
+      {
+        timestamps.push_front(m_db->get_block_timestamp(h));
+        cumulative.push_front(m_db->get_block_cumulative_difficulty(h));
+      }
+    }
+    base_height = parent_height + 1;
+    hash_check_height = m_blocks_hash_check.size();
+
+    for (size_t i = first; i < ids.size(); ++i)
+    {
+      const uint64_t height = base_height + i - first;
+      if (height < hash_check_height && m_blocks_hash_check[height] != crypto::null_hash && m_blocks_hash_check[height] != ids[i])
+      {
+        bad_hash = i;
+        break;
+      }
+      const uint8_t version = get_ideal_hard_fork_version(height);
+      const size_t count = std::min<size_t>(version < 8 ? DIFFICULTY_BLOCKS_COUNT : DIFFICULTY_BLOCKS_COUNT_V8, timestamps.size());
+      std::vector<uint64_t> window_timestamps(timestamps.end() - count, timestamps.end());
+      std::vector<difficulty_type> window_cumulative(cumulative.end() - count, cumulative.end());
+      const size_t target = version < 2 ? DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V2;
+      difficulty_type difficulty;
+      if (m_fixed_difficulty)
+        difficulty = m_fixed_difficulty;
+      else if (version < 8)
+        difficulty = next_difficulty(window_timestamps, window_cumulative, target);
+      else if (version == 8 || version >= 10)
+        difficulty = next_difficulty_v8(window_timestamps, window_cumulative, target);
+      else
+        difficulty = next_difficulty_v9(window_timestamps, window_cumulative, target);
+      if (difficulty == 0)
+      {
+        MERROR("Failed to compute difficulty for block header " << ids[i]);
+        return false;
+      }
+      difficulties[i] = difficulty;
+      cumulative_difficulties[i] = (cumulative.empty() ? 0 : cumulative.back()) + difficulty;
+      timestamps.push_back(headers[i].timestamp);
+      cumulative.push_back(cumulative_difficulties[i]);
+      if (timestamps.size() > window)
+      {
+        timestamps.pop_front();
+        cumulative.pop_front();
+      }
+    }
+  }
+
+  // blocks in the fast sync area were checked against the compiled hashes
+  // above, and RandomX needs seed blocks we may not have yet, so skip those
+  size_t hash_begin = first;
+  while (hash_begin < bad_hash && base_height + hash_begin - first < hash_check_height)
+    ++hash_begin;
+  size_t hash_end = hash_begin;
+  while (hash_end < bad_hash && headers[hash_end].major_version < RX_BLOCK_VERSION)
+    ++hash_end;
+
+  std::vector<crypto::hash> pows(ids.size(), crypto::null_hash);
+  if (hash_begin < hash_end)
+  {
+    tools::threadpool& tpool = tools::threadpool::getInstance();
+    const size_t threads = std::max<size_t>(1, std::min<size_t>(tpool.get_max_concurrency(), m_max_prepare_blocks_threads));
+    const size_t total = hash_end - hash_begin;
+    const size_t batch = (total + threads - 1) / threads;
+    std::vector<std::vector<blobdata>> batch_blobs;
+    std::vector<std::vector<uint8_t>> batch_versions;
+    std::vector<std::vector<crypto::hash>> batch_pows;
+    for (size_t i = hash_begin; i < hash_end; i += batch)
+    {
+      const size_t end = std::min(i + batch, hash_end);
+      batch_blobs.emplace_back(blobs.begin() + i, blobs.begin() + end);
+      batch_versions.emplace_back();
+      for (size_t j = i; j < end; ++j)
+        batch_versions.back().push_back(headers[j].major_version);
+    }
+    batch_pows.resize(batch_blobs.size());
+
+    tools::threadpool::waiter waiter;
+    for (size_t n = 0; n < batch_blobs.size(); ++n)
+    {
+      const uint64_t height = base_height + hash_begin - first + n * batch;
+      tpool.submit(&waiter, boost::bind(&Blockchain::header_longhash_worker, this, height, std::cref(batch_blobs[n]), std::cref(batch_versions[n]), std::ref(batch_pows[n])), true);
+    }
+    waiter.wait(&tpool);
+
+    if (m_cancel)
+      return true;
+
+    for (size_t n = 0; n < batch_pows.size(); ++n)
+      std::copy(batch_pows[n].begin(), batch_pows[n].end(), pows.begin() + hash_begin + n * batch);
+  }
+
+  bool valid = true;
+  size_t end = first;
+  for (; end < ids.size(); ++end)
+  {
+    if (end == bad_hash)
+    {
+      MERROR("Block header " << ids[end] << " does not match the compiled block hash at height " << (base_height + end - first));
+      valid = false;
+      break;
+    }
+    if (end >= hash_begin && end < hash_end && !check_hash(pows[end], difficulties[end]))
+    {
+      MERROR("Block header " << ids[end] << " does not have enough proof of work: " << pows[end] << ", difficulty " << difficulties[end]);
+      valid = false;
+      break;
+    }
+  }
+
+  CRITICAL_REGION_LOCAL(m_prevalidated_headers_lock);
+  if (m_prevalidated_headers.size() + (end - first) > BLOCK_HEADERS_PREVALIDATED_MAX_COUNT)
+  {
+    const uint64_t height = m_db->height();
+    for (auto i = m_prevalidated_headers.begin(); i != m_prevalidated_headers.end(); )
+    {
+      if (i->second.height < height)
+        i = m_prevalidated_headers.erase(i);
+      else
+        ++i;
+    }
+  }
+  for (size_t i = first; i < end && m_prevalidated_headers.size() < BLOCK_HEADERS_PREVALIDATED_MAX_COUNT; ++i)
+    m_prevalidated_headers[ids[i]] = {base_height + i - first, headers[i].timestamp, cumulative_difficulties[i], headers[i].prev_id, pows[i]};
+  nvalid = end;
+  MDEBUG("Prevalidated " << (end - first) << " block headers from height " << base_height << ", " << (hash_end - hash_begin) << " hashed, valid " << valid);
+  return valid;
+}
 
 //------------------------------------------------------------------
 // ND: Speedups:
@@ -4340,24 +4818,15 @@ bool Blockchain::prepare_handle_incoming_blocks(const std::vector<block_complete
         auto needed_offsets = relative_output_offsets_to_absolute(in_to_key.key_offsets);
 
         std::vector<output_data_t> outputs;
+        const std::vector<uint64_t> &offsets_found = offset_map[in_to_key.amount];
+        const std::vector<output_data_t> &outputs_found = tx_map[in_to_key.amount];
         for (const uint64_t & offset_needed : needed_offsets)
         {
-          size_t pos = 0;
-          bool found = false;
-
-          for (const uint64_t &offset_found : offset_map[in_to_key.amount])
-          {
-            if (offset_needed == offset_found)
-            {
-              found = true;
-              break;
-            }
-
-            ++pos;
-          }
-
-          if (found && pos < tx_map[in_to_key.amount].size())
-            outputs.push_back(tx_map[in_to_key.amount].at(pos));
+          // offsets_found is sorted and deduplicated
+          const auto offset_it = std::lower_bound(offsets_found.begin(), offsets_found.end(), offset_needed);
+          const size_t pos = offset_it - offsets_found.begin();
+          if (offset_it != offsets_found.end() && *offset_it == offset_needed && pos < outputs_found.size())
+            outputs.push_back(outputs_found[pos]);
           else
             break;
         }
@@ -38,6 +38,7 @@
 #include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/member.hpp>
 #include <atomic>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -45,6 +46,7 @@
 #include "string_tools.h"
 #include "cryptonote_basic/cryptonote_basic.h"
 #include "common/util.h"
+#include "common/windowed_median.h"
 #include "cryptonote_protocol/cryptonote_protocol_defs.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "cryptonote_basic/difficulty.h"
@@ -54,9 +56,12 @@
 #include "checkpoints/checkpoints.h"
 #include "cryptonote_basic/hardfork.h"
 #include "blockchain_db/blockchain_db.h"
+#include "output_key_cache.h"
 
 namespace tools { class Notify; }
 
+class blockchain_accessor_test;
+
 namespace cryptonote
 {
   class tx_memory_pool;
@@ -78,6 +83,7 @@ namespace cryptonote
   /************************************************************************/
   class Blockchain
   {
+    friend class ::blockchain_accessor_test;
   public:
     /**
      * @brief Now-defunct (TODO: remove) struct from in-memory blockchain
@@ -325,6 +331,15 @@ namespace cryptonote
      */
     bool reset_and_set_genesis_block(const block& b);
 
+    /**
+     * @brief removes blocks from the top of the blockchain
+     *
+     * Transactions from the removed blocks are returned to the pool.
+     *
+     * @param nblocks the number of blocks to remove
+     */
+    void pop_blocks(uint64_t nblocks);
+
     /**
      * @brief creates a new block to mine against
      *
@@ -910,6 +925,13 @@ namespace cryptonote
       return *m_db;
     }
 
+    /**
+     * @brief get the hit/miss counters of the ring member output key cache
+     *
+     * @return the cache's counters
+     */
+    output_key_cache_stats get_output_key_cache_stats() const;
+
     /**
      * @brief get a number of outputs of a specific amount
      *
@@ -922,6 +944,27 @@ namespace cryptonote
         std::vector<output_data_t> &outputs, std::unordered_map<crypto::hash,
         cryptonote::transaction> &txs) const;
 
+    /**
+     * @brief computes the proof of work for a set of block headers
+     *
+     * @param height the height of the first header
+     * @param blobs the hashing blobs to be hashed
+     * @param versions the major versions of those headers
+     * @param pows return-by-reference the proof of work of each header
+     */
+    void header_longhash_worker(uint64_t height, const std::vector<blobdata> &blobs,
+        const std::vector<uint8_t> &versions, std::vector<crypto::hash> &pows) const;
+
+    /**
+     * @brief looks up the proof of work computed for a prevalidated header
+     *
+     * @param id the block id
+     * @param pow return-by-reference the proof of work
+     *
+     * @return true if found, false otherwise
+     */
+    bool get_prevalidated_pow(const crypto::hash &id, crypto::hash &pow) const;
+
     /**
      * @brief computes the "short" and "long" hashes for a set of blocks
      *
@@ -952,6 +995,49 @@ namespace cryptonote
     bool is_within_compiled_block_hash_area() const { return is_within_compiled_block_hash_area(m_db->height()); }
     uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes);
 
+    /**
+     * @brief gets the hashing blobs of main chain blocks
+     *
+     * Stops at the first block which is not in the main chain.
+     *
+     * @param ids the blocks to get the hashing blobs for
+     * @param blobs return-by-reference the hashing blobs
+     *
+     * @return true if all the blocks were found, false otherwise
+     */
+    bool get_block_hashing_blobs(const std::vector<crypto::hash> &ids, std::vector<blobdata> &blobs) const;
+
+    /**
+     * @brief counts the leading blocks whose header is already known
+     *
+     * A header is known if its block is in the main chain, or if it was
+     * checked by prevalidate_block_headers and its block was not added yet.
+     *
+     * @param ids the block ids, in chain order
+     *
+     * @return the number of leading known headers
+     */
+    uint64_t get_known_block_headers_count(const std::vector<crypto::hash> &ids) const;
+
+    /**
+     * @brief checks block headers received ahead of their block bodies
+     *
+     * Each hashing blob must hash to its block id, the headers must link
+     * to each other and to a known block, and each header must have enough
+     * proof of work for the difficulty computed from the chain below it.
+     * The proof of work is computed on the threadpool and kept, so blocks
+     * are not hashed again when their bodies get added. Headers in the fast
+     * sync area are checked against the compiled block hashes instead of
+     * their proof of work.
+     *
+     * @param ids the block ids, in chain order
+     * @param blobs the hashing blobs of those blocks
+     * @param nvalid return-by-reference the number of headers which passed
+     *
+     * @return false if a header is invalid, true otherwise
+     */
+    bool prevalidate_block_headers(const std::vector<crypto::hash> &ids, const std::vector<blobdata> &blobs, uint64_t &nvalid);
+
     void lock();
     void unlock();
     bool try_lock();
@@ -1000,7 +1086,20 @@ namespace cryptonote
     // metadata containers
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, std::vector<output_data_t>>> m_scan_table;
     std::unordered_map<crypto::hash, crypto::hash> m_blocks_longhash_table;
+
+    // headers checked ahead of their block bodies, see prevalidate_block_headers
+    struct prevalidated_header
+    {
+      uint64_t height;
+      uint64_t timestamp;
+      difficulty_type cumulative_difficulty;
+      crypto::hash prev_id;
+      crypto::hash pow; // null if it was not computed
+    };
+    std::unordered_map<crypto::hash, prevalidated_header> m_prevalidated_headers;
+    mutable epee::critical_section m_prevalidated_headers_lock;
     std::unordered_map<crypto::hash, std::unordered_map<crypto::key_image, bool>> m_check_txin_table;
+    mutable output_key_cache m_output_key_cache;
 
     // SHA-3 hashes for each block and for fast pow checking
     std::vector<crypto::hash> m_blocks_hash_of_hashes;
@@ -1018,9 +1117,11 @@ namespace cryptonote
     uint64_t m_fake_scan_time;
     uint64_t m_sync_counter;
     uint64_t m_bytes_to_sync;
-    std::vector<uint64_t> m_timestamps;
-    std::vector<difficulty_type> m_difficulties;
+    std::deque<uint64_t> m_timestamps;
+    std::deque<difficulty_type> m_difficulties;
     uint64_t m_timestamps_and_difficulties_height;
+    mutable tools::windowed_median<size_t> m_weights_window;
+    mutable uint64_t m_weights_window_height;
 
     epee::critical_section m_difficulty_lock;
     crypto::hash m_difficulty_for_next_block_top_hash;
@@ -1064,6 +1165,20 @@ namespace cryptonote
     uint64_t m_prepare_nblocks;
     std::vector<block> *m_prepare_blocks;
 
+    /**
+     * @brief gets the metadata of a list of outputs, going through the output key cache
+     *
+     * Outputs found in the cache are not read from the db, the rest are read
+     * in bulk and added to the cache. As with BlockchainDB::get_output_key
+     * with allow_partial set, outputs stops short at the first output which
+     * does not exist.
+     *
+     * @param amount the amount
+     * @param offsets the global indices (indexed to the amount) of the outputs
+     * @param outputs return-by-reference the outputs collected
+     */
+    void get_output_keys_cached(const uint64_t amount, const std::vector<uint64_t> &offsets, std::vector<output_data_t> &outputs) const;
+
     /**
      * @brief collects the keys for all outputs being "spent" as an input
      *
@@ -1260,6 +1375,16 @@ namespace cryptonote
      */
     void get_last_n_blocks_weights(std::vector<size_t>& weights, size_t count) const;
 
+    /**
+     * @brief gets the median weight of the last CRYPTONOTE_REWARD_BLOCKS_WINDOW blocks
+     *
+     * The weights are kept in a window which follows the chain, so this
+     * only reads from the db the blocks added since the last call.
+     *
+     * @return the median block weight
+     */
+    size_t get_block_weights_median() const;
+
     /**
      * @brief checks if a transaction is unlocked (its outputs spendable)
      *
@@ -1069,6 +1069,11 @@ namespace cryptonote
     return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT;
   }
   //-----------------------------------------------------------------------------------------------
+  size_t core::get_fixed_block_sync_size() const
+  {
+    return block_sync_size;
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::are_key_images_spent_in_pool(const std::vector<crypto::key_image>& key_im, std::vector<bool> &spent) const
   {
     spent.clear();
@@ -1468,9 +1473,9 @@ namespace cryptonote
     return true;
   }
   //-----------------------------------------------------------------------------------------------
-  bool core::get_pool_transaction(const crypto::hash &id, cryptonote::blobdata& tx) const
+  bool core::get_pool_transaction(const crypto::hash &id, cryptonote::blobdata& tx, bool include_unrelayed_txes) const
   {
-    return m_mempool.get_transaction(id, tx);
+    return m_mempool.get_transaction(id, tx, include_unrelayed_txes);
   }
   //-----------------------------------------------------------------------------------------------
   bool core::pool_has_tx(const crypto::hash &id) const
@@ -1748,6 +1753,21 @@ namespace cryptonote
     return get_blockchain_storage().prevalidate_block_hashes(height, hashes);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_block_hashing_blobs(const std::vector<crypto::hash> &ids, std::vector<blobdata> &blobs) const
+  {
+    return get_blockchain_storage().get_block_hashing_blobs(ids, blobs);
+  }
+  //-----------------------------------------------------------------------------------------------
+  uint64_t core::get_known_block_headers_count(const std::vector<crypto::hash> &ids) const
+  {
+    return get_blockchain_storage().get_known_block_headers_count(ids);
+  }
+  //-----------------------------------------------------------------------------------------------
+  bool core::prevalidate_block_headers(const std::vector<crypto::hash> &ids, const std::vector<blobdata> &blobs, uint64_t &nvalid)
+  {
+    return get_blockchain_storage().prevalidate_block_headers(ids, blobs, nvalid);
+  }
+  //-----------------------------------------------------------------------------------------------
   uint64_t core::get_free_space() const
   {
     boost::filesystem::path path(m_config_folder);
@@ -459,10 +459,11 @@ namespace cryptonote
 
      /**
       * @copydoc tx_memory_pool::get_transaction
+      * @param include_unrelayed_txes include unrelayed txes in result
       *
       * @note see tx_memory_pool::get_transaction
       */
-     bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx) const;
+     bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx, bool include_unrelayed_txes = true) const;
 
      /**
       * @copydoc tx_memory_pool::get_pool_transactions_and_spent_keys_info
@@ -725,6 +726,13 @@ namespace cryptonote
       */
      size_t get_block_sync_size(uint64_t height) const;
 
+     /**
+      * @brief get the number of blocks to sync in one go set by the user
+      *
+      * @return that number, or 0 if it is left to adapt to each peer
+      */
+     size_t get_fixed_block_sync_size() const;
+
      /**
       * @brief get the sum of coinbase tx amounts between blocks
       *
@@ -763,6 +771,27 @@ namespace cryptonote
       */
      uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes);
 
+     /**
+      * @copydoc Blockchain::get_block_hashing_blobs
+      *
+      * @note see Blockchain::get_block_hashing_blobs
+      */
+     bool get_block_hashing_blobs(const std::vector<crypto::hash> &ids, std::vector<blobdata> &blobs) const;
+
+     /**
+      * @copydoc Blockchain::get_known_block_headers_count
+      *
+      * @note see Blockchain::get_known_block_headers_count
+      */
+     uint64_t get_known_block_headers_count(const std::vector<crypto::hash> &ids) const;
+
+     /**
+      * @copydoc Blockchain::prevalidate_block_headers
+      *
+      * @note see Blockchain::prevalidate_block_headers
+      */
+     bool prevalidate_block_headers(const std::vector<crypto::hash> &ids, const std::vector<blobdata> &blobs, uint64_t &nvalid);
+
      /**
       * @brief get free disk space on the blockchain partition
       *
@@ -687,11 +687,20 @@ namespace cryptonote
     rx_slow_hash(main_height, seed_height, seed_hash.data, bd.data(), bd.size(), res.data, 0, 1);
   }
 
+  static void get_cn_pow_params(uint8_t major_version, int &variant, int &modifier)
+  {
+    variant = major_version < 8 ? 0 : major_version >= 11 ? 2 : 1;
+    modifier = major_version < 12 ? CN_MODIFIER_NONE : CN_MODIFIER_REVERSE_WALTZ;
+  }
+
   bool get_block_longhash(const Blockchain *pbc, const block& b, crypto::hash& res, const uint64_t height, const int miners)
   {
-  
-    blobdata bd = get_block_hashing_blob(b);
-    if (b.major_version >= RX_BLOCK_VERSION)
+    return get_block_longhash(pbc, get_block_hashing_blob(b), b.major_version, res, height, miners);
+  }
+
+  bool get_block_longhash(const Blockchain *pbc, const blobdata& bd, uint8_t major_version, crypto::hash& res, const uint64_t height, const int miners)
+  {
+    if (major_version >= RX_BLOCK_VERSION)
     {
       uint64_t seed_height, main_height;
       crypto::hash hash;
@@ -708,13 +717,53 @@ namespace cryptonote
       }
       rx_slow_hash(main_height, seed_height, hash.data, bd.data(), bd.size(), res.data, miners, 0);
     } else {
-      const int cn_variant = b.major_version < 8 ? 0 : b.major_version >= 11 ? 2 : 1;
-      const int cn_modifier = b.major_version < 12 ? CN_MODIFIER_NONE : CN_MODIFIER_REVERSE_WALTZ;
+      int cn_variant, cn_modifier;
+      get_cn_pow_params(major_version, cn_variant, cn_modifier);
       crypto::cn_slow_hash(bd.data(), bd.size(), res, cn_variant, cn_modifier);
     }
     return true;
   }
 
+  void get_block_longhashes(const Blockchain *pbc, const std::vector<blobdata>& bds, const std::vector<uint8_t>& major_versions, const std::vector<uint64_t>& heights, std::vector<crypto::hash>& res, const int miners)
+  {
+    res.resize(bds.size());
+    std::vector<const void*> data;
+    std::vector<size_t> lengths;
+    size_t i = 0;
+    while (i < bds.size())
+    {
+      if (major_versions[i] >= RX_BLOCK_VERSION)
+      {
+        get_block_longhash(pbc, bds[i], major_versions[i], res[i], heights[i], miners);
+        ++i;
+        continue;
+      }
+
+      // CryptoNight blobs are interleaved in runs sharing the same variant
+      int cn_variant, cn_modifier;
+      get_cn_pow_params(major_versions[i], cn_variant, cn_modifier);
+      size_t end = i + 1;
+      while (end < bds.size() && major_versions[end] < RX_BLOCK_VERSION)
+      {
+        int variant, modifier;
+        get_cn_pow_params(major_versions[end], variant, modifier);
+        if (variant != cn_variant || modifier != cn_modifier)
+          break;
+        ++end;
+      }
+
+      data.clear();
+      lengths.clear();
+      for (size_t n = i; n < end; ++n)
+      {
+        data.push_back(bds[n].data());
+        lengths.push_back(bds[n].size());
+      }
+      crypto::cn_slow_hash_multi(data.data(), lengths.data(), res.data() + i, end - i, BLOCK_LONGHASH_INTERLEAVE_WAYS, cn_variant, cn_modifier);
+      i = end;
+    }
+  }
+
   crypto::hash get_block_longhash(const Blockchain *pbc, const block& b, const uint64_t height, const int miners)
   {
     crypto::hash p = crypto::null_hash;
@@ -726,4 +775,14 @@ namespace cryptonote
   {
     rx_reorg(split_height);
   }
+
+  void get_block_longhash_next_seed(const uint64_t seed_height, const crypto::hash& seed_hash)
+  {
+    rx_prepare_next_seed(seed_height, seed_hash.data);
+  }
+
+  void get_block_longhash_stop_next_seed()
+  {
+    rx_stop_prepare_next_seed();
+  }
 }
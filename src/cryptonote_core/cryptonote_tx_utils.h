@@ -104,7 +104,11 @@ namespace cryptonote
   void get_altblock_longhash(const block& b, crypto::hash& res, const uint64_t main_height, const uint64_t height,
     const uint64_t seed_height, const crypto::hash& seed_hash);
   crypto::hash get_block_longhash(const Blockchain *pb, const block& b, const uint64_t height, const int miners);
+  bool get_block_longhash(const Blockchain *pb, const blobdata& hashing_blob, uint8_t major_version, crypto::hash& res, const uint64_t height, const int miners);
+  void get_block_longhashes(const Blockchain *pb, const std::vector<blobdata>& hashing_blobs, const std::vector<uint8_t>& major_versions, const std::vector<uint64_t>& heights, std::vector<crypto::hash>& res, const int miners);
   void get_block_longhash_reorg(const uint64_t split_height);
+  void get_block_longhash_next_seed(const uint64_t seed_height, const crypto::hash& seed_hash);
+  void get_block_longhash_stop_next_seed();
 
 }
 
@@ -0,0 +1,112 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "output_key_cache.h"
+
+namespace cryptonote
+{
+
+output_key_cache::output_key_cache(size_t max_entries):
+  m_max_entries(std::max<size_t>(max_entries, 1)),
+  m_hand(0),
+  m_hits(0),
+  m_misses(0)
+{
+}
+
+bool output_key_cache::get(uint64_t amount, uint64_t index, output_data_t &data)
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  const auto it = m_index.find({amount, index});
+  if (it == m_index.end())
+  {
+    ++m_misses;
+    return false;
+  }
+  slot_t &slot = m_slots[it->second];
+  slot.referenced = true;
+  data = slot.data;
+  ++m_hits;
+  return true;
+}
+
+void output_key_cache::put(uint64_t amount, uint64_t index, const output_data_t &data)
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  const key_t key = {amount, index};
+  const auto it = m_index.find(key);
+  if (it != m_index.end())
+  {
+    m_slots[it->second].data = data;
+    return;
+  }
+
+  if (m_slots.size() < m_max_entries)
+  {
+    if (m_slots.empty())
+      m_index.reserve(m_max_entries);
+    m_index.emplace(key, m_slots.size());
+    m_slots.push_back({key, data, false});
+    return;
+  }
+
+  // sweep until we find an output which was not used since the last pass
+  while (m_slots[m_hand].referenced)
+  {
+    m_slots[m_hand].referenced = false;
+    m_hand = (m_hand + 1) % m_slots.size();
+  }
+  slot_t &slot = m_slots[m_hand];
+  m_index.erase(slot.key);
+  m_index.emplace(key, m_hand);
+  slot.key = key;
+  slot.data = data;
+  slot.referenced = false;
+  m_hand = (m_hand + 1) % m_slots.size();
+}
+
+void output_key_cache::clear()
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  m_slots.clear();
+  m_index.clear();
+  m_hand = 0;
+}
+
+output_key_cache_stats output_key_cache::get_stats() const
+{
+  boost::lock_guard<boost::mutex> lock(m_mutex);
+  output_key_cache_stats stats;
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  stats.entries = m_slots.size();
+  return stats;
+}
+
+}
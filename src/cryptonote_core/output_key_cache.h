@@ -0,0 +1,115 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "blockchain_db/blockchain_db.h"
+
+namespace cryptonote
+{
+
+/**
+ * @brief counters describing how an output_key_cache has been answering
+ */
+struct output_key_cache_stats
+{
+  uint64_t hits;    //!< lookups answered from memory
+  uint64_t misses;  //!< lookups which had to go to the db
+  uint64_t entries; //!< outputs currently held
+};
+
+/**
+ * @brief fixed size cache of output keys, keyed by (amount, global index)
+ *
+ * Ring members are resolved for every input of every transaction, both in
+ * the pool and in blocks, and recent outputs are picked as decoys over and
+ * over. An output never changes while it is in the chain, so its data can
+ * be kept until the chain is popped below it; the owner is expected to
+ * clear the cache whenever blocks are removed.
+ *
+ * Eviction uses the CLOCK algorithm: a hit only sets a flag, so lookups
+ * do not reorder anything.
+ */
+class output_key_cache
+{
+public:
+  explicit output_key_cache(size_t max_entries);
+
+  /**
+   * @brief looks up an output
+   *
+   * @return true and fills data if the output is cached
+   */
+  bool get(uint64_t amount, uint64_t index, output_data_t &data);
+
+  /**
+   * @brief adds an output, evicting one if the cache is full
+   */
+  void put(uint64_t amount, uint64_t index, const output_data_t &data);
+
+  /**
+   * @brief drops all outputs, keeping the counters
+   */
+  void clear();
+
+  output_key_cache_stats get_stats() const;
+
+private:
+  struct key_t
+  {
+    uint64_t amount;
+    uint64_t index;
+    bool operator==(const key_t &other) const { return amount == other.amount && index == other.index; }
+  };
+
+  struct key_hash
+  {
+    size_t operator()(const key_t &k) const { return k.index ^ (k.amount * 0x9e3779b97f4a7c15ull); }
+  };
+
+  struct slot_t
+  {
+    key_t key;
+    output_data_t data;
+    bool referenced;
+  };
+
+  mutable boost::mutex m_mutex;
+  size_t m_max_entries;
+  std::vector<slot_t> m_slots;
+  std::unordered_map<key_t, size_t, key_hash> m_index;
+  size_t m_hand;
+  std::atomic<uint64_t> m_hits;
+  std::atomic<uint64_t> m_misses;
+};
+
+}
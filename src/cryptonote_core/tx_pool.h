@@ -307,10 +307,11 @@ namespace cryptonote
      *
      * @param h the hash of the transaction to get
      * @param tx return-by-reference the transaction blob requested
+     * @param include_unrelayed_txes include txes which are not to be relayed, or were not relayed yet
      *
      * @return true if the transaction is found, otherwise false
      */
-    bool get_transaction(const crypto::hash& h, cryptonote::blobdata& txblob) const;
+    bool get_transaction(const crypto::hash& h, cryptonote::blobdata& txblob, bool include_unrelayed_txes = true) const;
 
     /**
      * @brief get a list of all relayable transactions and their hashes
@@ -28,6 +28,7 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <algorithm>
 #include <vector>
 #include <unordered_map>
 #include <boost/uuid/nil_generator.hpp>
@@ -38,6 +39,10 @@
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "cn.block_queue"
 
+#define SPAN_RATE_WEIGHT 0.3f // weight of the latest span in the running averages
+#define LATE_SPAN_FACTOR 3 // a span is late if it takes this many times longer than expected...
+#define LATE_SPAN_MARGIN (2 * 1000000) // ... plus this many microseconds, to account for latency
+
 namespace std {
   static_assert(sizeof(size_t) <= sizeof(boost::uuids::uuid), "boost::uuids::uuid too small");
   template<> struct hash<boost::uuids::uuid> {
@@ -55,7 +60,19 @@ void block_queue::add_blocks(uint64_t height, std::vector<cryptonote::block_comp
   boost::unique_lock<boost::recursive_mutex> lock(mutex);
   std::vector<crypto::hash> hashes;
   bool has_hashes = remove_span(height, &hashes);
+  const uint64_t nblocks = bcel.size();
   blocks.insert(span(height, std::move(bcel), connection_id, rate, size));
+  if (nblocks > 0)
+  {
+    // as in get_speed, the latest measurements matter most
+    peer_rate &pr = peer_rates[connection_id];
+    pr.rate = pr.nspans ? pr.rate * (1.0f - SPAN_RATE_WEIGHT) + rate * SPAN_RATE_WEIGHT : rate;
+    ++pr.nspans;
+    pr.nblocks += nblocks;
+    pr.size += size;
+    const float block_size = size / (float)nblocks;
+    avg_block_size = avg_block_size > 0.0f ? avg_block_size * (1.0f - SPAN_RATE_WEIGHT) + block_size * SPAN_RATE_WEIGHT : block_size;
+  }
   if (has_hashes)
   {
     for (const crypto::hash &h: hashes)
@@ -428,4 +445,49 @@ bool block_queue::foreach(std::function<bool(const span&)> f, bool include_block
   return true;
 }
 
+bool block_queue::get_peer_rate(const boost::uuids::uuid &connection_id, peer_rate &rate) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_rates.find(connection_id);
+  if (i == peer_rates.end())
+    return false;
+  rate = i->second;
+  return true;
+}
+
+void block_queue::remove_peer_rate(const boost::uuids::uuid &connection_id)
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  peer_rates.erase(connection_id);
+}
+
+uint64_t block_queue::get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_nblocks, uint64_t max_nblocks, uint64_t fixed_nblocks) const
+{
+  // a size set by the user is a cap, even for fast peers
+  if (fixed_nblocks > 0)
+    max_nblocks = std::min(max_nblocks, fixed_nblocks);
+
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_rates.find(connection_id);
+  if (i == peer_rates.end() || i->second.rate <= 0.0f || avg_block_size <= 0.0f)
+    return std::min(default_nblocks, max_nblocks);
+
+  // ask for enough blocks to keep the peer busy for a while, so the round
+  // trip between spans matters little, but not so many that a slow peer
+  // holds up the whole queue
+  const float bytes = std::min(i->second.rate * BLOCKS_SYNCHRONIZING_SPAN_SECONDS, (float)BLOCKS_SYNCHRONIZING_MAX_SPAN_SIZE);
+  const uint64_t nblocks = bytes / avg_block_size;
+  return std::max<uint64_t>(1, std::min(nblocks, max_nblocks));
+}
+
+bool block_queue::is_span_late(const boost::uuids::uuid &connection_id, uint64_t nblocks, boost::posix_time::ptime request_time, boost::posix_time::ptime now) const
+{
+  boost::unique_lock<boost::recursive_mutex> lock(mutex);
+  const auto i = peer_rates.find(connection_id);
+  if (i == peer_rates.end() || i->second.rate <= 0.0f || avg_block_size <= 0.0f)
+    return false;
+  const float expected = nblocks * avg_block_size / i->second.rate * 1e6f;
+  return (now - request_time).total_microseconds() > expected * LATE_SPAN_FACTOR + LATE_SPAN_MARGIN;
+}
+
 }
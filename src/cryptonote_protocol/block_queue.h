@@ -32,6 +32,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <set>
 #include <unordered_set>
 #include <boost/thread/recursive_mutex.hpp>
@@ -67,6 +68,14 @@ namespace cryptonote
     };
     typedef std::set<span> block_map;
 
+    struct peer_rate
+    {
+      float rate; // bytes per second, weighted towards the latest spans
+      uint64_t nspans;
+      uint64_t nblocks;
+      uint64_t size;
+    };
+
   public:
     void add_blocks(uint64_t height, std::vector<cryptonote::block_complete_entry> bcel, const boost::uuids::uuid &connection_id, float rate, size_t size);
     void add_blocks(uint64_t height, uint64_t nblocks, const boost::uuids::uuid &connection_id, boost::posix_time::ptime time = boost::date_time::min_date_time);
@@ -92,6 +101,10 @@ namespace cryptonote
     float get_speed(const boost::uuids::uuid &connection_id) const;
     bool foreach(std::function<bool(const span&)> f, bool include_blockchain_placeholder = false) const;
     bool requested(const crypto::hash &hash) const;
+    bool get_peer_rate(const boost::uuids::uuid &connection_id, peer_rate &rate) const;
+    void remove_peer_rate(const boost::uuids::uuid &connection_id);
+    uint64_t get_span_size(const boost::uuids::uuid &connection_id, uint64_t default_nblocks, uint64_t max_nblocks, uint64_t fixed_nblocks = 0) const;
+    bool is_span_late(const boost::uuids::uuid &connection_id, uint64_t nblocks, boost::posix_time::ptime request_time, boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time()) const;
 
   private:
     void erase_block(block_map::iterator j);
@@ -101,5 +114,7 @@ namespace cryptonote
     block_map blocks;
     mutable boost::recursive_mutex mutex;
     std::unordered_set<crypto::hash> requested_hashes;
+    std::map<boost::uuids::uuid, peer_rate> peer_rates;
+    float avg_block_size = 0.0f;
   };
 }
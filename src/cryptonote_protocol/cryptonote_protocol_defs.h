@@ -43,6 +43,27 @@ namespace cryptonote
   /************************************************************************/
   /* P2P connection info, serializable to json                            */
   /************************************************************************/
+  struct connection_command_info
+  {
+    int32_t command;
+    uint64_t messages_in;
+    uint64_t bytes_in;
+    uint64_t messages_out;
+    uint64_t bytes_out;
+    uint64_t handler_time; // usec
+    uint64_t queue_time; // usec
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(command)
+      KV_SERIALIZE(messages_in)
+      KV_SERIALIZE(bytes_in)
+      KV_SERIALIZE(messages_out)
+      KV_SERIALIZE(bytes_out)
+      KV_SERIALIZE(handler_time)
+      KV_SERIALIZE(queue_time)
+    END_KV_SERIALIZE_MAP()
+  };
+
   struct connection_info
   {
     bool incoming;
@@ -62,6 +83,12 @@ namespace cryptonote
     uint64_t send_count;
     uint64_t send_idle_time;
 
+    uint64_t recv_messages;
+    uint64_t send_messages;
+    uint64_t handler_time; // usec
+    uint64_t queue_time; // usec
+    std::vector<connection_command_info> commands;
+
     std::string state;
 
     uint64_t live_time;
@@ -91,6 +118,11 @@ namespace cryptonote
       KV_SERIALIZE(recv_idle_time)
       KV_SERIALIZE(send_count)
       KV_SERIALIZE(send_idle_time)
+      KV_SERIALIZE_OPT(recv_messages, (uint64_t)0)
+      KV_SERIALIZE_OPT(send_messages, (uint64_t)0)
+      KV_SERIALIZE_OPT(handler_time, (uint64_t)0)
+      KV_SERIALIZE_OPT(queue_time, (uint64_t)0)
+      KV_SERIALIZE(commands)
       KV_SERIALIZE(state)
       KV_SERIALIZE(live_time)
       KV_SERIALIZE(avg_download)
@@ -280,5 +312,125 @@ namespace cryptonote
       END_KV_SERIALIZE_MAP()
     };
   }; 
+
+  /************************************************************************/
+  /* Sent instead of NOTIFY_NEW_TRANSACTIONS to peers which support       */
+  /* P2P_SUPPORT_FLAG_TX_ANNOUNCE, they ask for the txes they do not have */
+  /************************************************************************/
+  struct NOTIFY_NEW_TRANSACTION_HASHES
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* Answered with NOTIFY_NEW_TRANSACTIONS                                */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_TRANSACTIONS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      std::vector<crypto::hash> tx_hashes;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_hashes)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* Transactions are referred to by short ids, see short_tx_ids.h        */
+  /************************************************************************/
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request
+    {
+      blobdata block; // without its tx hashes
+      crypto::hash block_hash;
+      uint64_t current_blockchain_height;
+      uint64_t short_id_nonce;
+      std::string short_ids;
+      std::vector<uint64_t> prefilled_tx_indices;
+      std::vector<blobdata> prefilled_txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(current_blockchain_height)
+        KV_SERIALIZE(short_id_nonce)
+        KV_SERIALIZE(short_ids)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(prefilled_tx_indices)
+        KV_SERIALIZE(prefilled_txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* another notification, compressed                                     */
+  /************************************************************************/
+  struct NOTIFY_COMPRESSED
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 13;
+
+    struct request
+    {
+      uint32_t command;
+      uint64_t size; // uncompressed
+      std::string data;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(command)
+        KV_SERIALIZE(size)
+        KV_SERIALIZE(data)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* Sent to peers which support P2P_SUPPORT_FLAG_BLOCK_HEADERS while     */
+  /* syncing, the headers are checked before the block bodies arrive      */
+  /************************************************************************/
+  struct NOTIFY_REQUEST_BLOCK_HEADERS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 14;
+
+    struct request
+    {
+      std::vector<crypto::hash> blocks;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(blocks)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* Block hashing blobs, in the order they were requested                */
+  /************************************************************************/
+  struct NOTIFY_RESPONSE_BLOCK_HEADERS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 15;
+
+    struct request
+    {
+      std::vector<blobdata> headers;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(headers)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
     
 }
@@ -43,9 +43,13 @@
 #include "cryptonote_protocol_defs.h"
 #include "cryptonote_protocol_handler_common.h"
 #include "block_queue.h"
+#include "tx_relay_queue.h"
+#include "short_tx_ids.h"
+#include "payload_compression.h"
 #include "cryptonote_basic/connection_context.h"
 #include "cryptonote_basic/cryptonote_stat_info.h"
 #include <boost/circular_buffer.hpp>
+#include <boost/thread/thread.hpp>
 
 PUSH_WARNINGS
 DISABLE_VS_WARNINGS(4355)
@@ -90,6 +94,12 @@ namespace cryptonote
       HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &cryptonote_protocol_handler::handle_response_chain_entry)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_FLUFFY_BLOCK, &cryptonote_protocol_handler::handle_notify_new_fluffy_block)			
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_FLUFFY_MISSING_TX, &cryptonote_protocol_handler::handle_request_fluffy_missing_tx)						
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTION_HASHES, &cryptonote_protocol_handler::handle_notify_new_transaction_hashes)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TRANSACTIONS, &cryptonote_protocol_handler::handle_request_transactions)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &cryptonote_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_COMPRESSED, &cryptonote_protocol_handler::handle_notify_compressed)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_request_block_headers)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_BLOCK_HEADERS, &cryptonote_protocol_handler::handle_response_block_headers)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -107,6 +117,7 @@ namespace cryptonote
     void log_connections();
     std::list<connection_info> get_connections();
     const block_queue &get_block_queue() const { return m_block_queue; }
+    tx_relay_queue::stats get_tx_relay_stats() const { return m_tx_relay_queue.get_stats(); }
     void stop();
     void on_connection_close(cryptonote_connection_context &context);
   private:
@@ -119,6 +130,12 @@ namespace cryptonote
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, cryptonote_connection_context& context);
     int handle_notify_new_fluffy_block(int command, NOTIFY_NEW_FLUFFY_BLOCK::request& arg, cryptonote_connection_context& context);
     int handle_request_fluffy_missing_tx(int command, NOTIFY_REQUEST_FLUFFY_MISSING_TX::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context);
+    int handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context);
+    int handle_notify_compressed(int command, NOTIFY_COMPRESSED::request& arg, cryptonote_connection_context& context);
+    int handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
+    int handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context);
 		
     //----------------- i_bc_protocol_layout ---------------------------------------
     virtual bool relay_block(NOTIFY_NEW_BLOCK::request& arg, cryptonote_connection_context& exclude_context);
@@ -126,12 +143,18 @@ namespace cryptonote
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, cryptonote_connection_context& context);
     bool request_missing_objects(cryptonote_connection_context& context, bool check_having_blocks, bool force_next_span = false);
+    bool request_block_headers(cryptonote_connection_context& context);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();
     bool should_download_next_span(cryptonote_connection_context& context) const;
     void drop_connection(cryptonote_connection_context &context, bool add_fail, bool flush_all_spans);
     bool kick_idle_peers();
     int try_add_next_blocks(cryptonote_connection_context &context);
+    void tx_relay_worker();
+    void flush_tx_relay_queue();
+    void retry_tx_requests();
+    bool relay_compact_block(const NOTIFY_NEW_BLOCK::request& arg, const std::list<boost::uuids::uuid> &connections);
+    bool post_notify_blob(int command, const std::string& blob, cryptonote_connection_context& context);
 
     t_core& m_core;
 
@@ -143,6 +166,9 @@ namespace cryptonote
     boost::mutex m_sync_lock;
     block_queue m_block_queue;
     epee::math_helper::once_a_time_seconds<30> m_idle_peer_kicker;
+    tx_relay_queue m_tx_relay_queue;
+    boost::thread m_tx_relay_thread;
+    payload_compression m_payload_compression;
 
     boost::mutex m_buffer_mutex;
     double get_avg_block_size();
@@ -155,7 +181,7 @@ namespace cryptonote
         std::string blob;
         epee::serialization::store_t_to_binary(arg, blob);
         //handler_response_blocks_now(blob.size()); // XXX
-        return m_p2p->invoke_notify_to_peer(t_parameter::ID, blob, context);
+        return post_notify_blob(t_parameter::ID, blob, context);
       }
 
       template<class t_parameter>
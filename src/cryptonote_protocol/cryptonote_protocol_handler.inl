@@ -65,7 +65,8 @@ namespace cryptonote
                                                                                                               m_p2p(p_net_layout),
                                                                                                               m_syncronized_connections_count(0),
                                                                                                               m_synchronized(offline),
-                                                                                                              m_stopping(false)
+                                                                                                              m_stopping(false),
+                                                                                                              m_tx_relay_queue(P2P_TX_RELAY_KNOWN_TXS, P2P_TX_RELAY_REQUEST_TIMEOUT, P2P_TX_RELAY_MAX_REQUESTED, P2P_TX_RELAY_MAX_UNDELIVERED)
 
   {
     if(!m_p2p)
@@ -75,12 +76,18 @@ namespace cryptonote
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::init(const boost::program_options::variables_map& vm)
   {
+    m_tx_relay_thread = boost::thread(&t_cryptonote_protocol_handler<t_core>::tx_relay_worker, this);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::deinit()
   {
+    if (m_tx_relay_thread.joinable())
+    {
+      m_tx_relay_thread.interrupt();
+      m_tx_relay_thread.join();
+    }
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
@@ -221,6 +228,26 @@ namespace cryptonote
       cnx.send_count = cntxt.m_send_cnt;
       cnx.send_idle_time = timestamp - std::max(cntxt.m_started, cntxt.m_last_send);
 
+      cnx.recv_messages = cntxt.m_recv_msgs;
+      cnx.send_messages = cntxt.m_send_msgs;
+      cnx.handler_time = cntxt.m_handler_ns / 1000;
+      cnx.queue_time = cntxt.m_queue_ns / 1000;
+      if (cntxt.m_command_stats)
+      {
+        for (const auto &t: cntxt.m_command_stats->get_totals())
+        {
+          connection_command_info cmd;
+          cmd.command = t.command;
+          cmd.messages_in = t.messages_in;
+          cmd.bytes_in = t.bytes_in;
+          cmd.messages_out = t.messages_out;
+          cmd.bytes_out = t.bytes_out;
+          cmd.handler_time = t.handler_ns / 1000;
+          cmd.queue_time = t.queue_ns / 1000;
+          cnx.commands.push_back(cmd);
+        }
+      }
+
       cnx.state = get_protocol_state_string(cntxt.m_state);
 
       cnx.live_time = timestamp - cntxt.m_started;
@@ -279,6 +306,9 @@ namespace cryptonote
       }
     }
 
+    if (is_inital)
+      m_tx_relay_queue.on_connection_open(context.m_connection_id);
+
     context.m_remote_blockchain_height = hshd.current_height;
 
     uint64_t target = m_core.get_target_blockchain_height();
@@ -793,7 +823,6 @@ namespace cryptonote
 
     if(arg.txs.size())
     {
-      //TODO: add announce usage here
       relay_transactions(arg, context);
     }
 
@@ -801,6 +830,216 @@ namespace cryptonote
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_transaction_hashes(int command, NOTIFY_NEW_TRANSACTION_HASHES::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_TRANSACTION_HASHES (" << arg.tx_hashes.size() << " txes)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+
+    if (arg.tx_hashes.size() > P2P_TX_RELAY_MAX_HASHES)
+    {
+      LOG_ERROR_CCONTEXT("Too many tx hashes in NOTIFY_NEW_TRANSACTION_HASHES, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // the peer has these, don't send them back
+    m_tx_relay_queue.on_txs_announced(context.m_connection_id, arg.tx_hashes);
+
+    // as with NOTIFY_NEW_TRANSACTIONS, txes aren't wanted while syncing
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new tx hashes while syncing, ignored");
+      return 1;
+    }
+
+    NOTIFY_REQUEST_TRANSACTIONS::request req;
+    for (const crypto::hash &tx_hash: arg.tx_hashes)
+    {
+      if (!m_core.pool_has_tx(tx_hash))
+        req.tx_hashes.push_back(tx_hash);
+    }
+    // if another peer announced them first, we're waiting for them already,
+    // and this one gets asked if that one does not deliver
+    m_tx_relay_queue.request_txs(context.m_connection_id, req.tx_hashes);
+    if (!req.tx_hashes.empty())
+    {
+      LOG_DEBUG_CC(context, "-->>NOTIFY_REQUEST_TRANSACTIONS: " << req.tx_hashes.size() << " txes");
+      post_notify<NOTIFY_REQUEST_TRANSACTIONS>(req, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_transactions(int command, NOTIFY_REQUEST_TRANSACTIONS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_TRANSACTIONS (" << arg.tx_hashes.size() << " txes)");
+    if (arg.tx_hashes.size() > P2P_TX_RELAY_MAX_HASHES)
+    {
+      LOG_ERROR_CCONTEXT("Too many tx hashes in NOTIFY_REQUEST_TRANSACTIONS, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    NOTIFY_NEW_TRANSACTIONS::request rsp;
+    uint64_t bytes = 0;
+    for (const crypto::hash &tx_hash: arg.tx_hashes)
+    {
+      // only hand out txes we announced to this peer, so the pool can't be
+      // probed for txes which are not being relayed. Those it announced to
+      // us don't count, it could announce anything.
+      if (!m_tx_relay_queue.was_announced(context.m_connection_id, tx_hash))
+      {
+        LOG_DEBUG_CC(context, "Peer requested tx " << tx_hash << " which was not announced to it");
+        continue;
+      }
+      // and it may not be relayable anymore
+      cryptonote::blobdata tx_blob;
+      if (m_core.get_pool_transaction(tx_hash, tx_blob, false))
+      {
+        bytes += tx_blob.size();
+        rsp.txs.push_back(std::move(tx_blob));
+      }
+    }
+    if (!rsp.txs.empty())
+    {
+      m_tx_relay_queue.on_sent(rsp.txs.size(), bytes, true);
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(rsp, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_NEW_COMPACT_BLOCK (height " << arg.current_blockchain_height << ", " << arg.short_ids.size() / short_tx_ids::SHORT_ID_SIZE << " txes, " << arg.prefilled_txs.size() << " prefilled)");
+    if(context.m_state != cryptonote_connection_context::state_normal)
+      return 1;
+    if(!is_synchronized())
+    {
+      LOG_DEBUG_CC(context, "Received new block while syncing, ignored");
+      return 1;
+    }
+
+    block new_block;
+    std::vector<short_tx_ids::short_id> ids;
+    if(!parse_and_validate_block_from_blob(arg.block, new_block) || !new_block.tx_hashes.empty() || !short_tx_ids::unpack(arg.short_ids, ids)
+        || ids.size() > P2P_COMPACT_BLOCK_MAX_TXS || arg.prefilled_tx_indices.size() != arg.prefilled_txs.size())
+    {
+      LOG_ERROR_CCONTEXT("sent invalid NOTIFY_NEW_COMPACT_BLOCK, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // we may have got it from another peer already
+    if(m_core.have_block(arg.block_hash))
+      return 1;
+
+    new_block.tx_hashes.resize(ids.size());
+    std::vector<bool> resolved(ids.size(), false);
+    for(size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+    {
+      const uint64_t idx = arg.prefilled_tx_indices[i];
+      transaction tx;
+      crypto::hash tx_prefix_hash;
+      if(idx >= ids.size() || resolved[idx] || !parse_and_validate_tx_from_blob(arg.prefilled_txs[i], tx, new_block.tx_hashes[idx], tx_prefix_hash))
+      {
+        LOG_ERROR_CCONTEXT("sent invalid prefilled tx in NOTIFY_NEW_COMPACT_BLOCK, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+      resolved[idx] = true;
+    }
+
+    // match the rest against the pool, ambiguous ids are requested like missing txes
+    std::vector<uint64_t> need_tx_indices;
+    if(arg.prefilled_txs.size() < ids.size())
+    {
+      std::vector<crypto::hash> pool_tx_hashes;
+      m_core.get_pool_transaction_hashes(pool_tx_hashes);
+      const short_tx_id_index index(short_tx_ids(arg.block_hash, arg.short_id_nonce), pool_tx_hashes);
+      for(size_t i = 0; i < ids.size(); ++i)
+      {
+        if(!resolved[i] && !index.find(ids[i], new_block.tx_hashes[i]))
+          need_tx_indices.push_back(i);
+      }
+      if(need_tx_indices.empty() && get_block_hash(new_block) != arg.block_hash)
+      {
+        // some short id matched the wrong pool tx, we can't tell which
+        MDEBUG("Short id collision in compact block " << arg.block_hash << ", requesting all its txes");
+        for(size_t i = 0; i < ids.size(); ++i)
+          if(!resolved[i])
+            need_tx_indices.push_back(i);
+      }
+    }
+
+    if(need_tx_indices.empty())
+    {
+      MDEBUG("We have all needed txes for compact block " << arg.block_hash);
+      NOTIFY_NEW_FLUFFY_BLOCK::request fluffy_arg = AUTO_VAL_INIT(fluffy_arg);
+      fluffy_arg.current_blockchain_height = arg.current_blockchain_height;
+      fluffy_arg.b.block = t_serializable_object_to_blob(new_block);
+      fluffy_arg.b.txs = std::move(arg.prefilled_txs);
+      return handle_notify_new_fluffy_block(NOTIFY_NEW_FLUFFY_BLOCK::ID, fluffy_arg, context);
+    }
+
+    // ask for the missing txes right away, the peer answers with a fluffy block
+    // which only carries those, so the prefilled ones have to go to the pool now
+    MDEBUG("We are missing " << need_tx_indices.size() << " txes for compact block " << arg.block_hash);
+    NOTIFY_REQUEST_FLUFFY_MISSING_TX::request missing_tx_req;
+    missing_tx_req.block_hash = arg.block_hash;
+    missing_tx_req.current_blockchain_height = arg.current_blockchain_height;
+    missing_tx_req.missing_tx_indices = std::move(need_tx_indices);
+    post_notify<NOTIFY_REQUEST_FLUFFY_MISSING_TX>(missing_tx_req, context);
+
+    for(size_t i = 0; i < arg.prefilled_txs.size(); ++i)
+    {
+      if(m_core.pool_has_tx(new_block.tx_hashes[arg.prefilled_tx_indices[i]]))
+        continue;
+      cryptonote::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      if(!m_core.handle_incoming_tx(arg.prefilled_txs[i], tvc, true, true, false) || tvc.m_verifivation_failed)
+      {
+        LOG_PRINT_CCONTEXT_L1("Block verification failed: transaction verification failed, dropping connection");
+        drop_connection(context, false, false);
+        return 1;
+      }
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_notify_compressed(int command, NOTIFY_COMPRESSED::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_COMPRESSED (command " << arg.command << ", " << arg.data.size() << " -> " << arg.size << " bytes)");
+    // 0 is for commands which may not be compressed at all, including NOTIFY_COMPRESSED itself
+    const size_t max_size = payload_compression::max_decompressed_size(arg.command);
+    if(max_size == 0)
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_COMPRESSED with command " << arg.command << " which may not be compressed, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    std::string blob;
+    if(!payload_compression::decompress(arg.data, arg.size, max_size, blob))
+    {
+      LOG_ERROR_CCONTEXT("sent invalid or oversized NOTIFY_COMPRESSED, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+    arg.data.clear();
+
+    std::string blob_out;
+    bool handled = false;
+    handle_invoke_map(true, arg.command, blob, blob_out, context, handled);
+    if(!handled)
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_COMPRESSED with unknown command " << arg.command << ", dropping connection");
+      drop_connection(context, false, false);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_cryptonote_protocol_handler<t_core>::handle_request_get_objects(int command, NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote_connection_context& context)
   {
     MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_GET_OBJECTS (" << arg.blocks.size() << " blocks, " << arg.txs.size() << " txes)");
@@ -1301,6 +1540,7 @@ skip:
     // we try for that span too if:
     //  - we're substantially faster, or:
     //  - we're the fastest and the other one isn't (avoids a peer being waaaay slow but yet unmeasured)
+    //  - the other one is well past the time its measured rate says it should take, and we're faster
     //  - the other one asked at least 5 seconds ago
     if (span_speed < .25 && speed > .75f)
     {
@@ -1313,6 +1553,11 @@ skip:
       return true;
     }
     const boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    if (speed > span_speed && m_block_queue.is_span_late(span_connection_id, span.second, request_time, now))
+    {
+      MDEBUG(context << " we should download it as it is late given the other peer's rate, and we're faster");
+      return true;
+    }
     if ((now - request_time).total_microseconds() > REQUEST_NEXT_SCHEDULED_SPAN_THRESHOLD)
     {
       MDEBUG(context << " we should download it as this span was requested long ago");
@@ -1400,7 +1645,7 @@ skip:
       NOTIFY_REQUEST_GET_OBJECTS::request req;
       bool is_next = false;
       size_t count = 0;
-      const size_t count_limit = m_core.get_block_sync_size(m_core.get_current_blockchain_height());
+      const size_t count_limit = m_block_queue.get_span_size(context.m_connection_id, m_core.get_block_sync_size(m_core.get_current_blockchain_height()), BLOCKS_SYNCHRONIZING_MAX_COUNT, m_core.get_fixed_block_sync_size());
       std::pair<uint64_t, uint64_t> span = std::make_pair(0, 0);
       {
         MDEBUG(context << " checking for gap");
@@ -1586,6 +1831,88 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::request_block_headers(cryptonote_connection_context& context)
+  {
+    // one request in flight per peer, the next one is sent when it is answered
+    if (!context.m_requested_headers.empty() || context.m_needed_objects.empty())
+      return true;
+
+    uint32_t support_flags = 0;
+    m_p2p->for_connection(context.m_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t f)->bool{
+      support_flags = f;
+      return true;
+    });
+    if (!(support_flags & P2P_SUPPORT_FLAG_BLOCK_HEADERS))
+      return true;
+
+    // skip the headers we already have, possibly from another peer
+    const uint64_t known = m_core.get_known_block_headers_count(context.m_needed_objects);
+    if (known >= context.m_needed_objects.size())
+      return true;
+
+    NOTIFY_REQUEST_BLOCK_HEADERS::request req;
+    const size_t count = std::min<size_t>(context.m_needed_objects.size() - known, BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT);
+    req.blocks.assign(context.m_needed_objects.begin() + known, context.m_needed_objects.begin() + known + count);
+    context.m_requested_headers = req.blocks;
+    LOG_PRINT_CCONTEXT_L1("-->>NOTIFY_REQUEST_BLOCK_HEADERS: blocks.size()=" << req.blocks.size() << ", first hash " << req.blocks.front());
+    return post_notify<NOTIFY_REQUEST_BLOCK_HEADERS>(req, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_request_block_headers(int command, NOTIFY_REQUEST_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_REQUEST_BLOCK_HEADERS (" << arg.blocks.size() << " blocks)");
+    if (arg.blocks.size() > BLOCK_HEADERS_SYNCHRONIZING_MAX_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("Requested block headers count is too big (" << arg.blocks.size() << "), dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
+    // we answer with the headers we have, up to the first block we do not have
+    NOTIFY_RESPONSE_BLOCK_HEADERS::request rsp;
+    m_core.get_block_hashing_blobs(arg.blocks, rsp.headers);
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_BLOCK_HEADERS: headers.size()=" << rsp.headers.size());
+    post_notify<NOTIFY_RESPONSE_BLOCK_HEADERS>(rsp, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_cryptonote_protocol_handler<t_core>::handle_response_block_headers(int command, NOTIFY_RESPONSE_BLOCK_HEADERS::request& arg, cryptonote_connection_context& context)
+  {
+    MLOG_P2P_MESSAGE("Received NOTIFY_RESPONSE_BLOCK_HEADERS (" << arg.headers.size() << " headers)");
+    if (context.m_requested_headers.empty() || arg.headers.size() > context.m_requested_headers.size())
+    {
+      LOG_ERROR_CCONTEXT("sent unrequested block headers, dropping connection");
+      drop_connection(context, true, false);
+      return 1;
+    }
+
+    std::vector<crypto::hash> ids;
+    ids.swap(context.m_requested_headers);
+    const bool complete = arg.headers.size() == ids.size();
+    ids.resize(arg.headers.size());
+
+    uint64_t nvalid = 0;
+    if (!m_core.prevalidate_block_headers(ids, arg.headers, nvalid))
+    {
+      // the blocks this peer sent us are likely bad too, don't bother adding them
+      LOG_ERROR_CCONTEXT("sent invalid block headers, dropping connection");
+      drop_connection(context, true, true);
+      return 1;
+    }
+    MDEBUG(context << " " << nvalid << "/" << ids.size() << " block headers checked");
+
+    // keep ahead of the block bodies while this peer keeps up
+    if (complete && !request_block_headers(context))
+    {
+      LOG_ERROR_CCONTEXT("Failed to request block headers, dropping connection");
+      drop_connection(context, false, false);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::on_connection_synchronized()
   {
     bool val_expected = false;
@@ -1661,6 +1988,13 @@ skip:
     }
     context.m_last_response_height -= arg.m_block_ids.size() - n_use_blocks;
 
+    if (!request_block_headers(context))
+    {
+      LOG_ERROR_CCONTEXT("Failed to request block headers, dropping connection");
+      drop_connection(context, false, false);
+      return 1;
+    }
+
     if (!request_missing_objects(context, false))
     {
       LOG_ERROR_CCONTEXT("Failed to request missing objects, dropping connection");
@@ -1683,13 +2017,18 @@ skip:
     fluffy_arg.b = arg.b;
     fluffy_arg.b.txs = fluffy_txs;
 
-    // sort peers between fluffy ones and others
-    std::list<boost::uuids::uuid> fullConnections, fluffyConnections;
-    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    // sort peers between compact, fluffy ones and others
+    std::list<boost::uuids::uuid> fullConnections, fluffyConnections, compactConnections;
+    m_p2p->for_each_connection([this, &exclude_context, &fullConnections, &fluffyConnections, &compactConnections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
     {
       if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
       {
-        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
+        if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_COMPACT_BLOCKS))
+        {
+          LOG_DEBUG_CC(context, "PEER SUPPORTS COMPACT BLOCKS - RELAYING COMPACT BLOCK");
+          compactConnections.push_back(context.m_connection_id);
+        }
+        else if(m_core.fluffy_blocks_enabled() && (support_flags & P2P_SUPPORT_FLAG_FLUFFY_BLOCKS))
         {
           LOG_DEBUG_CC(context, "PEER SUPPORTS FLUFFY BLOCKS - RELAYING THIN/COMPACT WHATEVER BLOCK");
           fluffyConnections.push_back(context.m_connection_id);
@@ -1703,7 +2042,9 @@ skip:
       return true;
     });
 
-    // send fluffy ones first, we want to encourage people to run that
+    // send compact and fluffy ones first, we want to encourage people to run that
+    if (!compactConnections.empty() && !relay_compact_block(arg, compactConnections))
+      fluffyConnections.splice(fluffyConnections.end(), compactConnections);
     if (!fluffyConnections.empty())
     {
       std::string fluffyBlob;
@@ -1721,12 +2062,262 @@ skip:
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::post_notify_blob(int command, const std::string& blob, cryptonote_connection_context& context)
+  {
+    uint32_t support_flags = 0;
+    if (blob.size() >= m_payload_compression.get_threshold() && blob.size() <= payload_compression::max_decompressed_size(command))
+    {
+      m_p2p->for_connection(context.m_connection_id, [&](cryptonote_connection_context& ctx, nodetool::peerid_type peer_id, uint32_t f)->bool{
+        support_flags = f;
+        return true;
+      });
+    }
+    if (support_flags & P2P_SUPPORT_FLAG_COMPRESSION)
+    {
+      NOTIFY_COMPRESSED::request req;
+      req.command = command;
+      req.size = blob.size();
+      if (m_payload_compression.compress(blob, context.m_current_speed_up, req.data))
+      {
+        MDEBUG(context << " compressed command " << command << " from " << blob.size() << " to " << req.data.size() << " bytes");
+        std::string compressed_blob;
+        epee::serialization::store_t_to_binary(req, compressed_blob);
+        return m_p2p->invoke_notify_to_peer(NOTIFY_COMPRESSED::ID, compressed_blob, context);
+      }
+    }
+    return m_p2p->invoke_notify_to_peer(command, blob, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_cryptonote_protocol_handler<t_core>::relay_compact_block(const NOTIFY_NEW_BLOCK::request& arg, const std::list<boost::uuids::uuid> &connections)
+  {
+    block b;
+    if(!parse_and_validate_block_from_blob(arg.b.block, b))
+    {
+      MERROR("Failed to parse block to relay as compact block");
+      return false;
+    }
+
+    NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+    compact_arg.block_hash = get_block_hash(b);
+    compact_arg.current_blockchain_height = arg.current_blockchain_height;
+    compact_arg.short_id_nonce = crypto::rand<uint64_t>();
+    const short_tx_ids sids(compact_arg.block_hash, compact_arg.short_id_nonce);
+    std::vector<short_tx_ids::short_id> ids;
+    ids.reserve(b.tx_hashes.size());
+    for(const crypto::hash &tx_hash: b.tx_hashes)
+      ids.push_back(sids.get(tx_hash));
+    short_tx_ids::pack(ids, compact_arg.short_ids);
+    const std::vector<crypto::hash> tx_hashes = std::move(b.tx_hashes);
+    b.tx_hashes.clear();
+    compact_arg.block = t_serializable_object_to_blob(b);
+
+    std::unordered_map<crypto::hash, const blobdata*> tx_blobs;
+    for(const blobdata &tx_blob: arg.b.txs)
+    {
+      transaction tx;
+      crypto::hash tx_hash, tx_prefix_hash;
+      if(parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
+        tx_blobs[tx_hash] = &tx_blob;
+    }
+
+    // send along the txes a peer isn't known to have, so it does not need
+    // to ask for them. Peers which need the same ones get the same blob.
+    std::map<std::vector<uint64_t>, std::list<boost::uuids::uuid>> groups;
+    for(const boost::uuids::uuid &connection: connections)
+    {
+      std::vector<uint64_t> prefill;
+      for(size_t i = 0; i < tx_hashes.size(); ++i)
+        if(tx_blobs.count(tx_hashes[i]) && !m_tx_relay_queue.is_known(connection, tx_hashes[i]))
+          prefill.push_back(i);
+      groups[std::move(prefill)].push_back(connection);
+    }
+    for(const auto &group: groups)
+    {
+      compact_arg.prefilled_tx_indices = group.first;
+      compact_arg.prefilled_txs.clear();
+      for(uint64_t idx: group.first)
+        compact_arg.prefilled_txs.push_back(*tx_blobs[tx_hashes[idx]]);
+      std::string compactBlob;
+      epee::serialization::store_t_to_binary(compact_arg, compactBlob);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, compactBlob, group.second);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   bool t_cryptonote_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, cryptonote_connection_context& exclude_context)
   {
-    // no check for success, so tell core they're relayed unconditionally
-    for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end(); ++tx_blob_it)
-      m_core.on_transaction_relayed(*tx_blob_it);
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+    std::vector<tx_relay_queue::tx_entry> txs;
+    txs.reserve(arg.txs.size());
+    for (const cryptonote::blobdata &tx_blob: arg.txs)
+    {
+      // no check for success, so tell core they're relayed unconditionally
+      m_core.on_transaction_relayed(tx_blob);
+
+      cryptonote::transaction tx;
+      crypto::hash tx_hash, tx_prefix_hash;
+      if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
+      {
+        LOG_ERROR("Failed to parse tx to relay");
+        continue;
+      }
+      txs.push_back({tx_hash, tx_blob.size()});
+    }
+
+    std::vector<boost::uuids::uuid> connections;
+    m_p2p->for_each_connection([&exclude_context, &connections](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      if (peer_id && exclude_context.m_connection_id != context.m_connection_id)
+        connections.push_back(context.m_connection_id);
+      return true;
+    });
+
+    // queued, to be sent in a batch by tx_relay_worker
+    m_tx_relay_queue.add_txs(txs, connections, exclude_context.m_connection_id);
+    if (!m_tx_relay_thread.joinable())
+      flush_tx_relay_queue();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::flush_tx_relay_queue()
+  {
+    std::map<boost::uuids::uuid, std::vector<tx_relay_queue::tx_entry>> pending;
+    m_tx_relay_queue.take_pending(pending);
+    if (pending.empty())
+      return;
+
+    // connections with the same txes queued get the same message, so it is
+    // only serialized once. Usually, that's all of them.
+    struct relay_group
+    {
+      std::vector<crypto::hash> txids;
+      uint64_t bytes;
+      std::list<boost::uuids::uuid> connections;
+    };
+    std::map<std::string, relay_group> announce_groups, full_groups;
+    m_p2p->for_each_connection([&](connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags)
+    {
+      const auto i = pending.find(context.m_connection_id);
+      if (i == pending.end())
+        return true;
+      std::string key;
+      key.reserve(i->second.size() * sizeof(crypto::hash));
+      for (const auto &tx: i->second)
+        key.append(tx.txid.data, sizeof(tx.txid.data));
+      auto &groups = (support_flags & P2P_SUPPORT_FLAG_TX_ANNOUNCE) ? announce_groups : full_groups;
+      auto g = groups.find(key);
+      if (g == groups.end())
+      {
+        g = groups.emplace(std::move(key), relay_group()).first;
+        g->second.bytes = 0;
+        for (const auto &tx: i->second)
+        {
+          g->second.txids.push_back(tx.txid);
+          g->second.bytes += tx.blob_size;
+        }
+      }
+      g->second.connections.push_back(context.m_connection_id);
+      return true;
+    });
+
+    for (const auto &g: announce_groups)
+    {
+      const relay_group &group = g.second;
+      for (size_t offset = 0; offset < group.txids.size(); offset += P2P_TX_RELAY_MAX_HASHES)
+      {
+        NOTIFY_NEW_TRANSACTION_HASHES::request req;
+        req.tx_hashes.assign(group.txids.begin() + offset, group.txids.begin() + std::min<size_t>(group.txids.size(), offset + P2P_TX_RELAY_MAX_HASHES));
+        std::string blob;
+        epee::serialization::store_t_to_binary(req, blob);
+        m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTION_HASHES::ID, blob, group.connections);
+      }
+      m_tx_relay_queue.on_announced(group.connections, group.txids, group.bytes);
+    }
+
+    std::unordered_map<crypto::hash, cryptonote::blobdata> tx_blobs;
+    for (const auto &g: full_groups)
+    {
+      const relay_group &group = g.second;
+      NOTIFY_NEW_TRANSACTIONS::request req;
+      uint64_t bytes = 0;
+      for (const crypto::hash &txid: group.txids)
+      {
+        auto i = tx_blobs.find(txid);
+        if (i == tx_blobs.end())
+        {
+          cryptonote::blobdata tx_blob;
+          if (!m_core.get_pool_transaction(txid, tx_blob))
+            continue; // mined or dropped in the meantime
+          i = tx_blobs.emplace(txid, std::move(tx_blob)).first;
+        }
+        req.txs.push_back(i->second);
+        bytes += i->second.size();
+      }
+      if (req.txs.empty())
+        continue;
+      std::string blob;
+      epee::serialization::store_t_to_binary(req, blob);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, blob, group.connections);
+      m_tx_relay_queue.on_sent(req.txs.size() * group.connections.size(), bytes * group.connections.size(), false);
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::retry_tx_requests()
+  {
+    std::map<boost::uuids::uuid, std::vector<crypto::hash>> retries;
+    std::vector<boost::uuids::uuid> failed;
+    m_tx_relay_queue.retry_requests(retries, failed, [this](const crypto::hash &txid) { return m_core.pool_has_tx(txid); });
+
+    for (const auto &r: retries)
+    {
+      m_p2p->for_connection(r.first, [&](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+        NOTIFY_REQUEST_TRANSACTIONS::request req;
+        req.tx_hashes = r.second;
+        LOG_DEBUG_CC(context, "-->>NOTIFY_REQUEST_TRANSACTIONS: " << req.tx_hashes.size() << " txes not sent by another peer");
+        post_notify<NOTIFY_REQUEST_TRANSACTIONS>(req, context);
+        return true;
+      });
+    }
+
+    for (const boost::uuids::uuid &conn_id: failed)
+    {
+      m_p2p->for_connection(conn_id, [this](cryptonote_connection_context& context, nodetool::peerid_type peer_id, uint32_t support_flags) {
+        LOG_PRINT_CCONTEXT_L1("Too many announced txes not sent when asked, dropping connection");
+        drop_connection(context, true, false);
+        return true;
+      });
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_cryptonote_protocol_handler<t_core>::tx_relay_worker()
+  {
+    MDEBUG("Tx relay thread started");
+    try
+    {
+      while (!m_stopping)
+      {
+        // jittered, so the timing of relays says less about where txes came from
+        const uint64_t delay = P2P_TX_RELAY_FLUSH_INTERVAL_MS / 2 + crypto::rand<uint64_t>() % P2P_TX_RELAY_FLUSH_INTERVAL_MS;
+        boost::this_thread::sleep_for(boost::chrono::milliseconds(delay));
+        try
+        {
+          flush_tx_relay_queue();
+          retry_tx_requests();
+        }
+        catch (const std::exception &e)
+        {
+          MERROR("Failed to relay txes: " << e.what());
+        }
+      }
+    }
+    catch (const boost::thread_interrupted&)
+    {
+    }
+    MDEBUG("Tx relay thread stopped");
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
@@ -1760,6 +2351,8 @@ skip:
     }
 
     m_block_queue.flush_spans(context.m_connection_id, false);
+    m_block_queue.remove_peer_rate(context.m_connection_id);
+    m_tx_relay_queue.on_connection_close(context.m_connection_id);
   }
 
   //------------------------------------------------------------------------------------------------------------------------
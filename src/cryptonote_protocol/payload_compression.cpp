@@ -0,0 +1,215 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <chrono>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#include "misc_language.h"
+#include "common/util.h"
+#include "cryptonote_config.h"
+#include "cryptonote_protocol_defs.h"
+#include "payload_compression.h"
+
+#define RATIO_WEIGHT 0.3f
+#define POOR_RATIO 0.9f
+#define GOOD_RATIO 0.5f
+#define SLOW_RATE_FACTOR 4     // compressing slower than 4x the link: lower the level
+#define FAST_RATE_FACTOR 16    // compressing faster than 16x the link: raise the level
+#define MIN_LEVEL 1
+#define MAX_LEVEL 9
+#define SAMPLE_INTERVAL 16     // one in that many payloads under the threshold is compressed anyway
+#define INFLATE_CHUNK_SIZE (64*1024)
+
+namespace cryptonote
+{
+
+payload_compression::payload_compression(unsigned max_jobs):
+  m_max_jobs(max_jobs ? max_jobs : std::max(1u, tools::get_max_concurrency())),
+  m_jobs(0),
+  m_below_threshold(0),
+  m_threshold(P2P_COMPRESSION_DEFAULT_THRESHOLD),
+  m_level(P2P_COMPRESSION_DEFAULT_LEVEL),
+  m_ratio(0.0f),
+  m_stats({0, 0, 0})
+{
+}
+
+bool payload_compression::compress_with_level(const std::string &blob, int level, std::string &out)
+{
+#ifdef HAVE_ZLIB
+  uLongf size = compressBound(blob.size());
+  out.resize(size);
+  if (::compress2((Bytef*)&out[0], &size, (const Bytef*)blob.data(), blob.size(), level) != Z_OK)
+    return false;
+  out.resize(size);
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool payload_compression::decompress(const std::string &blob, size_t size, size_t max_size, std::string &out)
+{
+#ifdef HAVE_ZLIB
+  out.clear();
+  if (size > max_size || size / P2P_COMPRESSION_MAX_RATIO > blob.size())
+    return false;
+
+  // inflate in chunks so memory follows what the data really expands to,
+  // not what the peer claims it will
+  z_stream stream = {};
+  if (::inflateInit(&stream) != Z_OK)
+    return false;
+  auto cleanup = epee::misc_utils::create_scope_leave_handler([&stream](){ ::inflateEnd(&stream); });
+  stream.next_in = (Bytef*)blob.data();
+  stream.avail_in = blob.size();
+  int r = Z_OK;
+  while (r == Z_OK)
+  {
+    const size_t done = out.size();
+    // one spare byte so data expanding past size is caught
+    const size_t chunk = std::min<size_t>(size + 1 - done, INFLATE_CHUNK_SIZE);
+    if (chunk == 0)
+      return false;
+    out.resize(done + chunk);
+    stream.next_out = (Bytef*)&out[done];
+    stream.avail_out = chunk;
+    r = ::inflate(&stream, Z_NO_FLUSH);
+    out.resize(done + chunk - stream.avail_out);
+    if (r == Z_BUF_ERROR && stream.avail_out != 0)
+      return false;
+    if (r == Z_BUF_ERROR)
+      r = Z_OK;
+  }
+  return r == Z_STREAM_END && stream.avail_in == 0 && out.size() == size;
+#else
+  return false;
+#endif
+}
+
+size_t payload_compression::max_decompressed_size(int command)
+{
+  switch (command)
+  {
+    case NOTIFY_RESPONSE_GET_OBJECTS::ID:
+    case NOTIFY_RESPONSE_CHAIN_ENTRY::ID:
+    case NOTIFY_RESPONSE_BLOCK_HEADERS::ID:
+      return P2P_DEFAULT_PACKET_MAX_SIZE;
+    case NOTIFY_NEW_BLOCK::ID:
+    case NOTIFY_NEW_FLUFFY_BLOCK::ID:
+    case NOTIFY_NEW_COMPACT_BLOCK::ID:
+    case NOTIFY_NEW_TRANSACTIONS::ID:
+      return P2P_COMPRESSION_MAX_NOTIFY_SIZE;
+    case NOTIFY_REQUEST_GET_OBJECTS::ID:
+    case NOTIFY_REQUEST_CHAIN::ID:
+    case NOTIFY_REQUEST_FLUFFY_MISSING_TX::ID:
+    case NOTIFY_NEW_TRANSACTION_HASHES::ID:
+    case NOTIFY_REQUEST_TRANSACTIONS::ID:
+    case NOTIFY_REQUEST_BLOCK_HEADERS::ID:
+      return P2P_COMPRESSION_MAX_REQUEST_SIZE;
+    default:
+      return 0;
+  }
+}
+
+bool payload_compression::compress(const std::string &blob, uint64_t link_rate, std::string &out)
+{
+  if (blob.size() < P2P_COMPRESSION_MIN_THRESHOLD)
+    return false;
+  // the threshold can only come back down if smaller payloads get measured now and then
+  if (blob.size() < get_threshold() && ++m_below_threshold % SAMPLE_INTERVAL != 0)
+    return false;
+
+  // no headroom left if every core is already compressing
+  const unsigned jobs = ++m_jobs;
+  auto job = epee::misc_utils::create_scope_leave_handler([this](){ --m_jobs; });
+  if (jobs > m_max_jobs)
+    return false;
+  const int level = jobs > m_max_jobs / 2 ? MIN_LEVEL : get_level();
+
+  const auto start = std::chrono::steady_clock::now();
+  const bool r = compress_with_level(blob, level, out);
+  const uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+  if (!r)
+    return false;
+  update(level, blob.size(), out.size(), usec, link_rate);
+  // peers refuse anything expanding more than that, send it as is
+  if (out.size() >= blob.size() || blob.size() / P2P_COMPRESSION_MAX_RATIO > out.size())
+    return false;
+
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  ++m_stats.messages;
+  m_stats.bytes_in += blob.size();
+  m_stats.bytes_out += out.size();
+  return true;
+}
+
+void payload_compression::update(int level, size_t size, size_t compressed_size, uint64_t usec, uint64_t link_rate)
+{
+  if (size == 0)
+    return;
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+
+  const float ratio = compressed_size / (float)size;
+  m_ratio = m_ratio == 0.0f ? ratio : m_ratio * (1.0f - RATIO_WEIGHT) + ratio * RATIO_WEIGHT;
+  if (m_ratio > POOR_RATIO)
+    m_threshold = std::min<size_t>(m_threshold * 2, P2P_COMPRESSION_MAX_THRESHOLD);
+  else if (m_ratio < GOOD_RATIO)
+    m_threshold = std::max<size_t>(m_threshold / 2, P2P_COMPRESSION_MIN_THRESHOLD);
+
+  // only levels actually picked by the policy say anything about m_level
+  if (link_rate == 0 || level != m_level)
+    return;
+  const uint64_t rate = size * 1000000 / std::max<uint64_t>(usec, 1);
+  if (rate < link_rate * SLOW_RATE_FACTOR)
+    m_level = std::max(m_level - 1, MIN_LEVEL);
+  else if (rate > link_rate * FAST_RATE_FACTOR)
+    m_level = std::min(m_level + 1, MAX_LEVEL);
+}
+
+size_t payload_compression::get_threshold() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_threshold;
+}
+
+int payload_compression::get_level() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_level;
+}
+
+payload_compression::stats payload_compression::get_stats() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  return m_stats;
+}
+
+}
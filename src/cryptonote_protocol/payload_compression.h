@@ -0,0 +1,82 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <boost/thread/mutex.hpp>
+
+namespace cryptonote
+{
+  /**
+   * @brief compresses large p2p payloads when it pays off
+   *
+   * The size threshold and compression level adapt to what is measured:
+   * the threshold goes up while payloads do not shrink much and back down
+   * while the smaller ones it samples do, the level goes
+   * down while compressing is not much faster than the peer's link, and
+   * payloads are sent as is when all cores are already busy compressing.
+   */
+  class payload_compression
+  {
+  public:
+    struct stats
+    {
+      uint64_t messages;
+      uint64_t bytes_in;
+      uint64_t bytes_out;
+    };
+
+    explicit payload_compression(unsigned max_jobs = 0);
+
+    //! returns false if blob should be sent uncompressed, link_rate in bytes/second or 0 if unknown
+    bool compress(const std::string &blob, uint64_t link_rate, std::string &out);
+    //! fails without allocating more than needed if blob expands to anything but size, or size is over max_size or the max ratio
+    static bool decompress(const std::string &blob, size_t size, size_t max_size, std::string &out);
+    //! largest payload a peer may send compressed for this command, 0 if it may not be compressed
+    static size_t max_decompressed_size(int command);
+
+    static bool compress_with_level(const std::string &blob, int level, std::string &out);
+    void update(int level, size_t size, size_t compressed_size, uint64_t usec, uint64_t link_rate);
+
+    size_t get_threshold() const;
+    int get_level() const;
+    stats get_stats() const;
+
+  private:
+    mutable boost::mutex m_mutex;
+    const unsigned m_max_jobs;
+    std::atomic<unsigned> m_jobs;
+    std::atomic<unsigned> m_below_threshold;
+    size_t m_threshold;
+    int m_level;
+    float m_ratio;
+    stats m_stats;
+  };
+}
@@ -0,0 +1,104 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <string.h>
+#include "common/int-util.h"
+#include "short_tx_ids.h"
+
+namespace cryptonote
+{
+
+short_tx_ids::short_tx_ids(const crypto::hash &block_hash, uint64_t nonce)
+{
+  char buf[sizeof(crypto::hash) + sizeof(uint64_t)];
+  memcpy(buf, &block_hash, sizeof(crypto::hash));
+  nonce = SWAP64LE(nonce);
+  memcpy(buf + sizeof(crypto::hash), &nonce, sizeof(nonce));
+  crypto::cn_fast_hash(buf, sizeof(buf), m_key);
+}
+
+short_tx_ids::short_id short_tx_ids::get(const crypto::hash &txid) const
+{
+  char buf[2 * sizeof(crypto::hash)];
+  memcpy(buf, &m_key, sizeof(m_key));
+  memcpy(buf + sizeof(crypto::hash), &txid, sizeof(txid));
+  crypto::hash h;
+  crypto::cn_fast_hash(buf, sizeof(buf), h);
+  short_id id = 0;
+  for (size_t n = 0; n < SHORT_ID_SIZE; ++n)
+    id |= ((short_id)(uint8_t)h.data[n]) << (8 * n);
+  return id;
+}
+
+void short_tx_ids::pack(const std::vector<short_id> &ids, std::string &blob)
+{
+  blob.resize(ids.size() * SHORT_ID_SIZE);
+  char *ptr = &blob[0];
+  for (short_id id: ids)
+  {
+    for (size_t n = 0; n < SHORT_ID_SIZE; ++n)
+      *ptr++ = (char)(id >> (8 * n));
+  }
+}
+
+bool short_tx_ids::unpack(const std::string &blob, std::vector<short_id> &ids)
+{
+  if (blob.size() % SHORT_ID_SIZE)
+    return false;
+  ids.resize(blob.size() / SHORT_ID_SIZE);
+  const char *ptr = blob.data();
+  for (short_id &id: ids)
+  {
+    id = 0;
+    for (size_t n = 0; n < SHORT_ID_SIZE; ++n)
+      id |= ((short_id)(uint8_t)*ptr++) << (8 * n);
+  }
+  return true;
+}
+
+short_tx_id_index::short_tx_id_index(const short_tx_ids &ids, const std::vector<crypto::hash> &txids)
+{
+  m_index.reserve(txids.size());
+  for (const crypto::hash &txid: txids)
+  {
+    auto res = m_index.emplace(ids.get(txid), std::make_pair(txid, true));
+    if (!res.second && res.first->second.first != txid)
+      res.first->second.second = false;
+  }
+}
+
+bool short_tx_id_index::find(short_tx_ids::short_id id, crypto::hash &txid) const
+{
+  const auto i = m_index.find(id);
+  if (i == m_index.end() || !i->second.second)
+    return false;
+  txid = i->second.first;
+  return true;
+}
+
+}
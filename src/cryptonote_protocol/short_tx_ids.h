@@ -0,0 +1,80 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief short transaction ids for compact blocks
+   *
+   * A compact block refers to its transactions by 6 byte ids rather than
+   * their full hash. The ids are keyed by the block hash and a nonce picked
+   * by the sender, so colliding transactions cannot be crafted ahead of time
+   * and an accidental collision does not repeat with the next peer.
+   */
+  class short_tx_ids
+  {
+  public:
+    typedef uint64_t short_id;
+    static constexpr size_t SHORT_ID_SIZE = 6;
+
+    short_tx_ids(const crypto::hash &block_hash, uint64_t nonce);
+
+    short_id get(const crypto::hash &txid) const;
+
+    static void pack(const std::vector<short_id> &ids, std::string &blob);
+    static bool unpack(const std::string &blob, std::vector<short_id> &ids);
+
+  private:
+    crypto::hash m_key;
+  };
+
+  /**
+   * @brief finds transactions by their short id
+   *
+   * Ids shared by several of the transactions indexed are not found, the
+   * caller has to get those transactions some other way.
+   */
+  class short_tx_id_index
+  {
+  public:
+    short_tx_id_index(const short_tx_ids &ids, const std::vector<crypto::hash> &txids);
+
+    bool find(short_tx_ids::short_id id, crypto::hash &txid) const;
+    size_t size() const { return m_index.size(); }
+
+  private:
+    std::unordered_map<short_tx_ids::short_id, std::pair<crypto::hash, bool>> m_index;
+  };
+}
@@ -0,0 +1,304 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include <boost/uuid/nil_generator.hpp>
+#include "tx_relay_queue.h"
+
+#define MAX_ANNOUNCERS 8  // per requested tx, peers to fall back on
+
+namespace cryptonote
+{
+
+tx_relay_queue::tx_relay_queue(size_t max_known_txs, time_t request_timeout, size_t max_requested_txs, size_t max_undelivered_txs):
+  m_max_known_txs(max_known_txs),
+  m_request_timeout(request_timeout),
+  m_max_requested_txs(max_requested_txs),
+  m_max_undelivered_txs(max_undelivered_txs),
+  m_stats()
+{
+}
+
+void tx_relay_queue::on_connection_open(const boost::uuids::uuid &connection)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  peer_state &peer = m_peers[connection];
+  peer.requested = 0;
+  peer.undelivered = 0;
+}
+
+void tx_relay_queue::add_known(peer_state &peer, const crypto::hash &txid)
+{
+  if (!peer.known.insert(txid).second)
+    return;
+  peer.known_order.push_back(txid);
+  while (peer.known_order.size() > m_max_known_txs)
+  {
+    peer.known.erase(peer.known_order.front());
+    peer.known_order.pop_front();
+  }
+}
+
+void tx_relay_queue::add_announced(peer_state &peer, const crypto::hash &txid)
+{
+  add_known(peer, txid);
+  if (!peer.announced.insert(txid).second)
+    return;
+  peer.announced_order.push_back(txid);
+  while (peer.announced_order.size() > m_max_known_txs)
+  {
+    peer.announced.erase(peer.announced_order.front());
+    peer.announced_order.pop_front();
+  }
+}
+
+void tx_relay_queue::add_request(const crypto::hash &txid, std::map<boost::uuids::uuid, peer_state>::iterator peer, std::deque<boost::uuids::uuid> announcers, time_t now)
+{
+  request_state &request = m_requested[txid];
+  request.connection = peer->first;
+  request.announcers = std::move(announcers);
+  request.expiry = m_request_expiry.emplace(now + m_request_timeout, txid);
+  ++peer->second.requested;
+}
+
+void tx_relay_queue::forget_request(std::unordered_map<crypto::hash, request_state>::iterator i)
+{
+  const auto peer = m_peers.find(i->second.connection);
+  if (peer != m_peers.end() && peer->second.requested > 0)
+    --peer->second.requested;
+  m_request_expiry.erase(i->second.expiry);
+  m_requested.erase(i);
+}
+
+void tx_relay_queue::add_txs(const std::vector<tx_entry> &txs, const std::vector<boost::uuids::uuid> &connections, const boost::uuids::uuid &source)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  // connections may have closed since they were listed, those are not re-added
+  const auto src = m_peers.find(source);
+  for (const tx_entry &tx: txs)
+  {
+    const auto i = m_requested.find(tx.txid);
+    if (i == m_requested.end())
+      continue;
+    if (src != m_peers.end() && i->second.connection == source && src->second.undelivered > 0)
+      --src->second.undelivered;
+    forget_request(i);
+  }
+
+  if (src != m_peers.end())
+  {
+    for (const tx_entry &tx: txs)
+      add_known(src->second, tx.txid);
+  }
+
+  for (const boost::uuids::uuid &connection: connections)
+  {
+    if (connection == source)
+      continue;
+    const auto i = m_peers.find(connection);
+    if (i == m_peers.end())
+      continue;
+    peer_state &peer = i->second;
+    for (const tx_entry &tx: txs)
+    {
+      if (peer.known.find(tx.txid) != peer.known.end())
+      {
+        m_stats.bytes_known += tx.blob_size;
+        continue;
+      }
+      add_known(peer, tx.txid);
+      peer.queue.push_back(tx);
+      ++m_stats.txs_queued;
+    }
+  }
+}
+
+void tx_relay_queue::take_pending(std::map<boost::uuids::uuid, std::vector<tx_entry>> &pending)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  pending.clear();
+  for (auto &peer: m_peers)
+  {
+    if (peer.second.queue.empty())
+      continue;
+    pending[peer.first] = std::move(peer.second.queue);
+    peer.second.queue.clear();
+  }
+}
+
+void tx_relay_queue::on_txs_announced(const boost::uuids::uuid &connection, const std::vector<crypto::hash> &txids)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  const auto i = m_peers.find(connection);
+  if (i == m_peers.end())
+    return;
+  for (const crypto::hash &txid: txids)
+    add_known(i->second, txid);
+}
+
+void tx_relay_queue::request_txs(const boost::uuids::uuid &connection, std::vector<crypto::hash> &txids, time_t now)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  const auto peer = m_peers.find(connection);
+  if (peer == m_peers.end())
+  {
+    txids.clear();
+    return;
+  }
+  txids.erase(std::remove_if(txids.begin(), txids.end(), [&](const crypto::hash &txid) {
+    const auto i = m_requested.find(txid);
+    if (i != m_requested.end())
+    {
+      // asked from another peer already, this one is a fallback
+      std::deque<boost::uuids::uuid> &announcers = i->second.announcers;
+      if (i->second.connection != connection && announcers.size() < MAX_ANNOUNCERS &&
+          std::find(announcers.begin(), announcers.end(), connection) == announcers.end())
+        announcers.push_back(connection);
+      return true;
+    }
+    if (peer->second.requested >= m_max_requested_txs)
+      return true;
+    add_request(txid, peer, {}, now);
+    return false;
+  }), txids.end());
+}
+
+void tx_relay_queue::retry_requests(std::map<boost::uuids::uuid, std::vector<crypto::hash>> &retries, std::vector<boost::uuids::uuid> &failed,
+    const std::function<bool(const crypto::hash&)> &have_tx, time_t now)
+{
+  retries.clear();
+  failed.clear();
+
+  struct expired_request
+  {
+    crypto::hash txid;
+    boost::uuids::uuid connection;
+    std::deque<boost::uuids::uuid> announcers;
+    bool have;
+  };
+  std::vector<expired_request> expired;
+  {
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    while (!m_request_expiry.empty() && m_request_expiry.begin()->first <= now)
+    {
+      const auto i = m_requested.find(m_request_expiry.begin()->second);
+      expired.push_back({i->first, i->second.connection, std::move(i->second.announcers), false});
+      forget_request(i);
+    }
+  }
+  if (expired.empty())
+    return;
+
+  // not under the lock, have_tx may well lock the pool
+  for (expired_request &e: expired)
+    e.have = have_tx(e.txid);
+
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  for (expired_request &e: expired)
+  {
+    if (e.have)
+      continue;
+    const auto peer = m_peers.find(e.connection);
+    if (peer != m_peers.end() && ++peer->second.undelivered == m_max_undelivered_txs)
+      failed.push_back(e.connection);
+    // announced again in the meantime, and asked already
+    if (m_requested.find(e.txid) != m_requested.end())
+      continue;
+    while (!e.announcers.empty())
+    {
+      const boost::uuids::uuid connection = e.announcers.front();
+      e.announcers.pop_front();
+      const auto next = m_peers.find(connection);
+      if (next == m_peers.end() || next->second.requested >= m_max_requested_txs)
+        continue;
+      add_request(e.txid, next, std::move(e.announcers), now);
+      retries[connection].push_back(e.txid);
+      break;
+    }
+  }
+}
+
+bool tx_relay_queue::is_known(const boost::uuids::uuid &connection, const crypto::hash &txid) const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  const auto i = m_peers.find(connection);
+  if (i == m_peers.end())
+    return false;
+  return i->second.known.find(txid) != i->second.known.end();
+}
+
+bool tx_relay_queue::was_announced(const boost::uuids::uuid &connection, const crypto::hash &txid) const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  const auto i = m_peers.find(connection);
+  if (i == m_peers.end())
+    return false;
+  return i->second.announced.find(txid) != i->second.announced.end();
+}
+
+void tx_relay_queue::on_announced(const std::list<boost::uuids::uuid> &connections, const std::vector<crypto::hash> &txids, uint64_t bytes)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  for (const boost::uuids::uuid &connection: connections)
+  {
+    const auto i = m_peers.find(connection);
+    if (i == m_peers.end())
+      continue;
+    for (const crypto::hash &txid: txids)
+      add_announced(i->second, txid);
+  }
+  m_stats.txs_announced += txids.size() * connections.size();
+  m_stats.bytes_announced += bytes * connections.size();
+}
+
+void tx_relay_queue::on_sent(size_t ntxs, uint64_t bytes, bool requested)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  m_stats.txs_sent += ntxs;
+  if (requested)
+    m_stats.bytes_requested += bytes;
+}
+
+void tx_relay_queue::on_connection_close(const boost::uuids::uuid &connection)
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  m_peers.erase(connection);
+}
+
+tx_relay_queue::stats tx_relay_queue::get_stats() const
+{
+  boost::unique_lock<boost::mutex> lock(m_mutex);
+  stats s = m_stats;
+  // what was announced but never asked for did not need sending
+  s.duplicate_bytes_avoided = s.bytes_known;
+  if (s.bytes_announced > s.bytes_requested)
+    s.duplicate_bytes_avoided += s.bytes_announced - s.bytes_requested;
+  return s;
+}
+
+}
@@ -0,0 +1,179 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/uuid/uuid.hpp>
+#include "crypto/hash.h"
+
+namespace cryptonote
+{
+  /**
+   * @brief bookkeeping for the batched transaction relay
+   *
+   * Transactions accepted for relay are queued per connection rather than
+   * sent right away, and the queues are flushed together every so often.
+   * Peers which support it only get the hashes, and ask for the ones they
+   * do not have. Each connection remembers the transactions it is known
+   * to have (it sent or announced them to us, or we announced them to it),
+   * so they are not queued for it again. Announced transactions are asked
+   * from one peer at a time, and from the next one which announced them if
+   * the first does not send them in time.
+   */
+  class tx_relay_queue
+  {
+  public:
+    struct tx_entry
+    {
+      crypto::hash txid;
+      size_t blob_size;
+    };
+
+    struct stats
+    {
+      uint64_t txs_queued;                //!< transactions queued, counting once per connection
+      uint64_t txs_announced;             //!< transaction hashes sent to peers
+      uint64_t txs_sent;                  //!< transaction blobs sent, in full or on request
+      uint64_t bytes_announced;           //!< size of the transactions announced
+      uint64_t bytes_requested;           //!< size of the transactions sent on request
+      uint64_t bytes_known;               //!< size of the transactions not queued because the peer had them
+      uint64_t duplicate_bytes_avoided;   //!< transaction bytes not sent to peers which already had them
+    };
+
+    tx_relay_queue(size_t max_known_txs, time_t request_timeout, size_t max_requested_txs, size_t max_undelivered_txs);
+
+    /**
+     * @brief starts tracking a connection, others are ignored
+     */
+    void on_connection_open(const boost::uuids::uuid &connection);
+
+    /**
+     * @brief queues transactions for the given connections
+     *
+     * The transactions are marked as known to the source connection, which
+     * may be nil. They are no longer waited for if they were requested.
+     */
+    void add_txs(const std::vector<tx_entry> &txs, const std::vector<boost::uuids::uuid> &connections, const boost::uuids::uuid &source);
+
+    /**
+     * @brief moves the queued transactions out, by connection
+     */
+    void take_pending(std::map<boost::uuids::uuid, std::vector<tx_entry>> &pending);
+
+    /**
+     * @brief records transactions announced by a peer as known to it
+     */
+    void on_txs_announced(const boost::uuids::uuid &connection, const std::vector<crypto::hash> &txids);
+
+    /**
+     * @brief filters out transactions already requested from a peer recently
+     *
+     * The remaining ones are recorded as requested from the connection,
+     * unless it has too many requests outstanding already. The filtered out
+     * ones will be asked from it if the peer they were asked from first
+     * does not deliver.
+     */
+    void request_txs(const boost::uuids::uuid &connection, std::vector<crypto::hash> &txids, time_t now = time(NULL));
+
+    /**
+     * @brief moves requests which timed out to the next peer which announced them
+     *
+     * Transactions have_tx says we got in the meantime are not asked again.
+     * The others count against the peer which did not send them, and those
+     * which failed to send too many are returned in failed.
+     */
+    void retry_requests(std::map<boost::uuids::uuid, std::vector<crypto::hash>> &retries, std::vector<boost::uuids::uuid> &failed,
+        const std::function<bool(const crypto::hash&)> &have_tx, time_t now = time(NULL));
+
+    /**
+     * @brief whether a connection is known to have a transaction
+     */
+    bool is_known(const boost::uuids::uuid &connection, const crypto::hash &txid) const;
+
+    /**
+     * @brief whether a connection may ask us for a transaction
+     *
+     * Only transactions we announced to it may be asked for, those it
+     * announced to us itself may not.
+     */
+    bool was_announced(const boost::uuids::uuid &connection, const crypto::hash &txid) const;
+
+    /**
+     * @brief records transaction hashes sent to peers
+     */
+    void on_announced(const std::list<boost::uuids::uuid> &connections, const std::vector<crypto::hash> &txids, uint64_t bytes);
+    void on_sent(size_t ntxs, uint64_t bytes, bool requested);
+
+    void on_connection_close(const boost::uuids::uuid &connection);
+    stats get_stats() const;
+
+  private:
+    struct peer_state
+    {
+      std::vector<tx_entry> queue;
+      std::unordered_set<crypto::hash> known;
+      std::deque<crypto::hash> known_order;
+      std::unordered_set<crypto::hash> announced;   //!< hashes we sent it, a subset of known
+      std::deque<crypto::hash> announced_order;
+      size_t requested;     //!< transactions asked from it and not received yet
+      size_t undelivered;   //!< transactions it did not send when asked, less those it did
+    };
+
+    struct request_state
+    {
+      boost::uuids::uuid connection;
+      std::deque<boost::uuids::uuid> announcers;  //!< other peers to ask, in turn
+      std::multimap<time_t, crypto::hash>::iterator expiry;
+    };
+
+    void add_known(peer_state &peer, const crypto::hash &txid);
+    void add_announced(peer_state &peer, const crypto::hash &txid);
+    void add_request(const crypto::hash &txid, std::map<boost::uuids::uuid, peer_state>::iterator peer, std::deque<boost::uuids::uuid> announcers, time_t now);
+    void forget_request(std::unordered_map<crypto::hash, request_state>::iterator i);
+
+  private:
+    mutable boost::mutex m_mutex;
+    size_t m_max_known_txs;
+    time_t m_request_timeout;
+    size_t m_max_requested_txs;
+    size_t m_max_undelivered_txs;
+    std::map<boost::uuids::uuid, peer_state> m_peers;
+    std::unordered_map<crypto::hash, request_state> m_requested;
+    std::multimap<time_t, crypto::hash> m_request_expiry;
+    stats m_stats;
+  };
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <map>
+#include <boost/thread/mutex.hpp>
+#include "net/net_utils_base.h"
+#include "p2p_protocol_defs.h"
+
+namespace nodetool
+{
+  /************************************************************************/
+  /*  Which peer ids and outgoing addresses currently have a connection,  */
+  /*  so the node does not have to walk every connection to find out.     */
+  /************************************************************************/
+  class connection_index
+  {
+  public:
+    void add_outgoing(const epee::net_utils::network_address& addr)
+    {
+      boost::mutex::scoped_lock lock(m_lock);
+      ++m_outgoing[addr];
+    }
+
+    void remove_outgoing(const epee::net_utils::network_address& addr)
+    {
+      boost::mutex::scoped_lock lock(m_lock);
+      remove(m_outgoing, addr);
+    }
+
+    void add_peer(peerid_type id)
+    {
+      if (!id)
+        return;
+      boost::mutex::scoped_lock lock(m_lock);
+      ++m_peers[id];
+    }
+
+    void remove_peer(peerid_type id)
+    {
+      if (!id)
+        return;
+      boost::mutex::scoped_lock lock(m_lock);
+      remove(m_peers, id);
+    }
+
+    bool has_outgoing(const epee::net_utils::network_address& addr) const
+    {
+      boost::mutex::scoped_lock lock(m_lock);
+      return m_outgoing.find(addr) != m_outgoing.end();
+    }
+
+    bool is_used(peerid_type id, const epee::net_utils::network_address& addr) const
+    {
+      boost::mutex::scoped_lock lock(m_lock);
+      return (id && m_peers.find(id) != m_peers.end()) || m_outgoing.find(addr) != m_outgoing.end();
+    }
+
+  private:
+    template<typename Map, typename Key>
+    static void remove(Map& map, const Key& key)
+    {
+      auto it = map.find(key);
+      if (it != map.end() && --it->second == 0)
+        map.erase(it);
+    }
+
+    mutable boost::mutex m_lock;
+    std::map<epee::net_utils::network_address, unsigned> m_outgoing;
+    std::map<peerid_type, unsigned> m_peers;
+  };
+}
@@ -43,6 +43,7 @@
 #include "p2p_protocol_defs.h"
 #include "storages/levin_abstract_invoke2.h"
 #include "net_peerlist.h"
+#include "net_connection_index.h"
 #include "math_helper.h"
 #include "net_node_common.h"
 #include "common/command_line.h"
@@ -120,6 +121,8 @@ namespace nodetool
     m_offline(false),
     m_save_graph(false),
     is_closing(false),
+    m_peerlist_journal_records(0),
+    m_peerlist_snapshot_needed(true),
     m_net_server( epee::net_utils::e_connection_type_P2P ) // this is a P2P connection of the main p2p node server, because this is class node_server<>
     {}
     virtual ~node_server()
@@ -281,6 +284,8 @@ namespace nodetool
     bool make_default_peer_id();
     bool make_default_config();
     bool store_config();
+    bool store_peerlist_journal(const std::vector<peerlist_journal_entry>& journal);
+    void set_connection_peer_id(p2p_connection_context& context, peerid_type peer_id);
     bool check_trust(const proof_of_trust& tr);
     //----------------- levin_commands_handler -------------------------------------------------------------
     virtual void on_connection_new(p2p_connection_context& context);
@@ -496,10 +501,15 @@ namespace nodetool
 
     t_payload_net_handler& m_payload_handler;
     peerlist_manager m_peerlist;
+    connection_index m_connection_index;
+    // records appended to the peerlist journal since the last full snapshot
+    size_t m_peerlist_journal_records;
+    bool m_peerlist_snapshot_needed;
 
     epee::math_helper::once_a_time_seconds<P2P_DEFAULT_HANDSHAKE_INTERVAL> m_peer_handshake_idle_maker_interval;
     epee::math_helper::once_a_time_seconds<1> m_connections_maker_interval;
-    epee::math_helper::once_a_time_seconds<60*30, false> m_peerlist_store_interval;
+    // mostly journal appends, so this can run much more often than a full rewrite would
+    epee::math_helper::once_a_time_seconds<60*5, false> m_peerlist_store_interval;
     epee::math_helper::once_a_time_seconds<60> m_gray_peerlist_housekeeping_interval;
     epee::math_helper::once_a_time_seconds<900, false> m_incoming_connections_interval;
 
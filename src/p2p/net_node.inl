@@ -41,6 +41,7 @@
 #include <atomic>
 #include <random>
 #include <boost/algorithm/string/join.hpp> // for logging
+#include <boost/serialization/vector.hpp>
 
 #include "version.h"
 #include "string_tools.h"
@@ -214,6 +215,28 @@ namespace nodetool
       make_default_config();
     }
 
+    // peerlist changes saved after that snapshot, the next store compacts them into a new one
+    std::ifstream journal_data;
+    journal_data.open(state_file_path + ".journal", std::ios_base::binary | std::ios_base::in);
+    size_t journal_records = 0;
+    while(!journal_data.fail() && journal_data.peek() != std::ifstream::traits_type::eof())
+    {
+      try
+      {
+        std::vector<peerlist_journal_entry> journal;
+        boost::archive::portable_binary_iarchive a(journal_data);
+        a >> journal;
+        m_peerlist.apply_journal(journal);
+        journal_records += journal.size();
+      }
+      catch (const std::exception &e)
+      {
+        MWARNING("Failed to load p2p peerlist journal, ignoring the rest of it: " << e.what());
+        break;
+      }
+    }
+    MDEBUG("Loaded " << journal_records << " peerlist journal records");
+
     // always recreate a new peer id
     make_default_peer_id();
 
@@ -808,6 +831,17 @@ namespace nodetool
       return false;
     }
 
+    // changes since the last store, given back to the peerlist unless they are written
+    std::vector<peerlist_journal_entry> journal;
+    m_peerlist.get_journal(journal);
+    bool stored = false;
+    auto restore_journal = epee::misc_utils::create_scope_leave_handler([&](){ if (!stored) m_peerlist.restore_journal(journal); });
+    if (store_peerlist_journal(journal))
+    {
+      stored = true;
+      return true;
+    }
+
     std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
     std::ofstream p2p_data;
     p2p_data.open( state_file_path , std::ios_base::binary | std::ios_base::out| std::ios::trunc);
@@ -817,8 +851,22 @@ namespace nodetool
       return false;
     };
 
-    boost::archive::portable_binary_oarchive a(p2p_data);
-    a << *this;
+    {
+      boost::archive::portable_binary_oarchive a(p2p_data);
+      a << *this;
+    }
+    p2p_data.close();
+    if(p2p_data.fail())
+    {
+      MWARNING("Failed to save config to file " << state_file_path);
+      return false;
+    }
+
+    // everything in the journal is in the snapshot now
+    std::ofstream journal_data(state_file_path + ".journal", std::ios_base::binary | std::ios_base::out | std::ios::trunc);
+    m_peerlist_journal_records = 0;
+    m_peerlist_snapshot_needed = false;
+    stored = true;
     return true;
     CATCH_ENTRY_L0("blockchain_storage::save", false);
 
@@ -826,6 +874,41 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::store_peerlist_journal(const std::vector<peerlist_journal_entry>& journal)
+  {
+    // replaying more than about half the peerlist costs more than rewriting it
+    const size_t peers = m_peerlist.get_white_peers_count() + m_peerlist.get_gray_peers_count();
+    if (m_peerlist_snapshot_needed || m_peerlist_journal_records + journal.size() > peers / 2)
+      return false;
+    if (journal.empty())
+      return true;
+
+    std::string journal_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME + ".journal";
+    std::ofstream journal_data;
+    journal_data.open(journal_file_path, std::ios_base::binary | std::ios_base::out | std::ios::app);
+    if(journal_data.fail())
+    {
+      MWARNING("Failed to append to peerlist journal " << journal_file_path);
+      return false;
+    }
+    // a partly written record can't be replayed, a snapshot has to replace it
+    m_peerlist_snapshot_needed = true;
+    {
+      boost::archive::portable_binary_oarchive a(journal_data);
+      a << journal;
+    }
+    journal_data.close();
+    if(journal_data.fail())
+    {
+      MWARNING("Failed to append to peerlist journal " << journal_file_path);
+      return false;
+    }
+    m_peerlist_snapshot_needed = false;
+    m_peerlist_journal_records += journal.size();
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::send_stop_signal()
   {
     MDEBUG("[node] sending stop signal");
@@ -1418,7 +1501,8 @@ namespace nodetool
           return;
         }
 
-        pi = context.peer_id = rsp.node_data.peer_id;
+        set_connection_peer_id(context, rsp.node_data.peer_id);
+        pi = rsp.node_data.peer_id;
         m_peerlist.set_peer_just_seen(rsp.node_data.peer_id, context.m_remote_address);
 
         if(rsp.node_data.peer_id == m_config.m_peer_id)
@@ -1510,18 +1594,7 @@ namespace nodetool
     if(m_config.m_peer_id == peer.id)
       return true;//dont make connections to ourself
 
-    bool used = false;
-    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
-    {
-      if(cntxt.peer_id == peer.id || (!cntxt.m_is_income && peer.adr == cntxt.m_remote_address))
-      {
-        used = true;
-        return false;//stop enumerating
-      }
-      return true;
-    });
-
-    return used;
+    return m_connection_index.is_used(peer.id, peer.adr);
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
@@ -1531,38 +1604,13 @@ namespace nodetool
         return true;//dont make connections to ourself
     }
 
-    bool used = false;
-
-    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
-    {
-      if(cntxt.peer_id == peer.id || (!cntxt.m_is_income && peer.adr == cntxt.m_remote_address))
-      {
-        used = true;
-
-        return false;//stop enumerating
-      }
-
-      return true;
-    });
-
-    return used;
+    return m_connection_index.is_used(peer.id, peer.adr);
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_addr_connected(const epee::net_utils::network_address& peer)
   {
-    bool connected = false;
-    m_net_server.get_config_object().foreach_connection([&](const p2p_connection_context& cntxt)
-    {
-      if(!cntxt.m_is_income && peer == cntxt.m_remote_address)
-      {
-        connected = true;
-        return false;//stop enumerating
-      }
-      return true;
-    });
-
-    return connected;
+    return m_connection_index.has_outgoing(peer);
   }
 
 #define LOG_PRINT_CC_PRIORITY_NODE(priority, con, msg) \
@@ -1752,38 +1800,33 @@ namespace nodetool
 
     size_t max_random_index = std::min<uint64_t>(local_peers_count -1, 20);
 
-    std::set<size_t> tried_peers;
+    std::set<epee::net_utils::network_address> tried_peers;
 
     size_t try_count = 0;
     size_t rand_count = 0;
     while(rand_count < (max_random_index+1)*3 &&  try_count < 10 && !m_net_server.is_stop_signal_sent())
     {
       ++rand_count;
-      size_t random_index;
+      peerlist_entry pe = AUTO_VAL_INIT(pe);
 
       if (use_white_list) {
         local_peers_count = m_peerlist.get_white_peers_count();
         if (!local_peers_count)
           return false;
         max_random_index = std::min<uint64_t>(local_peers_count -1, 20);
-        random_index = get_random_index_with_fixed_probability(max_random_index);
+        size_t random_index = get_random_index_with_fixed_probability(max_random_index);
+        CHECK_AND_ASSERT_MES(random_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
+        bool r = m_peerlist.get_white_peer_by_index(pe, random_index);
+        CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
       } else {
-        local_peers_count = m_peerlist.get_gray_peers_count();
-        if (!local_peers_count)
+        // spread over address buckets, so one network can not fill our gray connections
+        if (!m_peerlist.get_random_gray_peer(pe))
           return false;
-        random_index = crypto::rand<size_t>() % local_peers_count;
       }
 
-      CHECK_AND_ASSERT_MES(random_index < local_peers_count, false, "random_starter_index < peers_local.size() failed!!");
-
-      if(tried_peers.count(random_index))
+      if(!tried_peers.insert(pe.adr).second)
         continue;
 
-      tried_peers.insert(random_index);
-      peerlist_entry pe = AUTO_VAL_INIT(pe);
-      bool r = use_white_list ? m_peerlist.get_white_peer_by_index(pe, random_index):m_peerlist.get_gray_peer_by_index(pe, random_index);
-      CHECK_AND_ASSERT_MES(r, false, "Failed to get random peer from peerlist(white:" << use_white_list << ")");
-
       ++try_count;
 
       _note("Considering connecting (out) to peer: " << peerid_to_string(pe.id) << " " << pe.adr.str());
@@ -2196,9 +2239,11 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid> &connections)
   {
+    // build the message once, all connections queue the same bytes
+    const epee::byte_slice message = epee::levin::make_notify(command, data_buff);
     for(const auto& c_id: connections)
     {
-      m_net_server.get_config_object().notify(command, data_buff, c_id);
+      m_net_server.get_config_object().send(message, c_id);
     }
     return true;
   }
@@ -2407,7 +2452,7 @@ namespace nodetool
     }
 
     //associate peer_id with this connection
-    context.peer_id = arg.node_data.peer_id;
+    set_connection_peer_id(context, arg.node_data.peer_id);
     context.m_in_timedsync = false;
 
     if(arg.node_data.peer_id != m_config.m_peer_id && arg.node_data.my_port)
@@ -2521,9 +2566,10 @@ namespace nodetool
 
 
     // same as 'relay_notify_to_list' does but we also need a) populate announced_peers and b) some extra logging
+    const epee::byte_slice message = epee::levin::make_notify(COMMAND_SUPERNODE_ANNOUNCE::ID, blob);
     for (const auto &c: random_connections) {
         MTRACE("[" << c.info << "] invoking COMMAND_SUPERNODE_ANNOUCE");
-        if (m_net_server.get_config_object().notify(COMMAND_SUPERNODE_ANNOUNCE::ID, blob, c.id)) {
+        if (m_net_server.get_config_object().send(message, c.id)) {
             MTRACE("[" << c.info << "] COMMAND_SUPERNODE_ANNOUCE invoked, peer_id: " << c.peer_id);
             announced_peers.insert(c.peer_id);
 
@@ -2633,9 +2679,10 @@ namespace nodetool
           return true;
       });
 
+      const epee::byte_slice message = epee::levin::make_notify(COMMAND_BROADCAST::ID, blob);
       for (const auto &c: connections) {
           MTRACE("[" << c.info << "] invoking COMMAND_BROADCAST");
-          if (m_net_server.get_config_object().notify(COMMAND_BROADCAST::ID, blob, c.id)) {
+          if (m_net_server.get_config_object().send(message, c.id)) {
               MTRACE("[" << c.info << "] COMMAND_BROADCAST invoked, peer_id: " << c.peer_id);
               announced_peers.insert(c.peer_id);
           }
@@ -2851,6 +2898,8 @@ namespace nodetool
   template<class t_payload_net_handler>
   void node_server<t_payload_net_handler>::on_connection_new(p2p_connection_context& context)
   {
+    if (!context.m_is_income)
+      m_connection_index.add_outgoing(context.m_remote_address);
     MINFO("["<< epee::net_utils::print_connection_context(context) << "] NEW CONNECTION");
   }
   //-----------------------------------------------------------------------------------
@@ -2864,11 +2913,23 @@ namespace nodetool
       m_peerlist.remove_from_peer_anchor(na);
     }
 
+    if (!context.m_is_income)
+      m_connection_index.remove_outgoing(context.m_remote_address);
+    m_connection_index.remove_peer(context.peer_id);
+
     m_payload_handler.on_connection_close(context);
 
     MINFO("["<< epee::net_utils::print_connection_context(context) << "] CLOSE CONNECTION");
   }
 
+  template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::set_connection_peer_id(p2p_connection_context& context, peerid_type peer_id)
+  {
+    m_connection_index.remove_peer(context.peer_id);
+    context.peer_id = peer_id;
+    m_connection_index.add_peer(peer_id);
+  }
+  //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_priority_node(const epee::net_utils::network_address& na)
   {
@@ -33,6 +33,9 @@
 #include <list>
 #include <set>
 #include <map>
+#include <unordered_map>
+#include <vector>
+#include <boost/version.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/archive/portable_binary_oarchive.hpp>
 #include <boost/archive/portable_binary_iarchive.hpp>
@@ -42,7 +45,14 @@
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index/identity.hpp>
 #include <boost/multi_index/member.hpp>
+#include <boost/multi_index/global_fun.hpp>
 #include <boost/range/adaptor/reversed.hpp>
+#if BOOST_VERSION >= 105900
+#include <boost/multi_index/ranked_index.hpp>
+#define PEERLIST_RANKED_INDEX boost::multi_index::ranked_non_unique
+#else
+#define PEERLIST_RANKED_INDEX boost::multi_index::ordered_non_unique
+#endif
 
 
 #include "syncobj.h"
@@ -56,7 +66,39 @@
 
 namespace nodetool
 {
+  //! the /16 of IPv4 addresses, so peers can be picked evenly across networks rather than hosts
+  inline uint32_t get_address_bucket(const peerlist_entry& pe)
+  {
+    if (pe.adr.get_type_id() != epee::net_utils::ipv4_network_address::ID)
+      return 1 << 16;
+    const uint32_t ip = pe.adr.as<epee::net_utils::ipv4_network_address>().ip(); // network byte order
+    const uint8_t *bytes = reinterpret_cast<const uint8_t*>(&ip);
+    return (uint32_t(bytes[0]) << 8) | bytes[1];
+  }
+
+  //! the state of one address after some peerlist changes, appended to the peerlist journal
+  struct peerlist_journal_entry
+  {
+    enum list_type: uint8_t { none = 0, white = 1, gray = 2 };
 
+    epee::net_utils::network_address adr;
+    uint8_t list;
+    peerlist_entry peer;
+    bool anchor;
+    anchor_peerlist_entry anchor_peer;
+
+    template <class Archive, class t_version_type>
+    void serialize(Archive &a, const t_version_type ver)
+    {
+      a & adr;
+      a & list;
+      if (list != none)
+        a & peer;
+      a & anchor;
+      if (anchor)
+        a & anchor_peer;
+    }
+  };
 
   /************************************************************************/
   /*                                                                      */
@@ -84,11 +126,17 @@ namespace nodetool
     bool get_and_empty_anchor_peerlist(std::vector<anchor_peerlist_entry>& apl);
     bool remove_from_peer_anchor(const epee::net_utils::network_address& addr);
     bool find_peer(peerid_type id, peerlist_entry& pe);
+    //! moves the state of every address changed since the last call to journal
+    void get_journal(std::vector<peerlist_journal_entry>& journal);
+    //! marks the addresses of a journal which could not be stored as changed again
+    void restore_journal(const std::vector<peerlist_journal_entry>& journal);
+    void apply_journal(const std::vector<peerlist_journal_entry>& journal);
     
   private:
     struct by_time{};
     struct by_id{};
     struct by_addr{};
+    struct by_bucket{};
 
     struct modify_all_but_id
     {
@@ -129,8 +177,12 @@ namespace nodetool
       boost::multi_index::indexed_by<
       // access by peerlist_entry::net_adress
       boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,epee::net_utils::network_address,&peerlist_entry::adr> >,
-      // sort by peerlist_entry::last_seen<
-      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >
+      // sort by peerlist_entry::last_seen<, with access by position
+      PEERLIST_RANKED_INDEX<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,int64_t,&peerlist_entry::last_seen> >,
+      // access by peerlist_entry::id
+      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_id>, boost::multi_index::member<peerlist_entry,uint64_t,&peerlist_entry::id> >,
+      // group by address bucket, with access by position
+      PEERLIST_RANKED_INDEX<boost::multi_index::tag<by_bucket>, boost::multi_index::global_fun<const peerlist_entry&,uint32_t,&get_address_bucket> >
       > 
     > peers_indexed;
 
@@ -201,12 +253,30 @@ namespace nodetool
       serialize_peers(a, m_peers_gray, peerlist_entry(), ver);
       serialize_peers(a, m_peers_anchor, anchor_peerlist_entry(), ver);
 #endif
+      if (!typename Archive::is_saving())
+        rebuild_gray_buckets();
     }
 
   private: 
     bool peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi);
     void trim_white_peerlist();
     void trim_gray_peerlist();
+    void insert_gray(const peerlist_entry& pe);
+    void erase_gray(const epee::net_utils::network_address& addr);
+    void add_gray_bucket(uint32_t bucket);
+    void remove_gray_bucket(uint32_t bucket);
+    void rebuild_gray_buckets();
+
+    template<typename Index>
+    static typename Index::iterator get_nth(Index& index, typename Index::iterator first, size_t n)
+    {
+#if BOOST_VERSION >= 105900
+      return index.nth(index.rank(first) + n);
+#else
+      std::advance(first, n);
+      return first;
+#endif
+    }
 
     friend class boost::serialization::access;
     epee::critical_section m_peerlist_lock;
@@ -217,6 +287,13 @@ namespace nodetool
     peers_indexed m_peers_gray;
     peers_indexed m_peers_white;
     anchor_peers_indexed m_peers_anchor;
+
+    // distinct gray address buckets, and each one's position in that list and peer count
+    std::vector<uint32_t> m_gray_buckets;
+    std::unordered_map<uint32_t, std::pair<size_t, size_t>> m_gray_bucket_info;
+
+    // addresses changed since the last get_journal
+    std::set<epee::net_utils::network_address> m_journal;
   };
   //--------------------------------------------------------------------------------------------------
   inline
@@ -252,7 +329,7 @@ namespace nodetool
     while(m_peers_gray.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
     {
       peers_indexed::index<by_time>::type& sorted_index=m_peers_gray.get<by_time>();
-      sorted_index.erase(sorted_index.begin());
+      erase_gray(sorted_index.begin()->adr);
     }
   }
   //--------------------------------------------------------------------------------------------------
@@ -261,10 +338,60 @@ namespace nodetool
     while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
     {
       peers_indexed::index<by_time>::type& sorted_index=m_peers_white.get<by_time>();
+      m_journal.insert(sorted_index.begin()->adr);
       sorted_index.erase(sorted_index.begin());
     }
   }
   //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::insert_gray(const peerlist_entry& pe)
+  {
+    if (m_peers_gray.insert(pe).second)
+      add_gray_bucket(get_address_bucket(pe));
+    m_journal.insert(pe.adr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::erase_gray(const epee::net_utils::network_address& addr)
+  {
+    auto it = m_peers_gray.get<by_addr>().find(addr);
+    if (it == m_peers_gray.get<by_addr>().end())
+      return;
+    remove_gray_bucket(get_address_bucket(*it));
+    m_journal.insert(addr);
+    m_peers_gray.get<by_addr>().erase(it);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::add_gray_bucket(uint32_t bucket)
+  {
+    auto &info = m_gray_bucket_info[bucket];
+    if (info.second++ == 0)
+    {
+      info.first = m_gray_buckets.size();
+      m_gray_buckets.push_back(bucket);
+    }
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::remove_gray_bucket(uint32_t bucket)
+  {
+    auto it = m_gray_bucket_info.find(bucket);
+    if (it == m_gray_bucket_info.end() || --it->second.second)
+      return;
+    // swap with the last bucket to keep the list dense
+    const size_t pos = it->second.first;
+    const uint32_t last = m_gray_buckets.back();
+    m_gray_buckets[pos] = last;
+    m_gray_bucket_info[last].first = pos;
+    m_gray_buckets.pop_back();
+    m_gray_bucket_info.erase(bucket);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::rebuild_gray_buckets()
+  {
+    m_gray_buckets.clear();
+    m_gray_bucket_info.clear();
+    for (const auto &pe: m_peers_gray)
+      add_gray_bucket(get_address_bucket(pe));
+  }
+  //--------------------------------------------------------------------------------------------------
   inline 
   bool peerlist_manager::merge_peerlist(const std::list<peerlist_entry>& outer_bs)
   {
@@ -286,7 +413,7 @@ namespace nodetool
       return false;
 
     peers_indexed::index<by_time>::type& by_time_index = m_peers_white.get<by_time>();
-    p = *epee::misc_utils::move_it_backward(--by_time_index.end(), i);    
+    p = *get_nth(by_time_index, by_time_index.begin(), by_time_index.size() - 1 - i);
     return true;
   }
   //--------------------------------------------------------------------------------------------------
@@ -298,7 +425,7 @@ namespace nodetool
       return false;
 
     peers_indexed::index<by_time>::type& by_time_index = m_peers_gray.get<by_time>();
-    p = *epee::misc_utils::move_it_backward(--by_time_index.end(), i);    
+    p = *get_nth(by_time_index, by_time_index.begin(), by_time_index.size() - 1 - i);
     return true;
   }
   //--------------------------------------------------------------------------------------------------
@@ -378,6 +505,7 @@ namespace nodetool
      CRITICAL_REGION_LOCAL(m_peerlist_lock);
     //find in white list
     auto by_addr_it_wt = m_peers_white.get<by_addr>().find(ple.adr);
+    m_journal.insert(ple.adr);
     if(by_addr_it_wt == m_peers_white.get<by_addr>().end())
     {
       //put new record into white list
@@ -389,11 +517,7 @@ namespace nodetool
       m_peers_white.replace(by_addr_it_wt, ple);      
     }
     //remove from gray list, if need
-    auto by_addr_it_gr = m_peers_gray.get<by_addr>().find(ple.adr);
-    if(by_addr_it_gr != m_peers_gray.get<by_addr>().end())
-    {
-      m_peers_gray.erase(by_addr_it_gr);
-    }
+    erase_gray(ple.adr);
     return true;
     CATCH_ENTRY_L0("peerlist_manager::append_with_peer_white()", false);
   }
@@ -416,12 +540,13 @@ namespace nodetool
     if(by_addr_it_gr == m_peers_gray.get<by_addr>().end())
     {
       //put new record into white list
-      m_peers_gray.insert(ple);
+      insert_gray(ple);
       trim_gray_peerlist();    
     }else
     {
-      //update record in white list 
+      //update record in white list, the address and so its bucket stay the same
       m_peers_gray.replace(by_addr_it_gr, ple);      
+      m_journal.insert(ple.adr);
     }
     return true;
     CATCH_ENTRY_L0("peerlist_manager::append_with_peer_gray()", false);
@@ -438,6 +563,7 @@ namespace nodetool
 
     if(by_addr_it_anchor == m_peers_anchor.get<by_addr>().end()) {
       m_peers_anchor.insert(ple);
+      m_journal.insert(ple.adr);
     }
 
     return true;
@@ -456,10 +582,12 @@ namespace nodetool
       return false;
     }
 
-    size_t random_index = crypto::rand<size_t>() % m_peers_gray.size();
-
-    peers_indexed::index<by_time>::type& by_time_index = m_peers_gray.get<by_time>();
-    pe = *epee::misc_utils::move_it_backward(--by_time_index.end(), random_index);
+    // pick a bucket first, so networks with many peers are not favoured
+    const uint32_t bucket = m_gray_buckets[crypto::rand<size_t>() % m_gray_buckets.size()];
+    const size_t bucket_size = m_gray_bucket_info[bucket].second;
+    peers_indexed::index<by_bucket>::type& by_bucket_index = m_peers_gray.get<by_bucket>();
+    // the index is not unique, so start from the bucket's first peer
+    pe = *get_nth(by_bucket_index, by_bucket_index.lower_bound(bucket), crypto::rand<size_t>() % bucket_size);
 
     return true;
 
@@ -473,24 +601,21 @@ namespace nodetool
 
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
 
-    for (auto it = m_peers_white.begin(); it != m_peers_white.end(); it++) {
-        if ( (*it).id == id) {
-            pe = *it;
-            return true;
-        }
+    auto it = m_peers_white.get<by_id>().find(id);
+    if (it != m_peers_white.get<by_id>().end()) {
+        pe = *it;
+        return true;
     }
 
-    for (auto it = m_peers_gray.begin(); it != m_peers_gray.end(); it++) {
-        if ( (*it).id == id) {
-            pe = *it;
-            return true;
-        }
+    it = m_peers_gray.get<by_id>().find(id);
+    if (it != m_peers_gray.get<by_id>().end()) {
+        pe = *it;
+        return true;
     }
 
-
     return false;
 
-    CATCH_ENTRY_L0("peerlist_manager::get_random_gray_peer()", false);
+    CATCH_ENTRY_L0("peerlist_manager::find_peer()", false);
   }
   //--------------------------------------------------------------------------------------------------
   inline
@@ -500,11 +625,7 @@ namespace nodetool
 
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
 
-    peers_indexed::index_iterator<by_addr>::type iterator = m_peers_gray.get<by_addr>().find(pe.adr);
-
-    if (iterator != m_peers_gray.get<by_addr>().end()) {
-      m_peers_gray.erase(iterator);
-    }
+    erase_gray(pe.adr);
 
     return true;
 
@@ -521,8 +642,9 @@ namespace nodetool
     auto begin = m_peers_anchor.get<by_time>().begin();
     auto end = m_peers_anchor.get<by_time>().end();
 
-    std::for_each(begin, end, [&apl](const anchor_peerlist_entry &a) {
+    std::for_each(begin, end, [this, &apl](const anchor_peerlist_entry &a) {
       apl.push_back(a);
+      m_journal.insert(a.adr);
     });
 
     m_peers_anchor.get<by_time>().clear();
@@ -543,6 +665,7 @@ namespace nodetool
 
     if (iterator != m_peers_anchor.get<by_addr>().end()) {
       m_peers_anchor.erase(iterator);
+      m_journal.insert(addr);
     }
 
     return true;
@@ -550,6 +673,72 @@ namespace nodetool
     CATCH_ENTRY_L0("peerlist_manager::remove_from_peer_anchor()", false);
   }
   //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::get_journal(std::vector<peerlist_journal_entry>& journal)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+
+    journal.clear();
+    journal.reserve(m_journal.size());
+    for (const auto &addr: m_journal)
+    {
+      peerlist_journal_entry e = AUTO_VAL_INIT(e);
+      e.adr = addr;
+      e.list = peerlist_journal_entry::none;
+      auto it_wt = m_peers_white.get<by_addr>().find(addr);
+      auto it_gr = m_peers_gray.get<by_addr>().find(addr);
+      if (it_wt != m_peers_white.get<by_addr>().end())
+      {
+        e.list = peerlist_journal_entry::white;
+        e.peer = *it_wt;
+      }
+      else if (it_gr != m_peers_gray.get<by_addr>().end())
+      {
+        e.list = peerlist_journal_entry::gray;
+        e.peer = *it_gr;
+      }
+      auto it_anchor = m_peers_anchor.get<by_addr>().find(addr);
+      e.anchor = it_anchor != m_peers_anchor.get<by_addr>().end();
+      if (e.anchor)
+        e.anchor_peer = *it_anchor;
+      journal.push_back(e);
+    }
+    m_journal.clear();
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::restore_journal(const std::vector<peerlist_journal_entry>& journal)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+
+    // only the addresses, their state is read again on the next get_journal
+    for (const auto &e: journal)
+      m_journal.insert(e.adr);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline
+  void peerlist_manager::apply_journal(const std::vector<peerlist_journal_entry>& journal)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+
+    for (const auto &e: journal)
+    {
+      m_peers_white.get<by_addr>().erase(e.adr);
+      erase_gray(e.adr);
+      m_peers_anchor.get<by_addr>().erase(e.adr);
+      if (e.list == peerlist_journal_entry::white)
+        m_peers_white.insert(e.peer);
+      else if (e.list == peerlist_journal_entry::gray)
+        insert_gray(e.peer);
+      if (e.anchor)
+        m_peers_anchor.insert(e.anchor_peer);
+    }
+    trim_white_peerlist();
+    trim_gray_peerlist();
+    // this is the state already on disk
+    m_journal.clear();
+  }
+  //--------------------------------------------------------------------------------------------------
 }
 
 BOOST_CLASS_VERSION(nodetool::peerlist_manager, CURRENT_PEERLIST_STORAGE_ARCHIVE_VER)
@@ -34,6 +34,7 @@
 #include <boost/thread/mutex.hpp>
 #include "misc_log_ex.h"
 #include "common/perf_timer.h"
+#include "common/threadpool.h"
 #include "cryptonote_config.h"
 extern "C"
 {
@@ -86,6 +87,26 @@ static inline rct::key multiexp(const std::vector<MultiexpData> &data, bool HiGi
     return data.size() <= 64 ? straus(data, NULL, 0) : pippenger(data, NULL, get_pippenger_c(data.size()));
 }
 
+/* Run two independent parts of a proof, the first one on the thread pool */
+template<typename F0, typename F1>
+static void run_in_parallel(const F0 &f0, const F1 &f1)
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  std::exception_ptr e0, e1;
+  tpool.submit(&waiter, [&f0, &e0]() {
+    try { f0(); }
+    catch (...) { e0 = std::current_exception(); }
+  });
+  try { f1(); }
+  catch (...) { e1 = std::current_exception(); }
+  waiter.wait(&tpool);
+  if (e0)
+    std::rethrow_exception(e0);
+  if (e1)
+    std::rethrow_exception(e1);
+}
+
 static bool is_reduced(const rct::key &scalar)
 {
   rct::key reduced = scalar;
@@ -784,19 +805,17 @@ try_again:
   rct::key hash_cache = rct::hash_to_scalar(V);
 
   PERF_TIMER_START_BP(PROVE_step1);
-  // PAPER LINES 38-39
+  // PAPER LINES 38-42, the two commitments are the largest multiexps of the proof
   rct::key alpha = rct::skGen();
-  rct::key ve = vector_exponent(aL, aR);
-  rct::key A;
-  rct::addKeys(A, ve, rct::scalarmultBase(alpha));
-  A = rct::scalarmultKey(A, INV_EIGHT);
-
-  // PAPER LINES 40-42
   rct::keyV sL = rct::skvGen(MN), sR = rct::skvGen(MN);
   rct::key rho = rct::skGen();
-  ve = vector_exponent(sL, sR);
+  rct::key veA, veS;
+  run_in_parallel([&]() { veA = vector_exponent(aL, aR); }, [&]() { veS = vector_exponent(sL, sR); });
+  rct::key A;
+  rct::addKeys(A, veA, rct::scalarmultBase(alpha));
+  A = rct::scalarmultKey(A, INV_EIGHT);
   rct::key S;
-  rct::addKeys(S, ve, rct::scalarmultBase(rho));
+  rct::addKeys(S, veS, rct::scalarmultBase(rho));
   S = rct::scalarmultKey(S, INV_EIGHT);
 
   // PAPER LINES 43-45
@@ -919,15 +938,18 @@ try_again:
   rct::keyV aprime(MN);
   rct::keyV bprime(MN);
   const rct::key yinv = invert(y);
-  rct::key yinvpow = rct::identity();
+  const rct::keyV yinvpow = vector_powers(yinv, MN);
   for (size_t i = 0; i < MN; ++i)
   {
     Gprime[i] = Gi[i];
-    Hprime[i] = scalarmultKey(Hi_p3[i], yinvpow);
-    sc_mul(yinvpow.bytes, yinvpow.bytes, yinv.bytes);
     aprime[i] = l[i];
     bprime[i] = r[i];
   }
+  const auto scale_Hprime = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i)
+      Hprime[i] = scalarmultKey(Hi_p3[i], yinvpow[i]);
+  };
+  run_in_parallel([&]() { scale_Hprime(0, MN / 2); }, [&]() { scale_Hprime(MN / 2, MN); });
   rct::keyV L(logMN);
   rct::keyV R(logMN);
   int round = 0;
@@ -946,11 +968,12 @@ try_again:
     rct::key cR = inner_product(slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
 
     // PAPER LINES 18-19
-    L[round] = vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size()));
+    run_in_parallel(
+      [&]() { L[round] = vector_exponent_custom(slice(Gprime, nprime, Gprime.size()), slice(Hprime, 0, nprime), slice(aprime, 0, nprime), slice(bprime, nprime, bprime.size())); },
+      [&]() { R[round] = vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime)); });
     sc_mul(tmp.bytes, cL.bytes, x_ip.bytes);
     rct::addKeys(L[round], L[round], rct::scalarmultH(tmp));
     L[round] = rct::scalarmultKey(L[round], INV_EIGHT);
-    R[round] = vector_exponent_custom(slice(Gprime, 0, nprime), slice(Hprime, nprime, Hprime.size()), slice(aprime, nprime, aprime.size()), slice(bprime, 0, nprime));
     sc_mul(tmp.bytes, cR.bytes, x_ip.bytes);
     rct::addKeys(R[round], R[round], rct::scalarmultH(tmp));
     R[round] = rct::scalarmultKey(R[round], INV_EIGHT);
@@ -966,8 +989,9 @@ try_again:
 
     // PAPER LINES 24-25
     const rct::key winv = invert(w[round]);
-    Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round]));
-    Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv));
+    run_in_parallel(
+      [&]() { Gprime = hadamard2(vector_scalar2(slice(Gprime, 0, nprime), winv), vector_scalar2(slice(Gprime, nprime, Gprime.size()), w[round])); },
+      [&]() { Hprime = hadamard2(vector_scalar2(slice(Hprime, 0, nprime), w[round]), vector_scalar2(slice(Hprime, nprime, Hprime.size()), winv)); });
 
     // PAPER LINES 28-29
     aprime = vector_add(vector_scalar(slice(aprime, 0, nprime), w[round]), vector_scalar(slice(aprime, nprime, aprime.size()), winv));
@@ -772,26 +772,54 @@ namespace rct {
                     outSk[i].mask = masks[i];
                 }
             }
-            else while (amounts_proved < n_amounts)
+            else
             {
-                size_t batch_size = 1;
-                if (range_proof_type == RangeProofMultiOutputBulletproof)
-                  while (batch_size * 2 + amounts_proved <= n_amounts && batch_size * 2 <= BULLETPROOF_MAX_OUTPUTS)
-                    batch_size *= 2;
-                rct::keyV C, masks;
-                std::vector<uint64_t> batch_amounts(batch_size);
-                for (i = 0; i < batch_size; ++i)
-                  batch_amounts[i] = outamounts[i + amounts_proved];
-                rv.p.bulletproofs.push_back(proveRangeBulletproof(C, masks, batch_amounts));
-            #ifdef DBG
-                CHECK_AND_ASSERT_THROW_MES(verBulletproof(rv.p.bulletproofs.back()), "verBulletproof failed on newly created proof");
-            #endif
-                for (i = 0; i < batch_size; ++i)
+                std::vector<size_t> batch_sizes;
+                while (amounts_proved < n_amounts)
                 {
-                  rv.outPk[i + amounts_proved].mask = rct::scalarmult8(C[i]);
-                  outSk[i + amounts_proved].mask = masks[i];
+                    size_t batch_size = 1;
+                    if (range_proof_type == RangeProofMultiOutputBulletproof)
+                      while (batch_size * 2 + amounts_proved <= n_amounts && batch_size * 2 <= BULLETPROOF_MAX_OUTPUTS)
+                        batch_size *= 2;
+                    batch_sizes.push_back(batch_size);
+                    amounts_proved += batch_size;
                 }
-                amounts_proved += batch_size;
+
+                // the batches are independent proofs, build them in parallel
+                tools::threadpool& tpool = tools::threadpool::getInstance();
+                tools::threadpool::waiter waiter;
+                rv.p.bulletproofs.resize(batch_sizes.size());
+                std::vector<std::exception_ptr> errors(batch_sizes.size());
+                amounts_proved = 0;
+                for (size_t n = 0; n < batch_sizes.size(); ++n)
+                {
+                    const size_t offset = amounts_proved;
+                    tpool.submit(&waiter, [&, n, offset] {
+                        try
+                        {
+                            rct::keyV C, masks;
+                            std::vector<uint64_t> batch_amounts(outamounts.begin() + offset, outamounts.begin() + offset + batch_sizes[n]);
+                            rv.p.bulletproofs[n] = proveRangeBulletproof(C, masks, batch_amounts);
+                        #ifdef DBG
+                            CHECK_AND_ASSERT_THROW_MES(verBulletproof(rv.p.bulletproofs[n]), "verBulletproof failed on newly created proof");
+                        #endif
+                            for (size_t j = 0; j < batch_sizes[n]; ++j)
+                            {
+                              rv.outPk[j + offset].mask = rct::scalarmult8(C[j]);
+                              outSk[j + offset].mask = masks[j];
+                            }
+                        }
+                        catch (...)
+                        {
+                            errors[n] = std::current_exception();
+                        }
+                    });
+                    amounts_proved += batch_sizes[n];
+                }
+                waiter.wait(&tpool);
+                for (const std::exception_ptr &e: errors)
+                    if (e)
+                        std::rethrow_exception(e);
             }
         }
 
@@ -829,8 +857,35 @@ namespace rct {
         key full_message = get_pre_mlsag_hash(rv,hwdev);
         if (msout)
           msout->c.resize(inamounts.size());
-        for (i = 0 ; i < inamounts.size(); i++) {
-            rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i]: NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
+        if (hwdev.get_type() == hw::device::SOFTWARE && inamounts.size() > 1)
+        {
+            // each input has its own MLSAG over the same message, sign them in parallel
+            // (a hardware device keeps signing state, so it still signs one input at a time)
+            tools::threadpool& tpool = tools::threadpool::getInstance();
+            tools::threadpool::waiter waiter;
+            std::vector<std::exception_ptr> errors(inamounts.size());
+            for (i = 0 ; i < inamounts.size(); i++) {
+                tpool.submit(&waiter, [&, i] {
+                    try
+                    {
+                        rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i]: NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
+                    }
+                    catch (...)
+                    {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            waiter.wait(&tpool);
+            for (const std::exception_ptr &e: errors)
+                if (e)
+                    std::rethrow_exception(e);
+        }
+        else
+        {
+            for (i = 0 ; i < inamounts.size(); i++) {
+                rv.p.MGs[i] = proveRctMGSimple(full_message, rv.mixRing[i], inSk[i], a[i], pseudoOuts[i], kLRki ? &(*kLRki)[i]: NULL, msout ? &msout->c[i] : NULL, index[i], hwdev);
+            }
         }
         return rv;
     }
@@ -29,6 +29,9 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <functional>
+#include <iomanip>
+#include <sstream>
 #include "include_base_utils.h"
 #include "string_tools.h"
 using namespace epee;
@@ -48,6 +51,7 @@ using namespace epee;
 #include "rpc/rpc_args.h"
 #include "core_rpc_server_error_codes.h"
 #include "p2p/net_node.h"
+#include "net/network_throttle.hpp"
 #include "version.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
@@ -56,6 +60,8 @@ using namespace epee;
 #define MAX_RESTRICTED_FAKE_OUTS_COUNT 40
 #define MAX_RESTRICTED_GLOBAL_FAKE_OUTS_COUNT 5000
 
+#define BLOCK_SCAN_DATA_CACHE_SIZE 2000
+
 namespace
 {
   void add_reason(std::string &reasons, const char *reason)
@@ -64,6 +70,100 @@ namespace
       reasons += ", ";
     reasons += reason;
   }
+
+  void fill_tx_scan_data(const cryptonote::transaction &tx, const crypto::hash &tx_hash, cryptonote::COMMAND_RPC_GET_BLOCKS_SCAN_DATA::tx_scan_data &data)
+  {
+    using namespace cryptonote;
+
+    data.tx_hash = tx_hash;
+    data.version = tx.version;
+    data.unlock_time = tx.unlock_time;
+    data.rct_type = tx.version >= 2 ? tx.rct_signatures.type : (uint8_t)rct::RCTTypeNull;
+    data.fee = 0;
+    if (tx.version >= 2 && tx.rct_signatures.type != rct::RCTTypeNull)
+      data.fee = tx.rct_signatures.txnFee;
+    else if (!tx.vin.empty() && tx.vin[0].type() != typeid(txin_gen))
+      get_tx_fee(tx, data.fee);
+
+    std::vector<tx_extra_field> tx_extra_fields;
+    parse_tx_extra(tx.extra, tx_extra_fields); // ok if partially parsed
+    tx_extra_pub_key pub_key_field;
+    for (size_t i = 0; find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, i); ++i)
+      data.tx_pub_keys.push_back(pub_key_field.pub_key);
+    tx_extra_additional_pub_keys additional_pub_keys;
+    if (find_tx_extra_field_by_type(tx_extra_fields, additional_pub_keys))
+      data.additional_tx_pub_keys = std::move(additional_pub_keys.data);
+    tx_extra_nonce extra_nonce;
+    if (find_tx_extra_field_by_type(tx_extra_fields, extra_nonce))
+      data.extra_nonce = std::move(extra_nonce.nonce);
+
+    data.output_keys.reserve(tx.vout.size());
+    data.output_amounts.reserve(tx.vout.size());
+    for (const tx_out &out: tx.vout)
+    {
+      // keep outputs aligned with their indices even for types a wallet can't own
+      data.output_keys.push_back(out.target.type() == typeid(txout_to_key) ? boost::get<txout_to_key>(out.target).key : crypto::null_pkey);
+      data.output_amounts.push_back(out.amount);
+    }
+    if (data.rct_type != rct::RCTTypeNull)
+    {
+      for (const rct::ctkey &pk: tx.rct_signatures.outPk)
+        data.commitments.push_back(pk.mask);
+      for (const rct::ecdhTuple &ecdh: tx.rct_signatures.ecdhInfo)
+      {
+        data.ecdh_masks.push_back(ecdh.mask);
+        data.ecdh_amounts.push_back(ecdh.amount);
+      }
+    }
+
+    for (const txin_v &in: tx.vin)
+    {
+      if (in.type() == typeid(txin_to_key))
+      {
+        const txin_to_key &in_to_key = boost::get<txin_to_key>(in);
+        data.key_images.push_back(in_to_key.k_image);
+        data.input_amounts.push_back(in_to_key.amount);
+      }
+    }
+  }
+
+  const char *get_command_name(int command)
+  {
+    using namespace nodetool;
+    using namespace cryptonote;
+    typedef COMMAND_HANDSHAKE_T<CORE_SYNC_DATA> COMMAND_HANDSHAKE;
+    typedef COMMAND_TIMED_SYNC_T<CORE_SYNC_DATA> COMMAND_TIMED_SYNC;
+    switch (command)
+    {
+#define COMMAND_NAME(type) case type::ID: return #type;
+      COMMAND_NAME(COMMAND_HANDSHAKE)
+      COMMAND_NAME(COMMAND_TIMED_SYNC)
+      COMMAND_NAME(COMMAND_PING)
+      COMMAND_NAME(COMMAND_REQUEST_SUPPORT_FLAGS)
+      COMMAND_NAME(NOTIFY_SUPERNODE_ANNOUNCE)
+      COMMAND_NAME(COMMAND_SUPERNODE_ANNOUNCE)
+      COMMAND_NAME(COMMAND_BROADCAST)
+      COMMAND_NAME(COMMAND_MULTICAST)
+      COMMAND_NAME(COMMAND_UNICAST)
+      COMMAND_NAME(NOTIFY_NEW_BLOCK)
+      COMMAND_NAME(NOTIFY_NEW_TRANSACTIONS)
+      COMMAND_NAME(NOTIFY_REQUEST_GET_OBJECTS)
+      COMMAND_NAME(NOTIFY_RESPONSE_GET_OBJECTS)
+      COMMAND_NAME(NOTIFY_REQUEST_CHAIN)
+      COMMAND_NAME(NOTIFY_RESPONSE_CHAIN_ENTRY)
+      COMMAND_NAME(NOTIFY_NEW_FLUFFY_BLOCK)
+      COMMAND_NAME(NOTIFY_REQUEST_FLUFFY_MISSING_TX)
+      COMMAND_NAME(NOTIFY_NEW_TRANSACTION_HASHES)
+      COMMAND_NAME(NOTIFY_REQUEST_TRANSACTIONS)
+      COMMAND_NAME(NOTIFY_NEW_COMPACT_BLOCK)
+      COMMAND_NAME(NOTIFY_COMPRESSED)
+      COMMAND_NAME(NOTIFY_REQUEST_BLOCK_HEADERS)
+      COMMAND_NAME(NOTIFY_RESPONSE_BLOCK_HEADERS)
+#undef COMMAND_NAME
+      case epee::net_utils::network_command_stats::other_command: return "other";
+      default: return "unknown";
+    }
+  }
 }
 
 namespace cryptonote
@@ -82,6 +182,8 @@ namespace cryptonote
     command_line::add_arg(desc, arg_restricted_rpc);
     command_line::add_arg(desc, arg_bootstrap_daemon_address);
     command_line::add_arg(desc, arg_bootstrap_daemon_login);
+    command_line::add_arg(desc, arg_rpc_sharded_io);
+    command_line::add_arg(desc, arg_rpc_reuse_port);
     cryptonote::rpc_args::init_options(desc);
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -103,6 +205,7 @@ namespace cryptonote
     m_restricted = restricted;
     m_nettype = nettype;
     m_net_server.set_threads_prefix("RPC");
+    m_net_server.set_io_service_sharding(command_line::get_arg(vm, arg_rpc_sharded_io), command_line::get_arg(vm, arg_rpc_reuse_port));
 
     auto rpc_config = cryptonote::rpc_args::process(vm);
     if (!rpc_config)
@@ -215,6 +318,26 @@ namespace cryptonote
     }
     res.database_size = m_core.get_blockchain_storage().get_db().get_database_size();
     res.update_available = m_core.is_update_available();
+    key_image_filter_stats ki_stats;
+    if (m_core.get_blockchain_storage().get_db().get_key_image_filter_stats(ki_stats))
+    {
+      res.key_image_filter_negatives = ki_stats.negatives;
+      res.key_image_filter_positives = ki_stats.positives;
+      res.key_image_filter_false_positives = ki_stats.false_positives;
+    }
+    else
+    {
+      res.key_image_filter_negatives = 0;
+      res.key_image_filter_positives = 0;
+      res.key_image_filter_false_positives = 0;
+    }
+    const output_key_cache_stats ok_stats = m_core.get_blockchain_storage().get_output_key_cache_stats();
+    res.output_key_cache_hits = ok_stats.hits;
+    res.output_key_cache_misses = ok_stats.misses;
+    const tx_relay_queue::stats relay_stats = m_p2p.get_payload_object().get_tx_relay_stats();
+    res.tx_relay_txs_announced = relay_stats.txs_announced;
+    res.tx_relay_txs_sent = relay_stats.txs_sent;
+    res.tx_relay_duplicate_bytes_avoided = relay_stats.duplicate_bytes_avoided;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -257,9 +380,9 @@ namespace cryptonote
     for(auto& bd: bs)
     {
       res.blocks.resize(res.blocks.size()+1);
-      res.blocks.back().block = bd.first.first;
       pruned_size += bd.first.first.size();
       unpruned_size += bd.first.first.size();
+      res.blocks.back().block = std::move(bd.first.first);
       res.output_indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices());
       res.output_indices.back().indices.push_back(COMMAND_RPC_GET_BLOCKS_FAST::tx_output_indices());
       if (!req.no_miner_tx)
@@ -295,6 +418,131 @@ namespace cryptonote
     MDEBUG("on_get_blocks: " << bs.size() << " blocks, " << ntxes << " txes, pruned size " << pruned_size << ", unpruned size " << unpruned_size);
     res.status = CORE_RPC_STATUS_OK;
     return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_block_scan_data(const crypto::hash& block_hash, COMMAND_RPC_GET_BLOCKS_SCAN_DATA::block_scan_data& data, crypto::hash& prev_hash)
+  {
+    {
+      boost::lock_guard<boost::mutex> lock(m_block_scan_data_cache_lock);
+      auto it = m_block_scan_data_cache.find(block_hash);
+      if (it != m_block_scan_data_cache.end())
+      {
+        data = it->second.data;
+        prev_hash = it->second.prev_hash;
+        return true;
+      }
+    }
+
+    block b;
+    if (!m_core.get_block_by_hash(block_hash, b))
+    {
+      MERROR("Block " << block_hash << " not found");
+      return false;
+    }
+
+    // the pruned tx tables hold the prefixes and the RingCT base, which is all a scanner reads
+    std::vector<cryptonote::blobdata> txs;
+    std::vector<crypto::hash> missed_txs;
+    if (!m_core.get_blockchain_storage().get_transactions_blobs(b.tx_hashes, txs, missed_txs, true) || !missed_txs.empty() || txs.size() != b.tx_hashes.size())
+    {
+      MERROR("Transactions of block " << block_hash << " not found");
+      return false;
+    }
+
+    data.block_hash = block_hash;
+    data.timestamp = b.timestamp;
+    data.txs.clear();
+    data.txs.resize(b.tx_hashes.size() + 1);
+    for (size_t i = 0; i < data.txs.size(); ++i)
+    {
+      transaction pruned_tx;
+      const transaction *tx = &b.miner_tx;
+      crypto::hash tx_hash;
+      if (i == 0)
+      {
+        tx_hash = get_transaction_hash(b.miner_tx);
+      }
+      else
+      {
+        tx_hash = b.tx_hashes[i - 1];
+        if (!parse_and_validate_tx_base_from_blob(txs[i - 1], pruned_tx))
+        {
+          MERROR("Failed to parse transaction " << tx_hash << " from block " << block_hash);
+          return false;
+        }
+        tx = &pruned_tx;
+      }
+      fill_tx_scan_data(*tx, tx_hash, data.txs[i]);
+      if (!m_core.get_tx_outputs_gindexs(tx_hash, data.txs[i].output_indices))
+      {
+        MERROR("Output indices of transaction " << tx_hash << " not found");
+        return false;
+      }
+    }
+    prev_hash = b.prev_id;
+
+    boost::lock_guard<boost::mutex> lock(m_block_scan_data_cache_lock);
+    if (m_block_scan_data_cache.emplace(block_hash, block_scan_data_cache_entry{data, prev_hash}).second)
+    {
+      m_block_scan_data_cache_order.push_back(block_hash);
+      if (m_block_scan_data_cache_order.size() > BLOCK_SCAN_DATA_CACHE_SIZE)
+      {
+        m_block_scan_data_cache.erase(m_block_scan_data_cache_order.front());
+        m_block_scan_data_cache_order.pop_front();
+      }
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_blocks_scan_data(const COMMAND_RPC_GET_BLOCKS_SCAN_DATA::request& req, COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response& res)
+  {
+    PERF_TIMER(on_get_blocks_scan_data);
+    bool r;
+    if (use_bootstrap_daemon_if_necessary<COMMAND_RPC_GET_BLOCKS_SCAN_DATA>(invoke_http_mode::BIN, "/get_blocks_scan_data.bin", req, res, r))
+      return r;
+
+    res.untrusted = false;
+    res.current_height = m_core.get_current_blockchain_height();
+    if (req.start_height > 0)
+    {
+      if (req.start_height >= res.current_height)
+      {
+        res.status = "Failed";
+        return false;
+      }
+      res.start_height = req.start_height;
+    }
+    else if (!m_core.get_blockchain_storage().find_blockchain_supplement(req.block_ids, res.start_height))
+    {
+      res.status = "Failed";
+      return false;
+    }
+
+    const uint64_t end_height = std::min<uint64_t>(res.current_height, res.start_height + COMMAND_RPC_GET_BLOCKS_SCAN_DATA_MAX_COUNT);
+    res.blocks.resize(end_height - res.start_height);
+    crypto::hash prev_hash;
+    for (uint64_t height = res.start_height; height < end_height; ++height)
+    {
+      COMMAND_RPC_GET_BLOCKS_SCAN_DATA::block_scan_data &data = res.blocks[height - res.start_height];
+      const crypto::hash block_hash = m_core.get_block_id_by_height(height);
+      crypto::hash block_prev_hash;
+      if (!get_block_scan_data(block_hash, data, block_prev_hash))
+      {
+        res.status = "Failed";
+        return false;
+      }
+      // blocks are looked up one by one, so a reorg in the middle would show as a broken chain
+      if (height > res.start_height && block_prev_hash != prev_hash)
+      {
+        res.status = CORE_RPC_STATUS_BUSY;
+        return true;
+      }
+      prev_hash = block_hash;
+    }
+
+    MDEBUG("on_get_blocks_scan_data: " << res.blocks.size() << " blocks from height " << res.start_height);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
   }
     bool core_rpc_server::on_get_alt_blocks_hashes(const COMMAND_RPC_GET_ALT_BLOCKS_HASHES::request& req, COMMAND_RPC_GET_ALT_BLOCKS_HASHES::response& res)
     {
@@ -2096,9 +2344,26 @@ namespace cryptonote
     ++res.height; // turn top block height into blockchain height
     res.target_height = m_core.get_target_blockchain_height();
 
-    for (const auto &c: m_p2p.get_payload_object().get_connections())
-      res.peers.push_back({c});
     const cryptonote::block_queue &block_queue = m_p2p.get_payload_object().get_block_queue();
+    const size_t block_sync_size = m_core.get_block_sync_size(res.height);
+    const size_t fixed_block_sync_size = m_core.get_fixed_block_sync_size();
+    for (const auto &c: m_p2p.get_payload_object().get_connections())
+    {
+      COMMAND_RPC_SYNC_INFO::peer p = {c, 0, 0, 0, 0};
+      boost::uuids::uuid connection_id;
+      if (epee::string_tools::hex_to_pod(c.connection_id, connection_id))
+      {
+        cryptonote::block_queue::peer_rate rate;
+        if (block_queue.get_peer_rate(connection_id, rate))
+        {
+          p.download_rate = (uint32_t)(rate.rate + 0.5f);
+          p.downloaded_blocks = rate.nblocks;
+          p.downloaded_size = rate.size;
+        }
+        p.span_size = block_queue.get_span_size(connection_id, block_sync_size, BLOCKS_SYNCHRONIZING_MAX_COUNT, fixed_block_sync_size);
+      }
+      res.peers.push_back(p);
+    }
     block_queue.foreach([&](const cryptonote::block_queue::span &span) {
       const std::string span_connection_id = epee::string_tools::pod_to_hex(span.connection_id);
       uint32_t speed = (uint32_t)(100.0f * block_queue.get_speed(span.connection_id) + 0.5f);
@@ -2354,6 +2619,78 @@ namespace cryptonote
       res.multicast_bytes_out = m_p2p.get_multicast_bytes_out();
       return true;
   }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_net_stats(const COMMAND_RPC_GET_NET_STATS::request& req, COMMAND_RPC_GET_NET_STATS::response& res, epee::json_rpc::error& error_resp)
+  {
+    PERF_TIMER(on_get_net_stats);
+    const auto totals = epee::net_utils::network_throttle_manager::get_global_command_stats().get_totals();
+    res.commands.reserve(totals.size());
+    for (const auto &t: totals)
+    {
+      COMMAND_RPC_GET_NET_STATS::command_stats cs;
+      cs.command = t.command;
+      cs.name = get_command_name(t.command);
+      cs.messages_in = t.messages_in;
+      cs.bytes_in = t.bytes_in;
+      cs.messages_out = t.messages_out;
+      cs.bytes_out = t.bytes_out;
+      cs.handler_time = t.handler_ns / 1000;
+      cs.queue_time = t.queue_ns / 1000;
+      res.commands.push_back(std::move(cs));
+    }
+    std::sort(res.commands.begin(), res.commands.end(), [](const COMMAND_RPC_GET_NET_STATS::command_stats &a, const COMMAND_RPC_GET_NET_STATS::command_stats &b) {
+      return a.command < b.command;
+    });
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_metrics(const epee::net_utils::http::http_request_info& query_info, epee::net_utils::http::http_response_info& response_info, connection_context& context)
+  {
+    PERF_TIMER(on_get_metrics);
+    if (m_restricted)
+    {
+      response_info.m_response_code = 403;
+      response_info.m_response_comment = "Forbidden";
+      return true;
+    }
+
+    COMMAND_RPC_GET_NET_STATS::request req;
+    COMMAND_RPC_GET_NET_STATS::response res;
+    epee::json_rpc::error error_resp;
+    on_get_net_stats(req, res, error_resp);
+
+    std::string &body = response_info.m_body;
+    const auto add_metric = [&](const char *metric, const char *type, const char *help, const std::function<std::string(const COMMAND_RPC_GET_NET_STATS::command_stats&)> &value) {
+      body += std::string("# HELP ") + metric + " " + help + "\n";
+      body += std::string("# TYPE ") + metric + " " + type + "\n";
+      for (const auto &cs: res.commands)
+        body += std::string(metric) + "{command=\"" + std::to_string(cs.command) + "\",name=\"" + cs.name + "\"} " + value(cs) + "\n";
+    };
+    const auto usec_to_sec = [](uint64_t usec) {
+      std::ostringstream ss;
+      ss << std::fixed << std::setprecision(6) << usec / 1000000.0;
+      return ss.str();
+    };
+    add_metric("graft_p2p_received_messages_total", "counter", "P2P messages received, by command",
+      [](const COMMAND_RPC_GET_NET_STATS::command_stats &cs) { return std::to_string(cs.messages_in); });
+    add_metric("graft_p2p_received_bytes_total", "counter", "P2P bytes received including levin headers, by command",
+      [](const COMMAND_RPC_GET_NET_STATS::command_stats &cs) { return std::to_string(cs.bytes_in); });
+    add_metric("graft_p2p_sent_messages_total", "counter", "P2P messages sent, by command",
+      [](const COMMAND_RPC_GET_NET_STATS::command_stats &cs) { return std::to_string(cs.messages_out); });
+    add_metric("graft_p2p_sent_bytes_total", "counter", "P2P bytes sent including levin headers, by command",
+      [](const COMMAND_RPC_GET_NET_STATS::command_stats &cs) { return std::to_string(cs.bytes_out); });
+    add_metric("graft_p2p_handler_seconds_total", "counter", "CPU time spent handling received P2P messages, by command",
+      [&](const COMMAND_RPC_GET_NET_STATS::command_stats &cs) { return usec_to_sec(cs.handler_time); });
+    add_metric("graft_p2p_queue_seconds_total", "counter", "Time received P2P messages waited for their handler, by command",
+      [&](const COMMAND_RPC_GET_NET_STATS::command_stats &cs) { return usec_to_sec(cs.queue_time); });
+
+    response_info.m_response_code = 200;
+    response_info.m_response_comment = "Ok";
+    response_info.m_mime_tipe = "text/plain; version=0.0.4";
+    response_info.m_header_info.m_content_type = " text/plain; version=0.0.4";
+    return true;
+  }
 
   //------------------------------------------------------------------------------------------------------------------------------
 
@@ -2395,4 +2732,16 @@ namespace cryptonote
     , "Specify username:password for the bootstrap daemon login"
     , ""
     };
+
+  const command_line::arg_descriptor<bool> core_rpc_server::arg_rpc_sharded_io = {
+      "rpc-sharded-io"
+    , "Run one io_service per RPC thread, with each connection handled by a single thread"
+    , false
+    };
+
+  const command_line::arg_descriptor<bool> core_rpc_server::arg_rpc_reuse_port = {
+      "rpc-reuse-port"
+    , "With --rpc-sharded-io, accept connections on every RPC thread using SO_REUSEPORT"
+    , false
+    };
 }  // namespace cryptonote
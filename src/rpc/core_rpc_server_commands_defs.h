@@ -54,7 +54,7 @@ namespace cryptonote
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define CORE_RPC_VERSION_MAJOR 2
-#define CORE_RPC_VERSION_MINOR 1
+#define CORE_RPC_VERSION_MINOR 4
 #define MAKE_CORE_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define CORE_RPC_VERSION MAKE_CORE_RPC_VERSION(CORE_RPC_VERSION_MAJOR, CORE_RPC_VERSION_MINOR)
 
@@ -135,6 +135,90 @@ namespace cryptonote
     };
   };
 
+  // What a wallet needs to find and decode its outputs and spends in a block, without signatures or range proofs
+  struct COMMAND_RPC_GET_BLOCKS_SCAN_DATA
+  {
+    struct request
+    {
+      std::list<crypto::hash> block_ids; // short chain history, as for COMMAND_RPC_GET_BLOCKS_FAST
+      uint64_t    start_height;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(block_ids)
+        KV_SERIALIZE(start_height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct tx_scan_data
+    {
+      crypto::hash tx_hash;
+      uint64_t version;
+      uint64_t unlock_time;
+      uint8_t rct_type;
+      uint64_t fee;
+      std::vector<crypto::public_key> tx_pub_keys;            // every tx public key field of extra, in order
+      std::vector<crypto::public_key> additional_tx_pub_keys;
+      std::string extra_nonce;                                // payment id lives here
+      std::vector<crypto::public_key> output_keys;
+      std::vector<uint64_t> output_amounts;                   // 0 for RingCT outputs
+      std::vector<rct::key> commitments;                      // RingCT only
+      std::vector<rct::key> ecdh_masks;                       // RingCT only
+      std::vector<rct::key> ecdh_amounts;                     // RingCT only
+      std::vector<uint64_t> output_indices;
+      std::vector<crypto::key_image> key_images;
+      std::vector<uint64_t> input_amounts;                    // amount of each key image's input, 0 for RingCT inputs
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(tx_hash)
+        KV_SERIALIZE(version)
+        KV_SERIALIZE(unlock_time)
+        KV_SERIALIZE(rct_type)
+        KV_SERIALIZE(fee)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(tx_pub_keys)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(additional_tx_pub_keys)
+        KV_SERIALIZE(extra_nonce)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(output_keys)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(output_amounts)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(commitments)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(ecdh_masks)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(ecdh_amounts)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(output_indices)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(key_images)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(input_amounts)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct block_scan_data
+    {
+      crypto::hash block_hash;
+      uint64_t timestamp;
+      std::vector<tx_scan_data> txs; // miner tx first
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_hash)
+        KV_SERIALIZE(timestamp)
+        KV_SERIALIZE(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<block_scan_data> blocks;
+      uint64_t    start_height;
+      uint64_t    current_height;
+      std::string status;
+      bool untrusted;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(blocks)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(current_height)
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(untrusted)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_BLOCKS_BY_HEIGHT
   {
     struct request
@@ -900,6 +984,14 @@ namespace cryptonote
       bool was_bootstrap_ever_used;
       uint64_t database_size;
       bool update_available;
+      uint64_t key_image_filter_negatives;
+      uint64_t key_image_filter_positives;
+      uint64_t key_image_filter_false_positives;
+      uint64_t output_key_cache_hits;
+      uint64_t output_key_cache_misses;
+      uint64_t tx_relay_txs_announced;
+      uint64_t tx_relay_txs_sent;
+      uint64_t tx_relay_duplicate_bytes_avoided;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(status)
@@ -934,6 +1026,14 @@ namespace cryptonote
         KV_SERIALIZE(was_bootstrap_ever_used)
         KV_SERIALIZE(database_size)
         KV_SERIALIZE(update_available)
+        KV_SERIALIZE_OPT(key_image_filter_negatives, (uint64_t)0)
+        KV_SERIALIZE_OPT(key_image_filter_positives, (uint64_t)0)
+        KV_SERIALIZE_OPT(key_image_filter_false_positives, (uint64_t)0)
+        KV_SERIALIZE_OPT(output_key_cache_hits, (uint64_t)0)
+        KV_SERIALIZE_OPT(output_key_cache_misses, (uint64_t)0)
+        KV_SERIALIZE_OPT(tx_relay_txs_announced, (uint64_t)0)
+        KV_SERIALIZE_OPT(tx_relay_txs_sent, (uint64_t)0)
+        KV_SERIALIZE_OPT(tx_relay_duplicate_bytes_avoided, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -2188,9 +2288,17 @@ namespace cryptonote
     struct peer
     {
       connection_info info;
+      uint32_t download_rate;
+      uint64_t downloaded_blocks;
+      uint64_t downloaded_size;
+      uint64_t span_size;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(info)
+        KV_SERIALIZE_OPT(download_rate, (uint32_t)0)
+        KV_SERIALIZE_OPT(downloaded_blocks, (uint64_t)0)
+        KV_SERIALIZE_OPT(downloaded_size, (uint64_t)0)
+        KV_SERIALIZE_OPT(span_size, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
@@ -2543,6 +2651,49 @@ namespace cryptonote
     };
   };
 
+  struct COMMAND_RPC_GET_NET_STATS
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct command_stats
+    {
+      int32_t command;
+      std::string name;
+      uint64_t messages_in;
+      uint64_t bytes_in;
+      uint64_t messages_out;
+      uint64_t bytes_out;
+      uint64_t handler_time; // usec
+      uint64_t queue_time; // usec
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(command)
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(messages_in)
+        KV_SERIALIZE(bytes_in)
+        KV_SERIALIZE(messages_out)
+        KV_SERIALIZE(bytes_out)
+        KV_SERIALIZE(handler_time)
+        KV_SERIALIZE(queue_time)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string status;
+      std::vector<command_stats> commands;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(status)
+        KV_SERIALIZE(commands)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_OUTPUT_DISTRIBUTION
   {
     struct request
@@ -2262,6 +2262,23 @@ bool simple_wallet::set_ignore_fractional_outputs(const std::vector<std::string>
   return true;
 }
 
+bool simple_wallet::set_refresh_pipeline_depth(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
+{
+  const auto pwd_container = get_and_verify_password();
+  if (pwd_container)
+  {
+    uint32_t depth;
+    if (!epee::string_tools::get_xtype_from_string(depth, args[1]) || depth == 0 || depth > tools::wallet2::max_refresh_pipeline_depth)
+    {
+      fail_msg_writer() << (boost::format(tr("Invalid pipeline depth, it must be between 1 and %u")) % tools::wallet2::max_refresh_pipeline_depth).str();
+      return true;
+    }
+    m_wallet->refresh_pipeline_depth(depth);
+    m_wallet->rewrite(m_wallet_file, pwd_container->password());
+  }
+  return true;
+}
+
 bool simple_wallet::help(const std::vector<std::string> &args/* = std::vector<std::string>()*/)
 {
   if(args.empty())
@@ -2454,7 +2471,9 @@ simple_wallet::simple_wallet()
                                   "  Set the lookahead sizes for the subaddress hash table.\n "
                                   "  Set this if you are not sure whether you will spend on a key reusing Graft fork later.\n "
                                   "segregation-height <n>\n "
-                                  "  Set to the height of a key reusing fork you want to use, 0 to use default."));
+                                  "  Set to the height of a key reusing fork you want to use, 0 to use default.\n "
+                                  "refresh-pipeline-depth <n>\n "
+                                  "  Set how many block requests may be in flight while refreshing, from 1 (no pipelining) to 16."));
   m_cmd_binder.set_handler("encrypted_seed",
                            boost::bind(&simple_wallet::encrypted_seed, this, _1),
                            tr("Display the encrypted Electrum-style mnemonic seed."));
@@ -2682,6 +2701,7 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     success_msg_writer() << "subaddress-lookahead = " << lookahead.first << ":" << lookahead.second;
     success_msg_writer() << "segregation-height = " << m_wallet->segregation_height();
     success_msg_writer() << "ignore-fractional-outputs = " << m_wallet->ignore_fractional_outputs();
+    success_msg_writer() << "refresh-pipeline-depth = " << m_wallet->refresh_pipeline_depth();
     success_msg_writer() << "device_name = " << m_wallet->device_name();
     return true;
   }
@@ -2738,6 +2758,7 @@ bool simple_wallet::set_variable(const std::vector<std::string> &args)
     CHECK_SIMPLE_VARIABLE("subaddress-lookahead", set_subaddress_lookahead, tr("<major>:<minor>"));
     CHECK_SIMPLE_VARIABLE("segregation-height", set_segregation_height, tr("unsigned integer"));
     CHECK_SIMPLE_VARIABLE("ignore-fractional-outputs", set_ignore_fractional_outputs, tr("0 or 1"));
+    CHECK_SIMPLE_VARIABLE("refresh-pipeline-depth", set_refresh_pipeline_depth, tr("integer from 1 to 16"));
   }
   fail_msg_writer() << tr("set: unrecognized argument(s)");
   return true;
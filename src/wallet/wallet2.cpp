@@ -108,6 +108,12 @@ using namespace cryptonote;
 
 #define FEE_ESTIMATE_GRACE_BLOCKS 10 // estimate fee valid for that many blocks
 
+#define HASHCHAIN_REORG_WINDOW 5000 // keep every block hash for that many blocks, only checkpoints below
+
+#define RCT_DISTRIBUTION_REFETCH_BLOCKS 16 // re-request that many cached blocks to catch reorgs
+#define DECOY_POOL_MIN_PICKS 1024 // draw at least that many gamma picks when the decoy pool runs low
+#define DECOY_POOL_MAX_PICKS 5000 // never keep more gamma picks than that
+
 #define SECOND_OUTPUT_RELATEDNESS_THRESHOLD 0.0f
 
 #define SUBADDRESS_LOOKAHEAD_MAJOR 50
@@ -119,6 +125,9 @@ using namespace cryptonote;
 
 #define OUTPUT_EXPORT_FILE_MAGIC "Graft output export\003"
 
+#define CACHE_JOURNAL_MAGIC "Graft wallet cache journal\001"
+#define CACHE_JOURNAL_MAX_RECORDS 1024 /* the full cache is rewritten after that many journal records */
+
 #define SEGREGATION_FORK_HEIGHT 99999999
 #define TESTNET_SEGREGATION_FORK_HEIGHT 99999999
 #define STAGENET_SEGREGATION_FORK_HEIGHT 99999999
@@ -126,6 +135,8 @@ using namespace cryptonote;
 
 #define FIRST_REFRESH_GRANULARITY     1024
 
+#define DERIVATION_BATCH_SIZE 64 /* tx public keys per batched derivation job */
+
 #define GAMMA_PICK_HALF_WINDOW 5
 
 static const std::string MULTISIG_SIGNATURE_MAGIC = "SigMultisigPkV1";
@@ -784,6 +795,7 @@ namespace tools
 const size_t MAX_SPLIT_ATTEMPTS = 30;
 
 constexpr const std::chrono::seconds wallet2::rpc_timeout;
+constexpr const uint32_t wallet2::max_refresh_pipeline_depth;
 const char* wallet2::tr(const char* str) { return i18n_translate(str, "tools::wallet2"); }
 
 wallet_keys_unlocker::wallet_keys_unlocker(wallet2 &w, const boost::optional<tools::password_container> &password):
@@ -822,6 +834,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_multisig_rescan_info(NULL),
   m_multisig_rescan_k(NULL),
   m_run(true),
+  m_daemon_ssl(false),
   m_callback(0),
   m_trusted_daemon(false),
   m_nettype(nettype),
@@ -850,6 +863,7 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_key_reuse_mitigation2(true),
   m_segregation_height(0),
   m_ignore_fractional_outputs(true),
+  m_refresh_pipeline_depth(1),
   m_is_initialized(false),
   m_kdf_rounds(kdf_rounds),
   is_old_file_format(false),
@@ -863,6 +877,8 @@ wallet2::wallet2(network_type nettype, uint64_t kdf_rounds, bool unattended, boo
   m_light_wallet_balance(0),
   m_light_wallet_unlocked_balance(0),
   m_key_device_type(hw::device::device_type::SOFTWARE),
+  m_rct_distribution_start_height(0),
+  m_decoy_pool(),
   m_ring_history_saved(false),
   m_ringdb(),
   m_last_block_reward(0),
@@ -960,6 +976,9 @@ bool wallet2::init(std::string daemon_address, boost::optional<epee::net_utils::
   m_daemon_address = std::move(daemon_address);
   m_daemon_login = std::move(daemon_login);
   m_trusted_daemon = trusted_daemon;
+  m_daemon_ssl = ssl;
+  m_rct_distribution.clear();
+  m_decoy_pool = decoy_pool();
   // When switching from light wallet to full wallet, we need to reset the height we got from lw node.
   return m_http_client.set_server(get_daemon_address(), get_daemon_login(), ssl);
 }
@@ -1164,6 +1183,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
     }
     m_subaddress_labels.resize(index.major + 1, {"Untitled account"});
     m_subaddress_labels[index.major].resize(index.minor + 1);
+    m_cache_journal.subaddresses = true;
     get_account_tags();
   }
   else if (m_subaddress_labels[index.major].size() <= index.minor)
@@ -1179,6 +1199,7 @@ void wallet2::expand_subaddresses(const cryptonote::subaddress_index& index)
        m_subaddresses[D] = index2;
     }
     m_subaddress_labels[index.major].resize(index.minor + 1);
+    m_cache_journal.subaddresses = true;
   }
 }
 //----------------------------------------------------------------------------------------------------
@@ -1197,6 +1218,7 @@ void wallet2::set_subaddress_label(const cryptonote::subaddress_index& index, co
   THROW_WALLET_EXCEPTION_IF(index.major >= m_subaddress_labels.size(), error::account_index_outofbound);
   THROW_WALLET_EXCEPTION_IF(index.minor >= m_subaddress_labels[index.major].size(), error::address_index_outofbound);
   m_subaddress_labels[index.major][index.minor] = label;
+  m_cache_journal.subaddresses = true;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_subaddress_lookahead(size_t major, size_t minor)
@@ -1221,6 +1243,7 @@ void wallet2::set_spent(size_t idx, uint64_t height)
   LOG_PRINT_L2("Setting SPENT at " << height << ": ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = true;
   td.m_spent_height = height;
+  cache_journal_transfer(idx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::set_unspent(size_t idx)
@@ -1229,6 +1252,93 @@ void wallet2::set_unspent(size_t idx)
   LOG_PRINT_L2("Setting UNSPENT: ki " << td.m_key_image << ", amount " << print_money(td.m_amount));
   td.m_spent = false;
   td.m_spent_height = 0;
+  cache_journal_transfer(idx);
+}
+//----------------------------------------------------------------------------------------------------
+namespace
+{
+  template<typename Index>
+  void unindex(Index &index, const typename Index::key_type &key, const typename Index::mapped_type value)
+  {
+    auto range = index.equal_range(key);
+    for (auto i = range.first; i != range.second; ++i)
+    {
+      if (i->second == value)
+      {
+        index.erase(i);
+        return;
+      }
+    }
+  }
+
+  void insert_sorted(std::vector<size_t> &v, size_t idx)
+  {
+    // transfers are almost always appended
+    if (v.empty() || v.back() < idx)
+      v.push_back(idx);
+    else
+      v.insert(std::lower_bound(v.begin(), v.end(), idx), idx);
+  }
+
+  void erase_sorted(std::vector<size_t> &v, size_t idx)
+  {
+    auto i = std::lower_bound(v.begin(), v.end(), idx);
+    if (i != v.end() && *i == idx)
+      v.erase(i);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_transfer(size_t idx)
+{
+  const cryptonote::subaddress_index &index = m_transfers[idx].m_subaddr_index;
+  insert_sorted(m_transfers_by_account[index.major], idx);
+  insert_sorted(m_transfers_by_subaddress[index], idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_transfer(size_t idx)
+{
+  const cryptonote::subaddress_index &index = m_transfers[idx].m_subaddr_index;
+  erase_sorted(m_transfers_by_account[index.major], idx);
+  erase_sorted(m_transfers_by_subaddress[index], idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_payment(const payment_container::value_type &payment)
+{
+  const payment_details &pd = payment.second;
+  m_payments_by_account.emplace(std::make_pair(pd.m_subaddr_index.major, pd.m_block_height), &payment);
+  m_payments_by_subaddress.emplace(std::make_tuple(pd.m_subaddr_index.major, pd.m_subaddr_index.minor, pd.m_block_height), &payment);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_payment(const payment_container::value_type &payment)
+{
+  const payment_details &pd = payment.second;
+  unindex(m_payments_by_account, std::make_pair(pd.m_subaddr_index.major, pd.m_block_height), &payment);
+  unindex(m_payments_by_subaddress, std::make_tuple(pd.m_subaddr_index.major, pd.m_subaddr_index.minor, pd.m_block_height), &payment);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &tx)
+{
+  m_confirmed_txs_by_account.emplace(std::make_pair(tx.second.m_subaddr_account, tx.second.m_block_height), &tx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::unindex_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &tx)
+{
+  unindex(m_confirmed_txs_by_account, std::make_pair(tx.second.m_subaddr_account, tx.second.m_block_height), &tx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_indexes()
+{
+  m_transfers_by_account.clear();
+  m_transfers_by_subaddress.clear();
+  m_payments_by_account.clear();
+  m_payments_by_subaddress.clear();
+  m_confirmed_txs_by_account.clear();
+  for (size_t i = 0; i < m_transfers.size(); ++i)
+    index_transfer(i);
+  for (const auto &p: m_payments)
+    index_payment(p);
+  for (const auto &tx: m_confirmed_txs)
+    index_confirmed_tx(tx);
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::check_acc_out_precomp(const tx_out &o, const crypto::key_derivation &derivation, const std::vector<crypto::key_derivation> &additional_derivations, size_t i, tx_scan_info_t &tx_scan_info) const
@@ -1579,7 +1689,6 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
             "transactions outputs size=" + std::to_string(tx.vout.size()) +
             " not match with daemon response size=" + std::to_string(o_indices.size()));
       }
-
       for(size_t o: outs)
       {
 	THROW_WALLET_EXCEPTION_IF(tx.vout.size() <= o, error::wallet_internal_error, "wrong out in transaction: internal index=" +
@@ -1600,7 +1709,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
 	    td.m_global_output_index = o_indices[o];
-	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
+	    td.m_tx = compact_tx_prefix(tx, o);
 	    td.m_txid = txid;
             td.m_key_image = tx_scan_info[o].ki;
             td.m_key_image_known = !m_watch_only && !m_multisig;
@@ -1625,6 +1734,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
               td.m_rct = false;
             }
 	    set_unspent(m_transfers.size()-1);
+            index_transfer(m_transfers.size()-1);
             if (!m_multisig && !m_watch_only)
 	      m_key_images[td.m_key_image] = m_transfers.size()-1;
 	    m_pub_keys[tx_scan_info[o].in_ephemeral.pub] = m_transfers.size()-1;
@@ -1669,14 +1779,17 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           if (!pool)
           {
             transfer_details &td = m_transfers[kit->second];
+            cache_journal_transfer(kit->second);
+            unindex_transfer(kit->second);
 	    td.m_block_height = height;
 	    td.m_internal_output_index = o;
 	    td.m_global_output_index = o_indices[o];
-	    td.m_tx = (const cryptonote::transaction_prefix&)tx;
+	    td.m_tx = compact_tx_prefix(tx, o);
 	    td.m_txid = txid;
             td.m_amount = amount;
             td.m_pk_index = pk_index - 1;
             td.m_subaddr_index = tx_scan_info[o].received->index;
+            index_transfer(kit->second);
             expand_subaddresses(tx_scan_info[o].received->index);
             if (tx.vout[o].amount == 0)
             {
@@ -1739,6 +1852,7 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           //   1) the same output pub key was used as destination multiple times,
           //   2) the wallet set the highest amount among them to transfer_details::m_amount, and
           //   3) the wallet somehow spent that output with an amount smaller than the above amount, causing inconsistency
+          cache_journal_transfer(it->second);
           td.m_amount = amount;
         }
       }
@@ -1865,7 +1979,11 @@ void wallet2::process_new_transaction(const crypto::hash &txid, const cryptonote
           m_callback->on_unconfirmed_money_received(height, txid, tx, payment.m_amount, payment.m_subaddr_index);
       }
       else
-        m_payments.emplace(payment_id, payment);
+      {
+        index_payment(*m_payments.emplace(payment_id, payment));
+        if (!m_cache_journal.compact)
+          m_cache_journal.payments.push_back(std::make_pair(payment_id, payment));
+      }
       LOG_PRINT_L2("Payment found in " << (pool ? "pool" : "block") << ": " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
     }
   }
@@ -1887,7 +2005,11 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
   if(unconf_it != m_unconfirmed_txs.end()) {
     if (store_tx_info()) {
       try {
-        m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        auto entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details(unconf_it->second, height)));
+        if (entry.second)
+          index_confirmed_tx(*entry.first);
+        if (!m_cache_journal.compact)
+          m_cache_journal.confirmed_txs.insert(txid);
       }
       catch (...) {
         // can fail if the tx has unexpected input types
@@ -1901,6 +2023,10 @@ void wallet2::process_unconfirmed(const crypto::hash &txid, const cryptonote::tr
 void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::transaction &tx, uint64_t height, uint64_t ts, uint64_t spent, uint64_t received, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices)
 {
   std::pair<std::unordered_map<crypto::hash, confirmed_transfer_details>::iterator, bool> entry = m_confirmed_txs.insert(std::make_pair(txid, confirmed_transfer_details()));
+  if (!m_cache_journal.compact)
+    m_cache_journal.confirmed_txs.insert(txid);
+  if (!entry.second)
+    unindex_confirmed_tx(*entry.first);
   // fill with the info we know, some info might already be there
   if (entry.second)
   {
@@ -1936,6 +2062,7 @@ void wallet2::process_outgoing(const crypto::hash &txid, const cryptonote::trans
   entry.first->second.m_block_height = height;
   entry.first->second.m_timestamp = ts;
   entry.first->second.m_unlock_time = tx.unlock_time;
+  index_confirmed_tx(*entry.first);
 
   add_rings(tx);
 }
@@ -2007,6 +2134,9 @@ void wallet2::get_short_chain_history(std::list<crypto::hash>& ids, uint64_t gra
   }
   if(!base_included)
     ids.push_back(m_blockchain[m_blockchain.offset()]);
+  const std::map<size_t, crypto::hash> &checkpoints = m_blockchain.checkpoints();
+  for (auto it = checkpoints.rbegin(); it != checkpoints.rend(); ++it)
+    ids.push_back(it->second);
   if(m_blockchain.offset())
     ids.push_back(m_blockchain.genesis());
 }
@@ -2019,6 +2149,13 @@ void wallet2::parse_block_round(const cryptonote::blobdata &blob, cryptonote::bl
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
+{
+  uint64_t current_height;
+  boost::lock_guard<boost::mutex> lock(m_daemon_rpc_mutex);
+  pull_blocks(m_http_client, start_height, blocks_start_height, current_height, short_chain_history, blocks, o_indices);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_blocks(epee::net_utils::http::http_simple_client &http_client, uint64_t start_height, uint64_t &blocks_start_height, uint64_t &current_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices)
 {
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
@@ -2027,9 +2164,7 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
   req.prune = true;
   req.start_height = start_height;
   req.no_miner_tx = m_refresh_type == RefreshNoCoinbase;
-  m_daemon_rpc_mutex.lock();
-  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, m_http_client, rpc_timeout);
-  m_daemon_rpc_mutex.unlock();
+  bool r = net_utils::invoke_http_bin("/getblocks.bin", req, res, http_client, rpc_timeout);
   THROW_WALLET_EXCEPTION_IF(!r, error::no_connection_to_daemon, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   THROW_WALLET_EXCEPTION_IF(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
@@ -2038,6 +2173,7 @@ void wallet2::pull_blocks(uint64_t start_height, uint64_t &blocks_start_height,
       boost::lexical_cast<std::string>(res.output_indices.size()) + ") sizes from daemon");
 
   blocks_start_height = res.start_height;
+  current_height = res.current_height;
   blocks = std::move(res.blocks);
   o_indices = std::move(res.output_indices);
 }
@@ -2060,24 +2196,18 @@ void wallet2::pull_hashes(uint64_t start_height, uint64_t &blocks_start_height,
   hashes = std::move(res.m_block_ids);
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added)
+void wallet2::cache_parsed_blocks_tx_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const
 {
-  size_t current_index = start_height;
-  blocks_added = 0;
-
-  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
-  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
-
   tools::threadpool& tpool = tools::threadpool::getInstance();
   tools::threadpool::waiter waiter;
 
   size_t num_txes = 0;
-  std::vector<tx_cache_data> tx_cache_data;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
     num_txes += 1 + parsed_blocks[i].txes.size();
+  tx_cache_data.clear();
   tx_cache_data.resize(num_txes);
   size_t txidx = 0;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     THROW_WALLET_EXCEPTION_IF(parsed_blocks[i].txes.size() != parsed_blocks[i].block.tx_hashes.size(),
         error::wallet_internal_error, "Mismatched parsed_blocks[i].txes.size() and parsed_blocks[i].block.tx_hashes.size()");
@@ -2092,15 +2222,54 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   }
   THROW_WALLET_EXCEPTION_IF(txidx != num_txes, error::wallet_internal_error, "txidx does not match tx_cache_data size");
   waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::derive_tx_cache_data(std::vector<tx_cache_data> &tx_cache_data, tools::threadpool::waiter &waiter) const
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
 
-  hw::device &hwdev =  m_account.get_device();
-  hw::reset_mode rst(hwdev);
-  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
-  const cryptonote::account_keys &keys = m_account.get_keys();
+  // the jobs outlive this call, so they only capture the wallet and their slot
+  if (m_account.get_device().get_type() == hw::device::SOFTWARE)
+  {
+    // with the keys in memory, each job derives a batch of tx public keys at once
+    std::vector<wallet2::is_out_data*> iods;
+    for (auto &slot: tx_cache_data)
+    {
+      for (auto &iod: slot.primary)
+        iods.push_back(&iod);
+      for (auto &iod: slot.additional)
+        iods.push_back(&iod);
+    }
+    for (size_t i = 0; i < iods.size(); i += DERIVATION_BATCH_SIZE)
+    {
+      std::vector<wallet2::is_out_data*> batch(iods.begin() + i, iods.begin() + std::min<size_t>(iods.size(), i + DERIVATION_BATCH_SIZE));
+      tpool.submit(&waiter, [this, batch]() {
+        std::vector<crypto::public_key> keys;
+        keys.reserve(batch.size());
+        for (const wallet2::is_out_data *iod: batch)
+          keys.push_back(iod->pkey);
+        std::vector<crypto::key_derivation> derivations;
+        std::vector<bool> valid;
+        crypto::generate_key_derivations(keys, m_account.get_keys().m_view_secret_key, derivations, valid);
+        for (size_t n = 0; n < batch.size(); ++n)
+        {
+          if (valid[n])
+            batch[n]->derivation = derivations[n];
+          else
+          {
+            MWARNING("Failed to generate key derivation from tx pubkey, skipping");
+            memcpy(&batch[n]->derivation, rct::identity().bytes, sizeof(batch[n]->derivation));
+          }
+        }
+      }, true);
+    }
+    return;
+  }
 
-  auto gender = [&](wallet2::is_out_data &iod) {
+  auto gender = [this](wallet2::is_out_data &iod) {
+    hw::device &hwdev = m_account.get_device();
     boost::unique_lock<hw::device> hwdev_lock(hwdev);
-    if (!hwdev.generate_key_derivation(iod.pkey, keys.m_view_secret_key, iod.derivation))
+    if (!hwdev.generate_key_derivation(iod.pkey, m_account.get_keys().m_view_secret_key, iod.derivation))
     {
       MWARNING("Failed to generate key derivation from tx pubkey, skipping");
       static_assert(sizeof(iod.derivation) == sizeof(rct::key), "Mismatched sizes of key_derivation and rct::key");
@@ -2111,54 +2280,95 @@ void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cry
   for (auto &slot: tx_cache_data)
   {
     for (auto &iod: slot.primary)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      tpool.submit(&waiter, [gender, &iod]() { gender(iod); }, true);
     for (auto &iod: slot.additional)
-      tpool.submit(&waiter, [&gender, &iod]() { gender(iod); }, true);
+      tpool.submit(&waiter, [gender, &iod]() { gender(iod); }, true);
   }
-  waiter.wait(&tpool);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::match_tx_cache_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, tools::threadpool::waiter &waiter) const
+{
+  tools::threadpool& tpool = tools::threadpool::getInstance();
 
-  auto geniod = [&](const cryptonote::transaction &tx, size_t n_vouts, size_t txidx) {
+  auto geniod = [this](const cryptonote::transaction &tx, size_t n_vouts, wallet2::tx_cache_data &tx_cache_data) {
+    hw::device &hwdev = m_account.get_device();
     for (size_t k = 0; k < n_vouts; ++k)
     {
       const auto &o = tx.vout[k];
       if (o.target.type() == typeid(cryptonote::txout_to_key))
       {
         std::vector<crypto::key_derivation> additional_derivations;
-        for (const auto &iod: tx_cache_data[txidx].additional)
+        for (const auto &iod: tx_cache_data.additional)
           additional_derivations.push_back(iod.derivation);
         const auto &key = boost::get<txout_to_key>(o.target).key;
-        for (size_t l = 0; l < tx_cache_data[txidx].primary.size(); ++l)
+        for (size_t l = 0; l < tx_cache_data.primary.size(); ++l)
         {
-          THROW_WALLET_EXCEPTION_IF(tx_cache_data[txidx].primary[l].received.size() != n_vouts,
+          THROW_WALLET_EXCEPTION_IF(tx_cache_data.primary[l].received.size() != n_vouts,
               error::wallet_internal_error, "Unexpected received array size");
-          tx_cache_data[txidx].primary[l].received[k] = is_out_to_acc_precomp(m_subaddresses, key, tx_cache_data[txidx].primary[l].derivation, additional_derivations, k, hwdev);
+          tx_cache_data.primary[l].received[k] = is_out_to_acc_precomp(m_subaddresses, key, tx_cache_data.primary[l].derivation, additional_derivations, k, hwdev);
           additional_derivations.clear();
         }
       }
     }
   };
 
-  txidx = 0;
-  for (size_t i = 0; i < blocks.size(); ++i)
+  size_t txidx = 0;
+  for (size_t i = 0; i < parsed_blocks.size(); ++i)
   {
     if (m_refresh_type != RefreshType::RefreshNoCoinbase)
     {
       THROW_WALLET_EXCEPTION_IF(txidx >= tx_cache_data.size(), error::wallet_internal_error, "txidx out of range");
       const size_t n_vouts = m_refresh_type == RefreshType::RefreshOptimizeCoinbase ? 1 : parsed_blocks[i].block.miner_tx.vout.size();
-      tpool.submit(&waiter, [&, i, txidx](){ geniod(parsed_blocks[i].block.miner_tx, n_vouts, txidx); }, true);
+      const cryptonote::transaction &tx = parsed_blocks[i].block.miner_tx;
+      wallet2::tx_cache_data &slot = tx_cache_data[txidx];
+      tpool.submit(&waiter, [geniod, &tx, n_vouts, &slot](){ geniod(tx, n_vouts, slot); }, true);
     }
     ++txidx;
     for (size_t j = 0; j < parsed_blocks[i].txes.size(); ++j)
     {
       THROW_WALLET_EXCEPTION_IF(txidx >= tx_cache_data.size(), error::wallet_internal_error, "txidx out of range");
-      tpool.submit(&waiter, [&, i, j, txidx](){ geniod(parsed_blocks[i].txes[j], parsed_blocks[i].txes[j].vout.size(), txidx); }, true);
+      const cryptonote::transaction &tx = parsed_blocks[i].txes[j];
+      wallet2::tx_cache_data &slot = tx_cache_data[txidx];
+      tpool.submit(&waiter, [geniod, &tx, &slot](){ geniod(tx, tx.vout.size(), slot); }, true);
       ++txidx;
     }
   }
   THROW_WALLET_EXCEPTION_IF(txidx != tx_cache_data.size(), error::wallet_internal_error, "txidx did not reach expected value");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added)
+{
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(start_height), error::out_of_hashchain_bounds_error);
+
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+
+  std::vector<tx_cache_data> tx_cache_data;
+  cache_parsed_blocks_tx_data(parsed_blocks, tx_cache_data);
+
+  hw::device &hwdev =  m_account.get_device();
+  hw::reset_mode rst(hwdev);
+  hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+
+  derive_tx_cache_data(tx_cache_data, waiter);
+  waiter.wait(&tpool);
+
+  match_tx_cache_data(parsed_blocks, tx_cache_data, waiter);
   waiter.wait(&tpool);
   hwdev.set_mode(hw::device::NONE);
 
+  process_scanned_blocks(start_height, blocks, parsed_blocks, tx_cache_data, blocks_added);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_scanned_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, const std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added)
+{
+  size_t current_index = start_height;
+  blocks_added = 0;
+
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != parsed_blocks.size(), error::wallet_internal_error, "size mismatch");
+  THROW_WALLET_EXCEPTION_IF(!m_blockchain.is_in_bounds(current_index), error::out_of_hashchain_bounds_error);
+
   size_t tx_cache_data_offset = 0;
   for (size_t i = 0; i < blocks.size(); ++i)
   {
@@ -2223,48 +2433,69 @@ void wallet2::pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks
     // pull the new blocks
     std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
     pull_blocks(start_height, blocks_start_height, short_chain_history, blocks, o_indices);
-    THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
+    parse_blocks(blocks, o_indices, parsed_blocks, error);
+  }
+  catch(...)
+  {
+    error = true;
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::pull_and_parse_blocks_at(refresh_request &request)
+{
+  request.error = false;
 
-    tools::threadpool& tpool = tools::threadpool::getInstance();
-    tools::threadpool::waiter waiter;
-    parsed_blocks.resize(blocks.size());
-    for (size_t i = 0; i < blocks.size(); ++i)
-    {
-      tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
-        std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
-    }
-    waiter.wait(&tpool);
-    for (size_t i = 0; i < blocks.size(); ++i)
-    {
-      if (parsed_blocks[i].error)
-      {
-        error = true;
-        break;
-      }
-      parsed_blocks[i].o_indices = std::move(o_indices[i]);
-    }
+  try
+  {
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> o_indices;
+    pull_blocks(*request.http_client, request.start_height, request.blocks_start_height, request.current_height, {}, request.blocks, o_indices);
+    parse_blocks(request.blocks, o_indices, request.parsed_blocks, request.error);
+  }
+  catch(...)
+  {
+    request.error = true;
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error)
+{
+  THROW_WALLET_EXCEPTION_IF(blocks.size() != o_indices.size(), error::wallet_internal_error, "Mismatched sizes of blocks and o_indices");
 
-    boost::mutex error_lock;
-    for (size_t i = 0; i < blocks.size(); ++i)
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  tools::threadpool::waiter waiter;
+  parsed_blocks.resize(blocks.size());
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    tpool.submit(&waiter, boost::bind(&wallet2::parse_block_round, this, std::cref(blocks[i].block),
+      std::ref(parsed_blocks[i].block), std::ref(parsed_blocks[i].hash), std::ref(parsed_blocks[i].error)), true);
+  }
+  waiter.wait(&tpool);
+  for (size_t i = 0; i < blocks.size(); ++i)
+  {
+    if (parsed_blocks[i].error)
     {
-      parsed_blocks[i].txes.resize(blocks[i].txs.size());
-      for (size_t j = 0; j < blocks[i].txs.size(); ++j)
-      {
-        tpool.submit(&waiter, [&, i, j](){
-          if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j], parsed_blocks[i].txes[j]))
-          {
-            boost::unique_lock<boost::mutex> lock(error_lock);
-            error = true;
-          }
-        }, true);
-      }
+      error = true;
+      break;
     }
-    waiter.wait(&tpool);
+    parsed_blocks[i].o_indices = std::move(o_indices[i]);
   }
-  catch(...)
+
+  boost::mutex error_lock;
+  for (size_t i = 0; i < blocks.size(); ++i)
   {
-    error = true;
+    parsed_blocks[i].txes.resize(blocks[i].txs.size());
+    for (size_t j = 0; j < blocks[i].txs.size(); ++j)
+    {
+      tpool.submit(&waiter, [&, i, j](){
+        if (!parse_and_validate_tx_base_from_blob(blocks[i].txs[j], parsed_blocks[i].txes[j]))
+        {
+          boost::unique_lock<boost::mutex> lock(error_lock);
+          error = true;
+        }
+      }, true);
+    }
   }
+  waiter.wait(&tpool);
 }
 
 void wallet2::remove_obsolete_pool_txs(const std::vector<crypto::hash> &tx_hashes)
@@ -2689,6 +2920,52 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     }
   });
 
+  // with a pipeline depth above 1, the batches following the one being processed are
+  // requested by height ahead of time, each on its own connection to the daemon, and
+  // committed in order; any request which does not line up with the chain we end up
+  // with (reorg, short reply, error) drops the whole pipeline and we pull as usual
+  std::deque<std::unique_ptr<refresh_request>> pipeline;
+  std::vector<std::unique_ptr<epee::net_utils::http::http_simple_client>> idle_http_clients;
+  uint64_t daemon_height = 0;
+  if (m_refresh_pipeline_depth > 1)
+  {
+    boost::optional<std::string> result = m_node_rpc_proxy.get_height(daemon_height);
+    if (result)
+      daemon_height = 0;
+  }
+  auto cancel_pipeline = [&]() {
+    for (auto &request: pipeline)
+    {
+      request->waiter.wait(&tpool);
+      idle_http_clients.push_back(std::move(request->http_client));
+    }
+    pipeline.clear();
+  };
+  auto pipeline_canceller = epee::misc_utils::create_scope_leave_handler(cancel_pipeline);
+  auto fill_pipeline = [&](uint64_t next_start_height) {
+    while (pipeline.size() < m_refresh_pipeline_depth - 1 && next_start_height < daemon_height)
+    {
+      std::unique_ptr<refresh_request> request(new refresh_request());
+      if (!idle_http_clients.empty())
+      {
+        request->http_client = std::move(idle_http_clients.back());
+        idle_http_clients.pop_back();
+      }
+      else
+      {
+        request->http_client.reset(new epee::net_utils::http::http_simple_client());
+        if (!request->http_client->set_server(get_daemon_address(), get_daemon_login(), m_daemon_ssl))
+          break;
+      }
+      request->start_height = next_start_height;
+      refresh_request *r = request.get();
+      tpool.submit(&r->waiter, [this, r]{ pull_and_parse_blocks_at(*r); });
+      pipeline.push_back(std::move(request));
+      next_start_height += COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT;
+    }
+  };
+  auto batch_start_time = std::chrono::steady_clock::now();
+
   bool first = true;
   while(m_run.load(std::memory_order_relaxed))
   {
@@ -2705,7 +2982,20 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
         refreshed = false;
         break;
       }
-      tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error);});
+      const uint64_t expected_start_height = blocks_start_height + blocks.size();
+      bool pipelined = false, from_pipeline = false;
+      if (!first && m_refresh_pipeline_depth > 1 && expected_start_height < daemon_height)
+      {
+        if (!pipeline.empty() && pipeline.front()->start_height != expected_start_height)
+          cancel_pipeline();
+        fill_pipeline(pipeline.empty() ? expected_start_height : pipeline.back()->start_height + COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT);
+        pipelined = !pipeline.empty();
+      }
+      if (!pipelined)
+      {
+        cancel_pipeline();
+        tpool.submit(&waiter, [&]{pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error);});
+      }
 
       if (!first)
       {
@@ -2724,6 +3014,7 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
           generate_genesis(b);
           m_blockchain.clear();
           m_blockchain.push_back(get_block_hash(b));
+          invalidate_cache_journal();
           short_chain_history.clear();
           get_short_chain_history(short_chain_history);
           fast_refresh(stop_height, blocks_start_height, short_chain_history, true);
@@ -2737,9 +3028,44 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
           throw std::runtime_error(""); // loop again
         }
         blocks_fetched += added_blocks;
+
+        const auto now = std::chrono::steady_clock::now();
+        const uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - batch_start_time).count();
+        LOG_PRINT_L1("Refreshed " << blocks.size() << " blocks from height " << blocks_start_height << " in " << ms << " ms (" <<
+            (ms ? blocks.size() * 1000 / ms : blocks.size()) << " blocks/s), " << pipeline.size() << " requests in flight");
+        batch_start_time = now;
+      }
+      if (pipelined)
+      {
+        // the next batch must follow on from the chain we now have
+        refresh_request &request = *pipeline.front();
+        request.waiter.wait(&tpool);
+        if (!request.error)
+          daemon_height = std::max(daemon_height, request.current_height);
+        const bool follows = !request.error && !request.blocks.empty() && request.blocks_start_height == expected_start_height &&
+            m_blockchain.size() == expected_start_height && m_blockchain.is_in_bounds(expected_start_height - 1) &&
+            request.parsed_blocks[0].block.prev_id == m_blockchain[expected_start_height - 1];
+        if (follows)
+        {
+          next_blocks_start_height = request.blocks_start_height;
+          next_blocks = std::move(request.blocks);
+          next_parsed_blocks = std::move(request.parsed_blocks);
+          idle_http_clients.push_back(std::move(request.http_client));
+          pipeline.pop_front();
+          from_pipeline = true;
+        }
+        else
+        {
+          MDEBUG("Block request at height " << expected_start_height << " does not follow our chain, dropping " << pipeline.size() << " pipelined requests");
+          cancel_pipeline();
+          pull_and_parse_next_blocks(start_height, next_blocks_start_height, short_chain_history, blocks, parsed_blocks, next_blocks, next_parsed_blocks, error);
+        }
       }
-      waiter.wait(&tpool);
-      if(!first && blocks_start_height == next_blocks_start_height)
+      else
+      {
+        waiter.wait(&tpool);
+      }
+      if(!from_pipeline && !first && blocks_start_height == next_blocks_start_height)
       {
         m_node_rpc_proxy.set_height(m_blockchain.size());
         refreshed = true;
@@ -2763,12 +3089,14 @@ void wallet2::refresh(bool trusted_daemon, uint64_t start_height, uint64_t & blo
     {
       blocks_fetched += added_blocks;
       waiter.wait(&tpool);
+      cancel_pipeline();
       throw;
     }
     catch (const std::exception&)
     {
       blocks_fetched += added_blocks;
       waiter.wait(&tpool);
+      cancel_pipeline();
       if(try_count < 3)
       {
         LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
@@ -2849,10 +3177,13 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     }
   }
 
+  // only ask for the blocks we don't have yet, plus a few to notice a reorg
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request req = AUTO_VAL_INIT(req);
   cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response res = AUTO_VAL_INIT(res);
   req.amounts.push_back(0);
   req.from_height = 0;
+  if (m_rct_distribution.size() > RCT_DISTRIBUTION_REFETCH_BLOCKS)
+    req.from_height = m_rct_distribution_start_height + m_rct_distribution.size() - RCT_DISTRIBUTION_REFETCH_BLOCKS;
   req.cumulative = true;
   req.binary = true;
   m_daemon_rpc_mutex.lock();
@@ -2883,11 +3214,60 @@ bool wallet2::get_rct_distribution(uint64_t &start_height, std::vector<uint64_t>
     MWARNING("Failed to request output distribution: results are not for amount 0");
     return false;
   }
-  start_height = res.distributions[0].start_height;
-  distribution = std::move(res.distributions[0].distribution);
+  if (req.from_height > 0)
+  {
+    // rct counts are cumulative from the start of the chain, so a changed count
+    // at the first re-requested block means the chain below it was reorganized
+    const uint64_t offset = req.from_height - m_rct_distribution_start_height;
+    const std::vector<uint64_t> &d = res.distributions[0].distribution;
+    if (res.distributions[0].start_height != req.from_height || d.empty() || d[0] != m_rct_distribution[offset])
+    {
+      MDEBUG("Cached rct distribution does not match the daemon's, requesting it again");
+      m_rct_distribution.clear();
+      return get_rct_distribution(start_height, distribution);
+    }
+    m_rct_distribution.resize(offset);
+    m_rct_distribution.insert(m_rct_distribution.end(), d.begin(), d.end());
+  }
+  else
+  {
+    m_rct_distribution_start_height = res.distributions[0].start_height;
+    m_rct_distribution = std::move(res.distributions[0].distribution);
+  }
+  start_height = m_rct_distribution_start_height;
+  distribution = m_rct_distribution;
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::reset_decoy_pool(uint64_t rct_start_height, const std::vector<uint64_t> &rct_offsets)
+{
+  // picks drawn from another distribution would skew the selection, so they can't be kept
+  if (m_decoy_pool.rct_start_height == rct_start_height && m_decoy_pool.rct_offsets_size == rct_offsets.size() &&
+      !rct_offsets.empty() && m_decoy_pool.rct_top_offset == rct_offsets.back())
+    return;
+  m_decoy_pool = decoy_pool();
+  m_decoy_pool.rct_start_height = rct_start_height;
+  m_decoy_pool.rct_offsets_size = rct_offsets.size();
+  m_decoy_pool.rct_top_offset = rct_offsets.empty() ? 0 : rct_offsets.back();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::refill_decoy_pool(size_t min_picks, uint64_t num_unlocked_outs, const std::function<uint64_t()> &pick)
+{
+  if (m_decoy_pool.picks.size() >= min_picks)
+    return;
+
+  // picks past the unlocked outputs are always rejected by the selection, so they're
+  // dropped here, which leaves the remaining ones distributed as if drawn on demand
+  const size_t target = std::min<size_t>(std::max<size_t>(2 * min_picks, DECOY_POOL_MIN_PICKS), DECOY_POOL_MAX_PICKS);
+  for (size_t attempts = 0; m_decoy_pool.picks.size() < target && attempts < 4 * target; ++attempts)
+  {
+    const uint64_t i = pick();
+    if (i < num_unlocked_outs)
+      m_decoy_pool.picks.push_back(i);
+  }
+  LOG_PRINT_L1("Decoy pool refilled to " << m_decoy_pool.picks.size() << " gamma picks");
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::detach_blockchain(uint64_t height)
 {
   LOG_PRINT_L0("Detaching blockchain on height " << height);
@@ -2928,6 +3308,8 @@ void wallet2::detach_blockchain(uint64_t height)
     THROW_WALLET_EXCEPTION_IF(it_pk == m_pub_keys.end(), error::wallet_internal_error, "public key not found");
     m_pub_keys.erase(it_pk);
   }
+  for(size_t i = m_transfers.size(); i > i_start; --i)
+    unindex_transfer(i - 1);
   m_transfers.erase(it, m_transfers.end());
 
   size_t blocks_detached = m_blockchain.size() - height;
@@ -2936,7 +3318,10 @@ void wallet2::detach_blockchain(uint64_t height)
   for (auto it = m_payments.begin(); it != m_payments.end(); )
   {
     if(height <= it->second.m_block_height)
+    {
+      unindex_payment(*it);
       it = m_payments.erase(it);
+    }
     else
       ++it;
   }
@@ -2944,11 +3329,25 @@ void wallet2::detach_blockchain(uint64_t height)
   for (auto it = m_confirmed_txs.begin(); it != m_confirmed_txs.end(); )
   {
     if(height <= it->second.m_block_height)
+    {
+      unindex_confirmed_tx(*it);
       it = m_confirmed_txs.erase(it);
+    }
     else
       ++it;
   }
 
+  if (!m_cache_journal.compact)
+  {
+    m_cache_journal.blockchain_height = std::min<uint64_t>(m_cache_journal.blockchain_height, height);
+    m_cache_journal.transfers_size = std::min(m_cache_journal.transfers_size, m_transfers.size());
+    m_cache_journal.transfers.erase(m_cache_journal.transfers.lower_bound(m_cache_journal.transfers_size), m_cache_journal.transfers.end());
+    auto &payments = m_cache_journal.payments;
+    payments.erase(std::remove_if(payments.begin(), payments.end(), [height](const std::pair<crypto::hash, payment_details> &p) {
+      return height <= p.second.m_block_height;
+    }), payments.end());
+  }
+
   LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
 }
 //----------------------------------------------------------------------------------------------------
@@ -2977,6 +3376,8 @@ bool wallet2::clear()
   m_subaddresses.clear();
   m_subaddress_labels.clear();
   m_multisig_rounds_passed = 0;
+  invalidate_cache_journal();
+  rebuild_indexes();
   return true;
 }
 
@@ -3144,6 +3545,9 @@ bool wallet2::store_keys_to_buffer(const wipeable_string &password, std::string
   value2.SetInt(m_ignore_fractional_outputs ? 1 : 0);
   json.AddMember("ignore_fractional_outputs", value2, json.GetAllocator());
 
+  value2.SetUint(m_refresh_pipeline_depth);
+  json.AddMember("refresh_pipeline_depth", value2, json.GetAllocator());
+
   value2.SetUint(m_subaddress_lookahead_major);
   json.AddMember("subaddress_lookahead_major", value2, json.GetAllocator());
 
@@ -3269,6 +3673,7 @@ bool wallet2::load_keys_from_buffer(const std::string &encrypted_buf, const wipe
     m_key_reuse_mitigation2 = true;
     m_segregation_height = 0;
     m_ignore_fractional_outputs = true;
+    m_refresh_pipeline_depth = 1;
     m_subaddress_lookahead_major = SUBADDRESS_LOOKAHEAD_MAJOR;
     m_subaddress_lookahead_minor = SUBADDRESS_LOOKAHEAD_MINOR;
     m_device_name = "";
@@ -3424,6 +3829,8 @@ bool wallet2::load_keys_from_buffer(const std::string &encrypted_buf, const wipe
     m_segregation_height = field_segregation_height;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, ignore_fractional_outputs, int, Int, false, true);
     m_ignore_fractional_outputs = field_ignore_fractional_outputs;
+    GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, refresh_pipeline_depth, uint32_t, Uint, false, 1);
+    refresh_pipeline_depth(field_refresh_pipeline_depth);
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, subaddress_lookahead_major, uint32_t, Uint, false, SUBADDRESS_LOOKAHEAD_MAJOR);
     m_subaddress_lookahead_major = field_subaddress_lookahead_major;
     GET_FIELD_FROM_JSON_RETURN_ON_ERROR(json, subaddress_lookahead_minor, uint32_t, Uint, false, SUBADDRESS_LOOKAHEAD_MINOR);
@@ -4654,6 +5061,7 @@ void wallet2::load(const std::string& wallet_, const epee::wipeable_string& pass
   else
   {
     load_cache(m_wallet_file);
+    replay_cache_journal();
 //MONERO specific
 #if 0
     wallet2::cache_file_data cache_file_data;
@@ -4775,6 +5183,7 @@ void wallet2::load_cache(const string &cache_filename)
   std::string buf;
   bool r = epee::file_io_utils::load_file_to_string(cache_filename, buf, std::numeric_limits<size_t>::max());
   THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, cache_filename);
+  invalidate_cache_journal();
 
   // try to read it as an encrypted cache
   try
@@ -4792,6 +5201,9 @@ void wallet2::load_cache(const string &cache_filename)
       iss << cache_data;
       boost::archive::portable_binary_iarchive ar(iss);
       ar >> *this;
+      // only a cache in the current format can have a journal
+      m_cache_journal.snapshot_hash = crypto::cn_fast_hash(cache_file_data.cache_data.data(), cache_file_data.cache_data.size());
+      m_cache_journal.snapshot_size = cache_file_data.cache_data.size();
     }
     catch (...)
     {
@@ -4853,6 +5265,11 @@ void wallet2::load_cache(const string &cache_filename)
       m_account_public_address.m_spend_public_key != m_account.get_keys().m_account_address.m_spend_public_key ||
       m_account_public_address.m_view_public_key  != m_account.get_keys().m_account_address.m_view_public_key,
         error::wallet_files_doesnt_correspond, m_keys_file, cache_filename);
+
+  // caches written before transfers were compacted still carry the full tx prefixes
+  for (transfer_details &td: m_transfers)
+    td.m_tx = compact_tx_prefix(td.m_tx, td.m_internal_output_index);
+  rebuild_indexes();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::trim_hashchain()
@@ -4863,6 +5280,10 @@ void wallet2::trim_hashchain()
     if (td.m_block_height < height)
       height = td.m_block_height;
 
+  // past the reorg window, only sparse checkpoints are kept, even below our outputs
+  if (m_blockchain.size() > HASHCHAIN_REORG_WINDOW)
+    height = std::max<uint64_t>(height, m_blockchain.size() - HASHCHAIN_REORG_WINDOW);
+
   if (!m_blockchain.empty() && m_blockchain.size() == m_blockchain.offset())
   {
     MINFO("Fixing empty hashchain");
@@ -4877,6 +5298,7 @@ void wallet2::trim_hashchain()
       crypto::hash hash;
       epee::string_tools::hex_to_pod(res.block_header.hash, hash);
       m_blockchain.refill(hash);
+      invalidate_cache_journal();
     }
     else
     {
@@ -4891,6 +5313,46 @@ void wallet2::trim_hashchain()
   }
 }
 //----------------------------------------------------------------------------------------------------
+cryptonote::transaction_prefix wallet2::compact_tx_prefix(const cryptonote::transaction_prefix &tx, size_t output_index)
+{
+  // a transfer only needs its own output, the tx public keys and the key images of the
+  // inputs, so the rings, the other outputs and the rest of extra are not kept for it
+  THROW_WALLET_EXCEPTION_IF(output_index >= tx.vout.size(), error::wallet_internal_error,
+      "wrong out in transaction: internal index=" + std::to_string(output_index) + ", total_outs=" + std::to_string(tx.vout.size()));
+  cryptonote::transaction_prefix compact;
+  compact.version = tx.version;
+  compact.unlock_time = tx.unlock_time;
+  // outputs before ours stay as empty placeholders so it keeps its index
+  compact.vout.resize(output_index + 1);
+  compact.vout[output_index] = tx.vout[output_index];
+  compact.vin.reserve(tx.vin.size());
+  for (const txin_v &in: tx.vin)
+  {
+    if (in.type() == typeid(txin_to_key))
+    {
+      const txin_to_key &in_to_key = boost::get<txin_to_key>(in);
+      txin_to_key compact_in;
+      compact_in.amount = in_to_key.amount;
+      compact_in.k_image = in_to_key.k_image;
+      compact.vin.push_back(compact_in);
+    }
+    else
+    {
+      compact.vin.push_back(in);
+    }
+  }
+
+  std::vector<tx_extra_field> tx_extra_fields;
+  parse_tx_extra(tx.extra, tx_extra_fields); // ok if partially parsed
+  tx_extra_pub_key pub_key_field;
+  for (size_t i = 0; find_tx_extra_field_by_type(tx_extra_fields, pub_key_field, i); ++i)
+    add_tx_pub_key_to_extra(compact.extra, pub_key_field.pub_key);
+  tx_extra_additional_pub_keys additional_pub_keys;
+  if (find_tx_extra_field_by_type(tx_extra_fields, additional_pub_keys))
+    add_additional_tx_pub_keys_to_extra(compact.extra, additional_pub_keys.data);
+  return compact;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::check_genesis(const crypto::hash& genesis_hash) const {
   std::string what("Genesis block mismatch. You probably use wallet without testnet (or stagenet) flag with blockchain from test (or stage) network or vice versa");
 
@@ -4980,6 +5442,10 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_file);
     }
+    // remove old cache journal, it only applies to the old wallet file
+    boost::system::error_code ec;
+    boost::filesystem::remove(old_file + ".journal", ec);
+    invalidate_cache_journal();
     // remove old keys file
     r = boost::filesystem::remove(old_keys_file);
     if (!r) {
@@ -4990,8 +5456,10 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     if (!r) {
       LOG_ERROR("error removing file: " << old_address_file);
     }
-  } else {
-    store_cache(new_file);
+  } else if (!append_cache_journal()) {
+    crypto::hash snapshot_hash;
+    uint64_t snapshot_size;
+    write_cache(new_file, snapshot_hash, snapshot_size);
     //MONERO specific
 #if 0
     // save to new file
@@ -5018,10 +5486,20 @@ void wallet2::store_to(const std::string &path, const epee::wipeable_string &pas
     // here we have "*.new" file, we need to rename it to be without ".new"
     std::error_code e = tools::replace_file(new_file, m_wallet_file);
     THROW_WALLET_EXCEPTION_IF(e, error::file_save_error, m_wallet_file, e);
+    start_cache_journal(snapshot_hash, snapshot_size);
   }
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::store_cache(const string &filename)
+{
+  crypto::hash snapshot_hash;
+  uint64_t snapshot_size;
+  write_cache(filename, snapshot_hash, snapshot_size);
+  // the journal must not be appended to a cache it wasn't started for
+  invalidate_cache_journal();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::write_cache(const std::string &filename, crypto::hash &snapshot_hash, uint64_t &snapshot_size)
 {
   // preparing wallet data
   std::stringstream oss;
@@ -5035,6 +5513,8 @@ void wallet2::store_cache(const string &filename)
   cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
   crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cipher[0]);
   cache_file_data.cache_data = cipher;
+  snapshot_hash = crypto::cn_fast_hash(cipher.data(), cipher.size());
+  snapshot_size = cipher.size();
 
 #ifdef WIN32
     // On Windows avoid using std::ofstream which does not work with UTF-8 filenames
@@ -5056,6 +5536,245 @@ void wallet2::store_cache(const string &filename)
 #endif
 }
 //----------------------------------------------------------------------------------------------------
+void wallet2::cache_journal_transfer(size_t idx)
+{
+  // transfers past transfers_size are new since the last store and journaled whole anyway
+  if (!m_cache_journal.compact && idx < m_cache_journal.transfers_size)
+    m_cache_journal.transfers.insert(idx);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::invalidate_cache_journal()
+{
+  m_cache_journal = cache_journal_changes();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::start_cache_journal(const crypto::hash &snapshot_hash, uint64_t snapshot_size)
+{
+  invalidate_cache_journal();
+
+  // the header ties the journal to the cache it was started for, so a journal left
+  // behind by an interrupted store is never replayed on top of a newer cache
+  std::string header(CACHE_JOURNAL_MAGIC, strlen(CACHE_JOURNAL_MAGIC));
+  header += std::string((const char*)&snapshot_hash, sizeof(snapshot_hash));
+  if (!epee::file_io_utils::save_string_to_file(m_wallet_file + ".journal", header))
+  {
+    MERROR("Failed to start cache journal, the full cache will be stored again next time");
+    return;
+  }
+
+  m_cache_journal.compact = false;
+  m_cache_journal.snapshot_hash = snapshot_hash;
+  m_cache_journal.snapshot_size = snapshot_size;
+  m_cache_journal.journal_size = header.size();
+  m_cache_journal.blockchain_height = m_blockchain.size();
+  m_cache_journal.transfers_size = m_transfers.size();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::append_cache_journal()
+{
+  if (m_cache_journal.compact || m_light_wallet)
+    return false;
+  // compact once replaying the journal would cost about as much as loading the cache itself
+  if (m_cache_journal.records >= CACHE_JOURNAL_MAX_RECORDS || m_cache_journal.journal_size > m_cache_journal.snapshot_size)
+    return false;
+  // blocks below the hashchain offset were trimmed and can't be journaled
+  if (m_cache_journal.blockchain_height < m_blockchain.offset() || m_cache_journal.blockchain_height > m_blockchain.size())
+    return false;
+
+  cache_journal_record record;
+  record.blockchain_height = m_cache_journal.blockchain_height;
+  record.blocks.reserve(m_blockchain.size() - m_cache_journal.blockchain_height);
+  for (size_t i = m_cache_journal.blockchain_height; i < m_blockchain.size(); ++i)
+    record.blocks.push_back(m_blockchain[i]);
+  record.transfers_size = m_cache_journal.transfers_size;
+  for (size_t idx: m_cache_journal.transfers)
+    record.transfers.push_back(std::make_pair(idx, m_transfers[idx]));
+  for (size_t idx = m_cache_journal.transfers_size; idx < m_transfers.size(); ++idx)
+    record.transfers.push_back(std::make_pair(idx, m_transfers[idx]));
+  record.payments = m_cache_journal.payments;
+  for (const crypto::hash &txid: m_cache_journal.confirmed_txs)
+  {
+    // entries dropped by a reorg are dropped again by replaying the detach
+    auto i = m_confirmed_txs.find(txid);
+    if (i != m_confirmed_txs.end())
+      record.confirmed_txs.push_back(*i);
+  }
+  record.subaddresses = m_cache_journal.subaddresses;
+
+  std::stringstream oss;
+  boost::archive::portable_binary_oarchive ar(oss);
+  ar << record;
+  serialize_cache_journal_state(ar, record.subaddresses);
+
+  wallet2::cache_file_data cache_file_data = boost::value_initialized<wallet2::cache_file_data>();
+  cache_file_data.cache_data = oss.str();
+  std::string cipher;
+  cipher.resize(cache_file_data.cache_data.size());
+  cache_file_data.iv = crypto::rand<crypto::chacha_iv>();
+  crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cipher[0]);
+  cache_file_data.cache_data = cipher;
+
+  std::ostringstream ostr;
+  binary_archive<true> oar(ostr);
+  if (!::serialization::serialize(oar, cache_file_data))
+    return false;
+  const std::string blob = ostr.str();
+  if (!epee::file_io_utils::append_string_to_file(m_wallet_file + ".journal", blob))
+  {
+    // a partly written record ends the journal when replaying, so start over with a full cache
+    MERROR("Failed to append to cache journal, storing the full cache");
+    invalidate_cache_journal();
+    return false;
+  }
+
+  m_cache_journal.journal_size += blob.size();
+  ++m_cache_journal.records;
+  m_cache_journal.blockchain_height = m_blockchain.size();
+  m_cache_journal.transfers_size = m_transfers.size();
+  m_cache_journal.transfers.clear();
+  m_cache_journal.payments.clear();
+  m_cache_journal.confirmed_txs.clear();
+  m_cache_journal.subaddresses = false;
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::replay_cache_journal()
+{
+  const std::string filename = m_wallet_file + ".journal";
+  const crypto::hash snapshot_hash = m_cache_journal.snapshot_hash;
+  const uint64_t snapshot_size = m_cache_journal.snapshot_size;
+  if (snapshot_hash == crypto::null_hash)
+    return;
+
+  boost::system::error_code ec;
+  if (!boost::filesystem::exists(filename, ec) || ec)
+    return;
+
+  std::string buf;
+  bool r = epee::file_io_utils::load_file_to_string(filename, buf, std::numeric_limits<size_t>::max());
+  THROW_WALLET_EXCEPTION_IF(!r, error::file_read_error, filename);
+
+  const size_t magiclen = strlen(CACHE_JOURNAL_MAGIC);
+  if (buf.size() < magiclen + sizeof(crypto::hash) || memcmp(buf.data(), CACHE_JOURNAL_MAGIC, magiclen) ||
+      memcmp(buf.data() + magiclen, &snapshot_hash, sizeof(crypto::hash)))
+  {
+    MWARNING("Ignoring cache journal " << filename << ", it was not started for this cache");
+    return;
+  }
+
+  std::istringstream iss(buf);
+  iss.seekg(magiclen + sizeof(crypto::hash));
+  binary_archive<false> iar(iss);
+  size_t records = 0;
+  bool complete = true;
+  while (iar.remaining_bytes() > 0)
+  {
+    wallet2::cache_file_data cache_file_data;
+    if (!::do_serialize(iar, cache_file_data) || !iar.stream().good() || cache_file_data.cache_data.empty())
+    {
+      // the last store was interrupted, everything before it is intact
+      MWARNING("Cache journal " << filename << " ends with a partial record, ignoring it");
+      complete = false;
+      break;
+    }
+
+    std::string cache_data;
+    cache_data.resize(cache_file_data.cache_data.size());
+    crypto::chacha20(cache_file_data.cache_data.data(), cache_file_data.cache_data.size(), m_cache_key, cache_file_data.iv, &cache_data[0]);
+
+    try
+    {
+      std::stringstream ss;
+      ss << cache_data;
+      boost::archive::portable_binary_iarchive ar(ss);
+      cache_journal_record record;
+      ar >> record;
+
+      THROW_WALLET_EXCEPTION_IF(record.blockchain_height < m_blockchain.offset() || record.blockchain_height > m_blockchain.size(),
+          error::wallet_internal_error, "Cache journal record crops the hashchain out of bounds");
+      THROW_WALLET_EXCEPTION_IF(record.transfers_size > m_transfers.size(),
+          error::wallet_internal_error, "Cache journal record crops transfers out of bounds");
+      serialize_cache_journal_state(ar, record.subaddresses);
+
+      // same as detach_blockchain
+      if (record.blockchain_height < m_blockchain.size())
+      {
+        const uint64_t height = record.blockchain_height;
+        for (auto it = m_payments.begin(); it != m_payments.end(); )
+        {
+          if(height <= it->second.m_block_height)
+            it = m_payments.erase(it);
+          else
+            ++it;
+        }
+        for (auto it = m_confirmed_txs.begin(); it != m_confirmed_txs.end(); )
+        {
+          if(height <= it->second.m_block_height)
+            it = m_confirmed_txs.erase(it);
+          else
+            ++it;
+        }
+        m_blockchain.crop(height);
+      }
+      for (const crypto::hash &h: record.blocks)
+        m_blockchain.push_back(h);
+
+      for (size_t i = record.transfers_size; i < m_transfers.size(); ++i)
+      {
+        const transfer_details &td = m_transfers[i];
+        if (td.m_key_image_known && !td.m_key_image_partial)
+          m_key_images.erase(td.m_key_image);
+        m_pub_keys.erase(td.get_public_key());
+      }
+      m_transfers.erase(m_transfers.begin() + record.transfers_size, m_transfers.end());
+      for (auto &t: record.transfers)
+      {
+        const size_t idx = t.first;
+        THROW_WALLET_EXCEPTION_IF(idx > m_transfers.size(), error::wallet_internal_error, "Cache journal record has a gap in transfers");
+        if (idx == m_transfers.size())
+        {
+          m_transfers.push_back(std::move(t.second));
+        }
+        else
+        {
+          const transfer_details &td = m_transfers[idx];
+          if (td.m_key_image_known && !td.m_key_image_partial)
+            m_key_images.erase(td.m_key_image);
+          m_transfers[idx] = std::move(t.second);
+        }
+        const transfer_details &td = m_transfers[idx];
+        if (td.m_key_image_known && !td.m_key_image_partial)
+          m_key_images[td.m_key_image] = idx;
+        m_pub_keys[td.get_public_key()] = idx;
+      }
+
+      for (const auto &p: record.payments)
+        m_payments.emplace(p);
+      for (const auto &p: record.confirmed_txs)
+        m_confirmed_txs[p.first] = p.second;
+    }
+    catch (const std::exception &e)
+    {
+      THROW_WALLET_EXCEPTION(error::wallet_internal_error, "Failed to replay record " + std::to_string(records) + " of cache journal " + filename +
+          " (" + e.what() + "), remove it to load the wallet from its last full cache");
+    }
+    ++records;
+  }
+  rebuild_indexes();
+
+  MINFO("Replayed " << records << " cache journal records");
+  if (!complete)
+    return;
+
+  m_cache_journal.compact = false;
+  m_cache_journal.snapshot_hash = snapshot_hash;
+  m_cache_journal.snapshot_size = snapshot_size;
+  m_cache_journal.journal_size = buf.size();
+  m_cache_journal.records = records;
+  m_cache_journal.blockchain_height = m_blockchain.size();
+  m_cache_journal.transfers_size = m_transfers.size();
+}
+//----------------------------------------------------------------------------------------------------
 // TODO: implement till_block
 uint64_t wallet2::balance(uint32_t index_major/*, uint64_t till_block*/) const
 {
@@ -5160,6 +5879,45 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
   incoming_transfers = m_transfers;
 }
 //----------------------------------------------------------------------------------------------------
+bool wallet2::get_incoming_transfers(std::vector<size_t>& transfers, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices, const boost::optional<bool>& spent, size_t start, size_t max_results) const
+{
+  std::vector<const std::vector<size_t>*> lists;
+  if (subaddr_indices.empty())
+  {
+    const auto i = m_transfers_by_account.find(subaddr_account);
+    if (i != m_transfers_by_account.end())
+      lists.push_back(&i->second);
+  }
+  else
+  {
+    for (uint32_t minor: subaddr_indices)
+    {
+      const auto i = m_transfers_by_subaddress.find({subaddr_account, minor});
+      if (i != m_transfers_by_subaddress.end())
+        lists.push_back(&i->second);
+    }
+  }
+
+  // each list is sorted, so taking max_results + 1 from each is enough to find the first max_results overall
+  const size_t first = transfers.size();
+  for (const std::vector<size_t> *list: lists)
+  {
+    size_t found = 0;
+    for (auto i = std::lower_bound(list->begin(), list->end(), start); i != list->end() && (max_results == 0 || found <= max_results); ++i)
+    {
+      if (spent && m_transfers[*i].m_spent != *spent)
+        continue;
+      transfers.push_back(*i);
+      ++found;
+    }
+  }
+  std::sort(transfers.begin() + first, transfers.end());
+  if (max_results == 0 || transfers.size() - first <= max_results)
+    return false;
+  transfers.resize(first + max_results);
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
 {
   auto range = m_payments.equal_range(payment_id);
@@ -5173,31 +5931,99 @@ void wallet2::get_payments(const crypto::hash& payment_id, std::list<wallet2::pa
   });
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
+namespace
 {
-  auto range = std::make_pair(m_payments.begin(), m_payments.end());
-  std::for_each(range.first, range.second, [&payments, &min_height, &max_height, &subaddr_account, &subaddr_indices](const payment_container::value_type& x) {
-    if (min_height < x.second.m_block_height && max_height >= x.second.m_block_height &&
-      (!subaddr_account || *subaddr_account == x.second.m_subaddr_index.major) &&
-      (subaddr_indices.empty() || subaddr_indices.count(x.second.m_subaddr_index.minor) == 1))
-    {
-      payments.push_back(x);
+  // Calls f on the entries of several height ordered index ranges, in height order, until it accepted
+  // max_results of them (0 for all), always finishing the block of the last accepted one.
+  // Returns whether entries are left.
+  template<typename Iterator, typename F>
+  bool merge_by_height(std::vector<std::pair<Iterator, Iterator>> &ranges, size_t max_results, F f)
+  {
+    size_t results = 0;
+    uint64_t last_height = 0;
+    while (true)
+    {
+      auto next = ranges.end();
+      for (auto i = ranges.begin(); i != ranges.end(); ++i)
+        if (i->first != i->second && (next == ranges.end() || i->first->second->second.m_block_height < next->first->second->second.m_block_height))
+          next = i;
+      if (next == ranges.end())
+        return false;
+      const uint64_t height = next->first->second->second.m_block_height;
+      if (max_results && results >= max_results && height != last_height)
+        return true;
+      if (f(*next->first->second))
+      {
+        ++results;
+        last_height = height;
+      }
+      ++next->first;
     }
-  });
+  }
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
-    uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
+bool wallet2::get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices, size_t max_results) const
 {
-  for (auto i = m_confirmed_txs.begin(); i != m_confirmed_txs.end(); ++i) {
-    if (i->second.m_block_height <= min_height || i->second.m_block_height > max_height)
-      continue;
-    if (subaddr_account && *subaddr_account != i->second.m_subaddr_account)
-      continue;
-    if (!subaddr_indices.empty() && std::count_if(i->second.m_subaddr_indices.begin(), i->second.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) == 0)
-      continue;
-    confirmed_payments.push_back(*i);
+  if (min_height >= max_height)
+    return false;
+
+  std::vector<std::pair<payments_by_account_index::const_iterator, payments_by_account_index::const_iterator>> account_ranges;
+  std::vector<std::pair<payments_by_subaddress_index::const_iterator, payments_by_subaddress_index::const_iterator>> subaddress_ranges;
+  if (subaddr_account && !subaddr_indices.empty())
+  {
+    for (uint32_t minor: subaddr_indices)
+      subaddress_ranges.emplace_back(m_payments_by_subaddress.lower_bound(std::make_tuple(*subaddr_account, minor, min_height + 1)),
+          m_payments_by_subaddress.upper_bound(std::make_tuple(*subaddr_account, minor, max_height)));
+  }
+  else if (subaddr_account)
+  {
+    account_ranges.emplace_back(m_payments_by_account.lower_bound(std::make_pair(*subaddr_account, min_height + 1)),
+        m_payments_by_account.upper_bound(std::make_pair(*subaddr_account, max_height)));
+  }
+  else
+  {
+    // one range per account that received payments
+    for (auto i = m_payments_by_account.begin(); i != m_payments_by_account.end(); i = m_payments_by_account.upper_bound(std::make_pair(i->first.first, (uint64_t)-1)))
+      account_ranges.emplace_back(m_payments_by_account.lower_bound(std::make_pair(i->first.first, min_height + 1)),
+          m_payments_by_account.upper_bound(std::make_pair(i->first.first, max_height)));
+  }
+
+  const auto add = [&payments, &subaddr_account, &subaddr_indices](const payment_container::value_type &x) {
+    if (!subaddr_account && !subaddr_indices.empty() && subaddr_indices.count(x.second.m_subaddr_index.minor) == 0)
+      return false;
+    payments.push_back(x);
+    return true;
+  };
+  if (!subaddress_ranges.empty())
+    return merge_by_height(subaddress_ranges, max_results, add);
+  return merge_by_height(account_ranges, max_results, add);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
+    uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices, size_t max_results) const
+{
+  if (min_height >= max_height)
+    return false;
+
+  std::vector<std::pair<confirmed_txs_by_account_index::const_iterator, confirmed_txs_by_account_index::const_iterator>> ranges;
+  if (subaddr_account)
+  {
+    ranges.emplace_back(m_confirmed_txs_by_account.lower_bound(std::make_pair(*subaddr_account, min_height + 1)),
+        m_confirmed_txs_by_account.upper_bound(std::make_pair(*subaddr_account, max_height)));
   }
+  else
+  {
+    for (auto i = m_confirmed_txs_by_account.begin(); i != m_confirmed_txs_by_account.end(); i = m_confirmed_txs_by_account.upper_bound(std::make_pair(i->first.first, (uint64_t)-1)))
+      ranges.emplace_back(m_confirmed_txs_by_account.lower_bound(std::make_pair(i->first.first, min_height + 1)),
+          m_confirmed_txs_by_account.upper_bound(std::make_pair(i->first.first, max_height)));
+  }
+
+  return merge_by_height(ranges, max_results, [&confirmed_payments, &subaddr_indices](const std::pair<const crypto::hash, confirmed_transfer_details> &x) {
+    if (!subaddr_indices.empty() && std::count_if(x.second.m_subaddr_indices.begin(), x.second.m_subaddr_indices.end(), [&subaddr_indices](uint32_t index) { return subaddr_indices.count(index) == 1; }) == 0)
+      return false;
+    confirmed_payments.push_back(x);
+    return true;
+  });
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account, const std::set<uint32_t>& subaddr_indices) const
@@ -5659,7 +6485,10 @@ void wallet2::commit_tx(pending_tx& ptx)
 
   // tx generated, get rid of used k values
   for (size_t idx: ptx.selected_transfers)
+  {
     m_transfers[idx].m_multisig_k.clear();
+    cache_journal_transfer(idx);
+  }
 
   //fee includes dust if dust policy specified it.
   LOG_PRINT_L1("Transaction successfully sent. <" << txid << ">" << ENDL
@@ -6074,6 +6903,7 @@ bool wallet2::parse_tx_from_str(const std::string &signed_tx_st, std::vector<too
     td.m_key_image_partial = false;
     m_pub_keys[m_transfers[i].get_public_key()] = i;
   }
+  invalidate_cache_journal();
 
   ptx = signed_txs.ptx;
 
@@ -6087,7 +6917,10 @@ std::string wallet2::save_multisig_tx(multisig_tx_set txs)
   // txes generated, get rid of used k values
   for (size_t n = 0; n < txs.m_ptx.size(); ++n)
     for (size_t idx: txs.m_ptx[n].construction_data.selected_transfers)
+    {
       m_transfers[idx].m_multisig_k.clear();
+      cache_journal_transfer(idx);
+    }
 
   // zero out some data we don't want to share
   for (auto &ptx: txs.m_ptx)
@@ -6348,7 +7181,10 @@ bool wallet2::sign_multisig_tx(multisig_tx_set &exported_txs, std::vector<crypto
   // txes generated, get rid of used k values
   for (size_t n = 0; n < exported_txs.m_ptx.size(); ++n)
     for (size_t idx: exported_txs.m_ptx[n].construction_data.selected_transfers)
+    {
       m_transfers[idx].m_multisig_k.clear();
+      cache_journal_transfer(idx);
+    }
 
   exported_txs.m_signers.insert(get_multisig_signer_public_key());
 
@@ -7104,6 +7940,26 @@ void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>>
       return rct_offsets[first_block_offset] + crypto::rand<uint64_t>() % n_rct;
     };
 
+    // gamma picks come from the decoy pool when it has some, so that the transactions
+    // built one after the other from the same distribution share one batch of picks
+    auto next_gamma_pick = [&]()
+    {
+      if (m_decoy_pool.picks.empty())
+        return pick_gamma();
+      const uint64_t i = m_decoy_pool.picks.front();
+      m_decoy_pool.picks.pop_front();
+      return i;
+    };
+    if (has_rct_distribution)
+    {
+      reset_decoy_pool(rct_start_height, rct_offsets);
+      size_t min_picks = 0;
+      for (size_t idx: selected_transfers)
+        if (m_transfers[idx].is_rct())
+          min_picks += base_requested_outputs_count + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE;
+      refill_decoy_pool(min_picks, rct_offsets[rct_offsets.size() - CRYPTONOTE_DEFAULT_TX_SPENDABLE_AGE], pick_gamma);
+    }
+
     size_t num_selected_transfers = 0;
     for(size_t idx: selected_transfers)
     {
@@ -7301,17 +8157,17 @@ void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>>
             // gamma distribution
             if (num_found -1 < recent_outputs_count + pre_fork_outputs_count)
             {
-              do i = pick_gamma(); while (i >= segregation_limit[amount].first);
+              do i = next_gamma_pick(); while (i >= segregation_limit[amount].first);
               type = "pre-fork gamma";
             }
             else if (num_found -1 < recent_outputs_count + pre_fork_outputs_count + post_fork_outputs_count)
             {
-              do i = pick_gamma(); while (i < segregation_limit[amount].first || i >= num_outs);
+              do i = next_gamma_pick(); while (i < segregation_limit[amount].first || i >= num_outs);
               type = "post-fork gamma";
             }
             else
             {
-              do i = pick_gamma(); while (i >= num_outs);
+              do i = next_gamma_pick(); while (i >= num_outs);
               type = "gamma";
             }
           }
@@ -7392,7 +8248,9 @@ void wallet2::get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>>
     for (auto i: req.outputs)
       LOG_PRINT_L1("asking for output " << i.index << " for " << print_money(i.amount));
 
-    // get the keys for those
+    // get the keys for those: every ring is asked for whole, real output included, even
+    // when its decoys came from the pool, so the real output is always checked below
+    // against what the daemon sent for it along with its decoys
     m_daemon_rpc_mutex.lock();
     bool r = epee::net_utils::invoke_http_bin("/get_outs.bin", req, daemon_resp, m_http_client, rpc_timeout);
     m_daemon_rpc_mutex.unlock();
@@ -8134,6 +8992,8 @@ void wallet2::light_wallet_get_unspent_outs()
   
   // Clear old outputs
   m_transfers.clear();
+  m_transfers_by_account.clear();
+  m_transfers_by_subaddress.clear();
   
   for (const auto &o: ores.outputs) {
     bool spent = false;
@@ -8244,6 +9104,7 @@ void wallet2::light_wallet_get_unspent_outs()
     }
     if(!spent)
       set_unspent(m_transfers.size()-1);
+    index_transfer(m_transfers.size()-1);
     m_key_images[td.m_key_image] = m_transfers.size()-1;
     m_pub_keys[td.get_public_key()] = m_transfers.size()-1;
   }
@@ -8372,7 +9233,7 @@ void wallet2::light_wallet_get_address_txs()
         }
       } else {
         if (std::find(payments_txs.begin(), payments_txs.end(), tx_hash) == payments_txs.end()) {
-          m_payments.emplace(tx_hash, payment);
+          index_payment(*m_payments.emplace(tx_hash, payment));
           if (0 != m_callback) {
             m_callback->on_lw_money_received(t.height, payment.m_tx_hash, payment.m_amount);
           }
@@ -8420,7 +9281,7 @@ void wallet2::light_wallet_get_address_txs()
             ctd.m_payment_id = payment_id;
             ctd.m_block_height = t.height;
             ctd.m_timestamp = t.timestamp;
-            m_confirmed_txs.emplace(tx_hash,ctd);
+            index_confirmed_tx(*m_confirmed_txs.emplace(tx_hash,ctd).first);
           }
           if (0 != m_callback)
           {
@@ -9584,6 +10445,7 @@ void wallet2::discard_unmixable_outputs()
   for (size_t idx : unmixable_outputs)
   {
     m_transfers[idx].m_spent = true;
+    cache_journal_transfer(idx);
   }
 }
 
@@ -10724,13 +11586,11 @@ crypto::public_key wallet2::get_tx_pub_key_from_received_outs(const tools::walle
     bool r = hwdev.generate_key_derivation(tx_pub_key, keys.m_view_secret_key, derivation);
     THROW_WALLET_EXCEPTION_IF(!r, error::wallet_internal_error, "Failed to generate key derivation");
 
-    for (size_t i = 0; i < td.m_tx.vout.size(); ++i)
-    {
-      tx_scan_info_t tx_scan_info;
-      check_acc_out_precomp(td.m_tx.vout[i], derivation, additional_derivations, i, tx_scan_info);
-      if (!tx_scan_info.error && tx_scan_info.received)
-        return tx_pub_key;
-    }
+    // only our own output is kept with the transfer
+    tx_scan_info_t tx_scan_info;
+    check_acc_out_precomp(td.m_tx.vout[td.m_internal_output_index], derivation, additional_derivations, td.m_internal_output_index, tx_scan_info);
+    if (!tx_scan_info.error && tx_scan_info.received)
+      return tx_pub_key;
   }
 
   // we found no key yielding an output
@@ -10878,6 +11738,8 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
     return 0;
   }
 
+  invalidate_cache_journal();
+
   for (size_t n = 0; n < signed_key_images.size(); ++n)
   {
     const transfer_details &td = m_transfers[n];
@@ -11078,6 +11940,7 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       {
         if (j->second.m_tx_hash == *spent_txid)
         {
+          unindex_payment(*j);
           m_payments.erase(j);
           break;
         }
@@ -11094,7 +11957,9 @@ uint64_t wallet2::import_key_images(const std::vector<std::pair<crypto::key_imag
       pd.m_amount_in = pd.m_amount_out = td.amount();         // fee is unknown
       pd.m_block_height = 0;  // spent block height is unknown
       const crypto::hash &spent_txid = crypto::null_hash; // spent txid is unknown
-      m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+      auto entry = m_confirmed_txs.insert(std::make_pair(spent_txid, pd));
+      if (entry.second)
+        index_confirmed_tx(*entry.first);
     }
   }
 
@@ -11111,19 +11976,23 @@ wallet2::payment_container wallet2::export_payments() const
 }
 void wallet2::import_payments(const payment_container &payments)
 {
+  invalidate_cache_journal();
   m_payments.clear();
   for (auto const &p : payments)
   {
     m_payments.emplace(p);
   }
+  rebuild_indexes();
 }
 void wallet2::import_payments_out(const std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>> &confirmed_payments)
 {
+  invalidate_cache_journal();
   m_confirmed_txs.clear();
   for (auto const &p : confirmed_payments)
   {
     m_confirmed_txs.emplace(p);
   }
+  rebuild_indexes();
 }
 
 std::tuple<size_t,crypto::hash,std::vector<crypto::hash>> wallet2::export_blockchain() const
@@ -11140,6 +12009,7 @@ std::tuple<size_t,crypto::hash,std::vector<crypto::hash>> wallet2::export_blockc
 
 void wallet2::import_blockchain(const std::tuple<size_t, crypto::hash, std::vector<crypto::hash>> &bc)
 {
+  invalidate_cache_journal();
   m_blockchain.clear();
   if (std::get<0>(bc))
   {
@@ -11192,11 +12062,15 @@ std::string wallet2::export_outputs_to_str() const
 //----------------------------------------------------------------------------------------------------
 size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_details> &outputs)
 {
+  invalidate_cache_journal();
   m_transfers.clear();
+  m_transfers_by_account.clear();
+  m_transfers_by_subaddress.clear();
   m_transfers.reserve(outputs.size());
   for (size_t i = 0; i < outputs.size(); ++i)
   {
     transfer_details td = outputs[i];
+    td.m_tx = compact_tx_prefix(td.m_tx, td.m_internal_output_index);
 
     // the hot wallet wouldn't have known about key images (except if we already exported them)
     cryptonote::keypair in_ephemeral;
@@ -11219,6 +12093,7 @@ size_t wallet2::import_outputs(const std::vector<tools::wallet2::transfer_detail
     m_key_images[td.m_key_image] = m_transfers.size();
     m_pub_keys[td.get_public_key()] = m_transfers.size();
     m_transfers.push_back(std::move(td));
+    index_transfer(m_transfers.size() - 1);
   }
 
   return m_transfers.size();
@@ -11421,6 +12296,8 @@ cryptonote::blobdata wallet2::export_multisig()
 
     info[n].m_signer = signer;
   }
+  // every transfer got new k values, the next store writes the full cache
+  invalidate_cache_journal();
 
   std::stringstream oss;
   boost::archive::portable_binary_oarchive ar(oss);
@@ -11443,6 +12320,7 @@ void wallet2::update_multisig_rescan_info(const std::vector<std::vector<rct::key
   CHECK_AND_ASSERT_THROW_MES(multisig_k.size() >= m_transfers.size(), "Mismatched sizes of multisig_k and info");
 
   MDEBUG("update_multisig_rescan_info: updating index " << n);
+  invalidate_cache_journal();
   transfer_details &td = m_transfers[n];
   td.m_multisig_info.clear();
   for (const auto &pi: info)
@@ -38,6 +38,7 @@
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/vector.hpp>
 #include <boost/serialization/deque.hpp>
+#include <boost/serialization/map.hpp>
 #include <atomic>
 
 #include "include_base_utils.h"
@@ -58,12 +59,14 @@
 
 #include "wallet_errors.h"
 #include "common/password.h"
+#include "common/threadpool.h"
 #include "node_rpc_proxy.h"
 
 #undef MONERO_DEFAULT_LOG_CATEGORY
 #define MONERO_DEFAULT_LOG_CATEGORY "wallet.wallet2"
 
 class Serialization_portability_wallet_Test;
+class wallet_accessor_test;
 
 namespace tools
 {
@@ -123,17 +126,21 @@ namespace tools
   public:
     hashchain(): m_genesis(crypto::null_hash), m_offset(0) {}
 
+    // one in that many hashes trimmed off the front is kept as a checkpoint
+    static constexpr size_t checkpoint_interval = 1000;
+
     size_t size() const { return m_blockchain.size() + m_offset; }
     size_t offset() const { return m_offset; }
     const crypto::hash &genesis() const { return m_genesis; }
+    const std::map<size_t, crypto::hash> &checkpoints() const { return m_checkpoints; }
     void push_back(const crypto::hash &hash) { if (m_offset == 0 && m_blockchain.empty()) m_genesis = hash; m_blockchain.push_back(hash); }
     bool is_in_bounds(size_t idx) const { return idx >= m_offset && idx < size(); }
     const crypto::hash &operator[](size_t idx) const { return m_blockchain[idx - m_offset]; }
     crypto::hash &operator[](size_t idx) { return m_blockchain[idx - m_offset]; }
-    void crop(size_t height) { m_blockchain.resize(height - m_offset); }
-    void clear() { m_offset = 0; m_blockchain.clear(); }
+    void crop(size_t height) { m_blockchain.resize(height - m_offset); m_checkpoints.erase(m_checkpoints.lower_bound(height), m_checkpoints.end()); }
+    void clear() { m_offset = 0; m_blockchain.clear(); m_checkpoints.clear(); }
     bool empty() const { return m_blockchain.empty() && m_offset == 0; }
-    void trim(size_t height) { while (height > m_offset && m_blockchain.size() > 1) { m_blockchain.pop_front(); ++m_offset; } m_blockchain.shrink_to_fit(); }
+    void trim(size_t height) { while (height > m_offset && m_blockchain.size() > 1) { if (m_offset > 0 && m_offset % checkpoint_interval == 0 && m_blockchain.front() != crypto::null_hash) m_checkpoints[m_offset] = m_blockchain.front(); m_blockchain.pop_front(); ++m_offset; } m_blockchain.shrink_to_fit(); }
     void refill(const crypto::hash &hash) { m_blockchain.push_back(hash); --m_offset; }
 
     template <class t_archive>
@@ -142,22 +149,31 @@ namespace tools
       a & m_offset;
       a & m_genesis;
       a & m_blockchain;
+      if (ver < 1)
+        return;
+      a & m_checkpoints;
     }
 
   private:
     size_t m_offset;
     crypto::hash m_genesis;
     std::deque<crypto::hash> m_blockchain;
+    std::map<size_t, crypto::hash> m_checkpoints;
   };
 
   class wallet_keys_unlocker;
+  class wallet_scanner;
   class wallet2
   {
     friend class ::Serialization_portability_wallet_Test;
+    friend class ::wallet_accessor_test;
     friend class GraftWallet;
     friend class wallet_keys_unlocker;
+    friend class wallet_scanner;
   public:
     static constexpr const std::chrono::seconds rpc_timeout = std::chrono::minutes(3) + std::chrono::seconds(30);
+    //! each block request in flight holds a connection to the daemon and a batch of parsed blocks
+    static constexpr const uint32_t max_refresh_pipeline_depth = 16;
 
     enum RefreshType {
       RefreshFull,
@@ -370,6 +386,9 @@ namespace tools
 
     typedef std::vector<transfer_details> transfer_container;
     typedef std::unordered_multimap<crypto::hash, payment_details> payment_container;
+    typedef std::multimap<std::pair<uint32_t, uint64_t>, const payment_container::value_type*> payments_by_account_index;
+    typedef std::multimap<std::tuple<uint32_t, uint32_t, uint64_t>, const payment_container::value_type*> payments_by_subaddress_index;
+    typedef std::multimap<std::pair<uint32_t, uint64_t>, const std::pair<const crypto::hash, confirmed_transfer_details>*> confirmed_txs_by_account_index;
 
     struct multisig_sig
     {
@@ -460,6 +479,20 @@ namespace tools
         FIELD(cache_data)
       END_SERIALIZE()
     };
+
+    // Changes to the wallet cache since the previous store, appended to the
+    // cache journal instead of rewriting the whole cache. The small parts of
+    // the cache which are not tracked here follow each record verbatim.
+    struct cache_journal_record
+    {
+      uint64_t blockchain_height; // hashchain is cropped to this height before appending blocks
+      std::vector<crypto::hash> blocks;
+      uint64_t transfers_size; // transfers are cropped to this size before updating transfers
+      std::vector<std::pair<uint64_t, transfer_details>> transfers;
+      std::vector<std::pair<crypto::hash, payment_details>> payments;
+      std::vector<std::pair<crypto::hash, confirmed_transfer_details>> confirmed_txs;
+      bool subaddresses;
+    };
     
     // GUI Address book
     struct address_book_row
@@ -505,6 +538,19 @@ namespace tools
       std::vector<is_out_data> additional;
     };
 
+    // a getblocks.bin request at a given height, made ahead of time on its own connection
+    struct refresh_request
+    {
+      uint64_t start_height;
+      uint64_t blocks_start_height;
+      uint64_t current_height;
+      std::vector<cryptonote::block_complete_entry> blocks;
+      std::vector<parsed_block> parsed_blocks;
+      bool error;
+      std::unique_ptr<epee::net_utils::http::http_simple_client> http_client;
+      tools::threadpool::waiter waiter;
+    };
+
     bool testnet() const { return m_nettype == cryptonote::TESTNET; }
 
     /*!
@@ -633,6 +679,8 @@ namespace tools
     void load_cache(const std::string &filename);
     /*!
      * \brief store - stores wallet's cache, keys and address file using existing password to encrypt the keys
+     *               changes since the last store are appended to the cache journal, the full cache is only
+     *               rewritten when the journal grows too large or can't describe the changes
      */
     void store();
     /*!
@@ -821,10 +869,29 @@ namespace tools
     void discard_unmixable_outputs();
     bool check_connection(uint32_t *version = NULL, uint32_t timeout = 200000);
     void get_transfers(wallet2::transfer_container& incoming_transfers) const;
+    /*!
+     * \brief Gets the indices of the transfers received to a subaddress account, in increasing order
+     * \param transfers        Output transfer indices
+     * \param subaddr_account  Subaddress account to look up
+     * \param subaddr_indices  Subaddresses of the account to look up, all of them if empty
+     * \param spent            Only spent (or unspent) transfers if set
+     * \param start            Smallest transfer index to return
+     * \param max_results      Stop after that many transfers if not 0
+     * \return                 Whether there are more transfers after the last one returned
+     */
+    bool get_incoming_transfers(std::vector<size_t>& transfers, uint32_t subaddr_account, const std::set<uint32_t>& subaddr_indices = {}, const boost::optional<bool>& spent = boost::none, size_t start = 0, size_t max_results = 0) const;
     void get_payments(const crypto::hash& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height = 0, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
-    void get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
-    void get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
-      uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
+    /*!
+     * \brief Gets payments received in (min_height, max_height], in height order. If max_results is not 0, stops at the
+     *        end of the block in which that many payments were found, so the height of the last one can be passed as
+     *        min_height to get the next ones. Returns whether there are more payments after the last one returned.
+     */
+    bool get_payments(std::list<std::pair<crypto::hash,wallet2::payment_details>>& payments, uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}, size_t max_results = 0) const;
+    /*!
+     * \brief Gets confirmed outgoing payments in (min_height, max_height], in height order, paged like get_payments
+     */
+    bool get_payments_out(std::list<std::pair<crypto::hash,wallet2::confirmed_transfer_details>>& confirmed_payments,
+      uint64_t min_height, uint64_t max_height = (uint64_t)-1, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}, size_t max_results = 0) const;
     void get_unconfirmed_payments_out(std::list<std::pair<crypto::hash,wallet2::unconfirmed_transfer_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
     void get_unconfirmed_payments(std::list<std::pair<crypto::hash,wallet2::pool_payment_details>>& unconfirmed_payments, const boost::optional<uint32_t>& subaddr_account = boost::none, const std::set<uint32_t>& subaddr_indices = {}) const;
 
@@ -998,6 +1065,8 @@ namespace tools
     void segregation_height(uint64_t height) { m_segregation_height = height; }
     bool ignore_fractional_outputs() const { return m_ignore_fractional_outputs; }
     void ignore_fractional_outputs(bool value) { m_ignore_fractional_outputs = value; }
+    uint32_t refresh_pipeline_depth() const { return m_refresh_pipeline_depth; }
+    void refresh_pipeline_depth(uint32_t depth) { m_refresh_pipeline_depth = std::min(std::max<uint32_t>(depth, 1), max_refresh_pipeline_depth); }
     bool confirm_non_default_ring_size() const { return m_confirm_non_default_ring_size; }
     void confirm_non_default_ring_size(bool always) { m_confirm_non_default_ring_size = always; }
     const std::string & device_name() const { return m_device_name; }
@@ -1278,10 +1347,17 @@ namespace tools
     bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint64_t block_height) const;
     bool clear();
     void pull_blocks(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
+    void pull_blocks(epee::net_utils::http::http_simple_client &http_client, uint64_t start_height, uint64_t& blocks_start_height, uint64_t &current_height, const std::list<crypto::hash> &short_chain_history, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices);
     void pull_hashes(uint64_t start_height, uint64_t& blocks_start_height, const std::list<crypto::hash> &short_chain_history, std::vector<crypto::hash> &hashes);
     void fast_refresh(uint64_t stop_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, bool force = false);
     void pull_and_parse_next_blocks(uint64_t start_height, uint64_t &blocks_start_height, std::list<crypto::hash> &short_chain_history, const std::vector<cryptonote::block_complete_entry> &prev_blocks, const std::vector<parsed_block> &prev_parsed_blocks, std::vector<cryptonote::block_complete_entry> &blocks, std::vector<parsed_block> &parsed_blocks, bool &error);
+    void pull_and_parse_blocks_at(refresh_request &request);
+    void parse_blocks(const std::vector<cryptonote::block_complete_entry> &blocks, std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> &o_indices, std::vector<parsed_block> &parsed_blocks, bool &error);
     void process_parsed_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, uint64_t& blocks_added);
+    void cache_parsed_blocks_tx_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data) const;
+    void derive_tx_cache_data(std::vector<tx_cache_data> &tx_cache_data, tools::threadpool::waiter &waiter) const;
+    void match_tx_cache_data(const std::vector<parsed_block> &parsed_blocks, std::vector<tx_cache_data> &tx_cache_data, tools::threadpool::waiter &waiter) const;
+    void process_scanned_blocks(uint64_t start_height, const std::vector<cryptonote::block_complete_entry> &blocks, const std::vector<parsed_block> &parsed_blocks, const std::vector<tx_cache_data> &tx_cache_data, uint64_t& blocks_added);
     uint64_t select_transfers(uint64_t needed_money, std::vector<size_t> unused_transfers_indices, std::vector<size_t>& selected_transfers) const;
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const crypto::hash &txid, const cryptonote::transaction& tx, uint64_t height);
@@ -1304,6 +1380,14 @@ namespace tools
     std::vector<size_t> pick_preferred_rct_inputs(uint64_t needed_money, uint32_t subaddr_account, const std::set<uint32_t> &subaddr_indices) const;
     void set_spent(size_t idx, uint64_t height);
     void set_unspent(size_t idx);
+    void cache_journal_transfer(size_t idx);
+    void index_transfer(size_t idx);
+    void unindex_transfer(size_t idx);
+    void index_payment(const payment_container::value_type &payment);
+    void unindex_payment(const payment_container::value_type &payment);
+    void index_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &tx);
+    void unindex_confirmed_tx(const std::pair<const crypto::hash, confirmed_transfer_details> &tx);
+    void rebuild_indexes();
     void get_outs(std::vector<std::vector<get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count);
     bool tx_add_fake_output(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, uint64_t global_index, const crypto::public_key& tx_public_key, const rct::key& mask, uint64_t real_index, bool unlocked) const;
     crypto::public_key get_tx_pub_key_from_received_outs(const tools::wallet2::transfer_details &td) const;
@@ -1315,6 +1399,33 @@ namespace tools
     void scan_output(const cryptonote::transaction &tx, bool miner_tx, const crypto::public_key &tx_pub_key, size_t i, tx_scan_info_t &tx_scan_info, int &num_vouts_received, std::unordered_map<cryptonote::subaddress_index, uint64_t> &tx_money_got_in_outs, std::vector<size_t> &outs);
 
     void trim_hashchain();
+    static cryptonote::transaction_prefix compact_tx_prefix(const cryptonote::transaction_prefix &tx, size_t output_index);
+    void write_cache(const std::string &filename, crypto::hash &snapshot_hash, uint64_t &snapshot_size);
+    void start_cache_journal(const crypto::hash &snapshot_hash, uint64_t snapshot_size);
+    bool append_cache_journal();
+    void replay_cache_journal();
+    void invalidate_cache_journal();
+    template <class t_archive>
+    void serialize_cache_journal_state(t_archive &a, bool subaddresses)
+    {
+      a & m_unconfirmed_txs;
+      a & m_tx_keys;
+      a & m_tx_notes;
+      a & m_address_book;
+      a & m_scanned_pool_txs[0];
+      a & m_scanned_pool_txs[1];
+      if (subaddresses)
+      {
+        a & m_subaddresses;
+        a & m_subaddress_labels;
+      }
+      a & m_additional_tx_keys;
+      a & m_attributes;
+      a & m_unconfirmed_payments;
+      a & m_account_tags;
+      a & m_ring_history_saved;
+      a & m_last_block_reward;
+    }
     crypto::key_image get_multisig_composite_key_image(size_t n) const;
     rct::multisig_kLRki get_multisig_composite_kLRki(size_t n, const crypto::public_key &ignore, std::unordered_set<rct::key> &used_L, std::unordered_set<rct::key> &new_used_L) const;
     rct::multisig_kLRki get_multisig_kLRki(size_t n, const rct::key &k) const;
@@ -1328,6 +1439,8 @@ namespace tools
     void setup_keys(const epee::wipeable_string &password);
 
     bool get_rct_distribution(uint64_t &start_height, std::vector<uint64_t> &distribution);
+    void reset_decoy_pool(uint64_t rct_start_height, const std::vector<uint64_t> &rct_offsets);
+    void refill_decoy_pool(size_t min_picks, uint64_t num_unlocked_outs, const std::function<uint64_t()> &pick);
 
     uint64_t get_segregation_fork_height() const;
     void unpack_multisig_info(const std::vector<std::string>& info,
@@ -1358,6 +1471,12 @@ namespace tools
 
     transfer_container m_transfers;
     payment_container m_payments;
+    // lookups by subaddress and height, kept in step with m_transfers, m_payments and m_confirmed_txs
+    std::unordered_map<uint32_t, std::vector<size_t>> m_transfers_by_account;
+    std::unordered_map<cryptonote::subaddress_index, std::vector<size_t>> m_transfers_by_subaddress;
+    payments_by_account_index m_payments_by_account;
+    payments_by_subaddress_index m_payments_by_subaddress;
+    confirmed_txs_by_account_index m_confirmed_txs_by_account;
     std::unordered_map<crypto::key_image, size_t> m_key_images;
     std::unordered_map<crypto::public_key, size_t> m_pub_keys;
     cryptonote::account_public_address m_account_public_address;
@@ -1374,6 +1493,7 @@ namespace tools
     std::atomic<bool> m_run;
 
     boost::mutex m_daemon_rpc_mutex;
+    bool m_daemon_ssl;
 
     bool m_trusted_daemon;
     i_wallet2_callback* m_callback;
@@ -1415,6 +1535,7 @@ namespace tools
     bool m_key_reuse_mitigation2;
     uint64_t m_segregation_height;
     bool m_ignore_fractional_outputs;
+    uint32_t m_refresh_pipeline_depth;
     bool m_is_initialized;
     NodeRPCProxy m_node_rpc_proxy;
     std::unordered_set<crypto::hash> m_scanned_pool_txs[2];
@@ -1435,6 +1556,22 @@ namespace tools
     // store calculated key image for faster lookup
     std::unordered_map<crypto::public_key, std::map<uint64_t, crypto::key_image> > m_key_image_cache;
 
+    // cumulative rct output counts per block, extended incrementally from the daemon
+    uint64_t m_rct_distribution_start_height;
+    std::vector<uint64_t> m_rct_distribution;
+
+    // gamma picks drawn ahead of time from the current rct distribution; only valid
+    // for that distribution. Only the picks are pooled: the ring members are always
+    // fetched from the daemon along with the real output they go with
+    struct decoy_pool
+    {
+      uint64_t rct_start_height;
+      uint64_t rct_top_offset;
+      size_t rct_offsets_size;
+      std::deque<uint64_t> picks;
+    };
+    decoy_pool m_decoy_pool;
+
     std::string m_ring_database;
     bool m_ring_history_saved;
     std::unique_ptr<ringdb> m_ringdb;
@@ -1449,8 +1586,26 @@ namespace tools
     bool m_unattended;
 
     std::shared_ptr<tools::Notify> m_tx_notify;
+
+    // what changed in the cache since it was last stored, see append_cache_journal
+    struct cache_journal_changes
+    {
+      bool compact = true; // the next store writes a full cache and starts a new journal
+      crypto::hash snapshot_hash = crypto::null_hash;
+      uint64_t snapshot_size = 0;
+      uint64_t journal_size = 0;
+      size_t records = 0;
+      uint64_t blockchain_height = 0;
+      size_t transfers_size = 0;
+      std::set<size_t> transfers;
+      std::vector<std::pair<crypto::hash, payment_details>> payments;
+      std::unordered_set<crypto::hash> confirmed_txs;
+      bool subaddresses = false;
+    };
+    cache_journal_changes m_cache_journal;
   };
 }
+BOOST_CLASS_VERSION(tools::hashchain, 1)
 BOOST_CLASS_VERSION(tools::wallet2, 25)
 BOOST_CLASS_VERSION(tools::wallet2::transfer_details, 9)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_info, 1)
@@ -1467,6 +1622,7 @@ BOOST_CLASS_VERSION(tools::wallet2::signed_tx_set, 0)
 BOOST_CLASS_VERSION(tools::wallet2::tx_construction_data, 3)
 BOOST_CLASS_VERSION(tools::wallet2::pending_tx, 3)
 BOOST_CLASS_VERSION(tools::wallet2::multisig_sig, 0)
+BOOST_CLASS_VERSION(tools::wallet2::cache_journal_record, 0)
 
 namespace boost
 {
@@ -1775,6 +1931,18 @@ namespace boost
       a & x.key_image_sig;
     }
 
+    template <class Archive>
+    inline void serialize(Archive &a, tools::wallet2::cache_journal_record &x, const boost::serialization::version_type ver)
+    {
+      a & x.blockchain_height;
+      a & x.blocks;
+      a & x.transfers_size;
+      a & x.transfers;
+      a & x.payments;
+      a & x.confirmed_txs;
+      a & x.subaddresses;
+    }
+
     template <class Archive>
     inline void serialize(Archive &a, tools::wallet2::unsigned_tx_set &x, const boost::serialization::version_type ver)
     {
@@ -94,6 +94,24 @@ namespace
       entry.suggested_confirmations_threshold = (entry.amount + block_reward - 1) / block_reward;
   }
 
+  //------------------------------------------------------------------------------------------------------------------------------
+  // Sorts payments by height and cuts them after the block holding the limit-th one (0 for no limit).
+  // Returns the cursor to the next page, or 0 if this was the last one.
+  uint64_t page_payments(std::list<tools::wallet_rpc::payment_details> &payments, uint64_t limit)
+  {
+    payments.sort([](const tools::wallet_rpc::payment_details &a, const tools::wallet_rpc::payment_details &b) { return a.block_height < b.block_height; });
+    if (limit == 0 || payments.size() <= limit)
+      return 0;
+    auto i = std::next(payments.begin(), limit - 1);
+    const uint64_t last_height = i->block_height;
+    while (i != payments.end() && i->block_height == last_height)
+      ++i;
+    if (i == payments.end())
+      return 0;
+    payments.erase(i, payments.end());
+    return last_height + 1;
+  }
+
   template <typename Request>
   bool process_stake_transfer(const Request &req,  const std::vector<cryptonote::tx_destination_entry> &dsts,
                               tools::wallet2 * wallet, std::vector<uint8_t>& extra, epee::json_rpc::error &er)
@@ -1642,7 +1660,7 @@ namespace tools
 
     res.payments.clear();
     std::list<wallet2::payment_details> payment_list;
-    m_wallet->get_payments(payment_id, payment_list);
+    m_wallet->get_payments(payment_id, payment_list, req.cursor > 0 ? req.cursor - 1 : 0);
     for (auto & payment : payment_list)
     {
       wallet_rpc::payment_details rpc_payment;
@@ -1655,6 +1673,7 @@ namespace tools
       rpc_payment.address      = m_wallet->get_subaddress_as_str(payment.m_subaddr_index);
       res.payments.push_back(rpc_payment);
     }
+    res.next_cursor = page_payments(res.payments, req.limit);
 
     return true;
   }
@@ -1662,13 +1681,18 @@ namespace tools
   bool wallet_rpc_server::on_get_bulk_payments(const wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS::request& req, wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS::response& res, epee::json_rpc::error& er)
   {
     res.payments.clear();
+    res.next_cursor = 0;
     if (!m_wallet) return not_open(er);
 
+    // a cursor is the first height of the page to return
+    const uint64_t min_height = req.cursor > 0 ? std::max(req.min_block_height, req.cursor - 1) : req.min_block_height;
+
     /* If the payment ID list is empty, we get payments to any payment ID (or lack thereof) */
     if (req.payment_ids.empty())
     {
       std::list<std::pair<crypto::hash,wallet2::payment_details>> payment_list;
-      m_wallet->get_payments(payment_list, req.min_block_height);
+      if (m_wallet->get_payments(payment_list, min_height, (uint64_t)-1, boost::none, {}, req.limit) && !payment_list.empty())
+        res.next_cursor = payment_list.back().second.m_block_height + 1;
 
       for (auto & payment : payment_list)
       {
@@ -1719,7 +1743,7 @@ namespace tools
       }
 
       std::list<wallet2::payment_details> payment_list;
-      m_wallet->get_payments(payment_id, payment_list, req.min_block_height);
+      m_wallet->get_payments(payment_id, payment_list, min_height);
 
       for (auto & payment : payment_list)
       {
@@ -1734,6 +1758,7 @@ namespace tools
         res.payments.push_back(std::move(rpc_payment));
       }
     }
+    res.next_cursor = page_payments(res.payments, req.limit);
 
     return true;
   }
@@ -1761,30 +1786,22 @@ namespace tools
       available = false;
     }
 
-    wallet2::transfer_container transfers;
-    m_wallet->get_transfers(transfers);
+    std::vector<size_t> transfers;
+    const boost::optional<bool> spent = filter ? boost::optional<bool>(!available) : boost::none;
+    const bool more = m_wallet->get_incoming_transfers(transfers, req.account_index, req.subaddr_indices, spent, req.cursor, req.limit);
+    res.next_cursor = more ? transfers.back() + 1 : 0;
 
-    bool transfers_found = false;
-    for (const auto& td : transfers)
+    for (size_t idx : transfers)
     {
-      if (!filter || available != td.m_spent)
-      {
-        if (req.account_index != td.m_subaddr_index.major || (!req.subaddr_indices.empty() && req.subaddr_indices.count(td.m_subaddr_index.minor) == 0))
-          continue;
-        if (!transfers_found)
-        {
-          transfers_found = true;
-        }
-        auto txBlob = t_serializable_object_to_blob(td.m_tx);
-        wallet_rpc::transfer_details rpc_transfers;
-        rpc_transfers.amount       = td.amount();
-        rpc_transfers.spent        = td.m_spent;
-        rpc_transfers.global_index = td.m_global_output_index;
-        rpc_transfers.tx_hash      = epee::string_tools::pod_to_hex(td.m_txid);
-        rpc_transfers.subaddr_index = {td.m_subaddr_index.major, td.m_subaddr_index.minor};
-        rpc_transfers.key_image    = td.m_key_image_known ? epee::string_tools::pod_to_hex(td.m_key_image) : "";
-        res.transfers.push_back(rpc_transfers);
-      }
+      const wallet2::transfer_details &td = m_wallet->get_transfer_details(idx);
+      wallet_rpc::transfer_details rpc_transfers;
+      rpc_transfers.amount       = td.amount();
+      rpc_transfers.spent        = td.m_spent;
+      rpc_transfers.global_index = td.m_global_output_index;
+      rpc_transfers.tx_hash      = epee::string_tools::pod_to_hex(td.m_txid);
+      rpc_transfers.subaddr_index = {td.m_subaddr_index.major, td.m_subaddr_index.minor};
+      rpc_transfers.key_image    = td.m_key_image_known ? epee::string_tools::pod_to_hex(td.m_key_image) : "";
+      res.transfers.push_back(rpc_transfers);
     }
 
     return true;
@@ -2309,27 +2326,33 @@ namespace tools
       min_height = req.min_height;
       max_height = req.max_height <= max_height ? req.max_height : max_height;
     }
+    // a cursor is the first height of the page to return, and only the first page has pending and pool txes
+    if (req.cursor > 0)
+      min_height = std::max(min_height, req.cursor - 1);
 
-    if (req.in)
-    {
-      std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
-      m_wallet->get_payments(payments, min_height, max_height, req.account_index, req.subaddr_indices);
-      for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
-        res.in.push_back(wallet_rpc::transfer_entry());
-        fill_transfer_entry(res.in.back(), i->second.m_tx_hash, i->first, i->second);
-      }
+    // in and out are each limited to req.limit entries, and both cut after the lowest block a limit was hit in
+    std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> in_payments;
+    std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> out_payments;
+    uint64_t page_max_height = max_height;
+    if (req.in && m_wallet->get_payments(in_payments, min_height, max_height, req.account_index, req.subaddr_indices, req.limit) && !in_payments.empty())
+      page_max_height = std::min(page_max_height, in_payments.back().second.m_block_height);
+    if (req.out && m_wallet->get_payments_out(out_payments, min_height, max_height, req.account_index, req.subaddr_indices, req.limit) && !out_payments.empty())
+      page_max_height = std::min(page_max_height, out_payments.back().second.m_block_height);
+    res.next_cursor = page_max_height < max_height ? page_max_height + 1 : 0;
+
+    for (std::list<std::pair<crypto::hash, tools::wallet2::payment_details>>::const_iterator i = in_payments.begin(); i != in_payments.end() && i->second.m_block_height <= page_max_height; ++i) {
+      res.in.push_back(wallet_rpc::transfer_entry());
+      fill_transfer_entry(res.in.back(), i->second.m_tx_hash, i->first, i->second);
     }
 
-    if (req.out)
-    {
-      std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments;
-      m_wallet->get_payments_out(payments, min_height, max_height, req.account_index, req.subaddr_indices);
-      for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = payments.begin(); i != payments.end(); ++i) {
-        res.out.push_back(wallet_rpc::transfer_entry());
-        fill_transfer_entry(res.out.back(), i->first, i->second);
-      }
+    for (std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>>::const_iterator i = out_payments.begin(); i != out_payments.end() && i->second.m_block_height <= page_max_height; ++i) {
+      res.out.push_back(wallet_rpc::transfer_entry());
+      fill_transfer_entry(res.out.back(), i->first, i->second);
     }
 
+    if (req.cursor > 0)
+      return true;
+
     if (req.pending || req.failed) {
       std::list<std::pair<crypto::hash, tools::wallet2::unconfirmed_transfer_details>> upayments;
       m_wallet->get_unconfirmed_payments_out(upayments, req.account_index, req.subaddr_indices);
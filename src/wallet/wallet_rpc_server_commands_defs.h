@@ -47,7 +47,7 @@
 // advance which version they will stop working with
 // Don't go over 32767 for any of these
 #define WALLET_RPC_VERSION_MAJOR 1
-#define WALLET_RPC_VERSION_MINOR 4
+#define WALLET_RPC_VERSION_MINOR 5
 #define MAKE_WALLET_RPC_VERSION(major,minor) (((major)<<16)|(minor))
 #define WALLET_RPC_VERSION MAKE_WALLET_RPC_VERSION(WALLET_RPC_VERSION_MAJOR, WALLET_RPC_VERSION_MINOR)
 namespace tools
@@ -874,18 +874,24 @@ namespace wallet_rpc
     struct request
     {
       std::string payment_id;
+      uint64_t limit;
+      uint64_t cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payment_id)
+        KV_SERIALIZE_OPT(limit, (uint64_t)0)
+        KV_SERIALIZE_OPT(cursor, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
     struct response
     {
       std::list<payment_details> payments;
+      uint64_t next_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payments)
+        KV_SERIALIZE(next_cursor)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -896,19 +902,25 @@ namespace wallet_rpc
     {
       std::vector<std::string> payment_ids;
       uint64_t min_block_height;
+      uint64_t limit;
+      uint64_t cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payment_ids)
         KV_SERIALIZE(min_block_height)
+        KV_SERIALIZE_OPT(limit, (uint64_t)0)
+        KV_SERIALIZE_OPT(cursor, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
     struct response
     {
       std::list<payment_details> payments;
+      uint64_t next_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(payments)
+        KV_SERIALIZE(next_cursor)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -939,20 +951,26 @@ namespace wallet_rpc
       std::string transfer_type;
       uint32_t account_index;
       std::set<uint32_t> subaddr_indices;
+      uint64_t limit;
+      uint64_t cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(transfer_type)
         KV_SERIALIZE(account_index)
         KV_SERIALIZE(subaddr_indices)
+        KV_SERIALIZE_OPT(limit, (uint64_t)0)
+        KV_SERIALIZE_OPT(cursor, (uint64_t)0)
       END_KV_SERIALIZE_MAP()
     };
 
     struct response
     {
       std::list<transfer_details> transfers;
+      uint64_t next_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(transfers)
+        KV_SERIALIZE(next_cursor)
       END_KV_SERIALIZE_MAP()
     };
   };
@@ -1406,6 +1424,8 @@ namespace wallet_rpc
       uint64_t max_height;
       uint32_t account_index;
       std::set<uint32_t> subaddr_indices;
+      uint64_t limit;
+      uint64_t cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -1418,6 +1438,8 @@ namespace wallet_rpc
         KV_SERIALIZE_OPT(max_height, (uint64_t)CRYPTONOTE_MAX_BLOCK_NUMBER);
         KV_SERIALIZE(account_index);
         KV_SERIALIZE(subaddr_indices);
+        KV_SERIALIZE_OPT(limit, (uint64_t)0);
+        KV_SERIALIZE_OPT(cursor, (uint64_t)0);
       END_KV_SERIALIZE_MAP()
     };
 
@@ -1428,6 +1450,7 @@ namespace wallet_rpc
       std::list<transfer_entry> pending;
       std::list<transfer_entry> failed;
       std::list<transfer_entry> pool;
+      uint64_t next_cursor;
 
       BEGIN_KV_SERIALIZE_MAP()
         KV_SERIALIZE(in);
@@ -1435,6 +1458,7 @@ namespace wallet_rpc
         KV_SERIALIZE(pending);
         KV_SERIALIZE(failed);
         KV_SERIALIZE(pool);
+        KV_SERIALIZE(next_cursor);
       END_KV_SERIALIZE_MAP()
     };
   };
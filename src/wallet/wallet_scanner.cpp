@@ -0,0 +1,201 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "wallet_scanner.h"
+#include "common/threadpool.h"
+
+#undef MONERO_DEFAULT_LOG_CATEGORY
+#define MONERO_DEFAULT_LOG_CATEGORY "wallet.scanner"
+
+namespace tools
+{
+//----------------------------------------------------------------------------------------------------
+wallet_scanner::wallet_scanner():
+  m_run(false)
+{
+}
+//----------------------------------------------------------------------------------------------------
+void wallet_scanner::add_wallet(wallet2 *wallet)
+{
+  THROW_WALLET_EXCEPTION_IF(!wallet, error::wallet_internal_error, "null wallet");
+  THROW_WALLET_EXCEPTION_IF(wallet->light_wallet(), error::wallet_internal_error, "light wallets can't share a scanner");
+  boost::unique_lock<boost::mutex> lock(m_wallets_lock);
+  if (std::find(m_wallets.begin(), m_wallets.end(), wallet) != m_wallets.end())
+    return;
+  // the tx public keys cached once for all wallets depend on the refresh type
+  THROW_WALLET_EXCEPTION_IF(!m_wallets.empty() && m_wallets.front()->get_refresh_type() != wallet->get_refresh_type(),
+      error::wallet_internal_error, "wallets sharing a scanner must use the same refresh type");
+  m_wallets.push_back(wallet);
+}
+//----------------------------------------------------------------------------------------------------
+void wallet_scanner::remove_wallet(wallet2 *wallet)
+{
+  boost::unique_lock<boost::mutex> lock(m_wallets_lock);
+  m_wallets.erase(std::remove(m_wallets.begin(), m_wallets.end(), wallet), m_wallets.end());
+}
+//----------------------------------------------------------------------------------------------------
+size_t wallet_scanner::wallet_count() const
+{
+  boost::unique_lock<boost::mutex> lock(m_wallets_lock);
+  return m_wallets.size();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet_scanner::refresh_alone(wallet2 *wallet, bool trusted_daemon)
+{
+  try
+  {
+    wallet->refresh(trusted_daemon);
+  }
+  catch (const std::exception &e)
+  {
+    MERROR("Failed to refresh wallet " << wallet->get_account().get_public_address_str(wallet->nettype()) << ": " << e.what());
+  }
+}
+//----------------------------------------------------------------------------------------------------
+uint64_t wallet_scanner::refresh(bool trusted_daemon)
+{
+  boost::unique_lock<boost::mutex> refresh_lock(m_refresh_lock);
+  std::vector<wallet2*> wallets;
+  {
+    boost::unique_lock<boost::mutex> lock(m_wallets_lock);
+    wallets = m_wallets;
+  }
+  if (wallets.empty())
+    return 0;
+
+  m_run.store(true, std::memory_order_relaxed);
+  tools::threadpool& tpool = tools::threadpool::getInstance();
+  std::vector<wallet2*> detached;
+  uint64_t blocks_fetched = 0;
+
+  // wallets restored from a given height skip to it with hashes only, as in wallet2::refresh
+  for (wallet2 *w: wallets)
+  {
+    if (w->m_refresh_from_block_height > w->m_blockchain.size())
+    {
+      std::list<crypto::hash> short_chain_history;
+      uint64_t blocks_start_height;
+      w->m_run.store(true, std::memory_order_relaxed);
+      w->get_short_chain_history(short_chain_history);
+      w->fast_refresh(w->m_refresh_from_block_height, blocks_start_height, short_chain_history);
+    }
+  }
+
+  while (m_run.load(std::memory_order_relaxed) && !wallets.empty())
+  {
+    // the wallet furthest behind decides where the batch starts
+    wallet2 *leader = *std::min_element(wallets.begin(), wallets.end(),
+        [](const wallet2 *a, const wallet2 *b) { return a->m_blockchain.size() < b->m_blockchain.size(); });
+
+    std::list<crypto::hash> short_chain_history;
+    leader->get_short_chain_history(short_chain_history);
+    uint64_t blocks_start_height;
+    std::vector<cryptonote::block_complete_entry> blocks;
+    std::vector<wallet2::parsed_block> parsed_blocks;
+    bool error = false;
+    leader->pull_and_parse_next_blocks(0, blocks_start_height, short_chain_history, {}, {}, blocks, parsed_blocks, error);
+    THROW_WALLET_EXCEPTION_IF(error, error::wallet_internal_error, "Failed to pull and parse blocks");
+    if (blocks.empty())
+      break;
+    blocks_fetched += blocks.size();
+
+    // parsed once, shared by all: tx extra fields and tx public keys
+    std::vector<wallet2::tx_cache_data> shared_tx_cache_data;
+    leader->cache_parsed_blocks_tx_data(parsed_blocks, shared_tx_cache_data);
+
+    // wallets which already have the whole batch sit this round out
+    const uint64_t blocks_end_height = blocks_start_height + blocks.size();
+    std::vector<wallet2*> scanning;
+    for (wallet2 *w: wallets)
+      if (w->m_blockchain.size() < blocks_end_height)
+        scanning.push_back(w);
+
+    // all wallets' derivations, then all wallets' output checks, each stage batched on the threadpool
+    std::vector<std::vector<wallet2::tx_cache_data>> tx_cache_data(scanning.size(), shared_tx_cache_data);
+    std::vector<std::unique_ptr<hw::reset_mode>> device_modes;
+    for (wallet2 *w: scanning)
+    {
+      hw::device &hwdev = w->m_account.get_device();
+      device_modes.emplace_back(new hw::reset_mode(hwdev));
+      hwdev.set_mode(hw::device::TRANSACTION_PARSE);
+    }
+    tools::threadpool::waiter waiter;
+    for (size_t n = 0; n < scanning.size(); ++n)
+      scanning[n]->derive_tx_cache_data(tx_cache_data[n], waiter);
+    waiter.wait(&tpool);
+    for (size_t n = 0; n < scanning.size(); ++n)
+      scanning[n]->match_tx_cache_data(parsed_blocks, tx_cache_data[n], waiter);
+    waiter.wait(&tpool);
+    device_modes.clear();
+
+    uint64_t blocks_added = 0;
+    for (size_t n = 0; n < scanning.size(); ++n)
+    {
+      wallet2 *w = scanning[n];
+      try
+      {
+        uint64_t added = 0;
+        w->process_scanned_blocks(blocks_start_height, blocks, parsed_blocks, tx_cache_data[n], added);
+        blocks_added += added;
+      }
+      catch (const std::exception &e)
+      {
+        MWARNING("Wallet " << w->get_account().get_public_address_str(w->nettype()) << " can't follow the shared scan (" << e.what() << "), refreshing it alone");
+        detached.push_back(w);
+        wallets.erase(std::find(wallets.begin(), wallets.end(), w));
+      }
+    }
+
+    // the daemon only sent back what everybody already had: all caught up
+    if (blocks_added == 0)
+      break;
+  }
+
+  for (wallet2 *w: wallets)
+  {
+    w->m_node_rpc_proxy.set_height(w->m_blockchain.size());
+    try
+    {
+      w->update_pool_state(true);
+    }
+    catch (...)
+    {
+      LOG_PRINT_L1("Failed to check pending transactions");
+    }
+    w->m_first_refresh_done = true;
+  }
+
+  for (wallet2 *w: detached)
+    refresh_alone(w, trusted_daemon);
+
+  LOG_PRINT_L1("Shared refresh done, blocks received: " << blocks_fetched << ", wallets: " << wallets.size() << " shared, " << detached.size() << " alone");
+  return blocks_fetched;
+}
+//----------------------------------------------------------------------------------------------------
+}
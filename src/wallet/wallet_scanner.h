@@ -0,0 +1,78 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include "wallet2.h"
+
+namespace tools
+{
+  /*!
+   * \brief Refreshes many wallets against one daemon, fetching and parsing each block once
+   *
+   * Every round pulls a batch of blocks through the wallet furthest behind,
+   * parses them and extracts their tx public keys once, then has every
+   * wallet which still needs those blocks compute its derivations and
+   * output matches on the shared threadpool, all batched together, before
+   * the results are applied to each wallet in turn. Wallets sharing a
+   * scanner must talk to the same daemon and use the same refresh type.
+   * A wallet which cannot follow the shared batches (a reorg deeper than the
+   * batch, a trimmed hash chain) is refreshed on its own instead.
+   *
+   * The scanner does not own the wallets; they must outlive their
+   * registration and must not be refreshed by anything else meanwhile.
+   */
+  class wallet_scanner
+  {
+  public:
+    wallet_scanner();
+
+    void add_wallet(wallet2 *wallet);
+    void remove_wallet(wallet2 *wallet);
+    size_t wallet_count() const;
+
+    /*!
+     * \brief Brings every registered wallet up to the daemon's height
+     * \param trusted_daemon  whether the daemon is trusted, as for wallet2::refresh
+     * \return                the number of blocks fetched from the daemon
+     */
+    uint64_t refresh(bool trusted_daemon);
+    void stop() { m_run.store(false, std::memory_order_relaxed); }
+
+  private:
+    void refresh_alone(wallet2 *wallet, bool trusted_daemon);
+
+    mutable boost::mutex m_wallets_lock;
+    std::vector<wallet2*> m_wallets;
+    boost::mutex m_refresh_lock;
+    std::atomic<bool> m_run;
+  };
+}
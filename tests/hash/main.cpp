@@ -89,8 +89,17 @@ struct hash_func {
   {"slow-0-waltz", cn_slow_hash_0_waltz}, {"slow-1-waltz", cn_slow_hash_1_waltz},
   {"slow-2-waltz", cn_slow_hash_2_waltz}, {"slow-2-reverse-waltz", cn_slow_hash_2_reverse_waltz}};
 
+struct slow_hash_params {
+  const char *name;
+  int variant;
+  int modifier;
+} slow_hashes[] = {{"slow", 0, 0}, {"slow-1", 1, 0}, {"slow-2", 2, 0},
+  {"slow-0-waltz", 0, CN_MODIFIER_WALTZ}, {"slow-1-waltz", 1, CN_MODIFIER_WALTZ},
+  {"slow-2-waltz", 2, CN_MODIFIER_WALTZ}, {"slow-2-reverse-waltz", 2, CN_MODIFIER_REVERSE_WALTZ}};
+
 int test_variant2_int_sqrt();
 int test_variant2_int_sqrt_ref();
+int test_slow_hash_multi(const char *name, const char *path);
 
 int main(int argc, char *argv[]) {
   hash_f *f;
@@ -134,6 +143,9 @@ int main(int argc, char *argv[]) {
     cerr << "Wrong number of arguments" << endl;
     return 1;
   }
+  if (strncmp(argv[1], "multi-", 6) == 0) {
+    return test_slow_hash_multi(argv[1] + 6, argv[2]);
+  }
   for (hf = hashes;; hf++) {
     if (hf >= &hashes[sizeof(hashes) / sizeof(hash_func)]) {
       cerr << "Unknown function" << endl;
@@ -181,6 +193,60 @@ int main(int argc, char *argv[]) {
   return error ? 1 : 0;
 }
 
+int test_slow_hash_multi(const char *name, const char *path) {
+  const slow_hash_params *params = NULL;
+  for (const slow_hash_params &p: slow_hashes) {
+    if (strcmp(name, p.name) == 0) {
+      params = &p;
+      break;
+    }
+  }
+  if (!params) {
+    cerr << "Unknown function" << endl;
+    return 1;
+  }
+
+  fstream input;
+  vector<chash> expected;
+  vector<vector<char>> inputs;
+  input.open(path, ios_base::in);
+  for (;;) {
+    chash h;
+    vector<char> data;
+    input.exceptions(ios_base::badbit);
+    get(input, h);
+    if (input.rdstate() & ios_base::eofbit) {
+      break;
+    }
+    input.exceptions(ios_base::badbit | ios_base::failbit | ios_base::eofbit);
+    input.clear(input.rdstate());
+    get(input, data);
+    expected.push_back(h);
+    inputs.push_back(std::move(data));
+  }
+
+  vector<const void *> data(inputs.size());
+  vector<size_t> lengths(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    data[i] = inputs[i].data();
+    lengths[i] = inputs[i].size();
+  }
+
+  // every lane count, so that uneven tails are covered too
+  bool error = false;
+  for (size_t ways = 1; ways <= CN_SLOW_HASH_MAX_WAYS; ++ways) {
+    vector<chash> actual(inputs.size());
+    cn_slow_hash_multi(data.data(), lengths.data(), actual.data(), inputs.size(), ways, params->variant, params->modifier);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (expected[i] != actual[i]) {
+        cerr << "Hash mismatch on test " << (i + 1) << " with " << ways << " ways" << endl;
+        error = true;
+      }
+    }
+  }
+  return error ? 1 : 0;
+}
+
 #if defined(__x86_64__) || (defined(_MSC_VER) && defined(_WIN64))
 
 #include <emmintrin.h>
@@ -28,10 +28,12 @@
 // 
 // Parts of this file are originally copyright (c) 2012-2013 The Cryptonote developers
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <functional>
 #include <numeric>
+#include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 #include <vector>
 
@@ -52,6 +54,12 @@ namespace
   const size_t CONNECTION_TIMEOUT = 10000;
   const size_t DEFAULT_OPERATION_TIMEOUT = 30000;
   const size_t RESERVED_CONN_CNT = 1;
+  const size_t ECHO_CONNECTION_COUNT = 2000;
+  const size_t ECHO_ROUNDS = 20;
+  const size_t ECHO_RESPONSE_SIZE = 1024;
+
+  int g_argc = 0;
+  char** g_argv = nullptr;
 
   template<typename t_predicate>
   bool busy_wait_for(size_t timeout_ms, const t_predicate& predicate, size_t sleep_ms = 10)
@@ -196,6 +204,7 @@ namespace
       m_tcp_server.get_config_object().set_handler(&m_commands_handler);
       m_tcp_server.get_config_object().m_invoke_timeout = CONNECTION_TIMEOUT;
 
+      set_io_service_sharding(m_tcp_server, g_argc, g_argv);
       ASSERT_TRUE(m_tcp_server.init_server(clt_port, "127.0.0.1"));
       ASSERT_TRUE(m_tcp_server.run_server(m_thread_count, false));
 
@@ -626,6 +635,71 @@ TEST_F(net_load_test_clt, permament_open_and_close_and_connections_closed_by_ser
   ASSERT_EQ(RESERVED_CONN_CNT, m_tcp_server.get_config_object().get_connections_count());
 }
 
+TEST_F(net_load_test_clt, echo_throughput_and_latency)
+{
+  // Open connections
+  t_connection_opener_1 connection_opener(m_tcp_server, ECHO_CONNECTION_COUNT);
+  parallel_exec([&] {
+    while (connection_opener.open());
+  });
+  EXPECT_TRUE(busy_wait_for(DEFAULT_OPERATION_TIMEOUT, [&]{ return ECHO_CONNECTION_COUNT + RESERVED_CONN_CNT <= m_commands_handler.new_connection_counter() + connection_opener.error_count(); }));
+  ASSERT_EQ(0, connection_opener.error_count());
+
+  std::vector<boost::uuids::uuid> connections;
+  m_tcp_server.get_config_object().foreach_connection([&](test_connection_context& ctx) {
+    if (ctx.m_connection_id != m_cmd_conn_id)
+      connections.push_back(ctx.m_connection_id);
+    return true;
+  });
+  ASSERT_EQ(ECHO_CONNECTION_COUNT, connections.size());
+
+  // Every round sends one request on every connection, so the server sees all of them at once
+  boost::mutex latencies_mutex;
+  std::vector<uint64_t> latencies;
+  std::atomic<size_t> responses(0), errors(0);
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t round = 0; round < ECHO_ROUNDS; ++round)
+  {
+    parallel_exec([&](size_t thread_idx) {
+      for (size_t i = thread_idx; i < connections.size(); i += m_thread_count)
+      {
+        CMD_ECHO::request req;
+        req.response_size = ECHO_RESPONSE_SIZE;
+        const auto sent = std::chrono::steady_clock::now();
+        bool r = epee::net_utils::async_invoke_remote_command2<CMD_ECHO::response>(connections[i], CMD_ECHO::ID, req,
+          m_tcp_server.get_config_object(), [&, sent](int code, const CMD_ECHO::response& rsp, const test_connection_context&) {
+            const uint64_t usec = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent).count();
+            if (code <= 0 || rsp.data.size() != ECHO_RESPONSE_SIZE)
+              errors.fetch_add(1, std::memory_order_relaxed);
+            boost::unique_lock<boost::mutex> lock(latencies_mutex);
+            latencies.push_back(usec);
+            responses.fetch_add(1, std::memory_order_seq_cst);
+        });
+        if (!r)
+          errors.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+    EXPECT_TRUE(busy_wait_for(DEFAULT_OPERATION_TIMEOUT, [&]{ return (round + 1) * connections.size() <= responses.load(std::memory_order_seq_cst) + errors.load(std::memory_order_relaxed); }, 1));
+  }
+  const uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+  boost::unique_lock<boost::mutex> lock(latencies_mutex);
+  ASSERT_EQ(0, errors.load());
+  ASSERT_EQ(ECHO_ROUNDS * connections.size(), latencies.size());
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) { return latencies[std::min<size_t>(latencies.size() * p, latencies.size() - 1)]; };
+  LOG_PRINT_L0("echo: " << latencies.size() << " requests on " << connections.size() << " connections in " << elapsed / 1000 << " ms, " <<
+    latencies.size() * 1000000 / std::max<uint64_t>(elapsed, 1) << " requests/s, latency (us) p50 " << percentile(0.5) <<
+    ", p99 " << percentile(0.99) << ", p99.9 " << percentile(0.999) << ", max " << latencies.back());
+  lock.unlock();
+
+  // Close connections
+  for (size_t i = 0; i < ECHO_CONNECTION_COUNT; ++i)
+    connection_opener.close(i);
+  EXPECT_TRUE(busy_wait_for(DEFAULT_OPERATION_TIMEOUT, [&]{ return m_commands_handler.new_connection_counter() - RESERVED_CONN_CNT <= m_commands_handler.close_connection_counter(); }));
+  ASSERT_EQ(RESERVED_CONN_CNT, m_tcp_server.get_config_object().get_connections_count());
+}
+
 int main(int argc, char** argv)
 {
   tools::on_startup();
@@ -634,5 +708,7 @@ int main(int argc, char** argv)
   mlog_configure(mlog_get_default_log_path("net_load_tests_clt.log"), true);
 
   ::testing::InitGoogleTest(&argc, argv);
+  g_argc = argc;
+  g_argv = argv;
   return RUN_ALL_TESTS();
 }
@@ -215,6 +215,22 @@ namespace net_load_tests
   const std::string clt_port("36230");
   const std::string srv_port("36231");
 
+  // run the clt and srv both with and without these to compare io_service sharding with a shared io_service
+  const std::string sharded_io_arg("--sharded-io");
+  const std::string reuse_port_arg("--reuse-port");
+
+  inline void set_io_service_sharding(test_tcp_server& tcp_server, int argc, char** argv)
+  {
+    bool sharded = false, reuse_port = false;
+    for (int i = 1; i < argc; ++i)
+    {
+      sharded |= sharded_io_arg == argv[i];
+      reuse_port |= reuse_port_arg == argv[i];
+    }
+    tcp_server.set_io_service_sharding(sharded, reuse_port);
+    LOG_PRINT_L0("io_service sharding " << (sharded ? "enabled" : "disabled") << (reuse_port ? ", SO_REUSEPORT" : ""));
+  }
+
   enum command_ids
   {
     cmd_close_all_connections_id = 73564,
@@ -223,7 +239,8 @@ namespace net_load_tests
     cmd_reset_statistics_id,
     cmd_shutdown_id,
     cmd_send_data_requests_id,
-    cmd_data_request_id
+    cmd_data_request_id,
+    cmd_echo_id
   };
 
   struct CMD_CLOSE_ALL_CONNECTIONS
@@ -357,4 +374,29 @@ namespace net_load_tests
       END_KV_SERIALIZE_MAP()
     };
   };
+
+  struct CMD_ECHO
+  {
+    const static int ID = cmd_echo_id;
+
+    struct request
+    {
+      std::string data;
+      uint64_t response_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(data)
+        KV_SERIALIZE(response_size)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::string data;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(data)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
 }
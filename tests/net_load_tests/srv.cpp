@@ -88,6 +88,7 @@ namespace
       HANDLE_INVOKE_T2(CMD_GET_STATISTICS, &srv_levin_commands_handler::handle_get_statistics)
       HANDLE_INVOKE_T2(CMD_RESET_STATISTICS, &srv_levin_commands_handler::handle_reset_statistics)
       HANDLE_INVOKE_T2(CMD_START_OPEN_CLOSE_TEST, &srv_levin_commands_handler::handle_start_open_close_test)
+      HANDLE_INVOKE_T2(CMD_ECHO, &srv_levin_commands_handler::handle_echo)
     END_INVOKE_MAP2()
 
     int handle_close_all_connections(int command, const CMD_CLOSE_ALL_CONNECTIONS::request& req, test_connection_context& context)
@@ -130,6 +131,12 @@ namespace
       }
     }
 
+    int handle_echo(int command, const CMD_ECHO::request& req, CMD_ECHO::response& rsp, test_connection_context& /*context*/)
+    {
+      rsp.data.resize(req.response_size);
+      return 1;
+    }
+
     int handle_shutdown(int command, const CMD_SHUTDOWN::request& req, test_connection_context& /*context*/)
     {
       LOG_PRINT_L0("Got shutdown request. Shutting down...");
@@ -222,6 +229,7 @@ int main(int argc, char** argv)
   size_t thread_count = (std::max)(min_thread_count, boost::thread::hardware_concurrency() / 2);
 
   test_tcp_server tcp_server(epee::net_utils::e_connection_type_RPC);
+  set_io_service_sharding(tcp_server, argc, argv);
   if (!tcp_server.init_server(srv_port, "127.0.0.1"))
     return 1;
 
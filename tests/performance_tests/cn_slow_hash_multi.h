@@ -0,0 +1,73 @@
+// Copyright (c) 2019, The Graft Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string.h>
+#include "crypto/hash.h"
+
+// Hashes a batch of block-sized inputs with cn_slow_hash_multi, interleaving
+// <ways> of them at a time; ways = 1 is the plain one-at-a-time baseline.
+template<size_t ways>
+class test_cn_slow_hash_multi
+{
+public:
+  static const size_t loop_count = 5;
+  static const size_t batch_size = 4;
+  static const size_t data_size = 76;
+
+  bool init()
+  {
+    for (size_t i = 0; i < batch_size; ++i)
+    {
+      memset(m_data[i], 0, data_size);
+      memcpy(m_data[i], "caveat emptor", 13);
+      m_data[i][data_size - 1] = i;
+      m_ptrs[i] = m_data[i];
+      m_lengths[i] = data_size;
+      crypto::cn_slow_hash(m_data[i], data_size, m_expected_hashes[i], 2, CN_MODIFIER_REVERSE_WALTZ);
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::hash hashes[batch_size];
+    crypto::cn_slow_hash_multi(m_ptrs, m_lengths, hashes, batch_size, ways, 2, CN_MODIFIER_REVERSE_WALTZ);
+    for (size_t i = 0; i < batch_size; ++i)
+      if (hashes[i] != m_expected_hashes[i])
+        return false;
+    return true;
+  }
+
+private:
+  char m_data[batch_size][data_size];
+  const void *m_ptrs[batch_size];
+  size_t m_lengths[batch_size];
+  crypto::hash m_expected_hashes[batch_size];
+};
@@ -81,3 +81,86 @@ private:
   std::vector<cryptonote::tx_destination_entry> m_destinations;
   cryptonote::transaction m_tx;
 };
+
+// Builds a transaction spending in_count outputs of one sender, each in its own ring of ring_size,
+// to follow how signing time grows with the number of inputs (as in sweeps)
+template<size_t a_in_count, size_t a_out_count, rct::RangeProofType range_proof_type, size_t a_ring_size = 11>
+class test_construct_tx_inputs
+{
+  static_assert(0 < a_in_count, "in_count must be greater than 0");
+  static_assert(0 < a_out_count, "out_count must be greater than 0");
+  static_assert(0 < a_ring_size, "ring_size must be greater than 0");
+
+public:
+  static const size_t loop_count = a_in_count < 16 ? 10 : 3;
+  static const size_t in_count  = a_in_count;
+  static const size_t out_count = a_out_count;
+  static const size_t ring_size = a_ring_size;
+
+  bool init()
+  {
+    using namespace cryptonote;
+
+    m_sender.generate();
+    m_alice.generate();
+
+    // the rings share their decoys, only the real outputs differ
+    std::vector<tx_source_entry::output_entry> decoys;
+    for (size_t i = 0; i + 1 < ring_size; ++i)
+    {
+      account_base decoy;
+      decoy.generate();
+      transaction tx;
+      if (!construct_miner_tx(0, 0, 0, 2, 0, decoy.get_keys().m_account_address, tx))
+        return false;
+      const txout_to_key &tx_out = boost::get<txout_to_key>(tx.vout[0].target);
+      decoys.push_back(std::make_pair(0, rct::ctkey({rct::pk2rct(tx_out.key), rct::zeroCommit(tx.vout[0].amount)})));
+    }
+
+    uint64_t amount = 0;
+    for (size_t n = 0; n < in_count; ++n)
+    {
+      transaction tx;
+      if (!construct_miner_tx(0, 0, 0, 2, 0, m_sender.get_keys().m_account_address, tx))
+        return false;
+      const txout_to_key &tx_out = boost::get<txout_to_key>(tx.vout[0].target);
+
+      tx_source_entry source_entry;
+      source_entry.outputs = decoys;
+      source_entry.real_output = ring_size / 2;
+      source_entry.outputs.insert(source_entry.outputs.begin() + source_entry.real_output, std::make_pair(0, rct::ctkey({rct::pk2rct(tx_out.key), rct::zeroCommit(tx.vout[0].amount)})));
+      for (size_t i = 0; i < ring_size; ++i)
+        source_entry.outputs[i].first = i;
+      source_entry.amount = tx.vout[0].amount;
+      source_entry.real_out_tx_key = get_tx_pub_key_from_extra(tx);
+      source_entry.real_output_in_tx_index = 0;
+      source_entry.mask = rct::identity();
+      source_entry.rct = false;
+      m_sources.push_back(source_entry);
+      amount += source_entry.amount;
+    }
+
+    for (size_t i = 0; i < out_count; ++i)
+    {
+      m_destinations.push_back(tx_destination_entry(amount / out_count, m_alice.get_keys().m_account_address, false));
+    }
+
+    return true;
+  }
+
+  bool test()
+  {
+    crypto::secret_key tx_key;
+    std::vector<crypto::secret_key> additional_tx_keys;
+    std::unordered_map<crypto::public_key, cryptonote::subaddress_index> subaddresses;
+    subaddresses[m_sender.get_keys().m_account_address.m_spend_public_key] = {0,0};
+    return cryptonote::construct_tx_and_get_tx_key(m_sender.get_keys(), subaddresses, m_sources, m_destinations, cryptonote::account_public_address{}, std::vector<uint8_t>(), m_tx, 0, tx_key, additional_tx_keys, true, range_proof_type);
+  }
+
+private:
+  cryptonote::account_base m_sender;
+  cryptonote::account_base m_alice;
+  std::vector<cryptonote::tx_source_entry> m_sources;
+  std::vector<cryptonote::tx_destination_entry> m_destinations;
+  cryptonote::transaction m_tx;
+};
@@ -42,6 +42,8 @@
 #include "cn_slow_hash_2.h"
 #include "cn_slow_hash_waltz.h"
 #include "cn_slow_hash_reverse_waltz.h"
+#include "cn_slow_hash_multi.h"
+#include "rx_slow_hash.h"
 #include "derive_public_key.h"
 #include "derive_secret_key.h"
 #include "ge_frombytes_vartime.h"
@@ -147,6 +149,15 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE4(filter, p, test_construct_tx, 100, 2, true, rct::RangeProofPaddedBulletproof);
   TEST_PERFORMANCE4(filter, p, test_construct_tx, 100, 10, true, rct::RangeProofPaddedBulletproof);
 
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 1, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 2, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 4, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 8, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 16, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 32, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 64, 2, rct::RangeProofPaddedBulletproof);
+  TEST_PERFORMANCE3(filter, p, test_construct_tx_inputs, 16, 10, rct::RangeProofMultiOutputBulletproof);
+
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 1, 2, false);
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 2, 2, false);
   TEST_PERFORMANCE3(filter, p, test_check_tx_signature, 10, 2, false);
@@ -196,6 +207,11 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE0(filter, p, test_cn_slow_hash_2);
   TEST_PERFORMANCE0(filter, p, test_cn_slow_hash_waltz);
   TEST_PERFORMANCE0(filter, p, test_cn_slow_hash_reverse_waltz);
+  TEST_PERFORMANCE1(filter, p, test_cn_slow_hash_multi, 1);
+  TEST_PERFORMANCE1(filter, p, test_cn_slow_hash_multi, 2);
+  TEST_PERFORMANCE1(filter, p, test_cn_slow_hash_multi, 4);
+  TEST_PERFORMANCE1(filter, p, test_rx_seed_init, false);
+  TEST_PERFORMANCE1(filter, p, test_rx_seed_init, true);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 32);
   TEST_PERFORMANCE1(filter, p, test_cn_fast_hash, 16384);
 
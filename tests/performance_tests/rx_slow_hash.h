@@ -0,0 +1,74 @@
+// Copyright (c) 2019, The Graft Project
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+// 
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+// 
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+// 
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string.h>
+#include "crypto/hash.h"
+
+extern "C" void rx_stop_mining(void);
+
+// Measures how long switching to a new RandomX seed takes: the cache init
+// alone, or the full dataset init done for miners. With the dataset saved to
+// MONERO_RANDOMX_DATASET_DIR, a second run measures loading it back instead.
+template<bool dataset>
+class test_rx_seed_init
+{
+public:
+  static const size_t loop_count = dataset ? 1 : 10;
+
+  bool init()
+  {
+    memset(m_seed, 0, sizeof(m_seed));
+    memcpy(m_data, "caveat emptor", sizeof(m_data));
+    m_seed_index = 0;
+    return true;
+  }
+
+  bool test()
+  {
+    // a different seed each call, but the same ones from run to run
+    ++m_seed_index;
+    memcpy(m_seed, &m_seed_index, sizeof(m_seed_index));
+    char hash[32];
+    crypto::rx_slow_hash(1, 0, m_seed, m_data, sizeof(m_data), hash, dataset ? 1 : 0, 0);
+    return true;
+  }
+
+  ~test_rx_seed_init()
+  {
+    crypto::rx_slow_hash_free_state();
+    if (dataset)
+      rx_stop_mining();
+  }
+
+private:
+  char m_seed[32];
+  char m_data[13];
+  uint64_t m_seed_index;
+};
@@ -69,10 +69,12 @@ public:
   bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
   uint64_t get_target_blockchain_height() const { return 1; }
   size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+  size_t get_fixed_block_sync_size() const { return 0; }
   virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
   cryptonote::network_type get_nettype() const { return cryptonote::MAINNET; }
-  bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob) const { return false; }
+  bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob, bool include_unrelayed_txes = true) const { return false; }
   bool pool_has_tx(const crypto::hash &txid) const { return false; }
+  bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const { return false; }
   bool get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata, cryptonote::block>>& blocks, std::vector<cryptonote::blobdata>& txs) const { return false; }
   bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::transaction>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
   bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const { return false; }
@@ -83,6 +85,9 @@ public:
   cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
   bool fluffy_blocks_enabled() const { return false; }
   uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes) { return 0; }
+  bool get_block_hashing_blobs(const std::vector<crypto::hash> &ids, std::vector<cryptonote::blobdata> &blobs) const { return false; }
+  uint64_t get_known_block_headers_count(const std::vector<crypto::hash> &ids) const { return 0; }
+  bool prevalidate_block_headers(const std::vector<crypto::hash> &ids, const std::vector<cryptonote::blobdata> &blobs, uint64_t &nvalid) { nvalid = 0; return true; }
   void stop() {}
   void invoke_update_stakes_handler() {}
   typedef cryptonote::StakeTransactionProcessor::supernode_stakes_update_handler supernode_stakes_update_handler;
@@ -0,0 +1,298 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <algorithm>
+#include "gtest/gtest.h"
+
+#include "blockchain_db/testdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_basic/difficulty.h"
+#include "cryptonote_core/blockchain.h"
+#include "cryptonote_core/tx_pool.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+class TestDB: public BaseTestDB {
+public:
+  TestDB() { m_open = true; }
+  virtual bool block_exists(const crypto::hash& h, uint64_t *height) const
+  {
+    auto it = std::find(hashes.begin(), hashes.end(), h);
+    if (it == hashes.end())
+      return false;
+    if (height)
+      *height = it - hashes.begin();
+    return true;
+  }
+  virtual uint64_t get_block_timestamp(const uint64_t& height) const { return blocks.at(height).timestamp; }
+  virtual uint64_t get_top_block_timestamp() const { return blocks.back().timestamp; }
+  virtual size_t get_block_weight(const uint64_t& height) const { return 128; }
+  virtual difficulty_type get_block_cumulative_difficulty(const uint64_t& height) const { return cumulative_difficulties.at(height); }
+  virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const { return 10000000000; }
+  virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const { return hashes.at(height); }
+  virtual crypto::hash top_block_hash() const { return hashes.back(); }
+  virtual block get_top_block() const { return blocks.back(); }
+  virtual uint64_t height() const { return blocks.size(); }
+  virtual void remove_block() { blocks.pop_back(); cumulative_difficulties.pop_back(); hashes.pop_back(); }
+
+  virtual void add_block( const block& blk
+                        , size_t block_weight
+                        , const difficulty_type& cumulative_difficulty
+                        , const uint64_t& coins_generated
+                        , uint64_t num_rct_outs
+                        , const crypto::hash& blk_hash
+                        ) {
+    blocks.push_back(blk);
+    cumulative_difficulties.push_back(cumulative_difficulty);
+    hashes.push_back(blk_hash);
+  }
+  virtual block get_block_from_height(const uint64_t& height) const {
+    return blocks.at(height);
+  }
+  virtual void set_hard_fork_version(uint64_t height, uint8_t version) {
+    if (versions.size() <= height)
+      versions.resize(height+1);
+    versions[height] = version;
+  }
+  virtual uint8_t get_hard_fork_version(uint64_t height) const {
+    return versions.at(height);
+  }
+
+private:
+  std::vector<block> blocks;
+  std::vector<difficulty_type> cumulative_difficulties;
+  std::vector<crypto::hash> hashes;
+  std::deque<uint8_t> versions;
+};
+
+static const std::pair<uint8_t, uint64_t> test_hard_forks[] = { std::make_pair(1, 0), std::make_pair(0, 0) };
+static const cryptonote::test_options hard_fork_options = { test_hard_forks };
+
+static block mkblock(const crypto::hash &prev_id, uint64_t timestamp)
+{
+  block b;
+  b.major_version = 1;
+  b.minor_version = 1;
+  b.timestamp = timestamp;
+  b.prev_id = prev_id;
+  b.nonce = 0;
+  b.miner_tx.version = 1;
+  b.miner_tx.unlock_time = 0;
+  return b;
+}
+
+// a main chain of blocks spaced one target apart, each of the given difficulty
+struct test_blockchain
+{
+  tx_memory_pool txpool;
+  Blockchain bc;
+
+  test_blockchain(size_t height, difficulty_type difficulty): txpool(bc), bc(txpool)
+  {
+    TestDB *db = new TestDB();
+    crypto::hash prev_id = crypto::null_hash;
+    // the genesis block is far behind the others, the difficulty window must leave it out as the main chain does
+    uint64_t timestamp = 1500000000;
+    for (size_t h = 0; h < height; ++h)
+    {
+      const block b = mkblock(prev_id, timestamp);
+      prev_id = get_block_hash(b);
+      db->add_block(b, 0, difficulty * (h + 1), 0, 0, prev_id);
+      timestamp += h == 0 ? 10 * DIFFICULTY_TARGET_V1 : DIFFICULTY_TARGET_V1;
+    }
+    top_id = prev_id;
+    top_timestamp = timestamp - DIFFICULTY_TARGET_V1;
+    EXPECT_TRUE(bc.init(db, FAKECHAIN, true, &hard_fork_options));
+  }
+  ~test_blockchain() { bc.deinit(); }
+
+  crypto::hash top_id;
+  uint64_t top_timestamp;
+};
+
+// headers on top of the chain, with the given gaps between timestamps,
+// mined to the given difficulty if it is not 0
+static void make_headers(const test_blockchain &chain, const std::vector<uint64_t> &gaps, difficulty_type difficulty, std::vector<crypto::hash> &ids, std::vector<blobdata> &blobs)
+{
+  crypto::hash prev_id = chain.top_id;
+  uint64_t timestamp = chain.top_timestamp;
+  for (uint64_t gap: gaps)
+  {
+    timestamp += gap;
+    block b = mkblock(prev_id, timestamp);
+    while (difficulty && !check_hash(get_block_longhash(NULL, b, 0, 0), difficulty))
+      ++b.nonce;
+    prev_id = get_block_hash(b);
+    ids.push_back(prev_id);
+    blobs.push_back(get_block_hashing_blob(b));
+  }
+}
+
+}
+
+class blockchain_accessor_test
+{
+public:
+  static std::vector<crypto::hash> &blocks_hash_check(Blockchain &bc) { return bc.m_blocks_hash_check; }
+
+  static bool prevalidated(const Blockchain &bc, const crypto::hash &id, difficulty_type &cumulative_difficulty, crypto::hash &pow)
+  {
+    auto it = bc.m_prevalidated_headers.find(id);
+    if (it == bc.m_prevalidated_headers.end())
+      return false;
+    cumulative_difficulty = it->second.cumulative_difficulty;
+    pow = it->second.pow;
+    return true;
+  }
+};
+
+TEST(prevalidate_block_headers, rejects_bad_linkage)
+{
+  test_blockchain chain(8, 1);
+  std::vector<crypto::hash> ids;
+  std::vector<blobdata> blobs;
+  make_headers(chain, {DIFFICULTY_TARGET_V1, DIFFICULTY_TARGET_V1, DIFFICULTY_TARGET_V1}, 0, ids, blobs);
+
+  // the last header does not link to the one before it
+  std::swap(ids[1], ids[2]);
+  std::swap(blobs[1], blobs[2]);
+
+  uint64_t nvalid = 42;
+  ASSERT_FALSE(chain.bc.prevalidate_block_headers(ids, blobs, nvalid));
+  ASSERT_EQ(0, nvalid);
+
+  // a blob which does not hash to its id
+  std::swap(ids[1], ids[2]);
+  std::swap(blobs[0], blobs[1]);
+  ASSERT_FALSE(chain.bc.prevalidate_block_headers(ids, blobs, nvalid));
+  ASSERT_EQ(0, nvalid);
+
+  difficulty_type cumulative_difficulty;
+  crypto::hash pow;
+  for (const auto &id: ids)
+    ASSERT_FALSE(blockchain_accessor_test::prevalidated(chain.bc, id, cumulative_difficulty, pow));
+}
+
+TEST(prevalidate_block_headers, rejects_insufficient_pow)
+{
+  test_blockchain chain(8, 1000000000000);
+  std::vector<crypto::hash> ids;
+  std::vector<blobdata> blobs;
+  make_headers(chain, {DIFFICULTY_TARGET_V1, DIFFICULTY_TARGET_V1}, 0, ids, blobs);
+
+  uint64_t nvalid = 42;
+  ASSERT_FALSE(chain.bc.prevalidate_block_headers(ids, blobs, nvalid));
+  ASSERT_EQ(0, nvalid);
+
+  difficulty_type cumulative_difficulty;
+  crypto::hash pow;
+  ASSERT_FALSE(blockchain_accessor_test::prevalidated(chain.bc, ids[0], cumulative_difficulty, pow));
+}
+
+TEST(prevalidate_block_headers, carries_difficulty_across_batches)
+{
+  static const difficulty_type mined_difficulty = 16;
+  const std::vector<uint64_t> gaps = {50, 70, 20, 90, 40, 60};
+
+  test_blockchain chain(8, 4);
+  std::vector<crypto::hash> ids;
+  std::vector<blobdata> blobs;
+  make_headers(chain, gaps, mined_difficulty, ids, blobs);
+
+  // the first header continues the main chain difficulty
+  const difficulty_type next_difficulty = chain.bc.get_difficulty_for_next_block();
+
+  // one batch
+  uint64_t nvalid = 0;
+  ASSERT_TRUE(chain.bc.prevalidate_block_headers(ids, blobs, nvalid));
+  ASSERT_EQ(ids.size(), nvalid);
+  std::vector<difficulty_type> expected(ids.size());
+  crypto::hash pow;
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    ASSERT_TRUE(blockchain_accessor_test::prevalidated(chain.bc, ids[i], expected[i], pow));
+    ASSERT_TRUE(check_hash(pow, mined_difficulty));
+    ASSERT_LE(expected[i] - (i ? expected[i - 1] : 4 * 8), mined_difficulty);
+  }
+  ASSERT_EQ(4 * 8 + next_difficulty, expected[0]);
+
+  // the same headers in two batches, on a chain which has not seen them yet
+  test_blockchain split_chain(8, 4);
+  const size_t half = ids.size() / 2;
+  const std::vector<crypto::hash> ids0(ids.begin(), ids.begin() + half), ids1(ids.begin() + half, ids.end());
+  const std::vector<blobdata> blobs0(blobs.begin(), blobs.begin() + half), blobs1(blobs.begin() + half, blobs.end());
+  ASSERT_TRUE(split_chain.bc.prevalidate_block_headers(ids0, blobs0, nvalid));
+  ASSERT_EQ(half, nvalid);
+  ASSERT_TRUE(split_chain.bc.prevalidate_block_headers(ids1, blobs1, nvalid));
+  ASSERT_EQ(ids.size() - half, nvalid);
+  for (size_t i = 0; i < ids.size(); ++i)
+  {
+    difficulty_type cumulative_difficulty;
+    ASSERT_TRUE(blockchain_accessor_test::prevalidated(split_chain.bc, ids[i], cumulative_difficulty, pow));
+    ASSERT_EQ(expected[i], cumulative_difficulty);
+  }
+}
+
+TEST(prevalidate_block_headers, checks_fast_sync_hashes)
+{
+  // the difficulty is so high that these headers only pass if their proof of work is not checked
+  test_blockchain chain(8, 1000000000000);
+  std::vector<crypto::hash> ids;
+  std::vector<blobdata> blobs;
+  make_headers(chain, {DIFFICULTY_TARGET_V1, DIFFICULTY_TARGET_V1, DIFFICULTY_TARGET_V1, DIFFICULTY_TARGET_V1}, 0, ids, blobs);
+
+  std::vector<crypto::hash> &hash_check = blockchain_accessor_test::blocks_hash_check(chain.bc);
+  hash_check.resize(8 + ids.size(), crypto::null_hash);
+
+  // a header which is not the one compiled in is rejected, the ones before it are kept
+  std::copy(ids.begin(), ids.end(), hash_check.begin() + 8);
+  hash_check[8 + 2] = crypto::cn_fast_hash("x", 1);
+  uint64_t nvalid = 0;
+  ASSERT_FALSE(chain.bc.prevalidate_block_headers(ids, blobs, nvalid));
+  ASSERT_EQ(2, nvalid);
+  difficulty_type cumulative_difficulty;
+  crypto::hash pow;
+  ASSERT_TRUE(blockchain_accessor_test::prevalidated(chain.bc, ids[1], cumulative_difficulty, pow));
+  ASSERT_EQ(crypto::null_hash, pow);
+  ASSERT_FALSE(blockchain_accessor_test::prevalidated(chain.bc, ids[2], cumulative_difficulty, pow));
+
+  // the compiled in hashes replace the proof of work check
+  hash_check[8 + 2] = ids[2];
+  ASSERT_TRUE(chain.bc.prevalidate_block_headers(ids, blobs, nvalid));
+  ASSERT_EQ(ids.size(), nvalid);
+  for (const auto &id: ids)
+  {
+    ASSERT_TRUE(blockchain_accessor_test::prevalidated(chain.bc, id, cumulative_difficulty, pow));
+    ASSERT_EQ(crypto::null_hash, pow);
+  }
+}
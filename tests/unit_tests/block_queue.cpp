@@ -85,3 +85,57 @@ TEST(block_queue, flush_uuid)
   bq.add_blocks(0, 200, uuid1());
   ASSERT_EQ(bq.get_max_block_height(), 399);
 }
+
+TEST(block_queue, span_size)
+{
+  cryptonote::block_queue bq;
+
+  // unmeasured peers get the default
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 2048), 20);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 10), 10);
+  cryptonote::block_queue::peer_rate rate;
+  ASSERT_FALSE(bq.get_peer_rate(uuid1(), rate));
+
+  // 10 blocks of 1000 bytes at 10 kB/s: 5 seconds worth is 50 blocks
+  bq.add_blocks(0, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 10000.0f, 10000);
+  ASSERT_TRUE(bq.get_peer_rate(uuid1(), rate));
+  ASSERT_EQ(rate.nspans, 1);
+  ASSERT_EQ(rate.nblocks, 10);
+  ASSERT_EQ(rate.size, 10000);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 2048), BLOCKS_SYNCHRONIZING_SPAN_SECONDS * 10);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 30), 30);
+
+  // a faster peer gets bigger spans, a very slow one at least a block
+  bq.add_blocks(10, std::vector<cryptonote::block_complete_entry>(10), uuid2(), 100000.0f, 10000);
+  ASSERT_GT(bq.get_span_size(uuid2(), 20, 2048), bq.get_span_size(uuid1(), 20, 2048));
+  bq.add_blocks(20, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 0.001f, 10000);
+  bq.add_blocks(30, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 0.001f, 10000);
+  ASSERT_LT(bq.get_span_size(uuid1(), 20, 2048), BLOCKS_SYNCHRONIZING_SPAN_SECONDS * 10);
+  ASSERT_GE(bq.get_span_size(uuid1(), 20, 2048), 1);
+
+  // --block-sync-size caps fast peers too
+  ASSERT_EQ(bq.get_span_size(uuid2(), 20, 2048, 20), 20);
+  ASSERT_EQ(bq.get_span_size(uuid2(), 20, 10, 20), 10);
+  ASSERT_LE(bq.get_span_size(uuid1(), 20, 2048, 20), 20);
+
+  bq.remove_peer_rate(uuid1());
+  ASSERT_FALSE(bq.get_peer_rate(uuid1(), rate));
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 2048), 20);
+  ASSERT_EQ(bq.get_span_size(uuid1(), 20, 2048, 20), 20);
+}
+
+TEST(block_queue, late_span)
+{
+  cryptonote::block_queue bq;
+  const boost::posix_time::ptime t0 = boost::posix_time::microsec_clock::universal_time();
+
+  // no rate, can't tell
+  ASSERT_FALSE(bq.is_span_late(uuid1(), 10, t0, t0 + boost::posix_time::seconds(3600)));
+
+  // 10 blocks of 1000 bytes at 10 kB/s should take a second
+  bq.add_blocks(0, std::vector<cryptonote::block_complete_entry>(10), uuid1(), 10000.0f, 10000);
+  ASSERT_FALSE(bq.is_span_late(uuid1(), 10, t0, t0 + boost::posix_time::seconds(1)));
+  ASSERT_FALSE(bq.is_span_late(uuid1(), 10, t0, t0 + boost::posix_time::seconds(4)));
+  ASSERT_TRUE(bq.is_span_late(uuid1(), 10, t0, t0 + boost::posix_time::seconds(6)));
+  ASSERT_FALSE(bq.is_span_late(uuid1(), 100, t0, t0 + boost::posix_time::seconds(6)));
+}
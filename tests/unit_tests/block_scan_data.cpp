@@ -0,0 +1,424 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <unordered_map>
+#include "gtest/gtest.h"
+
+#include "blockchain_db/testdb.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "p2p/net_node.h"
+#include "ringct/rctOps.h"
+#include "rpc/core_rpc_server.h"
+#include "serialization/binary_archive.h"
+
+using namespace cryptonote;
+
+namespace
+{
+
+static uint64_t block_timestamp(uint64_t height)
+{
+  return 1500000000 + height * DIFFICULTY_TARGET_V1;
+}
+
+class TestDB: public BaseTestDB {
+public:
+  TestDB(): lookups_before_reorg(0), block_reads(0) { m_open = true; }
+
+  virtual uint64_t height() const { return chain.size(); }
+  virtual crypto::hash top_block_hash() const { return chain.back(); }
+  virtual block get_top_block() const { return block_by_hash(chain.back()); }
+  virtual block get_block_from_height(const uint64_t& height) const { return block_by_hash(chain.at(height)); }
+  virtual uint8_t get_hard_fork_version(uint64_t height) const { return 1; }
+  virtual uint64_t get_block_timestamp(const uint64_t& height) const { return block_timestamp(height); }
+  virtual uint64_t get_top_block_timestamp() const { return block_timestamp(chain.size() - 1); }
+  virtual size_t get_block_weight(const uint64_t& height) const { return 128; }
+  virtual difficulty_type get_block_cumulative_difficulty(const uint64_t& height) const { return height + 1; }
+  virtual uint64_t get_block_already_generated_coins(const uint64_t& height) const { return 10000000000; }
+  virtual crypto::hash get_block_hash_from_height(const uint64_t& height) const
+  {
+    // another chain takes over after a given number of lookups, as if a reorg happened meanwhile
+    if (lookups_before_reorg && --lookups_before_reorg == 0)
+      chain.swap(reorg_chain);
+    return chain.at(height);
+  }
+  virtual blobdata get_block_blob(const crypto::hash& h) const
+  {
+    auto it = blocks.find(h);
+    if (it == blocks.end())
+      throw BLOCK_DNE("Block not found");
+    ++block_reads;
+    return it->second;
+  }
+  virtual bool get_pruned_tx_blob(const crypto::hash& h, cryptonote::blobdata &tx) const
+  {
+    auto it = txs.find(h);
+    if (it == txs.end())
+      return false;
+    tx = it->second.first;
+    return true;
+  }
+  virtual bool tx_exists(const crypto::hash& h, uint64_t& tx_index) const
+  {
+    auto it = tx_indices.find(h);
+    if (it == tx_indices.end())
+      return false;
+    tx_index = it->second;
+    return true;
+  }
+  virtual std::vector<uint64_t> get_tx_amount_output_indices(const uint64_t tx_index) const { return output_indices.at(tx_index); }
+
+  crypto::hash add(const block &b, std::vector<crypto::hash> &to_chain)
+  {
+    const crypto::hash id = get_block_hash(b);
+    blocks[id] = block_to_blob(b);
+    add_tx(get_transaction_hash(b.miner_tx), b.miner_tx);
+    to_chain.push_back(id);
+    return id;
+  }
+
+  void add_tx(const crypto::hash &tx_hash, const transaction &tx)
+  {
+    std::stringstream ss;
+    binary_archive<true> ba(ss);
+    ASSERT_TRUE(const_cast<transaction&>(tx).serialize_base(ba));
+    txs[tx_hash] = std::make_pair(ss.str(), tx);
+    tx_indices[tx_hash] = output_indices.size();
+    std::vector<uint64_t> indices;
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+      indices.push_back(1000 * output_indices.size() + i);
+    output_indices.push_back(indices);
+  }
+
+  block block_by_hash(const crypto::hash &id) const
+  {
+    block b;
+    EXPECT_TRUE(parse_and_validate_block_from_blob(blocks.at(id), b));
+    return b;
+  }
+
+  mutable std::vector<crypto::hash> chain;
+  mutable std::vector<crypto::hash> reorg_chain;
+  mutable size_t lookups_before_reorg;
+  mutable size_t block_reads;
+  std::unordered_map<crypto::hash, blobdata> blocks;
+  std::unordered_map<crypto::hash, std::pair<blobdata, transaction>> txs;
+  std::unordered_map<crypto::hash, uint64_t> tx_indices;
+  std::vector<std::vector<uint64_t>> output_indices;
+};
+
+static const std::pair<uint8_t, uint64_t> test_hard_forks[] = { std::make_pair(1, 0), std::make_pair(0, 0) };
+static const cryptonote::test_options hard_fork_options = { test_hard_forks };
+
+static crypto::public_key make_public_key()
+{
+  return rct::rct2pk(rct::pkGen());
+}
+
+static transaction make_miner_tx(uint64_t height)
+{
+  transaction tx;
+  tx.version = 1;
+  tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+  txin_gen in;
+  in.height = height;
+  tx.vin.push_back(in);
+  tx.vout.push_back({1000 + height, txout_to_key(make_public_key())});
+  add_tx_pub_key_to_extra(tx, make_public_key());
+  return tx;
+}
+
+// a pre RingCT tx spending two outputs, with a payment id and additional tx keys
+static transaction make_v1_tx()
+{
+  transaction tx;
+  tx.version = 1;
+  tx.unlock_time = 0;
+  for (uint64_t amount: {7000, 3000})
+  {
+    txin_to_key in;
+    in.amount = amount;
+    in.key_offsets.push_back(amount / 1000);
+    in.k_image = rct::rct2ki(rct::pkGen());
+    tx.vin.push_back(in);
+  }
+  tx.vout.push_back({6000, txout_to_key(make_public_key())});
+  tx.vout.push_back({2000, txout_to_key(make_public_key())});
+  add_tx_pub_key_to_extra(tx, make_public_key());
+  add_additional_tx_pub_keys_to_extra(tx.extra, {make_public_key(), make_public_key()});
+  add_extra_nonce_to_tx_extra(tx.extra, std::string(9, '\x01'));
+  return tx;
+}
+
+static transaction make_rct_tx()
+{
+  transaction tx;
+  tx.version = 2;
+  tx.unlock_time = 0;
+  txin_to_key in;
+  in.amount = 0;
+  in.key_offsets.push_back(4);
+  in.k_image = rct::rct2ki(rct::pkGen());
+  tx.vin.push_back(in);
+  tx.rct_signatures.type = rct::RCTTypeFull;
+  tx.rct_signatures.txnFee = 1234;
+  for (size_t i = 0; i < 2; ++i)
+  {
+    tx.vout.push_back({0, txout_to_key(make_public_key())});
+    rct::ctkey pk;
+    pk.dest = rct::pkGen();
+    pk.mask = rct::pkGen();
+    tx.rct_signatures.outPk.push_back(pk);
+    rct::ecdhTuple ecdh;
+    ecdh.mask = rct::skGen();
+    ecdh.amount = rct::skGen();
+    tx.rct_signatures.ecdhInfo.push_back(ecdh);
+  }
+  add_tx_pub_key_to_extra(tx, make_public_key());
+  return tx;
+}
+
+static block make_block(const crypto::hash &prev_id, uint64_t height, const std::vector<crypto::hash> &tx_hashes = {})
+{
+  block b;
+  b.major_version = 1;
+  b.minor_version = 1;
+  b.timestamp = block_timestamp(height);
+  b.prev_id = prev_id;
+  b.nonce = 0;
+  b.miner_tx = make_miner_tx(height);
+  b.tx_hashes = tx_hashes;
+  return b;
+}
+
+typedef nodetool::node_server<cryptonote::t_cryptonote_protocol_handler<cryptonote::core>> test_p2p;
+
+class block_scan_data_test: public ::testing::Test
+{
+public:
+  block_scan_data_test(): m_core(nullptr), m_protocol(m_core, nullptr), m_p2p(m_protocol), m_rpc(m_core, m_p2p), m_db(new TestDB())
+  {
+  }
+
+  // a chain of the given height, the block at height 1 has a pre RingCT and a RingCT tx
+  void make_chain(size_t height)
+  {
+    m_v1_tx = make_v1_tx();
+    m_rct_tx = make_rct_tx();
+    m_v1_tx_hash = crypto::cn_fast_hash("v1", 2);
+    m_rct_tx_hash = crypto::cn_fast_hash("rct", 3);
+    m_db->add_tx(m_v1_tx_hash, m_v1_tx);
+    m_db->add_tx(m_rct_tx_hash, m_rct_tx);
+
+    crypto::hash prev_id = crypto::null_hash;
+    for (size_t h = 0; h < height; ++h)
+    {
+      m_blocks.push_back(h == 1 ? make_block(prev_id, h, {m_v1_tx_hash, m_rct_tx_hash}) : make_block(prev_id, h));
+      prev_id = m_db->add(m_blocks.back(), m_db->chain);
+    }
+    ASSERT_TRUE(m_core.get_blockchain_storage().init(m_db, FAKECHAIN, true, &hard_fork_options));
+  }
+
+  virtual void TearDown()
+  {
+    if (!m_blocks.empty())
+      m_core.get_blockchain_storage().deinit();
+    else
+      delete m_db;
+  }
+
+  bool get_scan_data(uint64_t start_height, COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response &res)
+  {
+    COMMAND_RPC_GET_BLOCKS_SCAN_DATA::request req;
+    req.start_height = start_height;
+    res = COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response();
+    return m_rpc.on_get_blocks_scan_data(req, res);
+  }
+
+  void check_tx(const COMMAND_RPC_GET_BLOCKS_SCAN_DATA::tx_scan_data &data, const crypto::hash &tx_hash, const transaction &tx)
+  {
+    ASSERT_EQ(tx_hash, data.tx_hash);
+    ASSERT_EQ(tx.version, data.version);
+    ASSERT_EQ(tx.unlock_time, data.unlock_time);
+
+    std::vector<tx_extra_field> fields;
+    ASSERT_TRUE(parse_tx_extra(tx.extra, fields));
+    ASSERT_EQ(std::vector<crypto::public_key>{get_tx_pub_key_from_extra(tx)}, data.tx_pub_keys);
+    ASSERT_EQ(get_additional_tx_pub_keys_from_extra(tx), data.additional_tx_pub_keys);
+    tx_extra_nonce extra_nonce;
+    ASSERT_EQ(find_tx_extra_field_by_type(fields, extra_nonce) ? extra_nonce.nonce : std::string(), data.extra_nonce);
+
+    ASSERT_EQ(tx.vout.size(), data.output_keys.size());
+    ASSERT_EQ(tx.vout.size(), data.output_amounts.size());
+    for (size_t i = 0; i < tx.vout.size(); ++i)
+    {
+      ASSERT_EQ(boost::get<txout_to_key>(tx.vout[i].target).key, data.output_keys[i]);
+      ASSERT_EQ(tx.vout[i].amount, data.output_amounts[i]);
+    }
+    uint64_t tx_index;
+    ASSERT_TRUE(m_db->tx_exists(tx_hash, tx_index));
+    ASSERT_EQ(m_db->output_indices[tx_index], data.output_indices);
+
+    std::vector<crypto::key_image> key_images;
+    std::vector<uint64_t> input_amounts;
+    uint64_t amount_in = 0;
+    for (const txin_v &in: tx.vin)
+    {
+      if (in.type() != typeid(txin_to_key))
+        continue;
+      key_images.push_back(boost::get<txin_to_key>(in).k_image);
+      input_amounts.push_back(boost::get<txin_to_key>(in).amount);
+      amount_in += boost::get<txin_to_key>(in).amount;
+    }
+    ASSERT_EQ(key_images, data.key_images);
+    ASSERT_EQ(input_amounts, data.input_amounts);
+
+    if (tx.version >= 2)
+    {
+      ASSERT_EQ(tx.rct_signatures.type, data.rct_type);
+      ASSERT_EQ(tx.rct_signatures.txnFee, data.fee);
+      ASSERT_EQ(tx.vout.size(), data.commitments.size());
+      ASSERT_EQ(tx.vout.size(), data.ecdh_masks.size());
+      ASSERT_EQ(tx.vout.size(), data.ecdh_amounts.size());
+      for (size_t i = 0; i < tx.vout.size(); ++i)
+      {
+        ASSERT_EQ(tx.rct_signatures.outPk[i].mask, data.commitments[i]);
+        ASSERT_EQ(tx.rct_signatures.ecdhInfo[i].mask, data.ecdh_masks[i]);
+        ASSERT_EQ(tx.rct_signatures.ecdhInfo[i].amount, data.ecdh_amounts[i]);
+      }
+    }
+    else
+    {
+      ASSERT_EQ((uint8_t)rct::RCTTypeNull, data.rct_type);
+      ASSERT_EQ(amount_in ? amount_in - get_outs_money_amount(tx) : 0, data.fee);
+      ASSERT_TRUE(data.commitments.empty());
+      ASSERT_TRUE(data.ecdh_masks.empty());
+      ASSERT_TRUE(data.ecdh_amounts.empty());
+    }
+  }
+
+protected:
+  cryptonote::core m_core;
+  cryptonote::t_cryptonote_protocol_handler<cryptonote::core> m_protocol;
+  test_p2p m_p2p;
+  cryptonote::core_rpc_server m_rpc;
+  TestDB *m_db;
+
+  std::vector<block> m_blocks;
+  transaction m_v1_tx, m_rct_tx;
+  crypto::hash m_v1_tx_hash, m_rct_tx_hash;
+};
+
+}
+
+TEST_F(block_scan_data_test, matches_full_block)
+{
+  make_chain(4);
+
+  COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response res;
+  ASSERT_TRUE(get_scan_data(1, res));
+  ASSERT_EQ(CORE_RPC_STATUS_OK, res.status);
+  ASSERT_EQ(1, res.start_height);
+  ASSERT_EQ(4, res.current_height);
+  ASSERT_EQ(3, res.blocks.size());
+
+  for (size_t i = 0; i < res.blocks.size(); ++i)
+  {
+    const block &b = m_blocks[i + 1];
+    ASSERT_EQ(get_block_hash(b), res.blocks[i].block_hash);
+    ASSERT_EQ(b.timestamp, res.blocks[i].timestamp);
+    ASSERT_EQ(b.tx_hashes.size() + 1, res.blocks[i].txs.size());
+    check_tx(res.blocks[i].txs[0], get_transaction_hash(b.miner_tx), b.miner_tx);
+  }
+  check_tx(res.blocks[0].txs[1], m_v1_tx_hash, m_v1_tx);
+  check_tx(res.blocks[0].txs[2], m_rct_tx_hash, m_rct_tx);
+}
+
+TEST_F(block_scan_data_test, caches_blocks_in_fifo_order)
+{
+  static const size_t cache_size = 2000;
+  make_chain(cache_size + 2);
+
+  // the first pass reads every block, and leaves the last cache_size ones cached
+  COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response res;
+  for (uint64_t start_height = 1; start_height < m_db->height(); start_height += res.blocks.size())
+  {
+    ASSERT_TRUE(get_scan_data(start_height, res));
+    ASSERT_EQ(CORE_RPC_STATUS_OK, res.status);
+  }
+  ASSERT_EQ(cache_size + 1, m_db->block_reads);
+
+  // cached blocks are not read again, and give the same data
+  COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response cached_res;
+  ASSERT_TRUE(get_scan_data(2, cached_res));
+  ASSERT_EQ(CORE_RPC_STATUS_OK, cached_res.status);
+  ASSERT_EQ(cache_size + 1, m_db->block_reads);
+  ASSERT_EQ(COMMAND_RPC_GET_BLOCKS_SCAN_DATA_MAX_COUNT, cached_res.blocks.size());
+  ASSERT_EQ(get_block_hash(m_blocks[2]), cached_res.blocks[0].block_hash);
+
+  // block 1 was evicted first, and reading it again evicts block 2, and so on in FIFO order
+  const size_t max_count = COMMAND_RPC_GET_BLOCKS_SCAN_DATA_MAX_COUNT;
+  ASSERT_TRUE(get_scan_data(1, res));
+  ASSERT_EQ(CORE_RPC_STATUS_OK, res.status);
+  ASSERT_EQ(cache_size + 1 + max_count, m_db->block_reads);
+
+  // while the newest blocks were kept
+  ASSERT_TRUE(get_scan_data(max_count + 2, res));
+  ASSERT_EQ(CORE_RPC_STATUS_OK, res.status);
+  ASSERT_EQ(cache_size - max_count, res.blocks.size());
+  ASSERT_EQ(cache_size + 1 + max_count, m_db->block_reads);
+}
+
+TEST_F(block_scan_data_test, busy_on_reorg_while_reading)
+{
+  make_chain(6);
+
+  // a competing chain forking after height 1, which takes over while height 3 is looked up
+  m_db->reorg_chain.assign(m_db->chain.begin(), m_db->chain.begin() + 2);
+  crypto::hash prev_id = m_db->reorg_chain.back();
+  for (uint64_t h = 2; h < 6; ++h)
+  {
+    block b = make_block(prev_id, h);
+    b.nonce = 1;
+    prev_id = m_db->add(b, m_db->reorg_chain);
+  }
+  m_db->lookups_before_reorg = 3;
+
+  COMMAND_RPC_GET_BLOCKS_SCAN_DATA::response res;
+  ASSERT_TRUE(get_scan_data(1, res));
+  ASSERT_EQ(CORE_RPC_STATUS_BUSY, res.status);
+
+  // once the reorg is over, the new chain is served
+  ASSERT_TRUE(get_scan_data(1, res));
+  ASSERT_EQ(CORE_RPC_STATUS_OK, res.status);
+  ASSERT_EQ(5, res.blocks.size());
+  for (size_t i = 0; i < res.blocks.size(); ++i)
+    ASSERT_EQ(m_db->chain[i + 1], res.blocks[i].block_hash);
+}
@@ -342,6 +342,25 @@ TYPED_TEST(BlockchainDBTest, RetrieveBlockData)
 
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[0]), hashes[0]);
   ASSERT_HASH_EQ(get_block_hash(this->m_blocks[1]), hashes[1]);
+
+  std::vector<std::pair<uint64_t, blobdata>> blobs;
+  ASSERT_TRUE(this->m_db->for_block_blobs_range(0, 1, [&blobs](uint64_t height, const epee::span<const uint8_t> &blob) {
+    blobs.push_back(std::make_pair(height, blobdata(reinterpret_cast<const char*>(blob.data()), blob.size())));
+    return true;
+  }));
+  ASSERT_EQ(2, blobs.size());
+  ASSERT_EQ(0, blobs[0].first);
+  ASSERT_EQ(1, blobs[1].first);
+  ASSERT_EQ(this->m_db->get_block_blob_from_height(0), blobs[0].second);
+  ASSERT_EQ(this->m_db->get_block_blob_from_height(1), blobs[1].second);
+
+  blobs.clear();
+  ASSERT_FALSE(this->m_db->for_block_blobs_range(0, 1, [&blobs](uint64_t height, const epee::span<const uint8_t> &blob) {
+    blobs.push_back(std::make_pair(height, blobdata()));
+    return false;
+  }));
+  ASSERT_EQ(1, blobs.size());
+  ASSERT_THROW(this->m_db->for_block_blobs_range(0, 2, [](uint64_t, const epee::span<const uint8_t>&) { return true; }), BLOCK_DNE);
 }
 
 }  // anonymous namespace
@@ -96,3 +96,42 @@ TEST(Crypto, verify_32)
     }
   }
 }
+
+TEST(Crypto, generate_key_derivations)
+{
+  crypto::public_key view_pub;
+  crypto::secret_key view_sec;
+  crypto::generate_keys(view_pub, view_sec);
+
+  std::vector<crypto::public_key> keys;
+  for (size_t i = 0; i < 17; ++i)
+  {
+    crypto::public_key pub;
+    crypto::secret_key sec;
+    crypto::generate_keys(pub, sec);
+    keys.push_back(pub);
+  }
+  // not a point: the y coordinate is out of range
+  crypto::public_key invalid;
+  memset(invalid.data, 0xff, sizeof(invalid.data));
+  keys.insert(keys.begin() + 5, invalid);
+
+  std::vector<crypto::key_derivation> derivations;
+  std::vector<bool> valid;
+  ASSERT_FALSE(crypto::generate_key_derivations(keys, view_sec, derivations, valid));
+  ASSERT_EQ(derivations.size(), keys.size());
+  ASSERT_EQ(valid.size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i)
+  {
+    crypto::key_derivation expected;
+    const bool r = crypto::generate_key_derivation(keys[i], view_sec, expected);
+    ASSERT_EQ(valid[i], r);
+    if (r)
+      ASSERT_EQ(memcmp(&derivations[i], &expected, sizeof(expected)), 0);
+  }
+
+  keys.erase(keys.begin() + 5);
+  ASSERT_TRUE(crypto::generate_key_derivations(keys, view_sec, derivations, valid));
+  ASSERT_TRUE(crypto::generate_key_derivations(std::vector<crypto::public_key>(), view_sec, derivations, valid));
+  ASSERT_TRUE(derivations.empty());
+}
@@ -414,6 +414,104 @@ TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_process
   ASSERT_TRUE(conn->last_send_data().empty());
 }
 
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_accounts_traffic_per_command)
+{
+  // Setup
+  const int expected_command = 3390127;
+  const std::string in_data(256, 'a');
+  const std::string out_data(128, 'b');
+
+  test_connection_ptr conn = create_connection();
+
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = in_data.size();
+  req_head.m_have_to_return_data = true;
+  req_head.m_command = expected_command;
+  req_head.m_flags = LEVIN_PACKET_REQUEST;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+
+  std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += in_data;
+
+  m_commands_handler.invoke_out_buf(out_data);
+
+  // Test
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_EQ(1, m_handler_config.notify(expected_command, in_data, conn->m_protocol_handler.get_connection_id()));
+
+  // Check
+  const test_levin_connection_context &context = conn->m_protocol_handler.m_connection_context;
+  ASSERT_EQ(1, context.m_recv_msgs);
+  ASSERT_EQ(2, context.m_send_msgs);
+
+  const auto totals = epee::net_utils::network_throttle_manager::get_global_command_stats().get_totals();
+  auto it = std::find_if(totals.begin(), totals.end(), [&](const epee::net_utils::network_command_stats::command_totals &t) {
+    return t.command == expected_command;
+  });
+  ASSERT_TRUE(it != totals.end());
+  ASSERT_EQ(1, it->messages_in);
+  ASSERT_EQ(sizeof(req_head) + in_data.size(), it->bytes_in);
+  ASSERT_EQ(2, it->messages_out);
+  ASSERT_EQ(2 * sizeof(req_head) + out_data.size() + in_data.size(), it->bytes_out);
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_accounts_unhandled_commands_as_other)
+{
+  // Setup
+  const int handled_command = 3390128;
+  const int unhandled_command = 3390129;
+  const std::string in_data(64, 'a');
+
+  test_connection_ptr conn = create_connection();
+  const test_levin_connection_context &context = conn->m_protocol_handler.m_connection_context;
+  ASSERT_TRUE(context.m_command_stats);
+
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = in_data.size();
+  req_head.m_have_to_return_data = false;
+  req_head.m_flags = LEVIN_PACKET_REQUEST;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+
+  req_head.m_command = handled_command;
+  std::string handled_buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  handled_buf += in_data;
+  req_head.m_command = unhandled_command;
+  std::string unhandled_buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  unhandled_buf += in_data;
+
+  // Test
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(handled_buf.data(), handled_buf.size()));
+  m_commands_handler.return_code(LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED);
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(unhandled_buf.data(), unhandled_buf.size()));
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(unhandled_buf.data(), unhandled_buf.size()));
+
+  // Check
+  const auto totals = context.m_command_stats->get_totals();
+  ASSERT_EQ(2, totals.size());
+  for (const auto &t: totals)
+  {
+    ASSERT_NE(unhandled_command, t.command);
+    if (t.command == handled_command)
+    {
+      ASSERT_EQ(1, t.messages_in);
+      ASSERT_EQ(handled_buf.size(), t.bytes_in);
+    }
+    else
+    {
+      ASSERT_EQ((int)epee::net_utils::network_command_stats::other_command, t.command);
+      ASSERT_EQ(2, t.messages_in);
+      ASSERT_EQ(2 * unhandled_buf.size(), t.bytes_in);
+    }
+  }
+
+  const auto global_totals = epee::net_utils::network_throttle_manager::get_global_command_stats().get_totals();
+  ASSERT_TRUE(std::none_of(global_totals.begin(), global_totals.end(), [&](const epee::net_utils::network_command_stats::command_totals &t) {
+    return t.command == unhandled_command;
+  }));
+}
+
 TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_processes_qued_callback)
 {
   test_connection_ptr conn = create_connection();
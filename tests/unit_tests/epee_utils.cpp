@@ -43,6 +43,7 @@
 
 #include "boost/archive/portable_binary_iarchive.hpp"
 #include "boost/archive/portable_binary_oarchive.hpp"
+#include "byte_slice.h"
 #include "hex.h"
 #include "net/net_utils_base.h"
 #include "net/local_ip.h"
@@ -372,6 +373,68 @@ TEST(Span, ToMutSpan)
   EXPECT_EQ((std::vector<unsigned>{1, 2, 3, 4}), mut);
 }
 
+TEST(ByteSlice, Construction)
+{
+  const epee::byte_slice empty{};
+  EXPECT_TRUE(empty.empty());
+  EXPECT_EQ(0u, empty.size());
+  EXPECT_EQ(nullptr, empty.data());
+  EXPECT_EQ(0, empty.use_count());
+
+  std::string source(1000, 'x'); // not small enough to be stored inline
+  const char* const source_data = source.data();
+  const epee::byte_slice moved{std::move(source)};
+  EXPECT_EQ(1000u, moved.size());
+  EXPECT_EQ(source_data, moved.data());
+  EXPECT_EQ(1, moved.use_count());
+
+  const char bytes[] = {'a', 'b', 'c'};
+  const epee::byte_slice copied{bytes, sizeof(bytes)};
+  EXPECT_EQ(3u, copied.size());
+  EXPECT_NE(static_cast<const void*>(bytes), static_cast<const void*>(copied.data()));
+  EXPECT_EQ(std::string("abc"), std::string(copied.data(), copied.size()));
+}
+
+TEST(ByteSlice, Sharing)
+{
+  epee::byte_slice slice{std::string{"0123456789"}};
+  const epee::byte_slice copy = slice;
+  EXPECT_EQ(slice.data(), copy.data());
+  EXPECT_EQ(2, slice.use_count());
+
+  const epee::byte_slice middle = slice.get_slice(2, 5);
+  EXPECT_EQ(slice.data() + 2, middle.data());
+  EXPECT_EQ(std::string("234"), std::string(middle.data(), middle.size()));
+  EXPECT_EQ(3, slice.use_count());
+  EXPECT_TRUE(slice.get_slice(4, 4).empty());
+  EXPECT_THROW(slice.get_slice(5, 4), std::out_of_range);
+  EXPECT_THROW(slice.get_slice(0, 11), std::out_of_range);
+
+  const epee::byte_slice moved = std::move(slice);
+  EXPECT_TRUE(slice.empty());
+  EXPECT_EQ(copy.data(), moved.data());
+  EXPECT_EQ(3, moved.use_count());
+}
+
+TEST(ByteSlice, TakeSlice)
+{
+  epee::byte_slice slice{std::string{"0123456789"}};
+  const char* const data = slice.data();
+
+  const epee::byte_slice first = slice.take_slice(4);
+  EXPECT_EQ(data, first.data());
+  EXPECT_EQ(4u, first.size());
+  EXPECT_EQ(data + 4, slice.data());
+  EXPECT_EQ(6u, slice.size());
+
+  const epee::byte_slice rest = slice.take_slice(100);
+  EXPECT_EQ(data + 4, rest.data());
+  EXPECT_EQ(6u, rest.size());
+  EXPECT_TRUE(slice.empty());
+  EXPECT_EQ(2, rest.use_count());
+  EXPECT_TRUE(slice.take_slice(1).empty());
+}
+
 TEST(ToHex, String)
 {
   EXPECT_TRUE(epee::to_hex::string(nullptr).empty());
@@ -127,3 +127,38 @@ TEST(hashchain, trim)
   ASSERT_FALSE(hashchain.empty());
   ASSERT_EQ(hashchain.genesis(), make_hash(1));
 }
+
+TEST(hashchain, trim_checkpoints)
+{
+  tools::hashchain hashchain;
+  const size_t interval = tools::hashchain::checkpoint_interval;
+  for (size_t n = 0; n < 3 * interval + 10; ++n)
+    hashchain.push_back(make_hash(n + 1));
+  hashchain.trim(3 * interval + 5);
+  ASSERT_EQ(hashchain.offset(), 3 * interval + 5);
+  ASSERT_EQ(hashchain.size(), 3 * interval + 10);
+  ASSERT_EQ(hashchain.checkpoints().size(), 3);
+  ASSERT_EQ(hashchain.checkpoints().at(interval), make_hash(interval + 1));
+  ASSERT_EQ(hashchain.checkpoints().at(2 * interval), make_hash(2 * interval + 1));
+  ASSERT_EQ(hashchain.checkpoints().at(3 * interval), make_hash(3 * interval + 1));
+  ASSERT_EQ(hashchain.genesis(), make_hash(1));
+  hashchain.crop(3 * interval + 7);
+  ASSERT_EQ(hashchain.checkpoints().size(), 3);
+  hashchain.clear();
+  ASSERT_TRUE(hashchain.checkpoints().empty());
+}
+
+TEST(hashchain, trim_checkpoints_incremental)
+{
+  tools::hashchain hashchain;
+  const size_t interval = tools::hashchain::checkpoint_interval;
+  for (size_t n = 0; n < 2 * interval + 10; ++n)
+    hashchain.push_back(make_hash(n + 1));
+  hashchain.trim(interval + 5);
+  ASSERT_EQ(hashchain.checkpoints().size(), 1);
+  hashchain.trim(2 * interval + 5);
+  ASSERT_EQ(hashchain.checkpoints().size(), 2);
+  hashchain.crop(2 * interval + 6);
+  ASSERT_EQ(hashchain.checkpoints().size(), 2);
+  ASSERT_EQ(hashchain.size(), 2 * interval + 6);
+}
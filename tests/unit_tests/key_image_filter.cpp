@@ -0,0 +1,120 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "blockchain_db/key_image_filter.h"
+
+namespace
+{
+  std::vector<crypto::key_image> make_key_images(size_t n)
+  {
+    std::vector<crypto::key_image> v(n);
+    for (auto &ki: v)
+      ki = crypto::rand<crypto::key_image>();
+    return v;
+  }
+}
+
+TEST(key_image_filter, empty_passes_everything)
+{
+  cryptonote::key_image_filter filter;
+  ASSERT_TRUE(filter.maybe_contains(crypto::rand<crypto::key_image>()));
+}
+
+TEST(key_image_filter, no_false_negatives)
+{
+  cryptonote::key_image_filter filter;
+  filter.reset(1000);
+  const auto key_images = make_key_images(5000);
+  for (const auto &ki: key_images)
+    filter.insert(ki);
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(filter.maybe_contains(ki));
+  ASSERT_EQ(5000, filter.entries());
+}
+
+TEST(key_image_filter, false_positive_rate)
+{
+  cryptonote::key_image_filter filter;
+  filter.reset(10000);
+  for (const auto &ki: make_key_images(10000))
+    filter.insert(ki);
+  ASSERT_FALSE(filter.needs_rebuild());
+  size_t positives = 0;
+  for (const auto &ki: make_key_images(100000))
+    positives += filter.maybe_contains(ki);
+  ASSERT_LT(positives, 500);
+
+  const cryptonote::key_image_filter_stats stats = filter.get_stats();
+  ASSERT_EQ(100000, stats.negatives + stats.positives);
+  ASSERT_EQ(positives, stats.positives);
+}
+
+TEST(key_image_filter, needs_rebuild)
+{
+  cryptonote::key_image_filter filter;
+  filter.reset(0);
+  size_t inserted = 0;
+  while (!filter.needs_rebuild() && inserted < 10000000)
+  {
+    filter.insert(crypto::rand<crypto::key_image>());
+    ++inserted;
+  }
+  ASSERT_TRUE(filter.needs_rebuild());
+
+  cryptonote::key_image_filter bigger;
+  bigger.reset(inserted);
+  filter.swap(bigger);
+  ASSERT_FALSE(filter.needs_rebuild());
+  ASSERT_EQ(0, filter.entries());
+}
+
+TEST(key_image_filter, store_and_load)
+{
+  const boost::filesystem::path filename = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+  const crypto::hash top_hash = crypto::rand<crypto::hash>();
+  const auto key_images = make_key_images(1000);
+
+  cryptonote::key_image_filter filter;
+  filter.reset(key_images.size());
+  for (const auto &ki: key_images)
+    filter.insert(ki);
+  ASSERT_TRUE(filter.store(filename.string(), top_hash, key_images.size()));
+
+  cryptonote::key_image_filter loaded;
+  ASSERT_FALSE(loaded.load(filename.string(), crypto::null_hash, key_images.size()));
+  ASSERT_FALSE(loaded.load(filename.string(), top_hash, key_images.size() + 1));
+  ASSERT_TRUE(loaded.load(filename.string(), top_hash, key_images.size()));
+  ASSERT_EQ(key_images.size(), loaded.entries());
+  for (const auto &ki: key_images)
+    ASSERT_TRUE(loaded.maybe_contains(ki));
+
+  boost::filesystem::remove(filename);
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "cryptonote_core/output_key_cache.h"
+
+namespace
+{
+  cryptonote::output_data_t make_output(uint64_t n)
+  {
+    cryptonote::output_data_t od;
+    memset(&od, 0, sizeof(od));
+    od.unlock_time = n;
+    od.height = n * 2;
+    od.pubkey.data[0] = n & 0xff;
+    return od;
+  }
+}
+
+TEST(output_key_cache, empty)
+{
+  cryptonote::output_key_cache cache(16);
+  cryptonote::output_data_t od;
+  ASSERT_FALSE(cache.get(0, 0, od));
+  const auto stats = cache.get_stats();
+  ASSERT_EQ(0, stats.hits);
+  ASSERT_EQ(1, stats.misses);
+  ASSERT_EQ(0, stats.entries);
+}
+
+TEST(output_key_cache, keyed_by_amount_and_index)
+{
+  cryptonote::output_key_cache cache(16);
+  cache.put(0, 5, make_output(1));
+  cache.put(1000, 5, make_output(2));
+  cryptonote::output_data_t od;
+  ASSERT_TRUE(cache.get(0, 5, od));
+  ASSERT_EQ(1, od.unlock_time);
+  ASSERT_TRUE(cache.get(1000, 5, od));
+  ASSERT_EQ(2, od.unlock_time);
+  ASSERT_FALSE(cache.get(1000, 6, od));
+  const auto stats = cache.get_stats();
+  ASSERT_EQ(2, stats.hits);
+  ASSERT_EQ(1, stats.misses);
+}
+
+TEST(output_key_cache, bounded)
+{
+  cryptonote::output_key_cache cache(64);
+  for (uint64_t i = 0; i < 1000; ++i)
+    cache.put(0, i, make_output(i));
+  ASSERT_EQ(64, cache.get_stats().entries);
+  size_t found = 0;
+  cryptonote::output_data_t od;
+  for (uint64_t i = 0; i < 1000; ++i)
+  {
+    if (cache.get(0, i, od))
+    {
+      ASSERT_EQ(i, od.unlock_time);
+      ++found;
+    }
+  }
+  ASSERT_EQ(64, found);
+}
+
+TEST(output_key_cache, keeps_referenced)
+{
+  cryptonote::output_key_cache cache(8);
+  for (uint64_t i = 0; i < 8; ++i)
+    cache.put(0, i, make_output(i));
+  cryptonote::output_data_t od;
+  ASSERT_TRUE(cache.get(0, 3, od));
+  // one new output evicts the first unreferenced one
+  cache.put(0, 100, make_output(100));
+  ASSERT_TRUE(cache.get(0, 3, od));
+  ASSERT_TRUE(cache.get(0, 100, od));
+  ASSERT_FALSE(cache.get(0, 0, od));
+}
+
+TEST(output_key_cache, clear)
+{
+  cryptonote::output_key_cache cache(8);
+  cache.put(0, 1, make_output(1));
+  cache.clear();
+  cryptonote::output_data_t od;
+  ASSERT_FALSE(cache.get(0, 1, od));
+  ASSERT_EQ(0, cache.get_stats().entries);
+  cache.put(0, 1, make_output(1));
+  ASSERT_TRUE(cache.get(0, 1, od));
+}
@@ -0,0 +1,148 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_config.h"
+#include "cryptonote_protocol/cryptonote_protocol_defs.h"
+#include "cryptonote_protocol/payload_compression.h"
+
+#ifdef HAVE_ZLIB
+
+TEST(payload_compression, round_trip)
+{
+  cryptonote::payload_compression compression(1);
+  std::string blob, compressed, decompressed;
+  for (int n = 0; n < 4096; ++n)
+    blob += "block " + std::to_string(n % 64);
+
+  ASSERT_TRUE(compression.compress(blob, 0, compressed));
+  ASSERT_LT(compressed.size(), blob.size());
+  ASSERT_TRUE(cryptonote::payload_compression::decompress(compressed, blob.size(), blob.size(), decompressed));
+  ASSERT_EQ(blob, decompressed);
+  ASSERT_EQ(1, compression.get_stats().messages);
+  ASSERT_EQ(blob.size(), compression.get_stats().bytes_in);
+  ASSERT_EQ(compressed.size(), compression.get_stats().bytes_out);
+
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed, blob.size() - 1, blob.size(), decompressed));
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed, blob.size() + 1, blob.size() + 1, decompressed));
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed.substr(1), blob.size(), blob.size(), decompressed));
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed.substr(0, compressed.size() / 2), blob.size(), blob.size(), decompressed));
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed, blob.size(), blob.size() - 1, decompressed));
+}
+
+TEST(payload_compression, bomb)
+{
+  // 64 MB of zeros squeeze into about 64 kB, way past any sane ratio
+  std::string compressed;
+  ASSERT_TRUE(cryptonote::payload_compression::compress_with_level(std::string(64*1024*1024, 0), 9, compressed));
+  std::string out;
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed, 64*1024*1024, P2P_DEFAULT_PACKET_MAX_SIZE * 2, out));
+  ASSERT_TRUE(out.empty());
+
+  // claiming a small size does not make it inflate everything
+  ASSERT_FALSE(cryptonote::payload_compression::decompress(compressed, compressed.size(), P2P_DEFAULT_PACKET_MAX_SIZE, out));
+  ASSERT_LE(out.size(), compressed.size() + 1);
+
+  // zeros are not sent compressed either, peers would refuse them
+  cryptonote::payload_compression compression(1);
+  ASSERT_FALSE(compression.compress(std::string(1024*1024, 0), 0, out));
+}
+
+TEST(payload_compression, max_size)
+{
+  ASSERT_EQ(0, cryptonote::payload_compression::max_decompressed_size(cryptonote::NOTIFY_COMPRESSED::ID));
+  ASSERT_EQ(0, cryptonote::payload_compression::max_decompressed_size(0));
+  ASSERT_EQ(P2P_DEFAULT_PACKET_MAX_SIZE, cryptonote::payload_compression::max_decompressed_size(cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::ID));
+  ASSERT_EQ(P2P_COMPRESSION_MAX_NOTIFY_SIZE, cryptonote::payload_compression::max_decompressed_size(cryptonote::NOTIFY_NEW_TRANSACTIONS::ID));
+  ASSERT_EQ(P2P_COMPRESSION_MAX_REQUEST_SIZE, cryptonote::payload_compression::max_decompressed_size(cryptonote::NOTIFY_REQUEST_TRANSACTIONS::ID));
+}
+
+TEST(payload_compression, small_or_incompressible)
+{
+  cryptonote::payload_compression compression(1);
+  std::string out;
+  ASSERT_FALSE(compression.compress(std::string(P2P_COMPRESSION_DEFAULT_THRESHOLD - 1, 'x'), 0, out));
+
+  std::string blob(P2P_COMPRESSION_DEFAULT_THRESHOLD, 0);
+  crypto::generate_random_bytes_thread_safe(blob.size(), (uint8_t*)&blob[0]);
+  ASSERT_FALSE(compression.compress(blob, 0, out));
+  ASSERT_EQ(0, compression.get_stats().messages);
+  ASSERT_GT(compression.get_threshold(), P2P_COMPRESSION_DEFAULT_THRESHOLD);
+}
+
+TEST(payload_compression, threshold_comes_back_down)
+{
+  cryptonote::payload_compression compression(1);
+  for (int n = 0; n < 64; ++n)
+    compression.update(compression.get_level(), 100000, 99000, 1000, 0);
+  ASSERT_EQ(P2P_COMPRESSION_MAX_THRESHOLD, compression.get_threshold());
+
+  // payloads under the threshold are mostly sent as is, but the sampled ones
+  // compressing well bring it back down
+  std::string blob, out;
+  for (int n = 0; n < 1024; ++n)
+    blob += "tx " + std::to_string(n * 7919 % 10007) + " ";
+  size_t compressed = 0;
+  for (int n = 0; n < 1024 && compression.get_threshold() > blob.size(); ++n)
+    compressed += compression.compress(blob, 0, out);
+  ASSERT_LE(compression.get_threshold(), blob.size());
+  ASSERT_GT(compressed, 0);
+  ASSERT_EQ(compressed, compression.get_stats().messages);
+  ASSERT_TRUE(compression.compress(blob, 0, out));
+
+  // but never below the minimum
+  ASSERT_FALSE(compression.compress(std::string(P2P_COMPRESSION_MIN_THRESHOLD - 1, 'x'), 0, out));
+}
+
+#endif
+
+TEST(payload_compression, adaptive)
+{
+  cryptonote::payload_compression compression(1);
+  const size_t threshold = compression.get_threshold();
+  const int level = compression.get_level();
+
+  // compresses well: lower threshold
+  compression.update(level, 100000, 10000, 1000, 0);
+  ASSERT_LT(compression.get_threshold(), threshold);
+  ASSERT_EQ(level, compression.get_level());
+
+  // 100 MB/s compression on a 1 MB/s link: spend more cpu
+  compression.update(level, 100000, 10000, 1000, 1000000);
+  ASSERT_EQ(level + 1, compression.get_level());
+
+  // 100 MB/s compression on a 50 MB/s link: spend less cpu
+  compression.update(level + 1, 100000, 10000, 1000, 50000000);
+  ASSERT_EQ(level, compression.get_level());
+
+  // does not compress: raise threshold until it hits the max
+  for (int n = 0; n < 64; ++n)
+    compression.update(level, 100000, 99000, 1000, 0);
+  ASSERT_EQ(P2P_COMPRESSION_MAX_THRESHOLD, compression.get_threshold());
+}
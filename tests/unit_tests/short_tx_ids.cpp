@@ -0,0 +1,81 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/short_tx_ids.h"
+
+TEST(short_tx_ids, pack_unpack)
+{
+  const cryptonote::short_tx_ids sids(crypto::rand<crypto::hash>(), 42);
+  std::vector<cryptonote::short_tx_ids::short_id> ids, unpacked;
+  for (int n = 0; n < 100; ++n)
+  {
+    ids.push_back(sids.get(crypto::rand<crypto::hash>()));
+    ASSERT_EQ(0, ids.back() >> (8 * cryptonote::short_tx_ids::SHORT_ID_SIZE));
+  }
+  std::string blob;
+  cryptonote::short_tx_ids::pack(ids, blob);
+  ASSERT_EQ(ids.size() * cryptonote::short_tx_ids::SHORT_ID_SIZE, blob.size());
+  ASSERT_TRUE(cryptonote::short_tx_ids::unpack(blob, unpacked));
+  ASSERT_EQ(ids, unpacked);
+
+  blob.push_back(0);
+  ASSERT_FALSE(cryptonote::short_tx_ids::unpack(blob, unpacked));
+  ASSERT_TRUE(cryptonote::short_tx_ids::unpack(std::string(), unpacked));
+  ASSERT_TRUE(unpacked.empty());
+}
+
+TEST(short_tx_ids, keyed)
+{
+  const crypto::hash block_hash = crypto::rand<crypto::hash>();
+  const crypto::hash txid = crypto::rand<crypto::hash>();
+  const cryptonote::short_tx_ids sids0(block_hash, 0), sids1(block_hash, 1), sids2(crypto::rand<crypto::hash>(), 0);
+  ASSERT_EQ(sids0.get(txid), cryptonote::short_tx_ids(block_hash, 0).get(txid));
+  ASSERT_NE(sids0.get(txid), sids1.get(txid));
+  ASSERT_NE(sids0.get(txid), sids2.get(txid));
+}
+
+TEST(short_tx_ids, index)
+{
+  const cryptonote::short_tx_ids sids(crypto::rand<crypto::hash>(), crypto::rand<uint64_t>());
+  std::vector<crypto::hash> txids;
+  for (int n = 0; n < 1000; ++n)
+    txids.push_back(crypto::rand<crypto::hash>());
+  txids.push_back(txids.front()); // duplicates are not ambiguous
+  const cryptonote::short_tx_id_index index(sids, txids);
+  ASSERT_EQ(1000, index.size());
+
+  crypto::hash txid;
+  for (const crypto::hash &h: txids)
+  {
+    ASSERT_TRUE(index.find(sids.get(h), txid));
+    ASSERT_EQ(h, txid);
+  }
+  ASSERT_FALSE(index.find(sids.get(crypto::rand<crypto::hash>()), txid));
+}
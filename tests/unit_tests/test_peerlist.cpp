@@ -30,6 +30,9 @@
 
 #include "gtest/gtest.h"
 
+#include <set>
+#include <sstream>
+#include <boost/serialization/vector.hpp>
 #include "common/util.h"
 #include "p2p/net_peerlist.h"
 #include "net/net_utils_base.h"
@@ -83,3 +86,134 @@ TEST(peer_list, merge_peer_lists)
 
 
 }
+
+TEST(peer_list, indexed_lookups)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+
+  // one crowded /16 and a single peer elsewhere
+  for (int i = 1; i <= 100; ++i)
+    ADD_GRAY_NODE(MAKE_IPV4_ADDRESS(123,43,12,i, 8080), 1000 + i, 34345 + i);
+  ADD_GRAY_NODE(MAKE_IPV4_ADDRESS(45,12,1,1, 8080), 2000, 34345);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(67,1,1,1, 8080), 3000, 34345);
+
+  nodetool::peerlist_entry pe;
+  ASSERT_TRUE(plm.find_peer(1050, pe));
+  const epee::net_utils::network_address expected{MAKE_IPV4_ADDRESS(123,43,12,50, 8080)};
+  ASSERT_EQ(pe.adr, expected);
+  ASSERT_TRUE(plm.find_peer(3000, pe));
+  ASSERT_FALSE(plm.find_peer(4000, pe));
+
+  // newest first
+  ASSERT_TRUE(plm.get_gray_peer_by_index(pe, 0));
+  ASSERT_EQ(pe.id, 1100);
+  ASSERT_TRUE(plm.get_gray_peer_by_index(pe, 100));
+  ASSERT_EQ(pe.id, 2000);
+  ASSERT_FALSE(plm.get_gray_peer_by_index(pe, 101));
+
+  // the lone peer gets picked about half the time, not once in a hundred
+  size_t lone = 0;
+  for (int i = 0; i < 1000; ++i)
+  {
+    ASSERT_TRUE(plm.get_random_gray_peer(pe));
+    if (pe.id == 2000)
+      ++lone;
+  }
+  ASSERT_GT(lone, 350);
+  ASSERT_LT(lone, 650);
+
+  // promoting the lone peer leaves only the crowded bucket, all of whose peers get picked
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(45,12,1,1, 8080), 2000, 34345);
+  std::set<uint64_t> picked;
+  for (int i = 0; i < 3000; ++i)
+  {
+    ASSERT_TRUE(plm.get_random_gray_peer(pe));
+    ASSERT_NE(pe.id, 2000);
+    picked.insert(pe.id);
+  }
+  ASSERT_EQ(picked.size(), 100u);
+}
+
+TEST(peer_list, journal)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  ADD_GRAY_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 1, 34345);
+  ADD_GRAY_NODE(MAKE_IPV4_ADDRESS(123,43,12,2, 8080), 2, 34345);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,3, 8080), 3, 34345);
+
+  // the saved state, and the changes made after it
+  nodetool::peerlist_manager restored;
+  restored.init(false);
+  std::vector<nodetool::peerlist_journal_entry> journal;
+  plm.get_journal(journal);
+  ASSERT_EQ(journal.size(), 3);
+  restored.apply_journal(journal);
+
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 1, 34346);
+  nodetool::peerlist_entry removed;
+  removed.adr = MAKE_IPV4_ADDRESS(123,43,12,2, 8080);
+  plm.remove_from_peer_gray(removed);
+  plm.get_journal(journal);
+  ASSERT_EQ(journal.size(), 2);
+
+  std::stringstream ss;
+  {
+    boost::archive::portable_binary_oarchive a(ss);
+    a << journal;
+  }
+  journal.clear();
+  {
+    boost::archive::portable_binary_iarchive a(ss);
+    a >> journal;
+  }
+  restored.apply_journal(journal);
+
+  plm.get_journal(journal);
+  ASSERT_TRUE(journal.empty());
+
+  std::list<nodetool::peerlist_entry> gray, white, restored_gray, restored_white;
+  plm.get_peerlist_full(gray, white);
+  restored.get_peerlist_full(restored_gray, restored_white);
+  ASSERT_EQ(gray.size(), 0);
+  ASSERT_EQ(white.size(), 2);
+  ASSERT_EQ(restored_gray.size(), gray.size());
+  ASSERT_EQ(restored_white.size(), white.size());
+  auto it = restored_white.begin();
+  for (const auto &pe: white)
+  {
+    ASSERT_EQ(pe.adr, it->adr);
+    ASSERT_EQ(pe.id, it->id);
+    ASSERT_EQ(pe.last_seen, it->last_seen);
+    ++it;
+  }
+}
+
+TEST(peer_list, journal_restored_after_failed_store)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  ADD_GRAY_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 1, 34345);
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,2, 8080), 2, 34345);
+
+  std::vector<nodetool::peerlist_journal_entry> journal;
+  plm.get_journal(journal);
+  ASSERT_EQ(journal.size(), 2);
+
+  // changed again before the store failed: the latest state is journaled
+  ADD_WHITE_NODE(MAKE_IPV4_ADDRESS(123,43,12,1, 8080), 1, 34346);
+  plm.restore_journal(journal);
+
+  plm.get_journal(journal);
+  ASSERT_EQ(journal.size(), 2);
+  for (const auto &e: journal)
+  {
+    ASSERT_EQ(e.list, nodetool::peerlist_journal_entry::white);
+    if (e.adr == MAKE_IPV4_ADDRESS(123,43,12,1, 8080))
+      ASSERT_EQ(e.peer.last_seen, 34346);
+  }
+
+  plm.get_journal(journal);
+  ASSERT_TRUE(journal.empty());
+}
@@ -327,3 +327,35 @@ TEST(parse_tx_extra, handles_rta_signatures)
     }
 }
 
+
+TEST(block_hashing_blob, parses_header_and_hashes_like_the_block)
+{
+  cryptonote::block b;
+  b.major_version = 12;
+  b.minor_version = 12;
+  b.timestamp = 1551934800;
+  b.prev_id = crypto::cn_fast_hash("prev", 4);
+  b.nonce = 0x12345678;
+  b.miner_tx.version = 2;
+  b.tx_hashes.push_back(crypto::cn_fast_hash("tx", 2));
+
+  const cryptonote::blobdata blob = cryptonote::get_block_hashing_blob(b);
+  cryptonote::block_header h;
+  ASSERT_TRUE(cryptonote::parse_block_header_from_hashing_blob(blob, h));
+  ASSERT_EQ(b.major_version, h.major_version);
+  ASSERT_EQ(b.timestamp, h.timestamp);
+  ASSERT_EQ(b.prev_id, h.prev_id);
+  ASSERT_EQ(b.nonce, h.nonce);
+
+  crypto::hash id;
+  ASSERT_TRUE(cryptonote::get_object_hash(blob, id));
+  ASSERT_EQ(cryptonote::get_block_hash(b), id);
+
+  crypto::hash pow_from_blob;
+  ASSERT_TRUE(cryptonote::get_block_longhash(NULL, blob, b.major_version, pow_from_blob, 1, 0));
+  ASSERT_EQ(cryptonote::get_block_longhash(NULL, b, 1, 0), pow_from_blob);
+
+  // the tx tree root and count must follow the header
+  ASSERT_FALSE(cryptonote::parse_block_header_from_hashing_blob(blob.substr(0, blob.size() - sizeof(crypto::hash)), h));
+  ASSERT_FALSE(cryptonote::parse_block_header_from_hashing_blob(blob.substr(0, 3), h));
+}
@@ -0,0 +1,325 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/uuid/nil_generator.hpp>
+#include <boost/uuid/uuid.hpp>
+#include "gtest/gtest.h"
+#include "crypto/crypto.h"
+#include "cryptonote_protocol/tx_relay_queue.h"
+
+namespace
+{
+  std::vector<boost::uuids::uuid> make_connections(cryptonote::tx_relay_queue &q, size_t n)
+  {
+    std::vector<boost::uuids::uuid> connections(n);
+    for (auto &c: connections)
+    {
+      c = crypto::rand<boost::uuids::uuid>();
+      q.on_connection_open(c);
+    }
+    return connections;
+  }
+
+  bool have_none(const crypto::hash &txid)
+  {
+    return false;
+  }
+
+  cryptonote::tx_relay_queue::tx_entry make_tx(size_t size)
+  {
+    return {crypto::rand<crypto::hash>(), size};
+  }
+}
+
+TEST(tx_relay_queue, empty)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  std::map<boost::uuids::uuid, std::vector<cryptonote::tx_relay_queue::tx_entry>> pending;
+  q.take_pending(pending);
+  ASSERT_TRUE(pending.empty());
+  ASSERT_EQ(0, q.get_stats().duplicate_bytes_avoided);
+}
+
+TEST(tx_relay_queue, queues_for_all_but_source)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 3);
+  const auto tx = make_tx(1000);
+  q.add_txs({tx}, connections, connections[0]);
+  std::map<boost::uuids::uuid, std::vector<cryptonote::tx_relay_queue::tx_entry>> pending;
+  q.take_pending(pending);
+  ASSERT_EQ(2, pending.size());
+  ASSERT_EQ(0, pending.count(connections[0]));
+  ASSERT_EQ(1, pending[connections[1]].size());
+  ASSERT_EQ(tx.txid, pending[connections[1]][0].txid);
+
+  // taking empties the queues
+  q.take_pending(pending);
+  ASSERT_TRUE(pending.empty());
+}
+
+TEST(tx_relay_queue, nil_source)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 2);
+  q.add_txs({make_tx(10)}, connections, boost::uuids::nil_uuid());
+  std::map<boost::uuids::uuid, std::vector<cryptonote::tx_relay_queue::tx_entry>> pending;
+  q.take_pending(pending);
+  ASSERT_EQ(2, pending.size());
+}
+
+TEST(tx_relay_queue, known_txes_not_queued_again)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 2);
+  const auto tx = make_tx(1000);
+  q.on_txs_announced(connections[1], {tx.txid});
+  q.add_txs({tx}, connections, boost::uuids::nil_uuid());
+  q.add_txs({tx}, connections, boost::uuids::nil_uuid());
+  std::map<boost::uuids::uuid, std::vector<cryptonote::tx_relay_queue::tx_entry>> pending;
+  q.take_pending(pending);
+  ASSERT_EQ(1, pending.size());
+  ASSERT_EQ(1, pending[connections[0]].size());
+  ASSERT_EQ(3000, q.get_stats().bytes_known);
+  ASSERT_EQ(3000, q.get_stats().duplicate_bytes_avoided);
+  ASSERT_TRUE(q.is_known(connections[0], tx.txid));
+  ASSERT_TRUE(q.is_known(connections[1], tx.txid));
+}
+
+TEST(tx_relay_queue, known_is_bounded)
+{
+  cryptonote::tx_relay_queue q(4, 30, 100, 100);
+  const auto connections = make_connections(q, 1);
+  std::vector<crypto::hash> txids;
+  for (int i = 0; i < 8; ++i)
+    txids.push_back(crypto::rand<crypto::hash>());
+  q.on_txs_announced(connections[0], txids);
+  for (int i = 0; i < 4; ++i)
+    ASSERT_FALSE(q.is_known(connections[0], txids[i]));
+  for (int i = 4; i < 8; ++i)
+    ASSERT_TRUE(q.is_known(connections[0], txids[i]));
+}
+
+TEST(tx_relay_queue, requests)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 1);
+  const crypto::hash txid0 = crypto::rand<crypto::hash>(), txid1 = crypto::rand<crypto::hash>();
+  std::vector<crypto::hash> txids{txid0};
+  q.request_txs(connections[0], txids, 1000);
+  ASSERT_EQ(1, txids.size());
+
+  // asked already, and not timed out yet
+  txids = {txid0, txid1};
+  q.request_txs(connections[0], txids, 1010);
+  ASSERT_EQ(1, txids.size());
+  ASSERT_EQ(txid1, txids[0]);
+
+  // timed out, nobody else to ask
+  std::map<boost::uuids::uuid, std::vector<crypto::hash>> retries;
+  std::vector<boost::uuids::uuid> failed;
+  q.retry_requests(retries, failed, have_none, 1030);
+  ASSERT_TRUE(retries.empty());
+  txids = {txid0};
+  q.request_txs(connections[0], txids, 1030);
+  ASSERT_EQ(1, txids.size());
+
+  // received, so it may be asked for again if announced again later
+  q.add_txs({{txid1, 100}}, {}, connections[0]);
+  txids = {txid1};
+  q.request_txs(connections[0], txids, 1031);
+  ASSERT_EQ(1, txids.size());
+}
+
+TEST(tx_relay_queue, retries_next_announcer)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 3);
+  const crypto::hash txid0 = crypto::rand<crypto::hash>(), txid1 = crypto::rand<crypto::hash>();
+  std::vector<crypto::hash> txids{txid0, txid1};
+  q.request_txs(connections[0], txids, 1000);
+  ASSERT_EQ(2, txids.size());
+  txids = {txid0, txid1};
+  q.request_txs(connections[1], txids, 1005);
+  ASSERT_TRUE(txids.empty());
+  txids = {txid0};
+  q.request_txs(connections[2], txids, 1010);
+  ASSERT_TRUE(txids.empty());
+
+  // nothing timed out yet
+  std::map<boost::uuids::uuid, std::vector<crypto::hash>> retries;
+  std::vector<boost::uuids::uuid> failed;
+  q.retry_requests(retries, failed, have_none, 1029);
+  ASSERT_TRUE(retries.empty());
+
+  // txid1 came in from elsewhere, txid0 goes to the next one in line
+  q.retry_requests(retries, failed, [&](const crypto::hash &txid) { return txid == txid1; }, 1030);
+  ASSERT_EQ(1, retries.size());
+  ASSERT_EQ(std::vector<crypto::hash>{txid0}, retries[connections[1]]);
+  ASSERT_TRUE(failed.empty());
+
+  // and then the one after that
+  q.retry_requests(retries, failed, have_none, 1060);
+  ASSERT_EQ(1, retries.size());
+  ASSERT_EQ(std::vector<crypto::hash>{txid0}, retries[connections[2]]);
+
+  // closed connections are skipped
+  txids = {txid1};
+  q.request_txs(connections[0], txids, 1060);
+  txids = {txid1};
+  q.request_txs(connections[1], txids, 1060);
+  q.on_connection_close(connections[1]);
+  txids = {txid1};
+  q.request_txs(connections[2], txids, 1060);
+  q.retry_requests(retries, failed, have_none, 1090);
+  ASSERT_EQ(1, retries.size());
+  ASSERT_EQ(std::vector<crypto::hash>{txid1}, retries[connections[2]]);
+
+  // delivered, not asked again
+  q.add_txs({{txid0, 100}, {txid1, 100}}, {}, connections[2]);
+  q.retry_requests(retries, failed, have_none, 1200);
+  ASSERT_TRUE(retries.empty());
+}
+
+TEST(tx_relay_queue, requests_are_capped_per_peer)
+{
+  cryptonote::tx_relay_queue q(100, 30, 2, 100);
+  const auto connections = make_connections(q, 2);
+  std::vector<crypto::hash> txids;
+  for (int i = 0; i < 3; ++i)
+    txids.push_back(crypto::rand<crypto::hash>());
+  const std::vector<crypto::hash> all = txids;
+  q.request_txs(connections[0], txids, 1000);
+  ASSERT_EQ(2, txids.size());
+
+  // another peer gets the one left over
+  txids = all;
+  q.request_txs(connections[1], txids, 1000);
+  ASSERT_EQ(std::vector<crypto::hash>{all[2]}, txids);
+
+  // receiving frees up room
+  q.add_txs({{all[0], 100}}, {}, connections[0]);
+  txids = {crypto::rand<crypto::hash>()};
+  q.request_txs(connections[0], txids, 1000);
+  ASSERT_EQ(1, txids.size());
+
+  // unknown connections can't be asked anything
+  txids = {crypto::rand<crypto::hash>()};
+  q.request_txs(crypto::rand<boost::uuids::uuid>(), txids, 1000);
+  ASSERT_TRUE(txids.empty());
+}
+
+TEST(tx_relay_queue, undelivered)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 3);
+  const auto connections = make_connections(q, 2);
+  std::map<boost::uuids::uuid, std::vector<crypto::hash>> retries;
+  std::vector<boost::uuids::uuid> failed;
+
+  std::vector<crypto::hash> txids{crypto::rand<crypto::hash>(), crypto::rand<crypto::hash>()};
+  q.request_txs(connections[0], txids, 1000);
+  q.retry_requests(retries, failed, have_none, 1030);
+  ASSERT_TRUE(failed.empty());
+
+  // delivering makes up for one not delivered
+  txids = {crypto::rand<crypto::hash>()};
+  q.request_txs(connections[0], txids, 1030);
+  q.add_txs({{txids[0], 100}}, {}, connections[0]);
+  txids = {crypto::rand<crypto::hash>()};
+  q.request_txs(connections[0], txids, 1030);
+  q.retry_requests(retries, failed, have_none, 1060);
+  ASSERT_TRUE(failed.empty());
+
+  txids = {crypto::rand<crypto::hash>()};
+  q.request_txs(connections[0], txids, 1060);
+  q.retry_requests(retries, failed, have_none, 1090);
+  ASSERT_EQ(std::vector<boost::uuids::uuid>{connections[0]}, failed);
+}
+
+TEST(tx_relay_queue, only_announced_txes_may_be_requested)
+{
+  cryptonote::tx_relay_queue q(4, 30, 100, 100);
+  const auto connections = make_connections(q, 2);
+
+  // a peer announcing a tx to us may not then ask us for it
+  const crypto::hash theirs = crypto::rand<crypto::hash>();
+  q.on_txs_announced(connections[0], {theirs});
+  ASSERT_TRUE(q.is_known(connections[0], theirs));
+  ASSERT_FALSE(q.was_announced(connections[0], theirs));
+
+  std::vector<crypto::hash> txids(5);
+  for (auto &txid: txids)
+    txid = crypto::rand<crypto::hash>();
+  q.on_announced({connections[0]}, txids, 5000);
+  ASSERT_FALSE(q.was_announced(connections[0], txids[0]));
+  for (size_t i = 1; i < txids.size(); ++i)
+  {
+    ASSERT_TRUE(q.was_announced(connections[0], txids[i]));
+    ASSERT_TRUE(q.is_known(connections[0], txids[i]));
+    ASSERT_FALSE(q.was_announced(connections[1], txids[i]));
+  }
+
+  q.on_connection_close(connections[0]);
+  ASSERT_FALSE(q.was_announced(connections[0], txids[1]));
+}
+
+TEST(tx_relay_queue, stats)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 2);
+  std::vector<crypto::hash> txids(5);
+  for (auto &txid: txids)
+    txid = crypto::rand<crypto::hash>();
+  q.on_announced({connections.begin(), connections.end()}, txids, 5000);
+  q.on_sent(3, 3000, true);
+  q.on_sent(5, 5000, false);
+  const auto stats = q.get_stats();
+  ASSERT_EQ(10, stats.txs_announced);
+  ASSERT_EQ(8, stats.txs_sent);
+  ASSERT_EQ(7000, stats.duplicate_bytes_avoided);
+}
+
+TEST(tx_relay_queue, connection_close)
+{
+  cryptonote::tx_relay_queue q(100, 30, 100, 100);
+  const auto connections = make_connections(q, 1);
+  const auto tx = make_tx(10);
+  q.add_txs({tx}, connections, boost::uuids::nil_uuid());
+  q.on_connection_close(connections[0]);
+  ASSERT_FALSE(q.is_known(connections[0], tx.txid));
+  std::map<boost::uuids::uuid, std::vector<cryptonote::tx_relay_queue::tx_entry>> pending;
+  q.take_pending(pending);
+  ASSERT_TRUE(pending.empty());
+
+  // listed before it closed, but not brought back
+  q.add_txs({make_tx(10)}, connections, boost::uuids::nil_uuid());
+  q.on_txs_announced(connections[0], {tx.txid});
+  q.take_pending(pending);
+  ASSERT_TRUE(pending.empty());
+  ASSERT_FALSE(q.is_known(connections[0], tx.txid));
+}
@@ -0,0 +1,208 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_core.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.h"
+#include "cryptonote_protocol/cryptonote_protocol_handler.inl"
+
+namespace
+{
+  // a core with only a pool, some txes of which are not to be relayed
+  class relay_test_core
+  {
+  public:
+    void on_synchronized(){}
+    void safesyncmode(const bool){}
+    uint64_t get_current_blockchain_height() const {return 1;}
+    void set_target_blockchain_height(uint64_t) {}
+    bool init(const boost::program_options::variables_map& vm) {return true ;}
+    bool deinit(){return true;}
+    bool get_short_chain_history(std::list<crypto::hash>& ids) const { return true; }
+    bool get_stat_info(cryptonote::core_stat_info& st_inf) const {return true;}
+    bool have_block(const crypto::hash& id) const {return true;}
+    void get_blockchain_top(uint64_t& height, crypto::hash& top_id)const{height=0;top_id=crypto::null_hash;}
+    bool handle_incoming_tx(const cryptonote::blobdata& tx_blob, cryptonote::tx_verification_context& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_txs(const std::vector<cryptonote::blobdata>& tx_blob, std::vector<cryptonote::tx_verification_context>& tvc, bool keeped_by_block, bool relayed, bool do_not_relay) { return true; }
+    bool handle_incoming_block(const cryptonote::blobdata& block_blob, cryptonote::block_verification_context& bvc, bool update_miner_blocktemplate = true) { return true; }
+    void pause_mine(){}
+    void resume_mine(){}
+    bool on_idle(){return true;}
+    bool find_blockchain_supplement(const std::list<crypto::hash>& qblock_ids, cryptonote::NOTIFY_RESPONSE_CHAIN_ENTRY::request& resp){return true;}
+    bool handle_get_objects(cryptonote::NOTIFY_REQUEST_GET_OBJECTS::request& arg, cryptonote::NOTIFY_RESPONSE_GET_OBJECTS::request& rsp, cryptonote::cryptonote_connection_context& context){return true;}
+    bool get_test_drop_download() const {return true;}
+    bool get_test_drop_download_height() const {return true;}
+    bool prepare_handle_incoming_blocks(const std::vector<cryptonote::block_complete_entry>  &blocks) { return true; }
+    bool cleanup_handle_incoming_blocks(bool force_sync = false) { return true; }
+    uint64_t get_target_blockchain_height() const { return 1; }
+    size_t get_block_sync_size(uint64_t height) const { return BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; }
+    size_t get_fixed_block_sync_size() const { return 0; }
+    virtual void on_transaction_relayed(const cryptonote::blobdata& tx) {}
+    cryptonote::network_type get_nettype() const { return cryptonote::MAINNET; }
+    bool get_pool_transaction(const crypto::hash& id, cryptonote::blobdata& tx_blob, bool include_unrelayed_txes = true) const
+    {
+      const auto i = pool.find(id);
+      if (i == pool.end() || (!include_unrelayed_txes && !i->second.second))
+        return false;
+      tx_blob = i->second.first;
+      return true;
+    }
+    bool pool_has_tx(const crypto::hash &txid) const { return pool.find(txid) != pool.end(); }
+    bool get_pool_transaction_hashes(std::vector<crypto::hash>& txs, bool include_unrelayed_txes = true) const { return false; }
+    bool get_blocks(uint64_t start_offset, size_t count, std::vector<std::pair<cryptonote::blobdata, cryptonote::block>>& blocks, std::vector<cryptonote::blobdata>& txs) const { return false; }
+    bool get_transactions(const std::vector<crypto::hash>& txs_ids, std::vector<cryptonote::transaction>& txs, std::vector<crypto::hash>& missed_txs) const { return false; }
+    bool get_block_by_hash(const crypto::hash &h, cryptonote::block &blk, bool *orphan = NULL) const { return false; }
+    uint8_t get_ideal_hard_fork_version() const { return 0; }
+    uint8_t get_ideal_hard_fork_version(uint64_t height) const { return 0; }
+    uint8_t get_hard_fork_version(uint64_t height) const { return 0; }
+    uint64_t get_earliest_ideal_height_for_version(uint8_t version) const { return 0; }
+    cryptonote::difficulty_type get_block_cumulative_difficulty(uint64_t height) const { return 0; }
+    bool fluffy_blocks_enabled() const { return false; }
+    uint64_t prevalidate_block_hashes(uint64_t height, const std::vector<crypto::hash> &hashes) { return 0; }
+    bool get_block_hashing_blobs(const std::vector<crypto::hash> &ids, std::vector<cryptonote::blobdata> &blobs) const { return false; }
+    uint64_t get_known_block_headers_count(const std::vector<crypto::hash> &ids) const { return 0; }
+    bool prevalidate_block_headers(const std::vector<crypto::hash> &ids, const std::vector<cryptonote::blobdata> &blobs, uint64_t &nvalid) { nvalid = 0; return true; }
+    void stop() {}
+    void invoke_update_stakes_handler() {}
+    typedef cryptonote::StakeTransactionProcessor::supernode_stakes_update_handler supernode_stakes_update_handler;
+    void set_update_stakes_handler(const supernode_stakes_update_handler&) {}
+    void invoke_stake_transactions_update_handler() {}
+    typedef cryptonote::StakeTransactionProcessor::blockchain_based_list_update_handler blockchain_based_list_update_handler;
+    void set_update_blockchain_based_list_handler(const blockchain_based_list_update_handler&) {}
+    void invoke_update_blockchain_based_list_handler(uint64_t last_received_block_height) {}
+
+    // blob, and whether it may be relayed
+    std::unordered_map<crypto::hash, std::pair<cryptonote::blobdata, bool>> pool;
+  };
+
+  // a single peer supporting tx announcements, recording what is sent to it
+  class relay_test_p2p: public nodetool::p2p_endpoint_stub<cryptonote::cryptonote_connection_context>
+  {
+  public:
+    relay_test_p2p()
+    {
+      epee::net_utils::connection_context_base &base = context;
+      base = epee::net_utils::connection_context_base(crypto::rand<boost::uuids::uuid>(), epee::net_utils::ipv4_network_address{MAKE_IP(1,2,3,4),0}, false);
+    }
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<boost::uuids::uuid>& connections)
+    {
+      sent.emplace_back(command, data_buff);
+      return true;
+    }
+    virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      sent.emplace_back(command, req_buff);
+      return true;
+    }
+    virtual void for_each_connection(std::function<bool(cryptonote::cryptonote_connection_context&,nodetool::peerid_type,uint32_t)> f)
+    {
+      f(context, 1, P2P_SUPPORT_FLAG_TX_ANNOUNCE);
+    }
+    virtual bool for_connection(const boost::uuids::uuid &connection, std::function<bool(cryptonote::cryptonote_connection_context&,nodetool::peerid_type,uint32_t)> f)
+    {
+      return connection == context.m_connection_id && f(context, 1, P2P_SUPPORT_FLAG_TX_ANNOUNCE);
+    }
+
+    cryptonote::cryptonote_connection_context context;
+    std::vector<std::pair<int, std::string>> sent;
+  };
+
+  typedef cryptonote::t_cryptonote_protocol_handler<relay_test_core> relay_test_protocol;
+
+  crypto::hash add_pool_tx(relay_test_core &core, uint64_t height, bool relayable)
+  {
+    cryptonote::transaction tx;
+    tx.version = 1;
+    tx.unlock_time = 0;
+    tx.vin.push_back(cryptonote::txin_gen{height});
+    const cryptonote::blobdata blob = cryptonote::tx_to_blob(tx);
+    const crypto::hash txid = cryptonote::get_transaction_hash(tx);
+    core.pool[txid] = std::make_pair(blob, relayable);
+    return txid;
+  }
+
+  void request(relay_test_protocol &protocol, relay_test_p2p &p2p, const std::vector<crypto::hash> &txids)
+  {
+    cryptonote::NOTIFY_REQUEST_TRANSACTIONS::request req;
+    req.tx_hashes = txids;
+    std::string blob, out;
+    epee::serialization::store_t_to_binary(req, blob);
+    bool handled = false;
+    protocol.handle_invoke_map(true, cryptonote::NOTIFY_REQUEST_TRANSACTIONS::ID, blob, out, p2p.context, handled);
+    ASSERT_TRUE(handled);
+  }
+}
+
+TEST(tx_relay_requests, only_announced_relayable_txes_are_sent)
+{
+  relay_test_core core;
+  relay_test_p2p p2p;
+  relay_test_protocol protocol(core, &p2p);
+  cryptonote::CORE_SYNC_DATA sync_data = AUTO_VAL_INIT(sync_data);
+  ASSERT_TRUE(protocol.process_payload_sync_data(sync_data, p2p.context, true));
+  ASSERT_EQ(cryptonote::cryptonote_connection_context::state_normal, p2p.context.m_state);
+
+  const crypto::hash relayed = add_pool_tx(core, 1, true);
+  const crypto::hash no_longer_relayable = add_pool_tx(core, 2, true);
+  const crypto::hash do_not_relay = add_pool_tx(core, 3, false);
+  const crypto::hash not_announced = add_pool_tx(core, 4, true);
+
+  // the first two are announced to the peer, the second is then no longer to be relayed
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request relay;
+  relay.txs = {core.pool[relayed].first, core.pool[no_longer_relayable].first};
+  cryptonote::cryptonote_connection_context source;
+  cryptonote::i_cryptonote_protocol &iprotocol = protocol;
+  p2p.sent.clear();
+  ASSERT_TRUE(iprotocol.relay_transactions(relay, source));
+  ASSERT_EQ(1u, p2p.sent.size());
+  ASSERT_EQ((int)cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::ID, p2p.sent[0].first);
+  core.pool[no_longer_relayable].second = false;
+
+  // a peer announcing a tx does not allow it to ask for it
+  cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::request announce;
+  announce.tx_hashes = {not_announced, do_not_relay};
+  std::string blob, out;
+  epee::serialization::store_t_to_binary(announce, blob);
+  bool handled = false;
+  protocol.handle_invoke_map(true, cryptonote::NOTIFY_NEW_TRANSACTION_HASHES::ID, blob, out, p2p.context, handled);
+  ASSERT_TRUE(handled);
+
+  p2p.sent.clear();
+  request(protocol, p2p, {relayed, no_longer_relayable, do_not_relay, not_announced});
+  ASSERT_EQ(1u, p2p.sent.size());
+  ASSERT_EQ((int)cryptonote::NOTIFY_NEW_TRANSACTIONS::ID, p2p.sent[0].first);
+  cryptonote::NOTIFY_NEW_TRANSACTIONS::request rsp;
+  ASSERT_TRUE(epee::serialization::load_t_from_binary(rsp, p2p.sent[0].second));
+  ASSERT_EQ(std::vector<cryptonote::blobdata>{core.pool[relayed].first}, rsp.txs);
+
+  // nothing to send
+  p2p.sent.clear();
+  request(protocol, p2p, {do_not_relay, not_announced});
+  ASSERT_TRUE(p2p.sent.empty());
+}
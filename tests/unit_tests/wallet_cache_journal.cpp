@@ -0,0 +1,275 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <boost/filesystem.hpp>
+#include "gtest/gtest.h"
+#include "file_io_utils.h"
+#include "wallet/wallet2.h"
+#include "wallet_test_daemon.h"
+
+namespace
+{
+  class WalletCacheJournal : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      boost::filesystem::create_directories(dir);
+      path = (dir / "wallet").string();
+      tools::wallet2 w;
+      w.generate(path, password, crypto::secret_key(), true, false);
+    }
+
+    virtual void TearDown()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(dir, ec);
+    }
+
+    std::string read(const std::string &filename) const
+    {
+      std::string data;
+      epee::file_io_utils::load_file_to_string(filename, data);
+      return data;
+    }
+
+    // stores a note, an attribute and a subaddress account on top of the generated wallet
+    void store_changes()
+    {
+      tools::wallet2 w;
+      w.load(path, password);
+      w.set_tx_note(txid, "journaled note");
+      w.set_attribute("journaled", "attribute");
+      w.add_subaddress_account("journaled account");
+      w.store();
+    }
+
+    void check_changes(bool expected)
+    {
+      tools::wallet2 w;
+      w.load(path, password);
+      EXPECT_EQ(expected ? "journaled note" : "", w.get_tx_note(txid));
+      EXPECT_EQ(expected ? "attribute" : "", w.get_attribute("journaled"));
+      ASSERT_EQ(expected ? 2u : 1u, w.get_num_subaddress_accounts());
+      if (expected)
+        EXPECT_EQ("journaled account", w.get_subaddress_label({1, 0}));
+    }
+
+    // both wallets have the same chain, transfers and payments
+    static void expect_same(tools::wallet2 &a, tools::wallet2 &b)
+    {
+      ASSERT_EQ(a.get_blockchain_current_height(), b.get_blockchain_current_height());
+      const tools::hashchain &chain_a = wallet_accessor_test::blockchain(a), &chain_b = wallet_accessor_test::blockchain(b);
+      ASSERT_EQ(chain_a.offset(), chain_b.offset());
+      for (size_t height = chain_a.offset(); height < chain_a.size(); ++height)
+        EXPECT_EQ(chain_a[height], chain_b[height]);
+
+      tools::wallet2::transfer_container transfers_a, transfers_b;
+      a.get_transfers(transfers_a);
+      b.get_transfers(transfers_b);
+      ASSERT_EQ(transfers_a.size(), transfers_b.size());
+      for (size_t n = 0; n < transfers_a.size(); ++n)
+      {
+        const tools::wallet2::transfer_details &ta = transfers_a[n], &tb = transfers_b[n];
+        EXPECT_EQ(ta.m_txid, tb.m_txid);
+        EXPECT_EQ(ta.m_block_height, tb.m_block_height);
+        EXPECT_EQ(ta.m_global_output_index, tb.m_global_output_index);
+        EXPECT_EQ(ta.amount(), tb.amount());
+        EXPECT_EQ(ta.m_spent, tb.m_spent);
+        EXPECT_EQ(ta.m_spent_height, tb.m_spent_height);
+        EXPECT_EQ(ta.m_key_image, tb.m_key_image);
+        EXPECT_EQ(ta.get_public_key(), tb.get_public_key());
+      }
+      EXPECT_EQ(a.balance(0), b.balance(0));
+      EXPECT_EQ(a.unlocked_balance(0), b.unlocked_balance(0));
+
+      std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments_a, payments_b;
+      a.get_payments(payments_a, 0);
+      b.get_payments(payments_b, 0);
+      ASSERT_EQ(payments_a.size(), payments_b.size());
+      for (auto i = payments_a.begin(), j = payments_b.begin(); i != payments_a.end(); ++i, ++j)
+      {
+        EXPECT_EQ(i->first, j->first);
+        EXPECT_EQ(i->second.m_tx_hash, j->second.m_tx_hash);
+        EXPECT_EQ(i->second.m_amount, j->second.m_amount);
+        EXPECT_EQ(i->second.m_block_height, j->second.m_block_height);
+      }
+
+      std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> out_a, out_b;
+      a.get_payments_out(out_a, 0);
+      b.get_payments_out(out_b, 0);
+      ASSERT_EQ(out_a.size(), out_b.size());
+      for (auto i = out_a.begin(), j = out_b.begin(); i != out_a.end(); ++i, ++j)
+      {
+        EXPECT_EQ(i->first, j->first);
+        EXPECT_EQ(i->second.m_amount_in, j->second.m_amount_in);
+        EXPECT_EQ(i->second.m_block_height, j->second.m_block_height);
+      }
+    }
+
+    boost::filesystem::path dir;
+    std::string path;
+    const epee::wipeable_string password = std::string("journal");
+    const crypto::hash txid = crypto::cn_fast_hash("txid", 4);
+  };
+}
+
+TEST_F(WalletCacheJournal, store_appends_without_rewriting_cache)
+{
+  const std::string cache = read(path);
+  const std::string journal = read(path + ".journal");
+  ASSERT_FALSE(cache.empty());
+  ASSERT_FALSE(journal.empty());
+
+  store_changes();
+
+  EXPECT_EQ(cache, read(path));
+  const std::string appended = read(path + ".journal");
+  ASSERT_GT(appended.size(), journal.size());
+  EXPECT_EQ(journal, appended.substr(0, journal.size()));
+  check_changes(true);
+}
+
+TEST_F(WalletCacheJournal, partial_record_is_ignored)
+{
+  store_changes();
+  const std::string journal = read(path + ".journal");
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(path + ".journal", journal + std::string(16, '\x7f')));
+  check_changes(true);
+
+  // the next store can't append after the partial record and writes the full cache instead
+  const std::string cache = read(path);
+  {
+    tools::wallet2 w;
+    w.load(path, password);
+    w.store();
+  }
+  EXPECT_NE(cache, read(path));
+  check_changes(true);
+}
+
+TEST_F(WalletCacheJournal, journal_of_another_cache_is_ignored)
+{
+  // a new journal is only a header, which ends with the hash of the cache
+  const size_t header_size = read(path + ".journal").size();
+  store_changes();
+  std::string journal = read(path + ".journal");
+  ASSERT_GT(journal.size(), header_size);
+  journal[header_size - 1] ^= 1;
+  ASSERT_TRUE(epee::file_io_utils::save_string_to_file(path + ".journal", journal));
+  check_changes(false);
+}
+
+TEST_F(WalletCacheJournal, journaled_reorg_loads_as_full_cache)
+{
+  tools::wallet2 w;
+  w.load(path, password);
+  const std::string cache = read(path);
+  unit_test::test_chain chain(wallet_accessor_test::genesis(w));
+  const cryptonote::tx_destination_entry to_us(5000, w.get_account().get_keys().m_account_address, false);
+  const cryptonote::tx_destination_entry to_other(1000, chain.other_address(), false);
+
+  // receive, and store
+  chain.add_block();
+  chain.add_block(chain.other_address(), {unit_test::test_chain::make_tx({to_us})});
+  chain.add_block(chain.other_address(), {unit_test::test_chain::make_tx({to_us, to_us})});
+  wallet_accessor_test::process_blocks(w, chain, 1);
+  ASSERT_EQ(3u, wallet_accessor_test::transfers(w).size());
+  w.store();
+
+  // spend what was received before the store, with an input amount which does not match ours
+  tools::wallet2::transfer_details spent = wallet_accessor_test::transfers(w)[0];
+  spent.m_amount -= 1000;
+  chain.add_block(chain.other_address(), {unit_test::test_chain::make_tx({to_other}, {spent})});
+  chain.add_block();
+  wallet_accessor_test::process_blocks(w, chain, 4);
+  ASSERT_TRUE(wallet_accessor_test::transfers(w)[0].m_spent);
+  ASSERT_EQ(4000u, wallet_accessor_test::transfers(w)[0].amount());
+  w.store();
+
+  // the spend and the second receive are reorged away
+  wallet_accessor_test::detach_blockchain(w, 3);
+  ASSERT_EQ(1u, wallet_accessor_test::transfers(w).size());
+  ASSERT_FALSE(wallet_accessor_test::transfers(w)[0].m_spent);
+  chain.pop_blocks(3);
+  chain.add_block(chain.other_address(), {unit_test::test_chain::make_tx({to_us})});
+  chain.add_block();
+  wallet_accessor_test::process_blocks(w, chain, 3);
+  ASSERT_EQ(2u, wallet_accessor_test::transfers(w).size());
+  w.store();
+
+  // all of it went to the journal
+  EXPECT_EQ(cache, read(path));
+
+  tools::wallet2 journaled;
+  journaled.load(path, password);
+  expect_same(w, journaled);
+
+  const std::string full_path = (dir / "full").string();
+  w.store_cache(full_path);
+  boost::filesystem::copy_file(path + ".keys", full_path + ".keys");
+  tools::wallet2 full;
+  full.load(full_path, password);
+  expect_same(full, journaled);
+}
+
+TEST_F(WalletCacheJournal, journaled_multisig_nonces)
+{
+  tools::wallet2 w;
+  w.load(path, password);
+  const std::string cache = read(path);
+  unit_test::test_chain chain(wallet_accessor_test::genesis(w));
+  const cryptonote::tx_destination_entry to_us(5000, w.get_account().get_keys().m_account_address, false);
+
+  chain.add_block();
+  chain.add_block(chain.other_address(), {unit_test::test_chain::make_tx({to_us, to_us})});
+  wallet_accessor_test::process_blocks(w, chain, 1);
+  tools::wallet2::transfer_container &transfers = wallet_accessor_test::transfers(w);
+  ASSERT_EQ(2u, transfers.size());
+  for (tools::wallet2::transfer_details &td: transfers)
+    td.m_multisig_k = {rct::skGen(), rct::skGen()};
+  w.store();
+
+  // saving a multisig tx uses up the nonces of its inputs
+  tools::wallet2::multisig_tx_set txs;
+  txs.m_ptx.resize(1);
+  txs.m_ptx[0].construction_data.selected_transfers = {0};
+  ASSERT_FALSE(w.save_multisig_tx(txs).empty());
+  ASSERT_TRUE(transfers[0].m_multisig_k.empty());
+  ASSERT_EQ(2u, transfers[1].m_multisig_k.size());
+  w.store();
+  EXPECT_EQ(cache, read(path));
+
+  tools::wallet2 journaled;
+  journaled.load(path, password);
+  const tools::wallet2::transfer_container &loaded = wallet_accessor_test::transfers(journaled);
+  ASSERT_EQ(transfers.size(), loaded.size());
+  for (size_t n = 0; n < transfers.size(); ++n)
+    EXPECT_EQ(transfers[n].m_multisig_k, loaded[n].m_multisig_k);
+}
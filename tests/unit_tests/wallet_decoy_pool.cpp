@@ -0,0 +1,132 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <limits>
+#include <set>
+#include "gtest/gtest.h"
+#include "wallet_test_daemon.h"
+
+namespace
+{
+  class WalletDecoyPool : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      unit_test::generate_wallet(w);
+      // no pre/post fork segregation, which would need another distribution
+      w.segregation_height(std::numeric_limits<uint32_t>::max());
+
+      // a few coinbase outputs of ours among enough rct outputs to pick decoys from
+      unit_test::test_chain chain(wallet_accessor_test::genesis(w));
+      const cryptonote::account_public_address &address = w.get_account().get_keys().m_account_address;
+      for (size_t height = 1; height < 2500; ++height)
+      {
+        const cryptonote::tx_destination_entry other(1000, chain.other_address(), false);
+        chain.add_block(height % 400 == 100 ? address : chain.other_address(), {unit_test::test_chain::make_tx({other, other, other})});
+      }
+
+      daemon.reset(new unit_test::test_daemon(chain));
+      ASSERT_TRUE(daemon->start());
+      ASSERT_TRUE(w.init(daemon->address()));
+      w.refresh(true);
+      ASSERT_EQ(6u, wallet_accessor_test::transfers(w).size());
+      for (const auto &td: wallet_accessor_test::transfers(w))
+        ASSERT_TRUE(td.is_rct());
+    }
+
+    virtual void TearDown()
+    {
+      w.deinit();
+      daemon.reset();
+    }
+
+    void get_outs(std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs)
+    {
+      wallet_accessor_test::get_outs(w, outs, selected_transfers, fake_outputs_count);
+    }
+
+    tools::wallet2 w;
+    std::unique_ptr<unit_test::test_daemon> daemon;
+    const std::vector<size_t> selected_transfers = {1, 4};
+    const size_t fake_outputs_count = 10;
+  };
+}
+
+TEST_F(WalletDecoyPool, real_outputs_are_fetched_with_pooled_decoys)
+{
+  std::vector<std::vector<tools::wallet2::get_outs_entry>> outs;
+  get_outs(outs);
+  const std::deque<uint64_t> picks = wallet_accessor_test::decoy_pool_picks(w);
+  ASSERT_FALSE(picks.empty());
+
+  // the next transaction draws its decoys from the pool, and still asks for every ring whole
+  daemon->clear_requests();
+  get_outs(outs);
+  const auto requests = daemon->outs_requests();
+  ASSERT_EQ(1u, requests.size());
+  const std::set<uint64_t> pooled(picks.begin(), picks.end());
+  std::set<uint64_t> real;
+  for (size_t idx: selected_transfers)
+    real.insert(wallet_accessor_test::transfers(w)[idx].m_global_output_index);
+  std::set<uint64_t> requested_real;
+  for (const auto &out: requests[0].outputs)
+  {
+    if (real.count(out.index))
+      requested_real.insert(out.index);
+    else
+      EXPECT_EQ(1u, pooled.count(out.index));
+  }
+  EXPECT_EQ(real, requested_real);
+
+  ASSERT_EQ(selected_transfers.size(), outs.size());
+  for (size_t n = 0; n < outs.size(); ++n)
+  {
+    const tools::wallet2::transfer_details &td = wallet_accessor_test::transfers(w)[selected_transfers[n]];
+    EXPECT_EQ(fake_outputs_count + 1, outs[n].size());
+    EXPECT_EQ(1, std::count_if(outs[n].begin(), outs[n].end(), [&td](const tools::wallet2::get_outs_entry &e) {
+      return std::get<0>(e) == td.m_global_output_index && std::get<1>(e) == td.get_public_key();
+    }));
+  }
+}
+
+TEST_F(WalletDecoyPool, daemon_faking_a_real_output_is_caught_with_pooled_decoys)
+{
+  std::vector<std::vector<tools::wallet2::get_outs_entry>> outs;
+  get_outs(outs);
+  ASSERT_FALSE(wallet_accessor_test::decoy_pool_picks(w).empty());
+
+  // a daemon sending made up keys could tell the real output when it is spent
+  const uint64_t real = wallet_accessor_test::transfers(w)[selected_transfers[0]].m_global_output_index;
+  daemon->set_outs_hook([real](const cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request &req, cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::response &res) {
+    for (size_t n = 0; n < req.outputs.size(); ++n)
+      if (req.outputs[n].index == real)
+        res.outs[n].key = rct::rct2pk(rct::pkGen());
+  });
+  EXPECT_THROW(get_outs(outs), tools::error::wallet_internal_error);
+}
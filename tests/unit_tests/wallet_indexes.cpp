@@ -0,0 +1,339 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <tuple>
+#include "gtest/gtest.h"
+#include "string_tools.h"
+#include "wallet_test_daemon.h"
+
+namespace
+{
+  // txids as hex, hashes have no ordering
+  typedef std::tuple<uint64_t, std::string, uint32_t, uint32_t, uint64_t> payment_key;
+  typedef std::pair<uint64_t, std::string> tx_key;
+
+  payment_key key(const std::pair<const crypto::hash, tools::wallet2::payment_details> &p)
+  {
+    const tools::wallet2::payment_details &pd = p.second;
+    return std::make_tuple(pd.m_block_height, epee::string_tools::pod_to_hex(pd.m_tx_hash), pd.m_subaddr_index.major, pd.m_subaddr_index.minor, pd.m_amount);
+  }
+
+  tx_key key(const std::pair<const crypto::hash, tools::wallet2::confirmed_transfer_details> &tx)
+  {
+    return std::make_pair(tx.second.m_block_height, epee::string_tools::pod_to_hex(tx.first));
+  }
+
+  // keys of a height ordered result, sorted within each block as the order there is unspecified
+  template<typename T>
+  auto keys(const std::list<T> &results) -> std::vector<decltype(key(results.front()))>
+  {
+    std::vector<decltype(key(results.front()))> v;
+    for (const auto &r: results)
+      v.push_back(key(r));
+    for (size_t n = 1; n < v.size(); ++n)
+      EXPECT_LE(std::get<0>(v[n - 1]), std::get<0>(v[n]));
+    std::sort(v.begin(), v.end());
+    return v;
+  }
+
+  class WalletIndexes : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      unit_test::generate_wallet(w);
+      w.add_subaddress_account("second");
+      chain.reset(new unit_test::test_chain(wallet_accessor_test::genesis(w)));
+
+      add_blocks(40);
+      wallet_accessor_test::process_blocks(w, *chain, 1);
+
+      // spends from both accounts, several in a block at times
+      std::vector<tools::wallet2::transfer_details> account0, account1;
+      for (const auto &td: wallet_accessor_test::transfers(w))
+        (td.m_subaddr_index.major == 0 ? account0 : account1).push_back(td);
+      const cryptonote::tx_destination_entry other(100, chain->other_address(), false);
+      for (size_t n = 0; n < 30; ++n)
+      {
+        std::vector<cryptonote::transaction> spends;
+        if (n % 2 == 0 && account0.size() >= 2)
+        {
+          spends.push_back(unit_test::test_chain::make_tx({other}, {account0[account0.size() - 1], account0[account0.size() - 2]}));
+          account0.resize(account0.size() - 2);
+        }
+        if (n % 3 == 0 && !account1.empty() && !account0.empty())
+        {
+          spends.push_back(unit_test::test_chain::make_tx({other}, {account1.back()}));
+          spends.push_back(unit_test::test_chain::make_tx({other}, {account0.back()}));
+          account1.pop_back();
+          account0.pop_back();
+        }
+        add_blocks(1, spends);
+      }
+      wallet_accessor_test::process_blocks(w, *chain, 41);
+      ASSERT_FALSE(wallet_accessor_test::confirmed_txs(w).empty());
+    }
+
+    // payments to several subaddresses of both accounts, often more than one in a block
+    void add_blocks(size_t count, std::vector<cryptonote::transaction> txs = {})
+    {
+      const auto to = [this](uint32_t major, uint32_t minor) {
+        const uint64_t amount = 1000 + chain->height() * 10 + major * 3 + minor;
+        return cryptonote::tx_destination_entry(amount, w.get_subaddress({major, minor}), major != 0 || minor != 0);
+      };
+      for (size_t n = 0; n < count; ++n)
+      {
+        const uint64_t height = chain->height();
+        if (height % 2 == 0)
+          txs.push_back(unit_test::test_chain::make_tx({to(0, 0)}));
+        if (height % 3 == 0)
+          txs.push_back(unit_test::test_chain::make_tx({to(0, 1), to(1, 2)}));
+        if (height % 5 == 0)
+        {
+          txs.push_back(unit_test::test_chain::make_tx({to(1, 0)}, {}, crypto::rand<crypto::hash>()));
+          txs.push_back(unit_test::test_chain::make_tx({to(0, 2)}));
+        }
+        chain->add_block(chain->other_address(), txs);
+        txs.clear();
+      }
+    }
+
+    // what get_payments returned before it used the indexes
+    std::vector<payment_key> scan_payments(uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &account, const std::set<uint32_t> &indices)
+    {
+      std::vector<payment_key> v;
+      for (const auto &p: wallet_accessor_test::payments(w))
+      {
+        const tools::wallet2::payment_details &pd = p.second;
+        if (min_height < pd.m_block_height && max_height >= pd.m_block_height &&
+            (!account || *account == pd.m_subaddr_index.major) &&
+            (indices.empty() || indices.count(pd.m_subaddr_index.minor) == 1))
+          v.push_back(key(p));
+      }
+      std::sort(v.begin(), v.end());
+      return v;
+    }
+
+    // what get_payments_out returned before it used the indexes
+    std::vector<tx_key> scan_payments_out(uint64_t min_height, uint64_t max_height, const boost::optional<uint32_t> &account, const std::set<uint32_t> &indices)
+    {
+      std::vector<tx_key> v;
+      for (const auto &tx: wallet_accessor_test::confirmed_txs(w))
+      {
+        const tools::wallet2::confirmed_transfer_details &ctd = tx.second;
+        if (ctd.m_block_height > min_height && ctd.m_block_height <= max_height &&
+            (!account || *account == ctd.m_subaddr_account) &&
+            (indices.empty() || std::count_if(ctd.m_subaddr_indices.begin(), ctd.m_subaddr_indices.end(), [&](uint32_t i) { return indices.count(i) == 1; }) > 0))
+          v.push_back(key(tx));
+      }
+      std::sort(v.begin(), v.end());
+      return v;
+    }
+
+    std::vector<size_t> scan_transfers(uint32_t account, const std::set<uint32_t> &indices, const boost::optional<bool> &spent)
+    {
+      std::vector<size_t> v;
+      const auto &transfers = wallet_accessor_test::transfers(w);
+      for (size_t n = 0; n < transfers.size(); ++n)
+      {
+        const tools::wallet2::transfer_details &td = transfers[n];
+        if (td.m_subaddr_index.major == account && (indices.empty() || indices.count(td.m_subaddr_index.minor) == 1) && (!spent || td.m_spent == *spent))
+          v.push_back(n);
+      }
+      return v;
+    }
+
+    // every lookup gives what a scan of everything gives
+    void expect_indexes_match()
+    {
+      const std::vector<boost::optional<uint32_t>> accounts = {boost::none, 0u, 1u, 2u};
+      const std::vector<std::set<uint32_t>> indices = {{}, {0}, {1, 2}, {2}, {7}};
+      const std::vector<std::pair<uint64_t, uint64_t>> ranges = {{0, (uint64_t)-1}, {0, 20}, {9, 10}, {10, 45}, {44, 1000}, {20, 20}};
+      for (const auto &account: accounts)
+      {
+        for (const auto &i: indices)
+        {
+          for (const auto &range: ranges)
+          {
+            std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments;
+            EXPECT_FALSE(w.get_payments(payments, range.first, range.second, account, i));
+            EXPECT_EQ(scan_payments(range.first, range.second, account, i), keys(payments));
+
+            std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments_out;
+            EXPECT_FALSE(w.get_payments_out(payments_out, range.first, range.second, account, i));
+            EXPECT_EQ(scan_payments_out(range.first, range.second, account, i), keys(payments_out));
+          }
+          if (!account)
+            continue;
+          for (const boost::optional<bool> &spent: {boost::optional<bool>(), boost::optional<bool>(false), boost::optional<bool>(true)})
+          {
+            std::vector<size_t> transfers;
+            EXPECT_FALSE(w.get_incoming_transfers(transfers, *account, i, spent));
+            EXPECT_EQ(scan_transfers(*account, i, spent), transfers);
+          }
+        }
+      }
+    }
+
+    tools::wallet2 w;
+    std::unique_ptr<unit_test::test_chain> chain;
+  };
+}
+
+TEST_F(WalletIndexes, match_full_scan)
+{
+  ASSERT_FALSE(scan_payments(0, (uint64_t)-1, 1u, {2}).empty());
+  ASSERT_FALSE(scan_payments_out(0, (uint64_t)-1, 1u, {}).empty());
+  expect_indexes_match();
+}
+
+TEST_F(WalletIndexes, paging)
+{
+  const std::vector<payment_key> all_payments = scan_payments(0, (uint64_t)-1, boost::none, {});
+  const std::vector<tx_key> all_payments_out = scan_payments_out(0, (uint64_t)-1, boost::none, {});
+  for (size_t max_results: {1, 2, 3, 5, 7})
+  {
+    std::vector<payment_key> paged;
+    uint64_t min_height = 0;
+    for (bool more = true; more; )
+    {
+      std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> page;
+      more = w.get_payments(page, min_height, (uint64_t)-1, boost::none, {}, max_results);
+      ASSERT_FALSE(page.empty() && more);
+      if (page.empty())
+        break;
+      // whole blocks only, so the next page starts with the next block
+      const uint64_t last_height = page.back().second.m_block_height;
+      ASSERT_GT(last_height, min_height);
+      ASSERT_EQ(scan_payments(min_height, last_height, boost::none, {}), keys(page));
+      for (const auto &key: keys(page))
+        paged.push_back(key);
+      min_height = last_height;
+    }
+    std::sort(paged.begin(), paged.end());
+    EXPECT_EQ(all_payments, paged);
+
+    std::vector<tx_key> paged_out;
+    min_height = 0;
+    for (bool more = true; more; )
+    {
+      std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> page;
+      more = w.get_payments_out(page, min_height, (uint64_t)-1, boost::none, {}, max_results);
+      ASSERT_FALSE(page.empty() && more);
+      if (page.empty())
+        break;
+      const uint64_t last_height = page.back().second.m_block_height;
+      ASSERT_EQ(scan_payments_out(min_height, last_height, boost::none, {}), keys(page));
+      for (const auto &key: keys(page))
+        paged_out.push_back(key);
+      min_height = last_height;
+    }
+    std::sort(paged_out.begin(), paged_out.end());
+    EXPECT_EQ(all_payments_out, paged_out);
+
+    std::vector<size_t> paged_transfers;
+    size_t start = 0;
+    for (bool more = true; more; )
+    {
+      std::vector<size_t> page;
+      more = w.get_incoming_transfers(page, 0, {}, boost::none, start, max_results);
+      ASSERT_LE(page.size(), max_results);
+      if (page.empty())
+        break;
+      paged_transfers.insert(paged_transfers.end(), page.begin(), page.end());
+      start = page.back() + 1;
+    }
+    EXPECT_EQ(scan_transfers(0, {}, boost::none), paged_transfers);
+  }
+}
+
+TEST_F(WalletIndexes, page_ending_at_block_boundary)
+{
+  // exactly as many results as the first blocks hold: the page ends with them, and more are left
+  const std::vector<payment_key> all_payments = scan_payments(0, (uint64_t)-1, boost::none, {});
+  const uint64_t second_height = std::get<0>(*std::upper_bound(all_payments.begin(), all_payments.end(), std::get<0>(all_payments.front()),
+      [](uint64_t height, const payment_key &key) { return height < std::get<0>(key); }));
+  const std::vector<payment_key> first = scan_payments(0, second_height, boost::none, {});
+  ASSERT_GT(first.size(), 1u);
+
+  std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> page;
+  EXPECT_TRUE(w.get_payments(page, 0, (uint64_t)-1, boost::none, {}, first.size()));
+  EXPECT_EQ(first, keys(page));
+
+  // one fewer, and the page still finishes the block it is in
+  page.clear();
+  EXPECT_TRUE(w.get_payments(page, 0, (uint64_t)-1, boost::none, {}, first.size() - 1));
+  EXPECT_EQ(first, keys(page));
+
+  // the rest follows without overlap
+  page.clear();
+  EXPECT_FALSE(w.get_payments(page, second_height, (uint64_t)-1, boost::none, {}, all_payments.size()));
+  EXPECT_EQ(all_payments.size() - first.size(), page.size());
+  EXPECT_EQ(scan_payments(second_height, (uint64_t)-1, boost::none, {}), keys(page));
+}
+
+TEST_F(WalletIndexes, after_detach)
+{
+  wallet_accessor_test::detach_blockchain(w, 50);
+  ASSERT_EQ(50u, w.get_blockchain_current_height());
+  expect_indexes_match();
+
+  // and after processing another fork from there
+  chain->pop_blocks(50);
+  add_blocks(10);
+  wallet_accessor_test::process_blocks(w, *chain, 50);
+  expect_indexes_match();
+}
+
+TEST_F(WalletIndexes, after_imports)
+{
+  // drop every other payment and outgoing tx
+  tools::wallet2::payment_container payments;
+  bool keep = false;
+  for (const auto &p: wallet_accessor_test::payments(w))
+    if ((keep = !keep))
+      payments.insert(p);
+  w.import_payments(payments);
+  ASSERT_EQ(payments.size(), wallet_accessor_test::payments(w).size());
+  expect_indexes_match();
+
+  std::list<std::pair<crypto::hash, tools::wallet2::confirmed_transfer_details>> payments_out;
+  for (const auto &tx: wallet_accessor_test::confirmed_txs(w))
+    if ((keep = !keep))
+      payments_out.push_back(tx);
+  w.import_payments_out(payments_out);
+  ASSERT_EQ(payments_out.size(), wallet_accessor_test::confirmed_txs(w).size());
+  expect_indexes_match();
+
+  // outputs come back in another order, as from a view only wallet's export
+  std::vector<tools::wallet2::transfer_details> outputs(wallet_accessor_test::transfers(w).begin(), wallet_accessor_test::transfers(w).end());
+  std::reverse(outputs.begin(), outputs.end());
+  outputs.resize(outputs.size() - 3);
+  ASSERT_EQ(outputs.size(), w.import_outputs(outputs));
+  expect_indexes_match();
+}
@@ -0,0 +1,126 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include "gtest/gtest.h"
+#include "wallet_test_daemon.h"
+
+namespace
+{
+  class WalletRefreshPipeline : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      unit_test::generate_wallet(w);
+      w.refresh_pipeline_depth(4);
+    }
+
+    virtual void TearDown()
+    {
+      w.deinit();
+      daemon.reset();
+    }
+
+    // a payment to us in a block of its own
+    cryptonote::transaction pay(unit_test::test_chain &chain)
+    {
+      const cryptonote::transaction tx = unit_test::test_chain::make_tx({{5000, w.get_address(), false}});
+      chain.add_block(chain.other_address(), {tx});
+      return tx;
+    }
+
+    static void add_blocks(unit_test::test_chain &chain, uint64_t height)
+    {
+      while (chain.height() < height)
+        chain.add_block();
+    }
+
+    tools::wallet2 w;
+    std::unique_ptr<unit_test::test_daemon> daemon;
+  };
+}
+
+TEST_F(WalletRefreshPipeline, depth_is_bounded)
+{
+  w.refresh_pipeline_depth(0);
+  EXPECT_EQ(1u, w.refresh_pipeline_depth());
+  w.refresh_pipeline_depth(tools::wallet2::max_refresh_pipeline_depth);
+  EXPECT_EQ(tools::wallet2::max_refresh_pipeline_depth, w.refresh_pipeline_depth());
+  w.refresh_pipeline_depth(1000000);
+  EXPECT_EQ(tools::wallet2::max_refresh_pipeline_depth, w.refresh_pipeline_depth());
+}
+
+TEST_F(WalletRefreshPipeline, reorg_falls_back_to_short_chain_history)
+{
+  // both chains share a payment, then each has one of its own, on either side of the
+  // fork, which is inside the first batch so every pipelined request is past it
+  unit_test::test_chain chain_a(wallet_accessor_test::genesis(w));
+  add_blocks(chain_a, 100);
+  const crypto::hash shared_txid = cryptonote::get_transaction_hash(pay(chain_a));
+  add_blocks(chain_a, 900);
+  unit_test::test_chain chain_b = chain_a;
+  add_blocks(chain_a, 2500);
+  pay(chain_a);
+  add_blocks(chain_a, 4500);
+  add_blocks(chain_b, 2600);
+  const crypto::hash b_txid = cryptonote::get_transaction_hash(pay(chain_b));
+  add_blocks(chain_b, 5000);
+
+  // the daemon switches to the other chain once the wallet has requests in flight
+  daemon.reset(new unit_test::test_daemon(chain_a));
+  std::atomic<bool> switched(false);
+  daemon->set_blocks_hook([&](const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request &req) {
+    if (req.start_height > 0 && !switched.exchange(true))
+      daemon->set_chain(chain_b);
+  });
+  ASSERT_TRUE(daemon->start());
+  ASSERT_TRUE(w.init(daemon->address()));
+  w.refresh(true);
+
+  ASSERT_TRUE(switched);
+  ASSERT_EQ(chain_b.height(), w.get_blockchain_current_height());
+  EXPECT_EQ(chain_b.hash(chain_b.height() - 1), wallet_accessor_test::blockchain(w)[chain_b.height() - 1]);
+
+  // a pipelined request got blocks which did not follow, and the wallet went back
+  // to asking by block ids, from where the chains split
+  const auto requests = daemon->blocks_requests();
+  const auto pipelined = std::find_if(requests.begin(), requests.end(),
+      [](const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request &req) { return req.start_height > 0; });
+  ASSERT_NE(requests.end(), pipelined);
+  EXPECT_NE(requests.end(), std::find_if(pipelined, requests.end(),
+      [](const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request &req) { return req.start_height == 0 && !req.block_ids.empty(); }));
+
+  // only the payments on the chain we ended up on are left
+  const auto &transfers = wallet_accessor_test::transfers(w);
+  ASSERT_EQ(2u, transfers.size());
+  EXPECT_EQ(shared_txid, transfers[0].m_txid);
+  EXPECT_EQ(100u, transfers[0].m_block_height);
+  EXPECT_EQ(b_txid, transfers[1].m_txid);
+  EXPECT_EQ(2600u, transfers[1].m_block_height);
+}
@@ -0,0 +1,182 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include "gtest/gtest.h"
+#include "wallet/wallet_scanner.h"
+#include "wallet_test_daemon.h"
+
+namespace
+{
+  const size_t NUM_WALLETS = 3;
+
+  class WalletScanner : public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      // each wallet has a twin with the same keys, refreshed on its own
+      for (size_t n = 0; n < NUM_WALLETS; ++n)
+      {
+        const crypto::secret_key key = rct::rct2sk(rct::skGen());
+        shared[n].generate("", "", key, true, false);
+        alone[n].generate("", "", key, true, false);
+      }
+
+      chain.reset(new unit_test::test_chain(wallet_accessor_test::genesis(shared[0])));
+      add_blocks(200);
+      daemon.reset(new unit_test::test_daemon(*chain));
+      ASSERT_TRUE(daemon->start());
+      for (size_t n = 0; n < NUM_WALLETS; ++n)
+      {
+        ASSERT_TRUE(shared[n].init(daemon->address()));
+        ASSERT_TRUE(alone[n].init(daemon->address()));
+      }
+    }
+
+    virtual void TearDown()
+    {
+      for (size_t n = 0; n < NUM_WALLETS; ++n)
+      {
+        shared[n].deinit();
+        alone[n].deinit();
+      }
+      daemon.reset();
+    }
+
+    // coinbase, main address and subaddress payments to every wallet, among other txes
+    void add_blocks(size_t count, const std::vector<cryptonote::transaction> &first_txs = {})
+    {
+      const cryptonote::tx_destination_entry other(1000, chain->other_address(), false);
+      for (size_t n = 0; n < count; ++n)
+      {
+        const uint64_t height = chain->height();
+        tools::wallet2 &w = shared[height % NUM_WALLETS];
+        std::vector<cryptonote::transaction> txs = n == 0 ? first_txs : std::vector<cryptonote::transaction>();
+        txs.push_back(unit_test::test_chain::make_tx({other, other}));
+        if (height % 20 == 5)
+          txs.push_back(unit_test::test_chain::make_tx({{2000 + height, w.get_subaddress({0, 1}), true}, other}));
+        if (height % 30 == 7)
+          txs.push_back(unit_test::test_chain::make_tx({{3000 + height, w.get_address(), false}}, {}, crypto::rand<crypto::hash>()));
+        chain->add_block(height % 50 == 10 ? w.get_address() : chain->other_address(), txs);
+      }
+    }
+
+    static void expect_same(tools::wallet2 &a, tools::wallet2 &b)
+    {
+      ASSERT_EQ(a.get_blockchain_current_height(), b.get_blockchain_current_height());
+      const uint64_t height = a.get_blockchain_current_height();
+      EXPECT_EQ(wallet_accessor_test::blockchain(a)[height - 1], wallet_accessor_test::blockchain(b)[height - 1]);
+
+      tools::wallet2::transfer_container transfers_a, transfers_b;
+      a.get_transfers(transfers_a);
+      b.get_transfers(transfers_b);
+      ASSERT_EQ(transfers_a.size(), transfers_b.size());
+      for (size_t n = 0; n < transfers_a.size(); ++n)
+      {
+        const tools::wallet2::transfer_details &ta = transfers_a[n], &tb = transfers_b[n];
+        EXPECT_EQ(ta.m_txid, tb.m_txid);
+        EXPECT_EQ(ta.m_block_height, tb.m_block_height);
+        EXPECT_EQ(ta.m_global_output_index, tb.m_global_output_index);
+        EXPECT_EQ(ta.amount(), tb.amount());
+        EXPECT_EQ(ta.m_spent, tb.m_spent);
+        EXPECT_EQ(ta.m_key_image, tb.m_key_image);
+        EXPECT_EQ(ta.m_subaddr_index.major, tb.m_subaddr_index.major);
+        EXPECT_EQ(ta.m_subaddr_index.minor, tb.m_subaddr_index.minor);
+      }
+      EXPECT_EQ(a.balance(0), b.balance(0));
+      EXPECT_EQ(a.unlocked_balance(0), b.unlocked_balance(0));
+
+      std::list<std::pair<crypto::hash, tools::wallet2::payment_details>> payments_a, payments_b;
+      a.get_payments(payments_a, 0);
+      b.get_payments(payments_b, 0);
+      ASSERT_EQ(payments_a.size(), payments_b.size());
+      for (auto i = payments_a.begin(), j = payments_b.begin(); i != payments_a.end(); ++i, ++j)
+      {
+        EXPECT_EQ(i->first, j->first);
+        EXPECT_EQ(i->second.m_tx_hash, j->second.m_tx_hash);
+        EXPECT_EQ(i->second.m_amount, j->second.m_amount);
+      }
+    }
+
+    tools::wallet2 shared[NUM_WALLETS];
+    tools::wallet2 alone[NUM_WALLETS];
+    std::unique_ptr<unit_test::test_chain> chain;
+    std::unique_ptr<unit_test::test_daemon> daemon;
+  };
+}
+
+TEST_F(WalletScanner, same_as_refreshing_alone)
+{
+  tools::wallet_scanner scanner;
+  for (size_t n = 0; n < NUM_WALLETS; ++n)
+    scanner.add_wallet(&shared[n]);
+  ASSERT_EQ(NUM_WALLETS, scanner.wallet_count());
+  EXPECT_GT(scanner.refresh(true), 0u);
+
+  for (size_t n = 0; n < NUM_WALLETS; ++n)
+  {
+    alone[n].refresh(true);
+    ASSERT_EQ(chain->height(), shared[n].get_blockchain_current_height());
+    ASSERT_FALSE(wallet_accessor_test::transfers(shared[n]).empty());
+    expect_same(shared[n], alone[n]);
+  }
+}
+
+TEST_F(WalletScanner, wallets_at_different_heights)
+{
+  // one wallet is ahead of the others, and one of them spends
+  shared[1].refresh(true);
+  alone[1].refresh(true);
+  const tools::wallet2::transfer_details spent = wallet_accessor_test::transfers(shared[1])[0];
+  const cryptonote::tx_destination_entry other(1000, chain->other_address(), false);
+  add_blocks(100, {unit_test::test_chain::make_tx({other}, {spent})});
+  daemon->set_chain(*chain);
+
+  tools::wallet_scanner scanner;
+  for (size_t n = 0; n < NUM_WALLETS; ++n)
+    scanner.add_wallet(&shared[n]);
+  scanner.refresh(true);
+
+  for (size_t n = 0; n < NUM_WALLETS; ++n)
+  {
+    alone[n].refresh(true);
+    ASSERT_EQ(chain->height(), shared[n].get_blockchain_current_height());
+    expect_same(shared[n], alone[n]);
+  }
+  EXPECT_TRUE(wallet_accessor_test::transfers(shared[1])[0].m_spent);
+
+  // and again, from where they all are now
+  add_blocks(50);
+  daemon->set_chain(*chain);
+  scanner.refresh(true);
+  for (size_t n = 0; n < NUM_WALLETS; ++n)
+  {
+    alone[n].refresh(true);
+    expect_same(shared[n], alone[n]);
+  }
+}
@@ -0,0 +1,451 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/thread/mutex.hpp>
+#include "crypto/crypto.h"
+#include "cryptonote_basic/account.h"
+#include "cryptonote_basic/cryptonote_format_utils.h"
+#include "cryptonote_core/cryptonote_tx_utils.h"
+#include "net/http_server_impl_base.h"
+#include "ringct/rctOps.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "wallet/wallet2.h"
+
+namespace unit_test
+{
+  /*!
+   * \brief A chain of hand made blocks and transactions for wallet tests
+   *
+   * Transactions are version 2 with no ring signatures and amounts in the clear,
+   * which the wallet scans like any other. All outputs share one global index
+   * space, as rct outputs do, and are served as unlocked.
+   */
+  class test_chain
+  {
+  public:
+    explicit test_chain(const cryptonote::block &genesis):
+      m_base_time(time(NULL) - 30 * 24 * 3600)
+    {
+      m_other.generate();
+      add(genesis, {});
+    }
+
+    size_t height() const { return m_blocks.size(); }
+    const crypto::hash &hash(uint64_t height) const { return m_hashes[height]; }
+    const cryptonote::block &block(uint64_t height) const { return m_blocks[height]; }
+    const std::vector<cryptonote::transaction> &txs(uint64_t height) const { return m_txs[height]; }
+    const cryptonote::block_complete_entry &blob(uint64_t height) const { return m_blobs[height]; }
+    const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices &o_indices(uint64_t height) const { return m_o_indices[height]; }
+    const std::vector<cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::outkey> &outputs() const { return m_outputs; }
+    // outputs created in the blocks up to and including that height
+    uint64_t cumulative_outputs(uint64_t height) const { return m_cumulative_outputs[height]; }
+    const cryptonote::account_public_address &other_address() const { return m_other.get_keys().m_account_address; }
+
+    bool find(const crypto::hash &hash, uint64_t &height) const
+    {
+      const auto i = m_heights.find(hash);
+      if (i == m_heights.end())
+        return false;
+      height = i->second;
+      return true;
+    }
+
+    // the next block mines reward to miner and includes txs
+    void add_block(const cryptonote::account_public_address &miner, const std::vector<cryptonote::transaction> &txs = {}, uint64_t reward = 1000000000)
+    {
+      cryptonote::block b;
+      b.major_version = 1;
+      b.minor_version = 0;
+      b.timestamp = m_base_time + height() * DIFFICULTY_TARGET_V2;
+      b.prev_id = m_hashes.back();
+      b.nonce = crypto::rand<uint32_t>();
+      b.miner_tx = make_miner_tx(height(), miner, reward);
+      for (const auto &tx: txs)
+        b.tx_hashes.push_back(cryptonote::get_transaction_hash(tx));
+      add(b, txs);
+    }
+
+    // an empty block, mined to someone else
+    void add_block() { add_block(other_address()); }
+
+    // keeps the blocks below height, so another chain can be grown from there
+    void pop_blocks(uint64_t height)
+    {
+      while (m_blocks.size() > height)
+      {
+        m_heights.erase(m_hashes.back());
+        m_outputs.resize(m_blocks.size() > 1 ? m_cumulative_outputs[m_blocks.size() - 2] : 0);
+        m_blocks.pop_back();
+        m_hashes.pop_back();
+        m_txs.pop_back();
+        m_blobs.pop_back();
+        m_o_indices.pop_back();
+        m_cumulative_outputs.pop_back();
+      }
+    }
+
+    static cryptonote::transaction make_miner_tx(uint64_t height, const cryptonote::account_public_address &miner, uint64_t reward)
+    {
+      cryptonote::transaction tx;
+      tx.version = 2;
+      tx.unlock_time = height + CRYPTONOTE_MINED_MONEY_UNLOCK_WINDOW;
+      tx.vin.push_back(cryptonote::txin_gen{(size_t)height});
+      add_outputs(tx, {cryptonote::tx_destination_entry(reward, miner, false)});
+      return tx;
+    }
+
+    /*!
+     * \brief A transaction paying destinations and spending the given outputs by key image
+     *
+     * Without anything to spend, it spends an output nobody knows about.
+     */
+    static cryptonote::transaction make_tx(const std::vector<cryptonote::tx_destination_entry> &destinations,
+        const std::vector<tools::wallet2::transfer_details> &spent = {}, const crypto::hash &payment_id = crypto::null_hash)
+    {
+      cryptonote::transaction tx;
+      tx.version = 2;
+      tx.unlock_time = 0;
+      uint64_t amount_out = 0;
+      for (const auto &dst: destinations)
+        amount_out += dst.amount;
+      for (const auto &td: spent)
+        tx.vin.push_back(cryptonote::txin_to_key{td.amount(), {td.m_global_output_index}, td.m_key_image});
+      if (spent.empty())
+      {
+        cryptonote::keypair k = cryptonote::keypair::generate(hw::get_device("default"));
+        tx.vin.push_back(cryptonote::txin_to_key{amount_out, {0}, *reinterpret_cast<const crypto::key_image*>(&k.pub)});
+      }
+      if (payment_id != crypto::null_hash)
+      {
+        cryptonote::blobdata extra_nonce;
+        cryptonote::set_payment_id_to_tx_extra_nonce(extra_nonce, payment_id);
+        cryptonote::add_extra_nonce_to_tx_extra(tx.extra, extra_nonce);
+      }
+      add_outputs(tx, destinations);
+      return tx;
+    }
+
+  private:
+    static void add_outputs(cryptonote::transaction &tx, const std::vector<cryptonote::tx_destination_entry> &destinations)
+    {
+      // subaddresses need their own tx public key per output, as the wallet does
+      const bool additional_keys = std::any_of(destinations.begin(), destinations.end(),
+          [](const cryptonote::tx_destination_entry &dst) { return dst.is_subaddress; });
+      const cryptonote::keypair tx_key = cryptonote::keypair::generate(hw::get_device("default"));
+      std::vector<crypto::public_key> additional_tx_public_keys;
+      for (size_t i = 0; i < destinations.size(); ++i)
+      {
+        const cryptonote::tx_destination_entry &dst = destinations[i];
+        crypto::secret_key r = tx_key.sec;
+        if (additional_keys)
+        {
+          const cryptonote::keypair k = cryptonote::keypair::generate(hw::get_device("default"));
+          r = k.sec;
+          additional_tx_public_keys.push_back(dst.is_subaddress ?
+              rct::rct2pk(rct::scalarmultKey(rct::pk2rct(dst.addr.m_spend_public_key), rct::sk2rct(r))) : k.pub);
+        }
+        crypto::key_derivation derivation;
+        crypto::public_key out_key;
+        crypto::generate_key_derivation(dst.addr.m_view_public_key, r, derivation);
+        crypto::derive_public_key(derivation, i, dst.addr.m_spend_public_key, out_key);
+        tx.vout.push_back({dst.amount, cryptonote::txout_to_key(out_key)});
+      }
+      cryptonote::add_tx_pub_key_to_extra(tx, tx_key.pub);
+      if (additional_keys)
+        cryptonote::add_additional_tx_pub_keys_to_extra(tx.extra, additional_tx_public_keys);
+    }
+
+    void add(const cryptonote::block &b, const std::vector<cryptonote::transaction> &txs)
+    {
+      const crypto::hash hash = cryptonote::get_block_hash(b);
+      m_heights[hash] = m_blocks.size();
+      m_hashes.push_back(hash);
+      m_blocks.push_back(b);
+      m_txs.push_back(txs);
+
+      cryptonote::block_complete_entry bce;
+      bce.block = cryptonote::block_to_blob(b);
+      cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices indices;
+      const auto add_tx_outputs = [&](const cryptonote::transaction &tx) {
+        indices.indices.push_back({});
+        const crypto::hash txid = cryptonote::get_transaction_hash(tx);
+        for (const auto &o: tx.vout)
+        {
+          indices.indices.back().indices.push_back(m_outputs.size());
+          m_outputs.push_back({boost::get<cryptonote::txout_to_key>(o.target).key, rct::zeroCommit(o.amount), true, m_blocks.size() - 1, txid});
+        }
+      };
+      add_tx_outputs(b.miner_tx);
+      for (const auto &tx: txs)
+      {
+        bce.txs.push_back(cryptonote::tx_to_blob(tx));
+        add_tx_outputs(tx);
+      }
+      m_blobs.push_back(std::move(bce));
+      m_o_indices.push_back(std::move(indices));
+      m_cumulative_outputs.push_back(m_outputs.size());
+    }
+
+    uint64_t m_base_time;
+    cryptonote::account_base m_other;
+    std::vector<cryptonote::block> m_blocks;
+    std::vector<crypto::hash> m_hashes;
+    std::unordered_map<crypto::hash, uint64_t> m_heights;
+    std::vector<std::vector<cryptonote::transaction>> m_txs;
+    std::vector<cryptonote::block_complete_entry> m_blobs;
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::block_output_indices> m_o_indices;
+    std::vector<cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::outkey> m_outputs;
+    std::vector<uint64_t> m_cumulative_outputs;
+  };
+
+  // epee's http handler map macros call some of its functions without the epee:: prefix
+  namespace misc_utils = epee::misc_utils;
+
+  /*!
+   * \brief Serves a test_chain over the daemon RPC calls the wallet makes to refresh and pick decoys
+   *
+   * It records the block and output requests it gets, and lets a test switch to
+   * another chain, or alter the outputs it answers with, as a daemon could.
+   */
+  class test_daemon: public epee::http_server_impl_base<test_daemon>
+  {
+  public:
+    typedef epee::net_utils::connection_context_base connection_context;
+    typedef std::function<void(const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request&)> blocks_hook;
+    typedef std::function<void(const cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request&, cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::response&)> outs_hook;
+
+    explicit test_daemon(const test_chain &chain):
+      m_chain(chain),
+      m_running(false)
+    {
+    }
+
+    ~test_daemon()
+    {
+      stop();
+    }
+
+    bool start()
+    {
+      if (!init([](size_t len, uint8_t *ptr) { crypto::generate_random_bytes_thread_safe(len, ptr); }, "0", "127.0.0.1"))
+        return false;
+      m_running = run(4, false);
+      return m_running;
+    }
+
+    void stop()
+    {
+      if (!m_running)
+        return;
+      m_running = false;
+      send_stop_signal();
+      timed_wait_server_stop(5000);
+      deinit();
+    }
+
+    std::string address() { return "127.0.0.1:" + std::to_string(get_binded_port()); }
+
+    void set_chain(const test_chain &chain) { boost::lock_guard<boost::mutex> lock(m_lock); m_chain = chain; }
+    test_chain chain() const { boost::lock_guard<boost::mutex> lock(m_lock); return m_chain; }
+    // called before each block request is answered, outside of the daemon's lock
+    void set_blocks_hook(blocks_hook hook) { boost::lock_guard<boost::mutex> lock(m_lock); m_blocks_hook = hook; }
+    // called on each output request's answer before it is sent
+    void set_outs_hook(outs_hook hook) { boost::lock_guard<boost::mutex> lock(m_lock); m_outs_hook = hook; }
+
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request> blocks_requests() const { boost::lock_guard<boost::mutex> lock(m_lock); return m_blocks_requests; }
+    std::vector<cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request> outs_requests() const { boost::lock_guard<boost::mutex> lock(m_lock); return m_outs_requests; }
+    void clear_requests() { boost::lock_guard<boost::mutex> lock(m_lock); m_blocks_requests.clear(); m_outs_requests.clear(); }
+
+    CHAIN_HTTP_TO_MAP2(connection_context);
+
+    BEGIN_URI_MAP2()
+      MAP_URI_AUTO_BIN2("/getblocks.bin", on_get_blocks, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2("/get_outs.bin", on_get_outs_bin, cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN)
+      BEGIN_JSON_RPC_MAP("/json_rpc")
+        MAP_JON_RPC("get_info", on_get_info, cryptonote::COMMAND_RPC_GET_INFO)
+        MAP_JON_RPC("get_version", on_get_version, cryptonote::COMMAND_RPC_GET_VERSION)
+        MAP_JON_RPC("get_output_distribution", on_get_output_distribution, cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    bool on_get_blocks(const cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request &req, cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::response &res)
+    {
+      blocks_hook hook;
+      {
+        boost::lock_guard<boost::mutex> lock(m_lock);
+        hook = m_blocks_hook;
+      }
+      if (hook)
+        hook(req);
+
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      m_blocks_requests.push_back(req);
+      uint64_t start_height = 0;
+      if (req.start_height > 0)
+      {
+        if (req.start_height >= m_chain.height())
+          return false;
+        start_height = req.start_height;
+      }
+      else
+      {
+        // from the most recent block we share, as a daemon does
+        if (req.block_ids.empty() || req.block_ids.back() != m_chain.hash(0))
+          return false;
+        for (const crypto::hash &id: req.block_ids)
+          if (m_chain.find(id, start_height))
+            break;
+      }
+      for (uint64_t height = start_height; height < m_chain.height() && height < start_height + COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT; ++height)
+      {
+        res.blocks.push_back(m_chain.blob(height));
+        res.output_indices.push_back(m_chain.o_indices(height));
+      }
+      res.start_height = start_height;
+      res.current_height = m_chain.height();
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+
+    bool on_get_outs_bin(const cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request &req, cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::response &res)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      m_outs_requests.push_back(req);
+      for (const auto &out: req.outputs)
+      {
+        if (out.amount != 0 || out.index >= m_chain.outputs().size())
+          return false;
+        res.outs.push_back(m_chain.outputs()[out.index]);
+      }
+      res.status = CORE_RPC_STATUS_OK;
+      if (m_outs_hook)
+        m_outs_hook(req, res);
+      return true;
+    }
+
+    bool on_get_info(const cryptonote::COMMAND_RPC_GET_INFO::request &req, cryptonote::COMMAND_RPC_GET_INFO::response &res)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      res.height = m_chain.height();
+      res.target_height = m_chain.height();
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+
+    bool on_get_version(const cryptonote::COMMAND_RPC_GET_VERSION::request &req, cryptonote::COMMAND_RPC_GET_VERSION::response &res)
+    {
+      res.version = CORE_RPC_VERSION;
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+
+    bool on_get_output_distribution(const cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::request &req, cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::response &res)
+    {
+      boost::lock_guard<boost::mutex> lock(m_lock);
+      if (req.amounts != std::vector<uint64_t>{0} || req.from_height >= m_chain.height())
+        return false;
+      const uint64_t to_height = req.to_height ? std::min<uint64_t>(req.to_height, m_chain.height() - 1) : m_chain.height() - 1;
+      cryptonote::COMMAND_RPC_GET_OUTPUT_DISTRIBUTION::distribution d;
+      d.amount = 0;
+      d.start_height = req.from_height;
+      d.binary = req.binary;
+      d.base = 0;
+      for (uint64_t height = req.from_height; height <= to_height; ++height)
+      {
+        const uint64_t below = height > 0 ? m_chain.cumulative_outputs(height - 1) : 0;
+        d.distribution.push_back(req.cumulative ? m_chain.cumulative_outputs(height) : m_chain.cumulative_outputs(height) - below);
+      }
+      res.distributions.push_back(std::move(d));
+      res.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+
+  private:
+    mutable boost::mutex m_lock;
+    test_chain m_chain;
+    blocks_hook m_blocks_hook;
+    outs_hook m_outs_hook;
+    std::vector<cryptonote::COMMAND_RPC_GET_BLOCKS_FAST::request> m_blocks_requests;
+    std::vector<cryptonote::COMMAND_RPC_GET_OUTPUTS_BIN::request> m_outs_requests;
+    bool m_running;
+  };
+
+  // A wallet with fresh keys, kept in memory, scanning from the genesis block
+  inline void generate_wallet(tools::wallet2 &w)
+  {
+    w.generate("", "", rct::rct2sk(rct::skGen()), true, false);
+  }
+}
+
+// Reaches into wallet2 for the tests which drive its scanning and decoy selection directly
+class wallet_accessor_test
+{
+public:
+  static cryptonote::block genesis(const tools::wallet2 &w)
+  {
+    cryptonote::block b;
+    w.generate_genesis(b);
+    return b;
+  }
+
+  static tools::wallet2::transfer_container &transfers(tools::wallet2 &w) { return w.m_transfers; }
+  static tools::hashchain &blockchain(tools::wallet2 &w) { return w.m_blockchain; }
+  static std::deque<uint64_t> &decoy_pool_picks(tools::wallet2 &w) { return w.m_decoy_pool.picks; }
+  static const tools::wallet2::payment_container &payments(const tools::wallet2 &w) { return w.m_payments; }
+  static const std::unordered_map<crypto::hash, tools::wallet2::confirmed_transfer_details> &confirmed_txs(const tools::wallet2 &w) { return w.m_confirmed_txs; }
+
+  // feeds the wallet the blocks of chain from start_height on, as a refresh would
+  static void process_blocks(tools::wallet2 &w, const unit_test::test_chain &chain, uint64_t start_height)
+  {
+    std::vector<cryptonote::block_complete_entry> blocks;
+    std::vector<tools::wallet2::parsed_block> parsed_blocks;
+    for (uint64_t height = start_height; height < chain.height(); ++height)
+    {
+      blocks.push_back(chain.blob(height));
+      parsed_blocks.push_back({chain.hash(height), chain.block(height), chain.txs(height), chain.o_indices(height), false});
+    }
+    uint64_t blocks_added;
+    w.process_parsed_blocks(start_height, blocks, parsed_blocks, blocks_added);
+  }
+
+  static void detach_blockchain(tools::wallet2 &w, uint64_t height) { w.detach_blockchain(height); }
+
+  static void get_outs(tools::wallet2 &w, std::vector<std::vector<tools::wallet2::get_outs_entry>> &outs, const std::vector<size_t> &selected_transfers, size_t fake_outputs_count)
+  {
+    w.get_outs(outs, selected_transfers, fake_outputs_count);
+  }
+};
@@ -0,0 +1,115 @@
+// Copyright (c) 2014-2018, The Monero Project
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without modification, are
+// permitted provided that the following conditions are met:
+//
+// 1. Redistributions of source code must retain the above copyright notice, this list of
+//    conditions and the following disclaimer.
+//
+// 2. Redistributions in binary form must reproduce the above copyright notice, this list
+//    of conditions and the following disclaimer in the documentation and/or other
+//    materials provided with the distribution.
+//
+// 3. Neither the name of the copyright holder nor the names of its contributors may be
+//    used to endorse or promote products derived from this software without specific
+//    prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+// EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+// MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+// THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+// STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF
+// THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+#include <deque>
+#include <random>
+#include "gtest/gtest.h"
+#include "misc_language.h"
+#include "common/windowed_median.h"
+
+namespace
+{
+  uint64_t reference_median(const std::deque<uint64_t> &values)
+  {
+    std::vector<uint64_t> v(values.begin(), values.end());
+    return epee::misc_utils::median(v);
+  }
+}
+
+TEST(windowed_median, empty)
+{
+  tools::windowed_median<uint64_t> m(10);
+  ASSERT_TRUE(m.empty());
+  ASSERT_EQ(0, m.median());
+}
+
+TEST(windowed_median, small)
+{
+  tools::windowed_median<uint64_t> m(3);
+  m.push_back(5);
+  ASSERT_EQ(5, m.median());
+  m.push_back(1);
+  ASSERT_EQ(3, m.median());
+  m.push_back(9);
+  ASSERT_EQ(5, m.median());
+  m.push_back(9);
+  ASSERT_EQ(3, m.size());
+  ASSERT_EQ(9, m.median());
+  m.pop_back();
+  ASSERT_EQ(5, m.median());
+  m.push_front(5);
+  ASSERT_EQ(5, m.front());
+  ASSERT_EQ(5, m.median());
+  m.push_front(100);
+  ASSERT_EQ(5, m.front());
+}
+
+TEST(windowed_median, zero_window)
+{
+  tools::windowed_median<uint64_t> m(0);
+  m.push_back(5);
+  ASSERT_TRUE(m.empty());
+  ASSERT_EQ(0, m.median());
+}
+
+TEST(windowed_median, matches_sorting)
+{
+  std::mt19937 rng(0);
+  tools::windowed_median<uint64_t> m(100);
+  std::deque<uint64_t> reference;
+  std::deque<uint64_t> dropped;
+  for (int i = 0; i < 20000; ++i)
+  {
+    // small values so there are plenty of duplicates
+    const uint64_t value = rng() % 50;
+    if (rng() % 4 == 0 && !reference.empty())
+    {
+      // roll back the newest value and bring back the last one that fell off
+      m.pop_back();
+      reference.pop_back();
+      if (!dropped.empty())
+      {
+        m.push_front(dropped.back());
+        reference.push_front(dropped.back());
+        dropped.pop_back();
+      }
+    }
+    else
+    {
+      m.push_back(value);
+      reference.push_back(value);
+      if (reference.size() > 100)
+      {
+        dropped.push_back(reference.front());
+        reference.pop_front();
+      }
+    }
+    ASSERT_EQ(reference.size(), m.size());
+    ASSERT_EQ(reference_median(reference), m.median());
+  }
+}